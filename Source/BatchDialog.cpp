@@ -0,0 +1,293 @@
+///
+/// A dialog for applying a recipe of filters to a whole folder of images in the background,
+/// leaving the main window free to keep working on the interactive image.
+///
+
+#include "BatchDialog.h"
+
+BatchDialog::BatchDialog( FilterProcessor* filter_processor, QList<QAction*> filter_actions, QWidget* parent )
+///
+/// Constructor
+///
+/// @param filter_processor
+///  The filter processor whose filter library the recipe is built from.
+///
+/// @param filter_actions
+///  The filter menu actions. Their text is shown to the user and their object name is the filter name.
+///
+/// @param parent
+///  The owner of the dialog.
+///
+: QDialog( parent ),
+  mFilterProcessor( filter_processor )
+{
+	setWindowTitle( tr("Batch Apply") );
+
+	mBatchProcessor = new BatchProcessor( filter_processor, this );
+	connect( mBatchProcessor, SIGNAL( BatchProgress(int, int, QString) ), this, SLOT( BatchProgress(int, int, QString) ) );
+	connect( mBatchProcessor, SIGNAL( BatchFinished(int, int) ), this, SLOT( BatchFinished(int, int) ) );
+
+	// Folder choosers
+	mInputEdit = new QLineEdit;
+	mOutputEdit = new QLineEdit;
+	QPushButton* input_button = new QPushButton( tr("Browse...") );
+	QPushButton* output_button = new QPushButton( tr("Browse...") );
+	connect( input_button, SIGNAL( clicked() ), this, SLOT( ChooseInputFolder() ) );
+	connect( output_button, SIGNAL( clicked() ), this, SLOT( ChooseOutputFolder() ) );
+
+	QGridLayout* folder_layout = new QGridLayout;
+	folder_layout->addWidget( new QLabel( tr("Input folder:") ), 0, 0 );
+	folder_layout->addWidget( mInputEdit, 0, 1 );
+	folder_layout->addWidget( input_button, 0, 2 );
+	folder_layout->addWidget( new QLabel( tr("Output folder:") ), 1, 0 );
+	folder_layout->addWidget( mOutputEdit, 1, 1 );
+	folder_layout->addWidget( output_button, 1, 2 );
+
+	// Recipe editor. The filter name is stored with each item so it can be retrieved later.
+	mAvailableList = new QListWidget;
+	for( int a = 0; a < filter_actions.size(); a++ )
+	{
+		if( filter_actions[a]->isSeparator() || filter_actions[a]->objectName() == "" )
+		{
+			continue;
+		}
+		QListWidgetItem* item = new QListWidgetItem( filter_actions[a]->text().remove('&'), mAvailableList );
+		item->setData( Qt::UserRole, filter_actions[a]->objectName() );
+	}
+	mRecipeList = new QListWidget;
+
+	QPushButton* add_button = new QPushButton( tr("Add >") );
+	QPushButton* remove_button = new QPushButton( tr("< Remove") );
+	connect( add_button, SIGNAL( clicked() ), this, SLOT( AddFilter() ) );
+	connect( remove_button, SIGNAL( clicked() ), this, SLOT( RemoveFilter() ) );
+	connect( mAvailableList, SIGNAL( itemDoubleClicked(QListWidgetItem*) ), this, SLOT( AddFilter() ) );
+	connect( mRecipeList, SIGNAL( itemDoubleClicked(QListWidgetItem*) ), this, SLOT( EditFilterParameters(QListWidgetItem*) ) );
+
+	QVBoxLayout* button_layout = new QVBoxLayout;
+	button_layout->addStretch();
+	button_layout->addWidget( add_button );
+	button_layout->addWidget( remove_button );
+	button_layout->addStretch();
+
+	QHBoxLayout* recipe_layout = new QHBoxLayout;
+	recipe_layout->addWidget( mAvailableList );
+	recipe_layout->addLayout( button_layout );
+	recipe_layout->addWidget( mRecipeList );
+
+	// Leave a core free for the interactive image by default
+	mConcurrencySpin = new QSpinBox;
+	mConcurrencySpin->setRange( 1, 64 );
+	mConcurrencySpin->setValue( qMax( 1, QThread::idealThreadCount() - 1 ) );
+
+	QHBoxLayout* concurrency_layout = new QHBoxLayout;
+	concurrency_layout->addWidget( new QLabel( tr("Images at once:") ) );
+	concurrency_layout->addWidget( mConcurrencySpin );
+	concurrency_layout->addStretch();
+
+	mWorkersCheck = new QCheckBox( tr("Run filters in separate processes (a crash only fails that image)") );
+
+	mCacheCheck = new QCheckBox( tr("Reuse results from earlier runs where the inputs haven't changed") );
+	mCacheCheck->setChecked( true );
+
+	mFastEncodeCheck = new QCheckBox( tr("Fast compression (larger output files)") );
+
+	mSequenceCheck = new QCheckBox( tr("Frame sequence: pipeline decoding, filtering and saving, in file name order") );
+
+	mProgressBar = new QProgressBar;
+	mProgressBar->setValue( 0 );
+	mStatusText = new QLabel;
+
+	mStartButton = new QPushButton( tr("Start") );
+	connect( mStartButton, SIGNAL( clicked() ), this, SLOT( StartOrCancel() ) );
+
+	QVBoxLayout* layout = new QVBoxLayout;
+	layout->addLayout( folder_layout );
+	layout->addLayout( recipe_layout );
+	layout->addLayout( concurrency_layout );
+	layout->addWidget( mWorkersCheck );
+	layout->addWidget( mCacheCheck );
+	layout->addWidget( mFastEncodeCheck );
+	layout->addWidget( mSequenceCheck );
+	layout->addWidget( mProgressBar );
+	layout->addWidget( mStatusText );
+	layout->addWidget( mStartButton );
+	setLayout( layout );
+}
+
+BatchDialog::~BatchDialog()
+///
+/// Destructor
+///
+{
+	// The batch processor is a child of the dialog and stops its jobs when deleted
+}
+
+void
+BatchDialog::ChooseInputFolder()
+///
+/// Displays a folder dialog for the folder of images to be processed.
+///
+/// @return
+///  Nothing
+///
+{
+	QString dir = QFileDialog::getExistingDirectory( this, tr("Input Folder"), mInputEdit->text() );
+	if( dir != "" )
+	{
+		mInputEdit->setText( dir );
+		if( mOutputEdit->text() == "" )
+		{
+			mOutputEdit->setText( QDir( dir ).absoluteFilePath( "filtered" ) );
+		}
+	}
+}
+
+void
+BatchDialog::ChooseOutputFolder()
+///
+/// Displays a folder dialog for the folder the results are written to.
+///
+/// @return
+///  Nothing
+///
+{
+	QString dir = QFileDialog::getExistingDirectory( this, tr("Output Folder"), mOutputEdit->text() );
+	if( dir != "" )
+	{
+		mOutputEdit->setText( dir );
+	}
+}
+
+void
+BatchDialog::AddFilter()
+///
+/// Appends the selected filter to the end of the recipe.
+///
+/// @return
+///  Nothing
+///
+{
+	QListWidgetItem* selected = mAvailableList->currentItem();
+	if( selected != NULL )
+	{
+		mRecipeList->addItem( selected->clone() );
+	}
+}
+
+void
+BatchDialog::EditFilterParameters( QListWidgetItem* item )
+///
+/// Lets the parameters of a filter in the recipe be changed, written after its name as in
+/// "gaussian:sigma=2.5".
+///
+/// @param item
+///  The recipe entry to edit.
+///
+/// @return
+///  Nothing
+///
+{
+	QString spec = item->data( Qt::UserRole ).toString();
+	QString name = spec.section( ':', 0, 0 );
+	QString label = item->text().section( " (", 0, 0 );
+	bool accepted = false;
+	QString new_spec = QInputDialog::getText( this, tr("Filter Parameters"),
+		tr("Filter and parameters, e.g. gaussian:sigma=2.5 or canny:low_threshold=10:high_threshold=60"),
+		QLineEdit::Normal, spec, &accepted ).trimmed();
+	if( !accepted || new_spec.section( ':', 0, 0 ) != name )
+	{
+		return;
+	}
+
+	if( mFilterProcessor->GetFilter( new_spec.toStdString() ).get() == NULL )
+	{
+		mStatusText->setText( tr("%1 doesn't take those parameters.").arg( label ) );
+		return;
+	}
+	item->setData( Qt::UserRole, new_spec );
+	QString parameters = new_spec.section( ':', 1 );
+	item->setText( label + (parameters != "" ? " (" + parameters.replace( ':', ", " ) + ")" : "") );
+}
+
+void
+BatchDialog::RemoveFilter()
+///
+/// Removes the selected filter from the recipe.
+///
+/// @return
+///  Nothing
+///
+{
+	delete mRecipeList->takeItem( mRecipeList->currentRow() );
+}
+
+void
+BatchDialog::StartOrCancel()
+///
+/// Starts a batch with the current settings, or cancels the batch that is running.
+///
+/// @return
+///  Nothing
+///
+{
+	if( mBatchProcessor->IsRunning() )
+	{
+		mBatchProcessor->Cancel();
+		mStartButton->setDisabled( true );
+		return;
+	}
+
+	QStringList recipe;
+	for( int i = 0; i < mRecipeList->count(); i++ )
+	{
+		recipe << mRecipeList->item( i )->data( Qt::UserRole ).toString();
+	}
+
+	EncodeSettings settings;
+	settings.fast = mFastEncodeCheck->isChecked();
+
+	mBatchProcessor->SetCacheEnabled( mCacheCheck->isChecked() );
+	mBatchProcessor->SetEncodeSettings( settings );
+	mBatchProcessor->SetSequenceMode( mSequenceCheck->isChecked() );
+	if( mBatchProcessor->Start( mInputEdit->text(), mOutputEdit->text(), recipe, mConcurrencySpin->value(), mWorkersCheck->isChecked() ) )
+	{
+		mStartButton->setText( tr("Cancel") );
+	}
+	else
+	{
+		mStatusText->setText( tr("Nothing to do. Check the folders and add at least one filter.") );
+	}
+}
+
+void
+BatchDialog::BatchProgress( int done, int total, QString status_text )
+///
+/// Updates the progress bar and status text.
+///
+/// @return
+///  Nothing
+///
+{
+	mProgressBar->setMaximum( total );
+	mProgressBar->setValue( done );
+	mStatusText->setText( status_text );
+}
+
+void
+BatchDialog::BatchFinished( int succeeded, int failed )
+///
+/// Resets the dialog so another batch can be started.
+///
+/// @return
+///  Nothing
+///
+{
+	QString status_text = tr("Finished. %1 images processed, %2 failed or skipped.").arg( succeeded ).arg( failed );
+	if( mWorkersCheck->isChecked() )
+	{
+		status_text += "\n" + mBatchProcessor->WorkerSummary();
+	}
+	mStatusText->setText( status_text );
+	mStartButton->setText( tr("Start") );
+	mStartButton->setEnabled( true );
+}
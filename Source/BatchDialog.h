@@ -0,0 +1,46 @@
+#ifndef _BATCH_DIALOG_H_
+#define _BATCH_DIALOG_H_
+
+#include <QApplication>
+#include <QtWidgets>
+
+#include "BatchProcessor.h"
+
+class BatchDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		BatchDialog( FilterProcessor* filter_processor, QList<QAction*> filter_actions, QWidget* parent = 0 );
+		~BatchDialog();
+
+	public slots:
+		void ChooseInputFolder();
+		void ChooseOutputFolder();
+		void AddFilter();
+		void RemoveFilter();
+		void EditFilterParameters( QListWidgetItem* item );
+		void StartOrCancel();
+
+		void BatchProgress( int done, int total, QString status_text );
+		void BatchFinished( int succeeded, int failed );
+
+	private:
+		FilterProcessor* mFilterProcessor;
+		BatchProcessor* mBatchProcessor;
+
+		QLineEdit* mInputEdit;
+		QLineEdit* mOutputEdit;
+		QListWidget* mAvailableList;
+		QListWidget* mRecipeList;
+		QSpinBox* mConcurrencySpin;
+		QCheckBox* mWorkersCheck;
+		QCheckBox* mCacheCheck;
+		QCheckBox* mFastEncodeCheck;
+		QCheckBox* mSequenceCheck;
+		QProgressBar* mProgressBar;
+		QLabel* mStatusText;
+		QPushButton* mStartButton;
+};
+
+#endif
@@ -0,0 +1,770 @@
+///
+/// Applies a recipe of filters to every image in a folder on a pool of background threads.
+/// Each file is decoded, filtered and encoded by its own job, so with several jobs in flight
+/// the decode, filter and encode stages of different files overlap. Optionally the filters
+/// run in a farm of worker processes instead, so an image that crashes a filter only fails
+/// that image. In sequence mode the files are frames that go through a pipeline of
+/// separate decode, filter and encode stages and are saved in order.
+///
+
+#include "BatchProcessor.h"
+
+// How much disk space results cached for reruns may take up
+#define DEFAULT_CACHE_BYTES ((qint64)2 << 30)
+
+// Images no larger than this on either side are thumbnails, and are filtered in groups by
+// one job. A group holds up to THUMBNAILS_PER_JOB images and THUMBNAIL_GROUP_BYTES of
+// decoded pixels, since every image of a group is held at once.
+#define THUMBNAIL_MAX_SIDE 256
+#define THUMBNAILS_PER_JOB 64
+#define THUMBNAIL_GROUP_BYTES ((qint64)4 << 20)
+
+// QThreadPool runs queued jobs of higher priority first, so a finished image is saved
+// before any more files are decoded
+#define ENCODE_JOB_PRIORITY 1
+
+typedef boost::shared_ptr<Filter> filter_ptr;
+
+static bool
+LoadCached( const QString& input_file, const std::vector<filter_ptr>& recipe, const QStringList& recipe_names, FilterCache* cache,
+	QImage& image, std::vector<QByteArray>& stage_keys, size_t& stages_done )
+///
+/// Works out the cache key of every stage of a recipe from an input file's contents,
+/// and loads the output of the last stage that is cached, or the input file if none is.
+///
+/// @param input_file
+///  The input file.
+///
+/// @param recipe
+///  The filters to apply to the file, in order.
+///
+/// @param recipe_names
+///  The name of each filter in the recipe.
+///
+/// @param cache
+///  The cache.
+///
+/// @param image
+///  Receives the image to continue the recipe from.
+///
+/// @param stage_keys
+///  Receives the cache key of each stage's output.
+///
+/// @param stages_done
+///  Receives the number of stages image has already been through.
+///
+/// @return
+///  True if an image was loaded.
+///
+{
+	QFile file( input_file );
+	if( !file.open( QIODevice::ReadOnly ) )
+	{
+		return false;
+	}
+	QByteArray contents = file.readAll();
+
+	QByteArray key = FilterCache::ContentKey( contents );
+	for( size_t f = 0; f < recipe.size(); f++ )
+	{
+		key = FilterCache::StageKey( key, recipe_names[f], recipe[f].get() );
+		stage_keys.push_back( key );
+	}
+
+	for( stages_done = recipe.size(); stages_done > 0; stages_done-- )
+	{
+		if( cache->Load( stage_keys[stages_done - 1], image ) )
+		{
+			return true;
+		}
+	}
+	return image.loadFromData( contents );
+}
+
+
+class BatchJob : public QRunnable
+{
+	public:
+		BatchJob( BatchProcessor* processor, QString input_file, QString output_file, std::vector<filter_ptr> recipe, QStringList recipe_names, FilterCache* cache, EncodeSettings settings, qint64 memory_budget )
+		: mProcessor( processor ),
+		  mInputFile( input_file ),
+		  mOutputFile( output_file ),
+		  mRecipe( recipe ),
+		  mRecipeNames( recipe_names ),
+		  mCache( cache ),
+		  mSettings( settings ),
+		  mMemoryBudget( memory_budget )
+		{
+		}
+
+		void run();
+
+	private:
+		BatchProcessor* mProcessor;
+		QString mInputFile;
+		QString mOutputFile;
+		std::vector<filter_ptr> mRecipe;
+		QStringList mRecipeNames;
+		FilterCache* mCache;
+		EncodeSettings mSettings;
+		qint64 mMemoryBudget;
+};
+
+void
+BatchJob::run()
+///
+/// Loads the input file, runs every filter in the recipe on it and saves the result.
+/// With a cache, the run picks up after the last stage whose output is cached, and the
+/// output of every stage that is run is added to the cache. Reports back to the batch
+/// processor on the GUI thread when done.
+///
+/// @return
+///  Nothing.
+///
+{
+	bool success = false;
+	if( !mProcessor->IsCancelled() )
+	{
+		QImage image;
+		std::vector<QByteArray> stage_keys;
+		size_t stages_done = 0;
+		if( mCache != NULL )
+		{
+			success = LoadCached( mInputFile, mRecipe, mRecipeNames, mCache, image, stage_keys, stages_done );
+		}
+		else
+		{
+			success = image.load( mInputFile );
+		}
+
+		for( size_t f = stages_done; f < mRecipe.size() && success && !mProcessor->IsCancelled(); f++ )
+		{
+			image = FilterProcessor::ApplyFilter( mRecipe[f].get(), image, NULL, mMemoryBudget );
+			success = !image.isNull();
+			if( success && mCache != NULL )
+			{
+				mCache->Store( stage_keys[f], image );
+			}
+		}
+		success = success && !mProcessor->IsCancelled() && ImageEncoder::Save( image, mOutputFile, mSettings );
+	}
+
+	QMetaObject::invokeMethod( mProcessor, "JobFinished", Qt::QueuedConnection, Q_ARG(QString, mInputFile), Q_ARG(bool, success) );
+}
+
+class ThumbnailJob : public QRunnable
+{
+	public:
+		ThumbnailJob( BatchProcessor* processor, QStringList input_files, QStringList output_files, std::vector<filter_ptr> recipe, QStringList recipe_names, FilterCache* cache, EncodeSettings settings, qint64 memory_budget )
+		: mProcessor( processor ),
+		  mInputFiles( input_files ),
+		  mOutputFiles( output_files ),
+		  mRecipe( recipe ),
+		  mRecipeNames( recipe_names ),
+		  mCache( cache ),
+		  mSettings( settings ),
+		  mMemoryBudget( memory_budget )
+		{
+		}
+
+		void run();
+
+	private:
+		BatchProcessor* mProcessor;
+		QStringList mInputFiles;
+		QStringList mOutputFiles;
+		std::vector<filter_ptr> mRecipe;
+		QStringList mRecipeNames;
+		FilterCache* mCache;
+		EncodeSettings mSettings;
+		qint64 mMemoryBudget;
+};
+
+void
+ThumbnailJob::run()
+///
+/// Filters a group of small files together. Each filter of the recipe runs once over all
+/// the images that need it, through FilterProcessor::ApplyFilterBatch, so the cost of a
+/// filter call is shared by the group. The whole group is decoded first, which the group's
+/// bound on decoded bytes keeps small. Otherwise works like BatchJob, including the cache.
+///
+/// @return
+///  Nothing.
+///
+{
+	int count = mInputFiles.size();
+	QVector<QImage> images( count );
+	std::vector< std::vector<QByteArray> > stage_keys( count );
+	std::vector<size_t> stages_done( count, 0 );
+	std::vector<bool> success( count, false );
+	for( int i = 0; i < count && !mProcessor->IsCancelled(); i++ )
+	{
+		if( mCache != NULL )
+		{
+			success[i] = LoadCached( mInputFiles[i], mRecipe, mRecipeNames, mCache, images[i], stage_keys[i], stages_done[i] );
+		}
+		else
+		{
+			success[i] = images[i].load( mInputFiles[i] );
+		}
+	}
+
+	for( size_t f = 0; f < mRecipe.size() && !mProcessor->IsCancelled(); f++ )
+	{
+		// Images whose output of this stage was cached skip it
+		QVector<QImage> batch;
+		QVector<int> batch_files;
+		for( int i = 0; i < count; i++ )
+		{
+			if( success[i] && stages_done[i] <= f )
+			{
+				batch << images[i];
+				batch_files << i;
+				images[i] = QImage();
+			}
+		}
+
+		batch = FilterProcessor::ApplyFilterBatch( mRecipe[f].get(), batch, mMemoryBudget );
+		for( int b = 0; b < batch.size(); b++ )
+		{
+			int i = batch_files[b];
+			images[i] = batch[b];
+			success[i] = !images[i].isNull();
+			if( success[i] && mCache != NULL )
+			{
+				mCache->Store( stage_keys[i][f], images[i] );
+			}
+		}
+	}
+
+	for( int i = 0; i < count; i++ )
+	{
+		bool saved = success[i] && !mProcessor->IsCancelled() && ImageEncoder::Save( images[i], mOutputFiles[i], mSettings );
+		images[i] = QImage();
+		QMetaObject::invokeMethod( mProcessor, "JobFinished", Qt::QueuedConnection, Q_ARG(QString, mInputFiles[i]), Q_ARG(bool, saved) );
+	}
+}
+
+class DecodeJob : public QRunnable
+{
+	public:
+		DecodeJob( BatchProcessor* processor, QString input_file )
+		: mProcessor( processor ),
+		  mInputFile( input_file )
+		{
+		}
+
+		void run();
+
+	private:
+		BatchProcessor* mProcessor;
+		QString mInputFile;
+};
+
+void
+DecodeJob::run()
+///
+/// Loads the input file and hands the image to the batch processor on the GUI thread,
+/// which passes it on to the worker farm.
+///
+/// @return
+///  Nothing.
+///
+{
+	QImage image;
+	if( !mProcessor->IsCancelled() )
+	{
+		image.load( mInputFile );
+	}
+
+	QMetaObject::invokeMethod( mProcessor, "ImageDecoded", Qt::QueuedConnection, Q_ARG(QString, mInputFile), Q_ARG(QImage, image) );
+}
+
+class EncodeJob : public QRunnable
+{
+	public:
+		EncodeJob( BatchProcessor* processor, QImage image, QString input_file, QString output_file, EncodeSettings settings )
+		: mProcessor( processor ),
+		  mImage( image ),
+		  mInputFile( input_file ),
+		  mOutputFile( output_file ),
+		  mSettings( settings )
+		{
+		}
+
+		void run();
+
+	private:
+		BatchProcessor* mProcessor;
+		QImage mImage;
+		QString mInputFile;
+		QString mOutputFile;
+		EncodeSettings mSettings;
+};
+
+void
+EncodeJob::run()
+///
+/// Saves an image filtered by the worker farm and reports back to the batch processor.
+///
+/// @return
+///  Nothing.
+///
+{
+	bool success = !mProcessor->IsCancelled() && ImageEncoder::Save( mImage, mOutputFile, mSettings );
+
+	QMetaObject::invokeMethod( mProcessor, "JobFinished", Qt::QueuedConnection, Q_ARG(QString, mInputFile), Q_ARG(bool, success) );
+}
+
+BatchProcessor::BatchProcessor( FilterProcessor* filter_processor, QObject* parent )
+///
+/// Constructor.
+///
+/// @param filter_processor
+///  The filter processor whose filter library the recipes are taken from.
+///
+/// @param parent
+///  The owner of this object.
+///
+: QObject( parent ),
+  mFilterProcessor( filter_processor ),
+  mCancelled( 0 ),
+  mTotal( 0 ),
+  mSucceeded( 0 ),
+  mFailed( 0 ),
+  mCacheEnabled( false ),
+  mSequenceMode( false ),
+  mInFlight( 0 )
+{
+	QString cache_dir = QDir( QStandardPaths::writableLocation( QStandardPaths::CacheLocation ) ).absoluteFilePath( "filter-outputs" );
+	mCache = new FilterCache( cache_dir, DEFAULT_CACHE_BYTES );
+
+	mSequencePipeline = new SequencePipeline( this );
+
+	mWorkerFarm = new WorkerFarm( this );
+	connect( mWorkerFarm, SIGNAL( JobFinished(int, QImage, bool) ), this, SLOT( WorkerJobFinished(int, QImage, bool) ) );
+}
+
+BatchProcessor::~BatchProcessor()
+///
+/// Destructor. Cancels any remaining work and waits for running jobs to stop.
+///
+{
+	Cancel();
+	mThreadPool.waitForDone();
+	delete mSequencePipeline;
+	delete mCache;
+}
+
+QStringList
+BatchProcessor::ImageFileFilters()
+///
+/// @return
+///  The file name patterns of the image types the batch processor picks up.
+///
+{
+	return QStringList() << "*.png" << "*.bmp" << "*.jpg" << "*.jpeg" << "*.tif" << "*.tiff";
+}
+
+bool
+BatchProcessor::Start( QString input_dir, QString output_dir, QStringList recipe, int max_concurrent, bool use_workers )
+///
+/// Queues every image in a folder to be filtered in the background.
+///
+/// @param input_dir
+///  The folder containing the images to be processed.
+///
+/// @param output_dir
+///  The folder the results are written to, using the same file names.
+///
+/// @param recipe
+///  The names of the filters to apply to each image, in order.
+///
+/// @param max_concurrent
+///  The maximum number of images processed at the same time. In worker mode, this is also
+///  the number of worker processes.
+///
+/// @param use_workers
+///  True to run the filters in separate worker processes instead of threads.
+///
+/// @return
+///  True if the batch was started. False if a batch is already running, the recipe is
+///  invalid, the output folder is the input folder, there are no images to process or the
+///  workers couldn't be started.
+///
+{
+	if( IsRunning() || recipe.isEmpty() )
+	{
+		return false;
+	}
+
+	std::vector<filter_ptr> filters;
+	for( int f = 0; f < recipe.size(); f++ )
+	{
+		filter_ptr filter = mFilterProcessor->GetFilter( recipe[f].toStdString() );
+		if( !filter )
+		{
+			return false;
+		}
+		filters.push_back( filter );
+	}
+
+	// Results written over the images being read would destroy them. A folder that doesn't
+	// exist yet has an empty canonical path, so it never matches.
+	QDir input( input_dir );
+	QDir output( output_dir );
+	if( input.canonicalPath().isEmpty() || input.canonicalPath() == output.canonicalPath() )
+	{
+		return false;
+	}
+
+	QStringList files = input.entryList( ImageFileFilters(), QDir::Files, QDir::Name );
+	if( files.isEmpty() || !output.mkpath( "." ) )
+	{
+		return false;
+	}
+
+	if( use_workers )
+	{
+		if( mWorkerFarm->IsRunning() && mWorkerFarm->Stats().size() != max_concurrent )
+		{
+			mWorkerFarm->Stop();
+		}
+		if( !mWorkerFarm->IsRunning() && !mWorkerFarm->Start( max_concurrent ) )
+		{
+			return false;
+		}
+	}
+
+	mCancelled.store( 0 );
+	mTotal = files.size();
+	mSucceeded = 0;
+	mFailed = 0;
+	mTimer.start();
+
+	// Only max_concurrent images are decoded at once, so memory use stays bounded
+	// however many files are queued. The images being filtered share the memory budget.
+	mThreadPool.setMaxThreadCount( max_concurrent > 0 ? max_concurrent : 1 );
+	qint64 memory_budget = ExecutionPlanner::DefaultBudget()/mThreadPool.maxThreadCount();
+	if( use_workers )
+	{
+		mRecipeNames = recipe;
+		mOutputDir = output;
+		mWaitingFiles.clear();
+		for( int i = 0; i < files.size(); i++ )
+		{
+			mWaitingFiles << input.absoluteFilePath( files[i] );
+		}
+		mInFlight = 0;
+		FeedWorkers();
+	}
+	else if( mSequenceMode )
+	{
+		QStringList input_files;
+		QStringList output_files;
+		for( int i = 0; i < files.size(); i++ )
+		{
+			input_files << input.absoluteFilePath( files[i] );
+			output_files << output.absoluteFilePath( files[i] );
+		}
+		mSequencePipeline->Start( input_files, output_files, filters, mEncodeSettings, mThreadPool.maxThreadCount() );
+	}
+	else
+	{
+		// Small images are filtered in groups, so the overhead of each filter call is paid
+		// once per group rather than once per image. They're told apart by the size in
+		// their headers, as the size of a compressed file says little about the image.
+		QStringList thumbnails;
+		QList<qint64> thumbnail_bytes;
+		for( int i = 0; i < files.size(); i++ )
+		{
+			QSize size = QImageReader( input.absoluteFilePath( files[i] ) ).size();
+			if( !size.isValid() || size.width() > THUMBNAIL_MAX_SIDE || size.height() > THUMBNAIL_MAX_SIDE )
+			{
+				mThreadPool.start( new BatchJob( this, input.absoluteFilePath( files[i] ), output.absoluteFilePath( files[i] ), filters, recipe, mCacheEnabled ? mCache : NULL, mEncodeSettings, memory_budget ) );
+				continue;
+			}
+			thumbnails << files[i];
+			thumbnail_bytes << (qint64)size.width()*size.height()*4;
+		}
+
+		// Groups are made small enough for every thread to get one, so a few thumbnails
+		// aren't all filtered by one thread while the others sit idle. With a group per
+		// thread, one group is decoded while others are being filtered.
+		int threads = mThreadPool.maxThreadCount();
+		int group_size = qBound( 1, (thumbnails.size() + threads - 1)/threads, THUMBNAILS_PER_JOB );
+		QStringList group_inputs;
+		QStringList group_outputs;
+		qint64 group_bytes = 0;
+		for( int i = 0; i < thumbnails.size(); i++ )
+		{
+			if( !group_inputs.isEmpty() && (group_inputs.size() == group_size || group_bytes + thumbnail_bytes[i] > THUMBNAIL_GROUP_BYTES) )
+			{
+				mThreadPool.start( new ThumbnailJob( this, group_inputs, group_outputs, filters, recipe, mCacheEnabled ? mCache : NULL, mEncodeSettings, memory_budget ) );
+				group_inputs.clear();
+				group_outputs.clear();
+				group_bytes = 0;
+			}
+			group_inputs << input.absoluteFilePath( thumbnails[i] );
+			group_outputs << output.absoluteFilePath( thumbnails[i] );
+			group_bytes += thumbnail_bytes[i];
+		}
+		if( !group_inputs.isEmpty() )
+		{
+			mThreadPool.start( new ThumbnailJob( this, group_inputs, group_outputs, filters, recipe, mCacheEnabled ? mCache : NULL, mEncodeSettings, memory_budget ) );
+		}
+	}
+
+	emit BatchProgress( 0, mTotal, tr("Processing %1 images...").arg( mTotal ) );
+	return true;
+}
+
+void
+BatchProcessor::Cancel()
+///
+/// Stops the current batch. Jobs that haven't started yet finish immediately without
+/// doing any work.
+///
+/// @return
+///  Nothing.
+///
+{
+	mCancelled.store( 1 );
+
+	// Files still waiting for the worker farm are skipped from the event loop
+	QMetaObject::invokeMethod( this, "FeedWorkers", Qt::QueuedConnection );
+}
+
+bool
+BatchProcessor::IsRunning() const
+///
+/// @return
+///  True while there are images in the current batch that haven't been finished.
+///
+{
+	return mSucceeded + mFailed < mTotal;
+}
+
+void
+BatchProcessor::SetCacheEnabled( bool enabled )
+///
+/// Sets whether batches reuse the stages cached by earlier runs, and cache the stages they
+/// run. Takes effect with the next batch. Batches run on worker processes aren't cached.
+///
+/// @param enabled
+///  True to use the cache.
+///
+/// @return
+///  Nothing.
+///
+{
+	mCacheEnabled = enabled;
+}
+
+void
+BatchProcessor::SetEncodeSettings( const EncodeSettings& settings )
+///
+/// Sets how the output images are encoded. Takes effect with the next batch.
+///
+/// @param settings
+///  The quality and compression effort to save with.
+///
+/// @return
+///  Nothing.
+///
+{
+	mEncodeSettings = settings;
+}
+
+void
+BatchProcessor::SetSequenceMode( bool enabled )
+///
+/// Sets whether batches treat the files, in name order, as the frames of a sequence such
+/// as a time-lapse. Frames are decoded, filtered and encoded by a pipeline of separate
+/// stages instead of one job per file, and are saved in order. Takes effect with the next
+/// batch. Worker process batches and the cache don't use sequence mode.
+///
+/// @param enabled
+///  True to process batches as sequences.
+///
+/// @return
+///  Nothing.
+///
+{
+	mSequenceMode = enabled;
+}
+
+bool
+BatchProcessor::IsCancelled() const
+///
+/// @return
+///  True if the current batch has been cancelled.
+///
+{
+	return mCancelled.load() != 0;
+}
+
+void
+BatchProcessor::JobFinished( QString file_name, bool success )
+///
+/// Updates the batch progress when a job finishes. Called on the GUI thread.
+///
+/// @param file_name
+///  The input file the job processed.
+///
+/// @param success
+///  True if the image was filtered and saved.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( success )
+	{
+		mSucceeded++;
+	}
+	else
+	{
+		mFailed++;
+	}
+
+	int done = mSucceeded + mFailed;
+	QString status_text;
+	if( IsCancelled() )
+	{
+		status_text = tr("Cancelling...");
+	}
+	else
+	{
+		// Estimate the time left from the average time per image so far
+		qint64 remaining_ms = mTimer.elapsed()*(mTotal - done)/done;
+		QTime remaining = QTime( 0, 0 ).addMSecs( (int)remaining_ms );
+		status_text = tr("%1 of %2: %3 %4. About %5 left.")
+			.arg( done ).arg( mTotal ).arg( QFileInfo( file_name ).fileName() )
+			.arg( success ? tr("done") : tr("failed") )
+			.arg( remaining.toString( "hh:mm:ss" ) );
+	}
+	emit BatchProgress( done, mTotal, status_text );
+
+	if( done == mTotal )
+	{
+		emit BatchFinished( mSucceeded, mFailed );
+	}
+}
+
+void
+BatchProcessor::FeedWorkers()
+///
+/// Starts decoding waiting files while there is room for them in the worker farm. Decoding
+/// only as far ahead as the farm can take keeps memory use bounded however many files are
+/// queued. Encodes share the thread pool with decodes and are started at a higher
+/// priority, so they are queued ahead of them and finished images can't pile up faster
+/// than they are saved either.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( IsCancelled() )
+	{
+		QStringList skipped = mWaitingFiles;
+		mWaitingFiles.clear();
+		for( int i = 0; i < skipped.size(); i++ )
+		{
+			JobFinished( skipped[i], false );
+		}
+		return;
+	}
+
+	while( !mWaitingFiles.isEmpty() && mInFlight < mWorkerFarm->Capacity() )
+	{
+		mInFlight++;
+		mThreadPool.start( new DecodeJob( this, mWaitingFiles.takeFirst() ) );
+	}
+}
+
+void
+BatchProcessor::ImageDecoded( QString file_name, QImage image )
+///
+/// Passes a decoded image on to the worker farm. Called on the GUI thread.
+///
+/// @param file_name
+///  The input file the image was loaded from.
+///
+/// @param image
+///  The decoded image, or a null image if it couldn't be loaded.
+///
+/// @return
+///  Nothing.
+///
+{
+	int job_id = -1;
+	if( !image.isNull() && !IsCancelled() )
+	{
+		job_id = mWorkerFarm->Submit( image, mRecipeNames );
+	}
+
+	if( job_id < 0 )
+	{
+		mInFlight--;
+		JobFinished( file_name, false );
+		FeedWorkers();
+		return;
+	}
+	mWorkerJobs[job_id] = file_name;
+}
+
+void
+BatchProcessor::WorkerJobFinished( int job_id, QImage result, bool success )
+///
+/// Queues the result of a worker farm job to be saved.
+///
+/// @param job_id
+///  The id of the farm job.
+///
+/// @param result
+///  The filtered image.
+///
+/// @param success
+///  False if the recipe failed or the worker crashed on this image.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( !mWorkerJobs.contains( job_id ) )
+	{
+		return;
+	}
+
+	QString file_name = mWorkerJobs.take( job_id );
+	mInFlight--;
+	if( success && !IsCancelled() )
+	{
+		QString output_file = mOutputDir.absoluteFilePath( QFileInfo( file_name ).fileName() );
+		mThreadPool.start( new EncodeJob( this, result, file_name, output_file, mEncodeSettings ), ENCODE_JOB_PRIORITY );
+	}
+	else
+	{
+		JobFinished( file_name, false );
+	}
+	FeedWorkers();
+}
+
+QString
+BatchProcessor::WorkerSummary() const
+///
+/// @return
+///  One line of statistics per worker process, or an empty string if no workers have run.
+///
+{
+	QStringList lines;
+	QVector<WorkerStats> stats = mWorkerFarm->Stats();
+	for( int i = 0; i < stats.size(); i++ )
+	{
+		lines << tr("Worker %1: %2 done, %3 failed, %4 restarts, %5 ms busy.")
+			.arg( i + 1 ).arg( stats[i].jobs_done ).arg( stats[i].jobs_failed )
+			.arg( stats[i].restarts ).arg( stats[i].busy_ms );
+	}
+	return lines.join( "\n" );
+}
\ No newline at end of file
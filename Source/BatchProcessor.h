@@ -0,0 +1,79 @@
+#ifndef _BATCH_PROCESSOR_H_
+#define _BATCH_PROCESSOR_H_
+
+#include <QApplication>
+#include <QtWidgets>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "Filter.h"
+#include "FilterCache.h"
+#include "FilterProcessor.h"
+#include "ImageEncoder.h"
+#include "SequencePipeline.h"
+#include "WorkerFarm.h"
+
+class BatchProcessor : public QObject
+{
+	Q_OBJECT
+
+	public:
+		BatchProcessor( FilterProcessor* filter_processor, QObject* parent = 0 );
+		~BatchProcessor();
+
+		bool Start( QString input_dir, QString output_dir, QStringList recipe, int max_concurrent, bool use_workers = false );
+		void Cancel();
+		bool IsRunning() const;
+
+		bool IsCancelled() const;
+
+		void SetCacheEnabled( bool enabled );
+		void SetEncodeSettings( const EncodeSettings& settings );
+		void SetSequenceMode( bool enabled );
+
+		QString WorkerSummary() const;
+
+		static QStringList ImageFileFilters();
+
+	signals:
+		void BatchProgress( int done, int total, QString status_text );
+		void BatchFinished( int succeeded, int failed );
+
+	public slots:
+		void JobFinished( QString file_name, bool success );
+		void ImageDecoded( QString file_name, QImage image );
+
+	private slots:
+		void FeedWorkers();
+		void WorkerJobFinished( int job_id, QImage result, bool success );
+
+	private:
+		FilterProcessor* mFilterProcessor;
+
+		QThreadPool mThreadPool;
+		QAtomicInt mCancelled;
+		QElapsedTimer mTimer;
+
+		int mTotal;
+		int mSucceeded;
+		int mFailed;
+
+		FilterCache* mCache;
+		bool mCacheEnabled;
+
+		EncodeSettings mEncodeSettings;
+
+		// Sequence mode runs the files as the frames of one pipeline
+		SequencePipeline* mSequencePipeline;
+		bool mSequenceMode;
+
+		// Worker process mode. Files wait in mWaitingFiles until there is room in the farm.
+		WorkerFarm* mWorkerFarm;
+		QStringList mRecipeNames;
+		QStringList mWaitingFiles;
+		QDir mOutputDir;
+		QMap<int, QString> mWorkerJobs;
+		int mInFlight;
+};
+
+#endif
@@ -0,0 +1,320 @@
+///
+/// Decides how to run a filter so it stays within a memory budget. Filters report how much
+/// memory they need for an image of a given size. When a whole image doesn't fit, filters
+/// that only look a fixed distance around each pixel are run on bands of rows, each band
+/// carrying enough rows from its neighbours (its halo) for the result to be identical.
+/// Pointwise filters need no halo and are streamed band by band, in place when they can
+/// be. Filters where any pixel can affect any other can't be split, and are refused rather
+/// than allowed to exhaust memory, unless their global step only needs a one byte per pixel
+/// map. Those build the map in bands and finish it whole.
+///
+
+#include "ExecutionPlanner.h"
+
+#include <string.h>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+// Used when the amount of physical memory can't be found out
+#define FALLBACK_BUDGET_BYTES ((qint64)2 << 30)
+
+static bool
+BuildsMap( const FilterCapabilities& capabilities )
+///
+/// @return
+///  True if a global filter can build the map its global step works on in bands.
+///
+{
+	return capabilities.halo == FILTER_HALO_GLOBAL && capabilities.map_halo >= 0;
+}
+
+static qint64
+PeakBytes( const Filter* filter, int width, int band_rows, int height, int channels )
+///
+/// @return
+///  The most memory in use at once when the image is filtered in bands of band_rows rows,
+///  or whole when band_rows is the height of the image.
+///
+{
+	FilterCapabilities capabilities = filter->Capabilities();
+	int halo = capabilities.halo > 0 ? capabilities.halo : 0;
+	qint64 frame = (qint64)width*height*channels;
+
+	qint64 run_bytes;
+	bool result_is_source;
+	if( band_rows >= height )
+	{
+		// The ingested frame and the filter's own needs, which include its result
+		run_bytes = frame + (qint64)filter->WorkingSetBytes( width, height, channels );
+		result_is_source = capabilities.in_place;
+	}
+	else if( BuildsMap( capabilities ) )
+	{
+		// The map is held throughout, alongside each band's needs and then the result. The
+		// filter's working set for a band is an overestimate, as it includes a result.
+		int input_rows = qMin( height, band_rows + 2*capabilities.map_halo );
+		qint64 map = (qint64)width*height;
+		run_bytes = frame + map + qMax( (qint64)filter->WorkingSetBytes( width, input_rows, channels ), frame );
+		result_is_source = false;
+	}
+	else
+	{
+		// In place filters without a halo work on the ingested frame directly. With a halo
+		// they get a copy of each band, so they don't overwrite rows the next band needs.
+		// Everything else writes each band's result into an output frame.
+		bool direct = capabilities.in_place && halo == 0;
+		int input_rows = qMin( height, band_rows + 2*halo );
+		qint64 band_input = (qint64)width*input_rows*channels;
+		run_bytes = frame + (direct ? 0 : frame) + (capabilities.in_place && halo > 0 ? band_input : 0) +
+			(qint64)filter->WorkingSetBytes( width, input_rows, channels );
+		result_is_source = direct;
+	}
+
+	// Converting the result back to an image takes another frame while the others are held
+	qint64 egress_bytes = frame*(result_is_source ? 2 : 3);
+	return qMax( run_bytes, egress_bytes );
+}
+
+static uchar*
+RunMapped( Filter* filter, const ExecutionPlan& plan, uchar* source, int width, int height, int channels )
+///
+/// Runs a global filter that builds its map in bands, then finishes the whole map.
+///
+/// @return
+///  The filtered image, or NULL if the filter failed.
+///
+{
+	int halo = filter->Capabilities().map_halo;
+	size_t row_bytes = (size_t)width*channels;
+	uchar* map = new uchar[(size_t)width*height];
+	bool success = true;
+	for( int y = 0; y < height && success; y += plan.band_rows )
+	{
+		int rows = qMin( plan.band_rows, height - y );
+		int input_start = qMax( 0, y - halo );
+		int input_rows = qMin( height, y + rows + halo ) - input_start;
+		success = filter->RunMapBand( source + input_start*row_bytes, width, input_rows, channels, y - input_start, rows, map + (size_t)y*width );
+	}
+
+	uchar* result = success ? filter->FinishMap( map, width, height, channels ) : NULL;
+	delete [] map;
+	return result;
+}
+
+ExecutionPlan::ExecutionPlan()
+///
+/// Constructor. A plan to run the whole image at once.
+///
+: mode( EXECUTE_FULL_FRAME ),
+  band_rows( 0 ),
+  band_count( 1 ),
+  peak_bytes( 0 ),
+  budget_bytes( 0 )
+{
+}
+
+QString
+ExecutionPlan::Describe() const
+///
+/// @return
+///  A short description of the plan for the status bar.
+///
+{
+	QString peak = QString( "peak ~%1 MB of %2 MB" ).arg( peak_bytes >> 20 ).arg( budget_bytes >> 20 );
+	switch( mode )
+	{
+		case EXECUTE_TILED:
+			return QString( "tiled in %1 bands, %2" ).arg( band_count ).arg( peak );
+		case EXECUTE_STREAMING:
+			return QString( "streamed in %1 bands, %2" ).arg( band_count ).arg( peak );
+		case EXECUTE_REFUSED:
+			return QString( "needs ~%1 MB, over the %2 MB memory budget" ).arg( peak_bytes >> 20 ).arg( budget_bytes >> 20 );
+		case EXECUTE_FULL_FRAME:
+		default:
+			return QString( "full frame, %1" ).arg( peak );
+	}
+}
+
+qint64
+ExecutionPlanner::DefaultBudget()
+///
+/// @return
+///  Half of the machine's physical memory, leaving the rest for the application, other
+///  programs and the operating system.
+///
+{
+	qint64 physical = 0;
+#if defined(Q_OS_UNIX) && defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+	physical = (qint64)sysconf( _SC_PHYS_PAGES )*sysconf( _SC_PAGESIZE );
+#elif defined(Q_OS_WIN)
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if( GlobalMemoryStatusEx( &status ) )
+	{
+		physical = (qint64)status.ullTotalPhys;
+	}
+#endif
+	return physical > 0 ? physical/2 : FALLBACK_BUDGET_BYTES;
+}
+
+ExecutionPlan
+ExecutionPlanner::Plan( const Filter* filter, int width, int height, int channels, qint64 budget_bytes )
+///
+/// Picks how to run a filter on an 8 bit image: whole if it fits in the budget, otherwise
+/// in the tallest bands that fit.
+///
+/// @param filter
+///  The filter.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of channels in the image.
+///
+/// @param budget_bytes
+///  The most memory the filter run may use.
+///
+/// @return
+///  The plan.
+///
+{
+	ExecutionPlan plan;
+	plan.budget_bytes = budget_bytes;
+	plan.band_rows = height;
+	plan.peak_bytes = PeakBytes( filter, width, height, height, channels );
+	if( plan.peak_bytes <= budget_bytes )
+	{
+		return plan;
+	}
+
+	FilterCapabilities capabilities = filter->Capabilities();
+	if( (capabilities.halo == FILTER_HALO_GLOBAL && !BuildsMap( capabilities )) || height <= 1 )
+	{
+		plan.mode = EXECUTE_REFUSED;
+		return plan;
+	}
+
+	// Working sets grow with the number of rows, so find the tallest band that fits
+	int low = 1;
+	int high = height - 1;
+	if( PeakBytes( filter, width, low, height, channels ) > budget_bytes )
+	{
+		plan.mode = EXECUTE_REFUSED;
+		plan.peak_bytes = PeakBytes( filter, width, low, height, channels );
+		return plan;
+	}
+	while( low < high )
+	{
+		int middle = low + (high - low + 1)/2;
+		if( PeakBytes( filter, width, middle, height, channels ) <= budget_bytes )
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+
+	plan.mode = capabilities.halo == 0 ? EXECUTE_STREAMING : EXECUTE_TILED;
+	if( BuildsMap( capabilities ) )
+	{
+		plan.mode = capabilities.map_halo == 0 ? EXECUTE_STREAMING : EXECUTE_TILED;
+	}
+	plan.band_rows = low;
+	plan.band_count = (height + low - 1)/low;
+	plan.peak_bytes = PeakBytes( filter, width, low, height, channels );
+	return plan;
+}
+
+uchar*
+ExecutionPlanner::Run( Filter* filter, const ExecutionPlan& plan, uchar* source, int width, int height, int channels )
+///
+/// Runs a filter as planned.
+///
+/// @param filter
+///  The filter.
+///
+/// @param plan
+///  The plan made for this filter and image size.
+///
+/// @param source
+///  The image, which filters that work in place may overwrite.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of channels in the image.
+///
+/// @return
+///  The filtered image as RunFilter would return it: a new buffer, or source for filters
+///  that work in place. NULL if the filter failed or the plan was refused.
+///
+{
+	if( plan.mode == EXECUTE_FULL_FRAME )
+	{
+		return filter->RunFilter( source, width, height, channels );
+	}
+	if( plan.mode == EXECUTE_REFUSED || plan.band_rows <= 0 )
+	{
+		return NULL;
+	}
+
+	FilterCapabilities capabilities = filter->Capabilities();
+	if( BuildsMap( capabilities ) )
+	{
+		return RunMapped( filter, plan, source, width, height, channels );
+	}
+
+	int halo = capabilities.halo > 0 ? capabilities.halo : 0;
+	bool direct = capabilities.in_place && halo == 0;
+	size_t row_bytes = (size_t)width*channels;
+
+	uchar* output = direct ? source : new uchar[row_bytes*height];
+	uchar* scratch = capabilities.in_place && halo > 0 ? new uchar[row_bytes*qMin( height, plan.band_rows + 2*halo )] : NULL;
+	bool success = true;
+	for( int y = 0; y < height && success; y += plan.band_rows )
+	{
+		int rows = qMin( plan.band_rows, height - y );
+		int input_start = qMax( 0, y - halo );
+		int input_rows = qMin( height, y + rows + halo ) - input_start;
+
+		// Rows are contiguous, so a band is just a pointer into the image
+		uchar* band = source + input_start*row_bytes;
+		if( scratch != NULL )
+		{
+			memcpy( scratch, band, input_rows*row_bytes );
+			band = scratch;
+		}
+
+		uchar* result = filter->RunFilter( band, width, input_rows, channels );
+		success = result != NULL && (result != band || capabilities.in_place);
+		if( success && result + (y - input_start)*row_bytes != output + y*row_bytes )
+		{
+			memcpy( output + y*row_bytes, result + (y - input_start)*row_bytes, rows*row_bytes );
+		}
+		if( result != NULL && result != band )
+		{
+			delete [] result;
+		}
+	}
+
+	delete [] scratch;
+	if( !success && output != source )
+	{
+		delete [] output;
+	}
+	return success ? output : NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef _EXECUTION_PLANNER_H_
+#define _EXECUTION_PLANNER_H_
+
+#include <QApplication>
+#include <QtWidgets>
+
+#include "Filter.h"
+
+// How a filter is run to keep within a memory budget.
+enum ExecutionMode
+{
+	EXECUTE_FULL_FRAME,		// the whole image in one call
+	EXECUTE_TILED,			// bands of rows, each with a halo of rows from its neighbours, or of
+							// the map a global filter finishes whole
+	EXECUTE_STREAMING,		// bands of rows of a pointwise filter, in place where it can be
+	EXECUTE_REFUSED			// too large for the budget and the filter can't be split
+};
+
+struct ExecutionPlan
+{
+	ExecutionPlan();
+
+	QString Describe() const;
+
+	ExecutionMode mode;
+	int band_rows;			// Rows each band produces
+	int band_count;
+	qint64 peak_bytes;		// Estimated memory in use at once, including the frame buffers
+	qint64 budget_bytes;
+};
+
+class ExecutionPlanner
+{
+	public:
+		static qint64 DefaultBudget();
+
+		static ExecutionPlan Plan( const Filter* filter, int width, int height, int channels, qint64 budget_bytes );
+		static uchar* Run( Filter* filter, const ExecutionPlan& plan, uchar* source, int width, int height, int channels );
+};
+
+#endif
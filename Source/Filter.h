@@ -1,12 +1,99 @@
 #ifndef _FILTER_H_
 #define _FILTER_H_
 
+#include <stddef.h>
+#include <map>
+#include <string>
+
 typedef unsigned char uchar;
+typedef unsigned short ushort;
+
+// Named settings for a filter, e.g. "sigma" for a blur
+typedef std::map<std::string, double> FilterParameters;
+
+// Pixel layouts a filter has an implementation for
+enum FilterFormat
+{
+	FILTER_FORMAT_GRAY8 = 1,		// RunFilter with one channel
+	FILTER_FORMAT_RGBA8 = 2,		// RunFilter with four channels
+	FILTER_FORMAT_RGBA16 = 4,		// RunFilter16
+	FILTER_FORMAT_FLOAT = 8			// RunFilterFloat
+};
+
+// Instruction sets a filter has dedicated code paths for
+enum FilterSimd
+{
+	FILTER_SIMD_SSE2 = 1,
+	FILTER_SIMD_SSSE3 = 2,
+	FILTER_SIMD_SSE41 = 4,
+	FILTER_SIMD_AVX2 = 8
+};
+
+// The halo of a filter where any input pixel can affect any output pixel
+#define FILTER_HALO_GLOBAL -1
+
+// What a filter needs and supports, so the code running it can split, combine and
+// schedule filters it knows nothing else about. The defaults are safe for any filter.
+struct FilterCapabilities
+{
+	FilterCapabilities()
+	: halo( FILTER_HALO_GLOBAL ),
+	  pointwise( false ),
+	  in_place( false ),
+	  per_channel( false ),
+	  clamped_edges( false ),
+	  map_halo( FILTER_HALO_GLOBAL ),
+	  formats( FILTER_FORMAT_RGBA8 ),
+	  simd( 0 )
+	{
+	}
+
+	int halo;			// Pixels of input needed on each side of an output pixel
+	bool pointwise;		// Each output pixel depends only on the input pixel at the same place
+	bool in_place;		// RunFilter may overwrite its source and return it as the result
+	bool per_channel;	// Each color channel is filtered on its own in the same way, and an
+						// opaque alpha stays opaque, so a gray image can be run as one channel
+	bool clamped_edges;	// Pixels beyond the edges are taken to repeat the edge pixels, so an
+						// image padded that way by the halo filters the same
+	int map_halo;		// For a global filter whose global step works only on a one byte per
+						// pixel map, the halo of the stages that build the map. It can then
+						// be run in bands through RunMapBand and finished with FinishMap.
+	unsigned formats;	// FilterFormat flags
+	unsigned simd;		// FilterSimd flags
+};
 
 class Filter
 {
 	public:
 		virtual ~Filter() {}
 		virtual uchar* RunFilter( uchar* source, int width, int height, int channels ) = 0;
+
+		// High bit depth versions. Filters that don't override these return NULL and the
+		// caller falls back to the 8 bit version.
+		virtual ushort* RunFilter16( ushort*, int, int, int ) { return NULL; }
+		virtual float* RunFilterFloat( float*, int, int, int ) { return NULL; }
+
+		// Describe what a filter produces, so cached results can be told apart. Bump the
+		// version whenever a change to the filter alters its output.
+		virtual int Version() const { return 1; }
+		virtual std::string Parameters() const { return ""; }
+
+		virtual FilterCapabilities Capabilities() const { return FilterCapabilities(); }
+
+		// The most memory RunFilter allocates at once on an 8 bit image of the given size,
+		// including its result. The default allows for a result and a float intermediate.
+		virtual size_t WorkingSetBytes( int width, int height, int channels ) const { return (size_t)width*height*channels*(1 + sizeof(float)); }
+
+		// Creates a copy of the filter with some of its settings changed. Returns NULL if the
+		// filter doesn't take a parameter or a value is out of range. Filters are shared
+		// between threads, so they are never reconfigured in place.
+		virtual Filter* WithParameters( const FilterParameters& ) const { return NULL; }
+
+		// For filters with a map_halo. RunMapBand runs the stages before the global step on
+		// a band of 8 bit rows carrying the halo, and writes the map for rows of the band
+		// from first_row on. FinishMap runs the global step on the whole map, which it may
+		// overwrite, and returns the result as RunFilter would.
+		virtual bool RunMapBand( uchar*, int, int, int, int, int, uchar* ) { return false; }
+		virtual uchar* FinishMap( uchar*, int, int, int ) { return NULL; }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,301 @@
+///
+/// A size bounded on disk cache of filtered images, so rerunning a recipe over the same
+/// inputs only recomputes the stages whose inputs or settings changed. Each stage's output
+/// is keyed by a hash of the key of its input, the filter name, version and parameters.
+///
+/// Images are stored uncompressed in the same layout QImage uses, and loaded by memory
+/// mapping the file, so a hit costs little more than reading the pages it touches. The
+/// least recently used images are removed once the cache grows past its size limit.
+///
+
+#include "FilterCache.h"
+
+#include <string.h>
+
+#define CACHE_FILE_MAGIC 0x48434649
+#define CACHE_FILE_VERSION 1
+#define CACHE_FILE_SUFFIX ".fcache"
+
+// Pixel rows start at a 16 byte boundary after the header and color table
+#define CACHE_DATA_ALIGNMENT 16
+
+struct CacheFileHeader
+{
+	quint32 magic;
+	quint32 version;
+	qint32 width;
+	qint32 height;
+	qint32 format;
+	qint32 bytes_per_line;
+	qint32 color_count;
+	qint32 reserved;
+};
+
+static qint64
+DataOffset( int color_count )
+///
+/// @return
+///  Where the pixel rows start in a cache file.
+///
+{
+	qint64 offset = sizeof(CacheFileHeader) + (qint64)color_count*sizeof(QRgb);
+	return (offset + CACHE_DATA_ALIGNMENT - 1)/CACHE_DATA_ALIGNMENT*CACHE_DATA_ALIGNMENT;
+}
+
+static void
+UnmapCacheFile( void* file )
+///
+/// Releases the mapping behind a cached image once the image is no longer used.
+///
+{
+	delete (QFile*)file;
+}
+
+FilterCache::FilterCache( QString directory, qint64 max_bytes )
+///
+/// Constructor. Picks up the images already in the cache directory.
+///
+/// @param directory
+///  The folder the cached images are kept in. Created if it doesn't exist.
+///
+/// @param max_bytes
+///  The size the cache is trimmed back to when it grows larger.
+///
+: mDirectory( directory ),
+  mMaxBytes( max_bytes ),
+  mTotalBytes( 0 )
+{
+	QDir dir( mDirectory );
+	dir.mkpath( "." );
+
+	QFileInfoList files = dir.entryInfoList( QStringList() << "*" CACHE_FILE_SUFFIX, QDir::Files );
+	for( int i = 0; i < files.size(); i++ )
+	{
+		Entry entry;
+		entry.size = files[i].size();
+		entry.last_used_ms = files[i].lastModified().toMSecsSinceEpoch();
+		mEntries[files[i].completeBaseName().toLatin1()] = entry;
+		mTotalBytes += entry.size;
+	}
+	Evict();
+}
+
+QByteArray
+FilterCache::ContentKey( const QByteArray& contents )
+///
+/// @param contents
+///  The contents of an input file.
+///
+/// @return
+///  The key of the unfiltered input.
+///
+{
+	return QCryptographicHash::hash( contents, QCryptographicHash::Sha1 ).toHex();
+}
+
+QByteArray
+FilterCache::StageKey( const QByteArray& input_key, const QString& filter_name, const Filter* filter )
+///
+/// @param input_key
+///  The key of the image going into the filter.
+///
+/// @param filter_name
+///  The name of the filter in the filter library.
+///
+/// @param filter
+///  The filter.
+///
+/// @return
+///  The key of the filter's output.
+///
+{
+	QCryptographicHash hash( QCryptographicHash::Sha1 );
+	hash.addData( input_key );
+	hash.addData( "\n" );
+	hash.addData( filter_name.toUtf8() );
+	hash.addData( "\n" );
+	hash.addData( QByteArray::number( filter->Version() ) );
+	hash.addData( "\n" );
+	hash.addData( filter->Parameters().c_str() );
+	return hash.result().toHex();
+}
+
+qint64
+FilterCache::Size() const
+///
+/// @return
+///  The number of bytes the cached images take up.
+///
+{
+	QMutexLocker locker( &mMutex );
+	return mTotalBytes;
+}
+
+QString
+FilterCache::EntryPath( const QByteArray& key ) const
+///
+/// @return
+///  The file a key's image is kept in.
+///
+{
+	return QDir( mDirectory ).absoluteFilePath( QString::fromLatin1( key ) + CACHE_FILE_SUFFIX );
+}
+
+bool
+FilterCache::Load( const QByteArray& key, QImage& image )
+///
+/// Looks up an image. The image refers to the mapped file directly rather than a copy,
+/// and is copied only if it is modified.
+///
+/// @param key
+///  The key the image was stored under.
+///
+/// @param image
+///  Receives the image.
+///
+/// @return
+///  True if the image was in the cache.
+///
+{
+	{
+		QMutexLocker locker( &mMutex );
+		QMap<QByteArray, Entry>::iterator it = mEntries.find( key );
+		if( it == mEntries.end() )
+		{
+			return false;
+		}
+		it->last_used_ms = QDateTime::currentMSecsSinceEpoch();
+	}
+
+	QFile* file = new QFile( EntryPath( key ) );
+	const uchar* data = NULL;
+	if( file->open( QIODevice::ReadOnly ) && file->size() >= (qint64)sizeof(CacheFileHeader) )
+	{
+		data = file->map( 0, file->size() );
+	}
+
+	CacheFileHeader header;
+	memset( &header, 0, sizeof(header) );
+	if( data != NULL )
+	{
+		memcpy( &header, data, sizeof(header) );
+	}
+
+	// Anything that doesn't add up is treated as a miss
+	if( data == NULL || header.magic != CACHE_FILE_MAGIC || header.version != CACHE_FILE_VERSION ||
+		header.color_count < 0 || header.color_count > 256 || header.width <= 0 || header.height <= 0 ||
+		file->size() != DataOffset( header.color_count ) + (qint64)header.bytes_per_line*header.height )
+	{
+		delete file;
+		return false;
+	}
+
+	QVector<QRgb> colors( header.color_count );
+	if( header.color_count > 0 )
+	{
+		memcpy( colors.data(), data + sizeof(CacheFileHeader), header.color_count*sizeof(QRgb) );
+	}
+
+	image = QImage( data + DataOffset( header.color_count ), header.width, header.height, header.bytes_per_line,
+		(QImage::Format)header.format, UnmapCacheFile, file );
+	if( header.color_count > 0 )
+	{
+		image.setColorTable( colors );
+	}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+	// Keeps the least recently used order across runs
+	QFile touch( EntryPath( key ) );
+	if( touch.open( QIODevice::ReadWrite ) )
+	{
+		touch.setFileTime( QDateTime::currentDateTime(), QFileDevice::FileModificationTime );
+	}
+#endif
+	return !image.isNull();
+}
+
+bool
+FilterCache::Store( const QByteArray& key, const QImage& image )
+///
+/// Adds an image to the cache, removing the least recently used images if the cache grows
+/// too large. Several threads may store images at once.
+///
+/// @param key
+///  The key to store the image under.
+///
+/// @param image
+///  The image.
+///
+/// @return
+///  True if the image was stored.
+///
+{
+	if( image.isNull() )
+	{
+		return false;
+	}
+
+	CacheFileHeader header;
+	memset( &header, 0, sizeof(header) );
+	header.magic = CACHE_FILE_MAGIC;
+	header.version = CACHE_FILE_VERSION;
+	header.width = image.width();
+	header.height = image.height();
+	header.format = image.format();
+	header.bytes_per_line = image.bytesPerLine();
+	header.color_count = image.colorCount();
+
+	QVector<QRgb> colors = image.colorTable();
+	QByteArray padding( DataOffset( header.color_count ) - sizeof(CacheFileHeader) - colors.size()*sizeof(QRgb), 0 );
+
+	// Written to a temporary file and renamed, so readers never see half an image
+	QSaveFile file( EntryPath( key ) );
+	if( !file.open( QIODevice::WriteOnly ) )
+	{
+		return false;
+	}
+	file.write( (const char*)&header, sizeof(header) );
+	file.write( (const char*)colors.constData(), colors.size()*sizeof(QRgb) );
+	file.write( padding );
+	file.write( (const char*)image.constBits(), (qint64)header.bytes_per_line*header.height );
+	if( !file.commit() )
+	{
+		return false;
+	}
+
+	QMutexLocker locker( &mMutex );
+	Entry& entry = mEntries[key];
+	mTotalBytes -= entry.size;
+	entry.size = DataOffset( header.color_count ) + (qint64)header.bytes_per_line*header.height;
+	entry.last_used_ms = QDateTime::currentMSecsSinceEpoch();
+	mTotalBytes += entry.size;
+	Evict();
+	return true;
+}
+
+void
+FilterCache::Evict()
+///
+/// Removes the least recently used images until the cache fits in its size limit. Images
+/// that are still mapped stay readable until they are released. The caller holds the mutex
+/// where needed.
+///
+/// @return
+///  Nothing.
+///
+{
+	while( mTotalBytes > mMaxBytes && !mEntries.isEmpty() )
+	{
+		QMap<QByteArray, Entry>::iterator oldest = mEntries.begin();
+		for( QMap<QByteArray, Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it )
+		{
+			if( it->last_used_ms < oldest->last_used_ms )
+			{
+				oldest = it;
+			}
+		}
+		QFile::remove( EntryPath( oldest.key() ) );
+		mTotalBytes -= oldest->size;
+		mEntries.erase( oldest );
+	}
+}
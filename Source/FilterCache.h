@@ -0,0 +1,41 @@
+#ifndef _FILTER_CACHE_H_
+#define _FILTER_CACHE_H_
+
+#include <QApplication>
+#include <QtWidgets>
+#include <string>
+
+#include "Filter.h"
+
+class FilterCache
+{
+	public:
+		FilterCache( QString directory, qint64 max_bytes );
+
+		bool Load( const QByteArray& key, QImage& image );
+		bool Store( const QByteArray& key, const QImage& image );
+
+		qint64 Size() const;
+
+		static QByteArray ContentKey( const QByteArray& contents );
+		static QByteArray StageKey( const QByteArray& input_key, const QString& filter_name, const Filter* filter );
+
+	private:
+		// An image file in the cache directory
+		struct Entry
+		{
+			qint64 size;
+			qint64 last_used_ms;
+		};
+
+		QString EntryPath( const QByteArray& key ) const;
+		void Evict();
+
+		QString mDirectory;
+		qint64 mMaxBytes;
+		qint64 mTotalBytes;
+		QMap<QByteArray, Entry> mEntries;
+		mutable QMutex mMutex;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _FILTER_PLUGIN_H_
+#define _FILTER_PLUGIN_H_
+
+#include "Filter.h"
+
+// Filters can be added without rebuilding the application by building them into a shared
+// library and putting it in the filters folder next to the executable, or in a folder
+// listed in the FILTER_PLUGIN_PATH environment variable. The library exports
+//
+//   FILTER_PLUGIN_EXPORT int FilterPluginApiVersion() { return FILTER_PLUGIN_API_VERSION; }
+//   FILTER_PLUGIN_EXPORT const FilterPluginInfo* FilterPluginFilters( int* count );
+//
+// Filters are C++ objects shared across the library boundary, so a plugin must be built
+// with the same compiler and the same Filter.h as the application. Bump the API version
+// whenever the Filter class changes so that older plugins are refused rather than crash.
+
+#define FILTER_PLUGIN_API_VERSION 5
+
+#if defined(_WIN32)
+#define FILTER_PLUGIN_EXPORT extern "C" __declspec(dllexport)
+#else
+#define FILTER_PLUGIN_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+struct FilterPluginInfo
+{
+	const char* name;		// The name recipes use for the filter. Must be unique.
+	const char* menu_text;	// The text of the filter's menu item.
+	Filter* (*create)();	// Creates the filter. The application owns and deletes it.
+};
+
+typedef int (*FilterPluginApiVersionFunction)();
+typedef const FilterPluginInfo* (*FilterPluginFiltersFunction)( int* count );
+
+#endif
@@ -6,11 +6,28 @@
 ///
 
 #include "FilterProcessor.h"
+#include "FilterPlugin.h"
 
 #include "Filters/BoxBlur.h"
 #include "Filters/Canny.h"
 #include "Filters/GaussianBlur.h"
 #include "Filters/InvertFilter.h"
+#include "Filters/MedianFilter.h"
+#include "Filters/PixelConversion.h"
+#include "Filters/UnsharpMask.h"
+
+#include <math.h>
+#include <string.h>
+
+// Images up to this many pixels are packed into atlases by ApplyFilterBatch. Larger ones
+// cost enough on their own that the overhead of a call doesn't matter.
+#define BATCH_MAX_IMAGE_PIXELS (256*256)
+
+// The most pixels in one atlas. Larger batches are split across several.
+#define BATCH_MAX_ATLAS_PIXELS ((qint64)16 << 20)
+
+// A budget no image reaches, to find the full frame peak of the high bit depth paths
+#define UNLIMITED_BUDGET ((qint64)1 << 62)
 
 typedef boost::shared_ptr<Filter> filter_ptr;
 typedef boost::shared_ptr<uchar> uchar_ptr;
@@ -21,6 +38,7 @@ FilterProcessor::FilterProcessor()
 ///
 /// Constructor.
 ///
+: mMemoryBudget( 0 )
 {
 	InitFilterLibrary();
 }
@@ -48,15 +66,21 @@ FilterProcessor::run()
 	if( !mImage.isNull() )
 	{
 		QMutexLocker locker(&mutex);
-		uchar* result_data = mFilterLibrary[mFilterName]->RunFilter(mImage.bits(), mImage.width(), mImage.height(), 4);
-		if( result_data != mImage.bits() )
+		FilterTimings timings;
+		QImage result = ApplyFilter( GetFilter( mFilterName, mParameters ).get(), mImage, &timings, mMemoryBudget );
+		if( !result.isNull() )
 		{
-	        mImage = QImage(result_data, mImage.width(), mImage.height(), mImage.format());
-	        delete [] result_data; // QImage takes a copy, so we don't need this pointer anymore.
+			mImage = result;
 
 	        // Pass the processed canvas to anyone who is interested
 			emit FilterDone( mImage );
-			emit FilterStatus( QString("Done!") );
+			emit FilterStatus( QString("Done! Filter took %1 ms, pixel conversion %2 ms (%3)%4.")
+				.arg( timings.filter_ms ).arg( timings.ingest_ms + timings.egress_ms ).arg( timings.plan.Describe() )
+				.arg( timings.reduced_precision ? ", filtered at 8 bits per channel" : "" ) );
+		}
+		else if( timings.plan.mode == EXECUTE_REFUSED )
+		{
+			emit FilterStatus( QString("Image too large for this filter: it %1. Filter canceled!").arg( timings.plan.Describe() ) );
 		}
 		else
 		{
@@ -65,10 +89,815 @@ FilterProcessor::run()
 	}
 }
 
+boost::shared_ptr<Filter>
+FilterProcessor::GetFilter( const string& filter_name, const FilterParameters& parameters ) const
+///
+/// Looks up a filter in the library. Filters hold no per-image state, so the same
+/// filter can be run from several threads at once.
+///
+/// @param filter_name
+///  The name of the filter, optionally followed by parameters as described in
+///  ParseFilterSpec, e.g. "gaussian:sigma=2.5".
+///
+/// @param parameters
+///  Settings to change from the filter's defaults. These override any in the name.
+///
+/// @return
+///  The filter, or an empty pointer if there is no filter with that name or it doesn't
+///  accept the parameters.
+///
+{
+	string name;
+	FilterParameters all_parameters;
+	if( !ParseFilterSpec( filter_name, name, all_parameters ) )
+	{
+		return filter_ptr();
+	}
+	for( FilterParameters::const_iterator p = parameters.begin(); p != parameters.end(); ++p )
+	{
+		all_parameters[p->first] = p->second;
+	}
+
+	map<string, filter_ptr>::const_iterator it = mFilterLibrary.find( name );
+	if( it == mFilterLibrary.end() || all_parameters.empty() )
+	{
+		return it != mFilterLibrary.end() ? it->second : filter_ptr();
+	}
+
+	// A configured copy. Its kernels come from the kernel cache, so this is cheap.
+	return filter_ptr( it->second->WithParameters( all_parameters ) );
+}
+
+bool
+FilterProcessor::ParseFilterSpec( const string& filter_spec, string& filter_name, FilterParameters& parameters )
+///
+/// Splits a filter as written in a recipe into its name and parameters. Parameters follow
+/// the name as colon separated name=value pairs, e.g. "canny:low_threshold=10:high_threshold=60".
+///
+/// @param filter_spec
+///  The filter as written in a recipe.
+///
+/// @param filter_name
+///  Receives the name of the filter.
+///
+/// @param parameters
+///  Receives the parameters.
+///
+/// @return
+///  False if a parameter isn't of the form name=number.
+///
+{
+	QStringList parts = QString::fromStdString( filter_spec ).split( ':' );
+	filter_name = parts[0].trimmed().toStdString();
+	parameters.clear();
+	for( int p = 1; p < parts.size(); p++ )
+	{
+		int equals = parts[p].indexOf( '=' );
+		bool number = false;
+		double value = equals > 0 ? parts[p].mid( equals + 1 ).toDouble( &number ) : 0.0;
+		if( !number )
+		{
+			return false;
+		}
+		parameters[parts[p].left( equals ).trimmed().toStdString()] = value;
+	}
+	return true;
+}
+
+QImage
+FilterProcessor::ApplyFilter( Filter* filter, const QImage& image, FilterTimings* timings, qint64 memory_budget )
+///
+/// Runs a filter on an image. High bit depth images use the filter's 16 bit or floating
+/// point version when its capabilities list one, and are refused if they don't fit the
+/// budget whole. Everything else is normalized to the filter layout once on the way in and
+/// converted back once on the way out.
+///
+/// @param filter
+///  The filter to run.
+///
+/// @param image
+///  The image to be filtered. It is not modified.
+///
+/// @param timings
+///  If not NULL, receives how long the conversions and the filter took, how the filter was
+///  run, and whether a high bit depth image was filtered at 8 bits.
+///
+/// @param memory_budget
+///  The most memory the filter may use. Images the filter would need more for are filtered
+///  in bands where the filter allows it, and refused otherwise. 0 uses half the machine's
+///  memory.
+///
+/// @return
+///  The filtered image, in the format of the source, or a null image if there was an error
+///  in processing or the image is too large for the budget.
+///
+{
+	if( timings != NULL )
+	{
+		timings->plan = ExecutionPlan();
+		timings->reduced_precision = false;
+	}
+	if( filter == NULL || image.isNull() )
+	{
+		return QImage();
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	FilterCapabilities capabilities = filter->Capabilities();
+	if( memory_budget <= 0 )
+	{
+		memory_budget = ExecutionPlanner::DefaultBudget();
+	}
+
+	// 16 bit samples take twice the memory of 8 bit ones and float samples four times. The
+	// high bit depth paths can't be split, so an image too large for them whole is refused
+	// rather than quietly filtered at 8 bits
+	QImage source = image;
+	QImage result;
+	bool floating_point = IsFloatingPoint( source.format() ) && (capabilities.formats & FILTER_FORMAT_FLOAT);
+	bool sixteen_bit = !floating_point && IsHighBitDepth( source.format() ) && (capabilities.formats & FILTER_FORMAT_RGBA16);
+	if( floating_point || sixteen_bit )
+	{
+		ExecutionPlan plan = ExecutionPlanner::Plan( filter, source.width()*(floating_point ? 4 : 2), source.height(), 4, UNLIMITED_BUDGET );
+		plan.budget_bytes = memory_budget;
+		if( plan.peak_bytes > memory_budget )
+		{
+			plan.mode = EXECUTE_REFUSED;
+		}
+		if( timings != NULL )
+		{
+			timings->plan = plan;
+		}
+		if( plan.mode == EXECUTE_REFUSED )
+		{
+			return QImage();
+		}
+
+		result = floating_point ? ApplyFilterFloat( filter, source ) : ApplyFilter16( filter, source );
+		if( !result.isNull() )
+		{
+			if( timings != NULL )
+			{
+				timings->ingest_ms = 0;
+				timings->filter_ms = timer.elapsed();
+				timings->egress_ms = 0;
+			}
+			return result;
+		}
+	}
+
+	// Filters with no high bit depth version run at 8 bits, and say so
+	bool reduced_precision = IsHighBitDepth( source.format() );
+	if( timings != NULL )
+	{
+		timings->reduced_precision = reduced_precision;
+	}
+
+	IngestedImage ingested;
+	if( !IngestForFilter( capabilities, source, ingested ) )
+	{
+		return QImage();
+	}
+	qint64 ingest_ms = timer.restart();
+
+	ExecutionPlan plan = ExecutionPlanner::Plan( filter, ingested.width, ingested.height, ingested.channels, memory_budget );
+	if( timings != NULL )
+	{
+		timings->plan = plan;
+	}
+
+	// Filters that work in place hand back the ingested pixels, which are freed with ingested
+	uchar* result_data = ExecutionPlanner::Run( filter, plan, ingested.data.get(), ingested.width, ingested.height, ingested.channels );
+	bool in_place = result_data == ingested.data.get();
+	if( result_data == NULL || (in_place && !capabilities.in_place) )
+	{
+		return QImage();
+	}
+	qint64 filter_ms = timer.restart();
+
+	result = Egress( result_data, ingested );
+	if( !in_place )
+	{
+		delete [] result_data;
+	}
+	if( reduced_precision )
+	{
+		result = result.convertToFormat( image.format() );
+	}
+
+	if( timings != NULL )
+	{
+		timings->ingest_ms = ingest_ms;
+		timings->filter_ms = filter_ms;
+		timings->egress_ms = timer.elapsed();
+	}
+	return result;
+}
+
+bool
+FilterProcessor::Ingest( const QImage& image, IngestedImage& ingested )
+///
+/// Converts an image of any format to the layout the filters work on. Grayscale images
+/// become one channel images, everything else becomes four channel RGBA with alpha in the
+/// last channel. Padding at the end of each row is removed. The common formats have
+/// dedicated converters; anything else is converted by Qt first.
+///
+/// @param image
+///  The image to be converted.
+///
+/// @param ingested
+///  Receives the converted pixels and the format to convert the result back to.
+///
+/// @return
+///  True if the image could be converted.
+///
+{
+	int width = image.width();
+	int height = image.height();
+	if( image.isNull() || width <= 0 || height <= 0 )
+	{
+		return false;
+	}
+
+	ingested.width = width;
+	ingested.height = height;
+
+	QImage::Format format = image.format();
+	const uchar* bits = image.constBits();
+	int stride = image.bytesPerLine();
+
+	// One channel sources
+	if( format == QImage::Format_Indexed8 && image.isGrayscale() )
+	{
+		uchar table[256];
+		memset( table, 0, sizeof(table) );
+		for( int i = 0; i < image.colorCount() && i < 256; i++ )
+		{
+			table[i] = qGray( image.color( i ) );
+		}
+		ingested.channels = 1;
+		ingested.data.reset( new uchar[(size_t)width*height] );
+		PixelConversion::MapIndexed( bits, stride, ingested.data.get(), width, width, height, table );
+		ingested.result_format = QImage::Format_Indexed8;
+		return true;
+	}
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	if( format == QImage::Format_Grayscale8 )
+	{
+		ingested.channels = 1;
+		ingested.data.reset( new uchar[(size_t)width*height] );
+		PixelConversion::CopyRows( bits, stride, ingested.data.get(), width, width, height );
+		ingested.result_format = QImage::Format_Grayscale8;
+		return true;
+	}
+#endif
+
+	// Four channel sources
+	ingested.channels = 4;
+	ingested.data.reset( new uchar[(size_t)width*height*4] );
+	uchar* data = ingested.data.get();
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+	if( format == QImage::Format_ARGB32 || format == QImage::Format_RGB32 )
+	{
+		// Stored as BGRA in memory
+		PixelConversion::SwapRedBlue( bits, stride, data, width*4, width, height );
+		ingested.result_format = QImage::Format_ARGB32;
+		return true;
+	}
+#endif
+	if( format == QImage::Format_RGB888 )
+	{
+		PixelConversion::ExpandRGBToRGBA( bits, stride, data, width*4, width, height );
+		ingested.result_format = QImage::Format_RGBA8888;
+		return true;
+	}
+
+	QImage converted = image;
+	if( format != QImage::Format_RGBA8888 && format != QImage::Format_RGBX8888 )
+	{
+		converted = image.convertToFormat( QImage::Format_RGBA8888 );
+	}
+	PixelConversion::CopyRows( converted.constBits(), converted.bytesPerLine(), data, width*4, width*4, height );
+	ingested.result_format = QImage::Format_RGBA8888;
+	return true;
+}
+
+QVector<QImage>
+FilterProcessor::ApplyFilterBatch( Filter* filter, const QVector<QImage>& images, qint64 memory_budget )
+///
+/// Runs a filter on many images in one call. For thumbnails the cost of a call, the
+/// conversions and the filter's setup outweigh the filtering itself, so small images are
+/// packed side by side into a shared atlas and the filter runs once over the lot. Each
+/// image is padded by the filter's halo with copies of its edge pixels, so results are the
+/// same as filtering the images one at a time. Large images, high bit depth images and
+/// filters that can't be packed, such as those whose halo is the whole image, are run one
+/// image at a time with ApplyFilter.
+///
+/// @param filter
+///  The filter to run.
+///
+/// @param images
+///  The images to be filtered. They are not modified.
+///
+/// @param memory_budget
+///  The most memory the filter may use for each atlas. 0 uses half the machine's memory.
+///
+/// @return
+///  The filtered images in the same order, with a null image for each one that failed.
+///
+{
+	QVector<QImage> results( images.size() );
+	if( filter == NULL )
+	{
+		return results;
+	}
+	if( memory_budget <= 0 )
+	{
+		memory_budget = ExecutionPlanner::DefaultBudget();
+	}
+
+	FilterCapabilities capabilities = filter->Capabilities();
+	bool packable = capabilities.halo == 0 || (capabilities.halo > 0 && capabilities.clamped_edges);
+	int padding = qMax( capabilities.halo, 0 );
+
+	std::vector<IngestedImage> ingested;
+	std::vector<int> result_indices;
+	for( int i = 0; i < images.size(); i++ )
+	{
+		const QImage& image = images[i];
+		if( image.isNull() )
+		{
+			continue;
+		}
+		if( !packable || (qint64)image.width()*image.height() > BATCH_MAX_IMAGE_PIXELS || IsHighBitDepth( image.format() ) )
+		{
+			results[i] = ApplyFilter( filter, image, NULL, memory_budget );
+			continue;
+		}
+
+		IngestedImage small;
+		if( IngestForFilter( capabilities, image, small ) )
+		{
+			ingested.push_back( small );
+			result_indices.push_back( i );
+		}
+	}
+
+	// Gray and four channel images go in separate atlases, each filled up to
+	// BATCH_MAX_ATLAS_PIXELS
+	int channel_counts[2] = { 1, 4 };
+	for( int n = 0; n < 2; n++ )
+	{
+		std::vector<int> members;
+		qint64 atlas_pixels = 0;
+		for( size_t m = 0; m <= ingested.size(); m++ )
+		{
+			qint64 cell_pixels = 0;
+			if( m < ingested.size() )
+			{
+				if( ingested[m].channels != channel_counts[n] )
+				{
+					continue;
+				}
+				cell_pixels = (qint64)(ingested[m].width + 2*padding)*(ingested[m].height + 2*padding);
+			}
+			if( !members.empty() && (m == ingested.size() || atlas_pixels + cell_pixels > BATCH_MAX_ATLAS_PIXELS) )
+			{
+				ApplyFilterToAtlas( filter, ingested, members, padding, memory_budget, results, result_indices );
+				members.clear();
+				atlas_pixels = 0;
+			}
+			if( m < ingested.size() )
+			{
+				members.push_back( (int)m );
+				atlas_pixels += cell_pixels;
+			}
+		}
+	}
+	return results;
+}
+
+void
+FilterProcessor::ApplyFilterToAtlas( Filter* filter, const std::vector<IngestedImage>& images, const std::vector<int>& members, int padding, qint64 memory_budget, QVector<QImage>& results, const std::vector<int>& result_indices )
+///
+/// Packs ingested images with the same number of channels into an atlas, runs a filter on
+/// it and converts each image's part of the result back into an image.
+///
+/// @param filter
+///  The filter to run.
+///
+/// @param images
+///  The ingested images.
+///
+/// @param members
+///  The indices of the images in images to pack.
+///
+/// @param padding
+///  The number of pixels each image is padded by on every side.
+///
+/// @param memory_budget
+///  The most memory the filter may use.
+///
+/// @param results
+///  Receives the filtered images.
+///
+/// @param result_indices
+///  The index in results of each image in images.
+///
+/// @return
+///  Nothing.
+///
+{
+	int channels = images[members[0]].channels;
+
+	// Lay the padded images out left to right in shelves about as wide as the atlas is tall
+	qint64 total_pixels = 0;
+	int widest = 0;
+	for( size_t m = 0; m < members.size(); m++ )
+	{
+		const IngestedImage& image = images[members[m]];
+		total_pixels += (qint64)(image.width + 2*padding)*(image.height + 2*padding);
+		widest = qMax( widest, image.width + 2*padding );
+	}
+	int atlas_width = qMax( widest, (int)sqrt( (double)total_pixels ) );
+
+	std::vector<QPoint> positions;
+	int x = 0;
+	int y = 0;
+	int shelf_height = 0;
+	for( size_t m = 0; m < members.size(); m++ )
+	{
+		const IngestedImage& image = images[members[m]];
+		if( x + image.width + 2*padding > atlas_width )
+		{
+			x = 0;
+			y += shelf_height;
+			shelf_height = 0;
+		}
+		positions.push_back( QPoint( x + padding, y + padding ) );
+		x += image.width + 2*padding;
+		shelf_height = qMax( shelf_height, image.height + 2*padding );
+	}
+	int atlas_height = y + shelf_height;
+
+	// Copy each image in with its edge pixels repeated out to the padding
+	size_t atlas_stride = (size_t)atlas_width*channels;
+	uchar* atlas = new uchar[atlas_stride*atlas_height];
+	memset( atlas, 0, atlas_stride*atlas_height );
+	for( size_t m = 0; m < members.size(); m++ )
+	{
+		const IngestedImage& image = images[members[m]];
+		size_t row_bytes = (size_t)image.width*channels;
+		for( int j = -padding; j < image.height + padding; j++ )
+		{
+			const uchar* row = image.data.get() + qBound( 0, j, image.height - 1 )*row_bytes;
+			uchar* atlas_row = atlas + (positions[m].y() + j)*atlas_stride + (size_t)positions[m].x()*channels;
+			memcpy( atlas_row, row, row_bytes );
+			for( int i = 1; i <= padding; i++ )
+			{
+				memcpy( atlas_row - i*channels, row, channels );
+				memcpy( atlas_row + row_bytes + (i - 1)*channels, row + row_bytes - channels, channels );
+			}
+		}
+	}
+
+	ExecutionPlan plan = ExecutionPlanner::Plan( filter, atlas_width, atlas_height, channels, memory_budget );
+	uchar* result_data = ExecutionPlanner::Run( filter, plan, atlas, atlas_width, atlas_height, channels );
+	bool in_place = result_data == atlas;
+	if( result_data != NULL && (!in_place || filter->Capabilities().in_place) )
+	{
+		for( size_t m = 0; m < members.size(); m++ )
+		{
+			const uchar* cell = result_data + positions[m].y()*atlas_stride + (size_t)positions[m].x()*channels;
+			results[result_indices[members[m]]] = Egress( cell, images[members[m]], (int)atlas_stride );
+		}
+	}
+
+	if( result_data != NULL && !in_place )
+	{
+		delete [] result_data;
+	}
+	delete [] atlas;
+}
+
+bool
+FilterProcessor::IngestForFilter( const FilterCapabilities& capabilities, const QImage& image, IngestedImage& ingested )
+///
+/// Converts an image to a pixel layout a filter declares support for.
+///
+/// @param capabilities
+///  The filter's capabilities.
+///
+/// @param image
+///  The image to be converted.
+///
+/// @param ingested
+///  Receives the converted pixels and the format to convert the result back to.
+///
+/// @return
+///  True if the image could be converted.
+///
+{
+	QImage source = image;
+	if( IsHighBitDepth( source.format() ) )
+	{
+		// The filter has no 16 bit implementation, so use the 8 bit one instead.
+		QImage::Format format = QImage::Format_ARGB32;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+		if( source.format() == QImage::Format_Grayscale16 )
+		{
+			format = QImage::Format_Grayscale8;
+		}
+#endif
+		source = source.convertToFormat( format );
+	}
+	if( !(capabilities.formats & FILTER_FORMAT_GRAY8) && source.depth() == 8 && source.isGrayscale() )
+	{
+		// The filter only takes four channels
+		source = source.convertToFormat( QImage::Format_RGBA8888 );
+	}
+
+	// Gray pictures stored with four channels are filtered as the one channel images they
+	// are, for a quarter of the work, when the filter treats every channel alike
+	if( capabilities.per_channel && (capabilities.formats & FILTER_FORMAT_GRAY8) && IngestGrayContent( source, ingested ) )
+	{
+		return true;
+	}
+	return Ingest( source, ingested );
+}
+
+bool
+FilterProcessor::IngestGrayContent( const QImage& image, IngestedImage& ingested )
+///
+/// Converts a four channel image whose pixels are all gray and opaque to a one channel
+/// image. Egress expands the result back to the image's own format.
+///
+/// @param image
+///  The image to be converted.
+///
+/// @param ingested
+///  Receives the converted pixels and the format to convert the result back to.
+///
+/// @return
+///  True if the image was converted. False if it isn't a four channel image, or has color
+///  or transparency, in which case ingested is unchanged.
+///
+{
+	int width = image.width();
+	int height = image.height();
+	if( image.isNull() || width <= 0 || height <= 0 )
+	{
+		return false;
+	}
+
+	// Alpha has to be the last byte of each pixel. The order of the color bytes doesn't
+	// matter, as they are all equal.
+	QImage::Format format = image.format();
+	QImage::Format result_format;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+	if( format == QImage::Format_ARGB32 || format == QImage::Format_RGB32 )
+	{
+		result_format = QImage::Format_ARGB32;
+	}
+	else
+#endif
+	if( format == QImage::Format_RGBA8888 || format == QImage::Format_RGBX8888 )
+	{
+		result_format = QImage::Format_RGBA8888;
+	}
+	else
+	{
+		return false;
+	}
+
+	const uchar* bits = image.constBits();
+	int stride = image.bytesPerLine();
+	if( !PixelConversion::IsGrayOpaque( bits, stride, width, height ) )
+	{
+		return false;
+	}
+
+	ingested.width = width;
+	ingested.height = height;
+	ingested.channels = 1;
+	ingested.data.reset( new uchar[(size_t)width*height] );
+	PixelConversion::ExtractGray( bits, stride, ingested.data.get(), width, width, height );
+	ingested.result_format = result_format;
+	return true;
+}
+
+QImage
+FilterProcessor::Egress( const uchar* data, const IngestedImage& ingested, int stride )
+///
+/// Converts filtered pixels in the filter layout back into an image.
+///
+/// @param data
+///  The filtered pixels, in the same layout as the ingested image.
+///
+/// @param ingested
+///  The ingested image the pixels were produced from.
+///
+/// @param stride
+///  The number of bytes between the start of each row of data, when the pixels are part of
+///  a larger image. 0 if the rows are tightly packed.
+///
+/// @return
+///  The resulting image.
+///
+{
+	int width = ingested.width;
+	int height = ingested.height;
+	if( stride <= 0 )
+	{
+		stride = width*ingested.channels;
+	}
+
+	if( ingested.channels == 1 )
+	{
+		QImage result( width, height, ingested.result_format );
+		if( result.depth() == 32 )
+		{
+			// A gray picture that came in with four channels
+			PixelConversion::ExpandGray( data, stride, result.bits(), result.bytesPerLine(), width, height );
+			return result;
+		}
+		if( ingested.result_format == QImage::Format_Indexed8 )
+		{
+			result.setColorCount( 256 );
+			for( int i = 0; i < 256; i++ )
+			{
+				result.setColor( i, qRgb( i, i, i ) );
+			}
+		}
+		PixelConversion::CopyRows( data, stride, result.bits(), result.bytesPerLine(), width, height );
+		return result;
+	}
+
+	QImage result( width, height, ingested.result_format );
+	if( ingested.result_format == QImage::Format_ARGB32 )
+	{
+		PixelConversion::SwapRedBlue( data, stride, result.bits(), result.bytesPerLine(), width, height );
+	}
+	else
+	{
+		PixelConversion::CopyRows( data, stride, result.bits(), result.bytesPerLine(), width*4, height );
+	}
+	return result;
+}
+
+bool
+FilterProcessor::IsHighBitDepth( QImage::Format format )
+///
+/// @param format
+///  The format of an image.
+///
+/// @return
+///  True if the image stores more than 8 bits per channel.
+///
+{
+	if( IsFloatingPoint( format ) )
+	{
+		return true;
+	}
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+	if( format == QImage::Format_Grayscale16 )
+	{
+		return true;
+	}
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	return format == QImage::Format_RGBA64 || format == QImage::Format_RGBX64 || format == QImage::Format_RGBA64_Premultiplied;
+#else
+	return false;
+#endif
+}
+
+bool
+FilterProcessor::IsFloatingPoint( QImage::Format format )
+///
+/// @param format
+///  The format of an image.
+///
+/// @return
+///  True if the image stores floating point channels.
+///
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+	return format == QImage::Format_RGBX16FPx4 || format == QImage::Format_RGBA16FPx4 || format == QImage::Format_RGBA16FPx4_Premultiplied ||
+		format == QImage::Format_RGBX32FPx4 || format == QImage::Format_RGBA32FPx4 || format == QImage::Format_RGBA32FPx4_Premultiplied;
+#else
+	Q_UNUSED( format );
+	return false;
+#endif
+}
+
+QImage
+FilterProcessor::ApplyFilter16( Filter* filter, const QImage& image )
+///
+/// Runs the 16 bit version of a filter on an image, keeping the full precision of the
+/// source through to the result.
+///
+/// @param filter
+///  The filter to run.
+///
+/// @param image
+///  A high bit depth image.
+///
+/// @return
+///  The filtered image in the same format as the source, or a null image if the filter has
+///  no 16 bit implementation.
+///
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	QImage source = image.convertToFormat( QImage::Format_RGBA64 );
+	int width = source.width();
+	int height = source.height();
+
+	ushort* source_data = (ushort*)source.bits();
+	ushort* result_data = filter->RunFilter16( source_data, width, height, 4 );
+	if( result_data == NULL || (result_data == source_data && !filter->Capabilities().in_place) )
+	{
+		return QImage();
+	}
+
+	// RGBA64 rows are tightly packed, so a filter that works in place leaves its result
+	// in the source image
+	QImage result = source;
+	if( result_data != source_data )
+	{
+		result = QImage( width, height, QImage::Format_RGBA64 );
+		for( int j = 0; j < height; j++ )
+		{
+			memcpy( result.scanLine(j), result_data + (size_t)j*width*4, width*4*sizeof(ushort) );
+		}
+		delete [] result_data;
+	}
+
+	return result.convertToFormat( image.format() );
+#else
+	return QImage();
+#endif
+}
+
+QImage
+FilterProcessor::ApplyFilterFloat( Filter* filter, const QImage& image )
+///
+/// Runs the floating point version of a filter on an image, so values outside 0 to 1 and
+/// the full precision of the source are kept through to the result.
+///
+/// @param filter
+///  The filter to run.
+///
+/// @param image
+///  A floating point image.
+///
+/// @return
+///  The filtered image in the same format as the source, or a null image if the filter has
+///  no floating point implementation.
+///
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+	QImage source = image.convertToFormat( QImage::Format_RGBA32FPx4 );
+	int width = source.width();
+	int height = source.height();
+
+	float* source_data = (float*)source.bits();
+	float* result_data = filter->RunFilterFloat( source_data, width, height, 4 );
+	if( result_data == NULL || (result_data == source_data && !filter->Capabilities().in_place) )
+	{
+		return QImage();
+	}
+
+	// RGBA32FPx4 rows are tightly packed, so a filter that works in place leaves its result
+	// in the source image
+	QImage result = source;
+	if( result_data != source_data )
+	{
+		result = QImage( width, height, QImage::Format_RGBA32FPx4 );
+		for( int j = 0; j < height; j++ )
+		{
+			memcpy( result.scanLine(j), result_data + (size_t)j*width*4, width*4*sizeof(float) );
+		}
+		delete [] result_data;
+	}
+
+	return result.convertToFormat( image.format() );
+#else
+	Q_UNUSED( filter );
+	Q_UNUSED( image );
+	return QImage();
+#endif
+}
+
 void
 FilterProcessor::InitFilterLibrary()
 ///
-/// Adds the default filters to the filter collection
+/// Adds the default filters to the filter collection, followed by the filters in the
+/// plugin libraries next to the executable and in the folders listed in the
+/// FILTER_PLUGIN_PATH environment variable.
 ///
 /// @return
 ///  Nothing.
@@ -77,10 +906,121 @@ FilterProcessor::InitFilterLibrary()
 	mFilterLibrary["invert"] = filter_ptr( new InvertFilter() );
 	mFilterLibrary["gaussian"] = filter_ptr( new GaussianBlur() );
 	mFilterLibrary["box_blur"] = filter_ptr( new BoxBlur() );
+	mFilterLibrary["median"] = filter_ptr( new MedianFilter() );
+	mFilterLibrary["unsharp_mask"] = filter_ptr( new UnsharpMask() );
+	mFilterLibrary["gaussian_large"] = filter_ptr( new GaussianBlur( 16.0 ) );
+	mFilterLibrary["canny_coarse"] = filter_ptr( new CannyEdge( 1 ) );
+
+	LoadPlugins( QDir( QCoreApplication::applicationDirPath() ).absoluteFilePath( "filters" ) );
+	QString plugin_path = QString::fromLocal8Bit( qgetenv( "FILTER_PLUGIN_PATH" ) );
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	QStringList plugin_dirs = plugin_path.split( QDir::listSeparator(), Qt::SkipEmptyParts );
+#else
+	QStringList plugin_dirs = plugin_path.split( QDir::listSeparator(), QString::SkipEmptyParts );
+#endif
+	for( int d = 0; d < plugin_dirs.size(); d++ )
+	{
+		LoadPlugins( plugin_dirs[d] );
+	}
+}
+
+int
+FilterProcessor::LoadPlugins( QString directory )
+///
+/// Adds the filters from every plugin library in a folder to the filter collection.
+/// Libraries built against a different version of the filter interface are skipped, as
+/// are filters whose names are already taken. Loaded libraries stay loaded for the life
+/// of the program, as their filters may still be in use by other threads.
+///
+/// @param directory
+///  The folder to look in.
+///
+/// @return
+///  The number of filters added.
+///
+{
+	int added = 0;
+	QDir dir( directory );
+	QFileInfoList files = dir.entryInfoList( QDir::Files );
+	for( int i = 0; i < files.size(); i++ )
+	{
+		QString library_file = files[i].absoluteFilePath();
+		if( !QLibrary::isLibrary( library_file ) )
+		{
+			continue;
+		}
+
+		QLibrary library( library_file );
+		FilterPluginApiVersionFunction api_version = (FilterPluginApiVersionFunction)library.resolve( "FilterPluginApiVersion" );
+		FilterPluginFiltersFunction plugin_filters = (FilterPluginFiltersFunction)library.resolve( "FilterPluginFilters" );
+		if( api_version == NULL || plugin_filters == NULL )
+		{
+			qWarning( "%s is not a filter plugin", qPrintable( library_file ) );
+			continue;
+		}
+		if( api_version() != FILTER_PLUGIN_API_VERSION )
+		{
+			qWarning( "%s was built for filter plugin version %d, not %d", qPrintable( library_file ), api_version(), FILTER_PLUGIN_API_VERSION );
+			continue;
+		}
+
+		int count = 0;
+		const FilterPluginInfo* info = plugin_filters( &count );
+		for( int f = 0; f < count && info != NULL; f++ )
+		{
+			// Colons separate parameters from the name in recipes
+			if( info[f].name == NULL || info[f].create == NULL || strchr( info[f].name, ':' ) != NULL || mFilterLibrary.count( info[f].name ) > 0 )
+			{
+				qWarning( "%s: skipped a filter with a missing, invalid or duplicate name", qPrintable( library_file ) );
+				continue;
+			}
+
+			filter_ptr filter( info[f].create() );
+			if( filter.get() == NULL )
+			{
+				continue;
+			}
+			mFilterLibrary[info[f].name] = filter;
+
+			PluginFilter plugin_filter;
+			plugin_filter.name = info[f].name;
+			plugin_filter.menu_text = QString::fromUtf8( info[f].menu_text != NULL ? info[f].menu_text : info[f].name );
+			plugin_filter.library = library_file;
+			mPluginFilters.push_back( plugin_filter );
+			added++;
+		}
+	}
+	return added;
+}
+
+const std::vector<PluginFilter>&
+FilterProcessor::PluginFilters() const
+///
+/// @return
+///  The filters loaded from plugins, in the order they were loaded.
+///
+{
+	return mPluginFilters;
+}
+
+void
+FilterProcessor::SetMemoryBudget( qint64 budget_bytes )
+///
+/// Sets the most memory filters started with StartFilter may use.
+///
+/// @param budget_bytes
+///  The budget. 0 uses half the machine's memory.
+///
+/// @return
+///  Nothing.
+///
+{
+	QMutexLocker locker(&mutex);
+	mMemoryBudget = budget_bytes;
 }
 
 void
-FilterProcessor::StartFilter( string filter_name, QImage image )
+FilterProcessor::StartFilter( string filter_name, QImage image, FilterParameters parameters )
 ///
 /// Sets the current image and filter name and starts the thread to begin filtering.
 ///
@@ -90,6 +1030,9 @@ FilterProcessor::StartFilter( string filter_name, QImage image )
 /// @param image
 ///  The image to be filtered
 ///
+/// @param parameters
+///  Settings to change from the filter's defaults, e.g. the sigma of a blur
+///
 /// @return
 ///  Nothing.
 ///
@@ -97,5 +1040,6 @@ FilterProcessor::StartFilter( string filter_name, QImage image )
 	QMutexLocker locker(&mutex);
 	mImage = image.copy();
 	mFilterName = filter_name;
+	mParameters = parameters;
 	start();
 }
\ No newline at end of file
@@ -5,10 +5,44 @@
 #include <QtWidgets>
 #include <string>
 #include <map>
+#include <vector>
 #include <boost/shared_ptr.hpp>
+#include <boost/shared_array.hpp>
 
+#include "ExecutionPlanner.h"
 #include "Filter.h"
 
+// Pixel data in the layout the filters work on: tightly packed rows of either four
+// channel RGBA (alpha at index 3) or one channel gray. A four channel result format
+// with one channel data is a gray picture that was stored with four channels.
+struct IngestedImage
+{
+	boost::shared_array<uchar> data;
+	int width;
+	int height;
+	int channels;
+	QImage::Format result_format;
+};
+
+// A filter loaded from a plugin library.
+struct PluginFilter
+{
+	std::string name;
+	QString menu_text;
+	QString library;
+};
+
+// Where the time went during one call to FilterProcessor::ApplyFilter, and how the filter
+// was run.
+struct FilterTimings
+{
+	qint64 ingest_ms;
+	qint64 filter_ms;
+	qint64 egress_ms;
+	ExecutionPlan plan;
+	bool reduced_precision;		// A high bit depth image the filter could only run on at 8 bits
+};
+
 class FilterProcessor : public QThread
 {
 	Q_OBJECT
@@ -17,7 +51,22 @@ class FilterProcessor : public QThread
 		FilterProcessor();
 		~FilterProcessor();
 
-		void StartFilter( std::string filter_name, QImage image );
+		void StartFilter( std::string filter_name, QImage image, FilterParameters parameters = FilterParameters() );
+
+		boost::shared_ptr<Filter> GetFilter( const std::string& filter_name, const FilterParameters& parameters = FilterParameters() ) const;
+		static bool ParseFilterSpec( const std::string& filter_spec, std::string& filter_name, FilterParameters& parameters );
+
+		int LoadPlugins( QString directory );
+		const std::vector<PluginFilter>& PluginFilters() const;
+
+		void SetMemoryBudget( qint64 budget_bytes );
+
+		static QImage ApplyFilter( Filter* filter, const QImage& image, FilterTimings* timings = NULL, qint64 memory_budget = 0 );
+		static QVector<QImage> ApplyFilterBatch( Filter* filter, const QVector<QImage>& images, qint64 memory_budget = 0 );
+
+		static bool Ingest( const QImage& image, IngestedImage& ingested );
+		static bool IngestGrayContent( const QImage& image, IngestedImage& ingested );
+		static QImage Egress( const uchar* data, const IngestedImage& ingested, int stride = 0 );
 
 	signals:
 		void FilterDone( QImage result );
@@ -29,10 +78,20 @@ class FilterProcessor : public QThread
 	private:
 		void InitFilterLibrary();
 
+		static bool IsHighBitDepth( QImage::Format format );
+		static bool IngestForFilter( const FilterCapabilities& capabilities, const QImage& image, IngestedImage& ingested );
+		static void ApplyFilterToAtlas( Filter* filter, const std::vector<IngestedImage>& images, const std::vector<int>& members, int padding, qint64 memory_budget, QVector<QImage>& results, const std::vector<int>& result_indices );
+		static bool IsFloatingPoint( QImage::Format format );
+		static QImage ApplyFilter16( Filter* filter, const QImage& image );
+		static QImage ApplyFilterFloat( Filter* filter, const QImage& image );
+
 		std::map<std::string, boost::shared_ptr<Filter> >  mFilterLibrary;
+		std::vector<PluginFilter> mPluginFilters;
 
 		QImage mImage;
 		std::string mFilterName;
+		FilterParameters mParameters;
+		qint64 mMemoryBudget;
 
 		QMutex mutex;
 	    QWaitCondition condition;
@@ -0,0 +1,222 @@
+///
+/// The worker side of the worker farm. A worker is a separate copy of the program started
+/// with --worker. It connects back to the farm over a local socket and runs filter recipes
+/// on pixel buffers the farm places in shared memory, one job at a time. If a filter
+/// crashes on a bad image only the worker dies, and the farm starts a new one.
+///
+
+#include "FilterWorker.h"
+#include "ExecutionPlanner.h"
+
+#include <string.h>
+
+FilterWorker::FilterWorker( QString server_name, int worker_index, QObject* parent )
+///
+/// Constructor.
+///
+/// @param server_name
+///  The name of the farm's local socket server.
+///
+/// @param worker_index
+///  The slot of this worker in the farm, sent back so the farm knows who connected.
+///
+/// @param parent
+///  The owner of this object.
+///
+: QObject( parent ),
+  mServerName( server_name ),
+  mWorkerIndex( worker_index )
+{
+	connect( &mSocket, SIGNAL( readyRead() ), this, SLOT( ReadyRead() ) );
+
+	// The farm going away means there will be no more work
+	connect( &mSocket, SIGNAL( disconnected() ), QCoreApplication::instance(), SLOT( quit() ) );
+}
+
+bool
+FilterWorker::Connect()
+///
+/// Connects to the farm and introduces this worker.
+///
+/// @return
+///  True if the farm could be reached.
+///
+{
+	mSocket.connectToServer( mServerName );
+	if( !mSocket.waitForConnected( 5000 ) )
+	{
+		return false;
+	}
+
+	QByteArray message;
+	QDataStream out( &message, QIODevice::WriteOnly );
+	out << (qint32)WORKER_HELLO << (qint32)mWorkerIndex;
+	WriteMessage( &mSocket, message );
+	return true;
+}
+
+void
+FilterWorker::WriteMessage( QIODevice* device, const QByteArray& message )
+///
+/// Sends one message, prefixed with its length.
+///
+/// @param device
+///  The socket to write to.
+///
+/// @param message
+///  The encoded message.
+///
+/// @return
+///  Nothing.
+///
+{
+	QByteArray block;
+	QDataStream out( &block, QIODevice::WriteOnly );
+	out << (quint32)message.size();
+	block.append( message );
+	device->write( block );
+}
+
+bool
+FilterWorker::ReadMessage( QIODevice* device, QByteArray& message )
+///
+/// Takes one complete message off a socket, if one has fully arrived.
+///
+/// @param device
+///  The socket to read from.
+///
+/// @param message
+///  Receives the encoded message.
+///
+/// @return
+///  True if a message was read. False if the next message hasn't fully arrived yet.
+///
+{
+	if( device->bytesAvailable() < (qint64)sizeof(quint32) )
+	{
+		return false;
+	}
+
+	quint32 size = 0;
+	QByteArray header = device->peek( sizeof(quint32) );
+	QDataStream in( header );
+	in >> size;
+	if( device->bytesAvailable() < (qint64)(sizeof(quint32) + size) )
+	{
+		return false;
+	}
+
+	device->read( sizeof(quint32) );
+	message = device->read( size );
+	return true;
+}
+
+void
+FilterWorker::ReadyRead()
+///
+/// Runs every job that has arrived and reports each result back to the farm.
+///
+/// @return
+///  Nothing.
+///
+{
+	QByteArray message;
+	while( ReadMessage( &mSocket, message ) )
+	{
+		QDataStream in( message );
+		qint32 type = 0;
+		in >> type;
+		if( type != WORKER_JOB )
+		{
+			continue;
+		}
+
+		qint32 job_id = 0, width = 0, height = 0, channels = 0;
+		qint64 memory_budget = 0;
+		QString memory_key;
+		QStringList recipe;
+		in >> job_id >> memory_key >> width >> height >> channels >> memory_budget >> recipe;
+
+		bool success = RunJob( memory_key, width, height, channels, memory_budget, recipe );
+
+		QByteArray reply;
+		QDataStream out( &reply, QIODevice::WriteOnly );
+		out << (qint32)WORKER_RESULT << job_id << success;
+		WriteMessage( &mSocket, reply );
+		mSocket.flush();
+	}
+}
+
+bool
+FilterWorker::RunJob( QString memory_key, int width, int height, int channels, qint64 memory_budget, QStringList recipe )
+///
+/// Runs a recipe on the pixels in a shared memory segment and writes the result back
+/// into the same segment. Filters keep the image layout, so the result always fits. Each
+/// filter is planned against the worker's share of the memory budget, as in the
+/// application, and a filter the plan refuses fails the job.
+///
+/// @param memory_key
+///  The key of the shared memory segment holding the pixels.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of channels in the image.
+///
+/// @param memory_budget
+///  The memory this worker may use at once, its share of the machine's budget.
+///
+/// @param recipe
+///  The names of the filters to run, in order.
+///
+/// @return
+///  True if every filter succeeded.
+///
+{
+	size_t size = (size_t)width*height*channels;
+	QSharedMemory memory( memory_key );
+	if( !memory.attach() || (size_t)memory.size() < size )
+	{
+		return false;
+	}
+
+	uchar* shared = (uchar*)memory.data();
+	uchar* current = shared;
+	bool success = true;
+	for( int f = 0; f < recipe.size() && success; f++ )
+	{
+		boost::shared_ptr<Filter> filter = mFilterProcessor.GetFilter( recipe[f].toStdString() );
+		uchar* result = NULL;
+		if( filter )
+		{
+			// A filter too large for the budget that can't be split fails the job rather
+			// than running whole and taking the memory of the other workers
+			ExecutionPlan plan = ExecutionPlanner::Plan( filter.get(), width, height, channels, memory_budget );
+			if( plan.mode != EXECUTE_REFUSED )
+			{
+				result = ExecutionPlanner::Run( filter.get(), plan, current, width, height, channels );
+			}
+		}
+
+		// Filters that work in place leave their result where it is, even in shared memory
+		bool in_place = result != NULL && result == current && filter->Capabilities().in_place;
+		success = result != NULL && (result != current || in_place);
+		if( current != shared && !in_place )
+		{
+			delete [] current;
+		}
+		current = success ? result : shared;
+	}
+
+	if( current != shared )
+	{
+		memcpy( shared, current, size );
+		delete [] current;
+	}
+	memory.detach();
+	return success;
+}
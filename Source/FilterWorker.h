@@ -0,0 +1,44 @@
+#ifndef _FILTER_WORKER_H_
+#define _FILTER_WORKER_H_
+
+#include <QApplication>
+#include <QtWidgets>
+#include <QtNetwork>
+
+#include "FilterProcessor.h"
+
+// The messages exchanged between a WorkerFarm and its worker processes. Each message is
+// a QDataStream encoded block starting with one of these types.
+enum WorkerMessageType
+{
+	WORKER_HELLO = 1,	// worker -> farm: qint32 worker index
+	WORKER_JOB,			// farm -> worker: qint32 job id, QString shared memory key, qint32 width, height, channels,
+						// qint64 memory budget, QStringList recipe
+	WORKER_RESULT		// worker -> farm: qint32 job id, bool success
+};
+
+class FilterWorker : public QObject
+{
+	Q_OBJECT
+
+	public:
+		FilterWorker( QString server_name, int worker_index, QObject* parent = 0 );
+
+		bool Connect();
+
+		static void WriteMessage( QIODevice* device, const QByteArray& message );
+		static bool ReadMessage( QIODevice* device, QByteArray& message );
+
+	private slots:
+		void ReadyRead();
+
+	private:
+		bool RunJob( QString memory_key, int width, int height, int channels, qint64 memory_budget, QStringList recipe );
+
+		FilterProcessor mFilterProcessor;
+		QLocalSocket mSocket;
+		QString mServerName;
+		int mWorkerIndex;
+};
+
+#endif
@@ -6,6 +6,169 @@
 
 #include "BoxBlur.h"
 #include "ImageAlgorithms.h"
+#include "KernelCache.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+// Larger boxes take more time per pixel than is useful
+#define MAX_RADIUS 256
+
+template<typename T> static T*
+Blur( T* source, int width, int height, int channels, int radius )
+///
+/// Box blurs an image of any pixel type. The intermediate result between the horizontal
+/// and vertical passes is kept in float so nothing is rounded or clamped until the end.
+///
+{
+	T* result = new T[width*height*channels];
+	float* horizontal = new float[width*height*channels];
+	kernel_ptr kernel = KernelCache::Box( radius );
+
+	ImageAlgorithms::HorizontalConvo(source, horizontal, width, height, channels, &(*kernel)[0], (int)kernel->size());
+	ImageAlgorithms::VerticalConvo(horizontal, result, width, height, channels, &(*kernel)[0], (int)kernel->size());
+
+	delete [] horizontal;
+	return result;
+}
+
+static uchar*
+SummedBlur( uchar* source, int width, int height, int channels, int radius )
+///
+/// Box blurs an 8 bit image through a summed-area table, so each pixel costs four lookups
+/// however large the box. The image is first padded by the radius with copies of its edge
+/// pixels, the same edges the convolution clamps to. Boxes are at most
+/// (2*MAX_RADIUS + 1)^2 pixels, well within what 32 bit sums hold.
+///
+{
+	int padded_width = width + 2*radius;
+	int padded_height = height + 2*radius;
+	size_t row_length = (size_t)width*channels;
+	uchar* padded = new uchar[(size_t)padded_width*padded_height*channels];
+	for( int j = 0; j < padded_height; j++ )
+	{
+		const uchar* row = source + std::min( std::max( j - radius, 0 ), height - 1 )*row_length;
+		uchar* padded_row = padded + (size_t)j*padded_width*channels;
+		for( int i = 0; i < radius; i++ )
+		{
+			memcpy( padded_row + i*channels, row, channels );
+			memcpy( padded_row + (radius + width + i)*channels, row + row_length - channels, channels );
+		}
+		memcpy( padded_row + radius*channels, row, row_length );
+	}
+
+	size_t stride = (size_t)(padded_width + 1)*channels;
+	uint32_t* sums = new uint32_t[stride*(padded_height + 1)];
+	ImageAlgorithms::IntegralImage( padded, sums, padded_width, padded_height, channels );
+	delete [] padded;
+
+	// The box around each pixel starts at its own position in the padded image
+	uchar* result = new uchar[row_length*height];
+	int size = 2*radius + 1;
+	uint32_t area = size*size;
+	for( int j = 0; j < height; j++ )
+	{
+		const uint32_t* top = sums + j*stride;
+		const uint32_t* bottom = sums + (j + size)*stride;
+		uchar* result_row = result + j*row_length;
+		for( size_t n = 0; n < row_length; n++ )
+		{
+			size_t right = n + size*channels;
+			uint32_t total = bottom[right] - bottom[n] - top[right] + top[n];
+			result_row[n] = (uchar)((total + area/2)/area);
+		}
+	}
+
+	delete [] sums;
+	return result;
+}
+
+BoxBlur::BoxBlur( int radius )
+///
+/// Constructor.
+///
+/// @param radius
+///  The number of pixels either side of the centre the box covers. The default of 4 makes
+///  a 9x9 box.
+///
+: mRadius( radius )
+{
+}
+
+int
+BoxBlur::Version() const
+///
+/// @return
+///  3 since 8 bit images are blurred through a summed-area table and rounded to nearest.
+///  2 kept an opaque alpha at 255 on gray images blurred as one channel.
+///
+{
+	return 3;
+}
+
+std::string
+BoxBlur::Parameters() const
+///
+/// @return
+///  The radius of the box.
+///
+{
+	char parameters[64];
+	snprintf( parameters, sizeof(parameters), "radius=%d", mRadius );
+	return parameters;
+}
+
+Filter*
+BoxBlur::WithParameters( const FilterParameters& parameters ) const
+///
+/// @param parameters
+///  "radius", a whole number of pixels from 1 to MAX_RADIUS.
+///
+/// @return
+///  A box blur with the given radius, or NULL if the parameters aren't valid.
+///
+{
+	int radius = mRadius;
+	for( FilterParameters::const_iterator it = parameters.begin(); it != parameters.end(); ++it )
+	{
+		if( it->first != "radius" || it->second < 1 || it->second > MAX_RADIUS || it->second != floor( it->second ) )
+		{
+			return NULL;
+		}
+		radius = (int)it->second;
+	}
+	return new BoxBlur( radius );
+}
+
+FilterCapabilities
+BoxBlur::Capabilities() const
+///
+/// @return
+///  A neighbourhood filter with implementations for every pixel type.
+///
+{
+	FilterCapabilities capabilities;
+	capabilities.halo = mRadius;
+	capabilities.per_channel = true;
+	capabilities.clamped_edges = true;
+	capabilities.formats = FILTER_FORMAT_GRAY8 | FILTER_FORMAT_RGBA8 | FILTER_FORMAT_RGBA16 | FILTER_FORMAT_FLOAT;
+	return capabilities;
+}
+
+size_t
+BoxBlur::WorkingSetBytes( int width, int height, int channels ) const
+///
+/// @return
+///  The result, and for 8 bit images the padded image with its 32 bit summed-area table.
+///  That's at least the float intermediate between the two passes of the other types.
+///
+{
+	size_t padded = (size_t)(width + 2*mRadius + 1)*(height + 2*mRadius + 1)*channels;
+	return (size_t)width*height*channels + padded*(1 + sizeof(uint32_t));
+}
 
 uchar*
 BoxBlur::RunFilter( uchar* source, int width, int height, int channels )
@@ -28,17 +191,23 @@ BoxBlur::RunFilter( uchar* source, int width, int height, int channels )
 ///  The image resulting from the box blur in the same size and format as source.
 ///
 {
-	uchar* result = new uchar[width*height*channels];
-	int kernel_size = 9;
-
-	double* kernel = new double[kernel_size];
-	for( int k = 0; k < kernel_size; k++ )
-	{
-		kernel[k] = 1.0/kernel_size;
-	}
+	return SummedBlur( source, width, height, channels, mRadius );
+}
 
-	ImageAlgorithms::HorizontalConvo(source, result, width, height, channels, kernel, kernel_size);
-	ImageAlgorithms::VerticalConvo(result, result, width, height, channels, kernel, kernel_size);
+ushort*
+BoxBlur::RunFilter16( ushort* source, int width, int height, int channels )
+///
+/// 16 bit version of RunFilter.
+///
+{
+	return Blur( source, width, height, channels, mRadius );
+}
 
-	return result;
+float*
+BoxBlur::RunFilterFloat( float* source, int width, int height, int channels )
+///
+/// Floating point version of RunFilter.
+///
+{
+	return Blur( source, width, height, channels, mRadius );
 }
\ No newline at end of file
@@ -6,8 +6,20 @@
 class BoxBlur : public Filter
 {
 	public:
+		BoxBlur( int radius = 4 );
+
+		int Version() const;
+		std::string Parameters() const;
+		Filter* WithParameters( const FilterParameters& parameters ) const;
+		FilterCapabilities Capabilities() const;
+		size_t WorkingSetBytes( int width, int height, int channels ) const;
+
 		uchar* RunFilter( uchar* source, int width, int height, int channels );
-};
+		ushort* RunFilter16( ushort* source, int width, int height, int channels );
+		float* RunFilterFloat( float* source, int width, int height, int channels );
 
+	private:
+		int mRadius;
+};
 
 #endif
\ No newline at end of file
@@ -6,6 +6,141 @@
 
 #include "Canny.h"
 #include "ImageAlgorithms.h"
+#include "ImagePyramid.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <list>
+#include <mutex>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+// Deeper levels are too coarse to find useful edges on
+#define MAX_PYRAMID_LEVEL 8
+
+// Rows of input each thinned gradient row depends on either side: two for the smoothing,
+// one for the Sobel operator and one for the nonmaximum suppression
+#define SUPPRESSION_HALO 4
+
+// Thinned gradients kept for reruns with other thresholds, for filters that ask for them.
+// Each entry holds a copy of the image the gradient was found on, at the level edges are
+// detected at, and a byte per pixel of that level for the gradient.
+#define MAX_CACHED_GRADIENT_BYTES ((size_t)256 << 20)
+
+// A thinned gradient magnitude. Shared and never modified once cached.
+typedef boost::shared_ptr< const std::vector<uchar> > gradient_ptr;
+
+struct CachedGradient
+{
+	uint64_t input_key;
+	int width;
+	int height;
+	int channels;
+	std::vector<uchar> input;
+	gradient_ptr suppressed;
+};
+
+// Most recently used first
+static std::list<CachedGradient> gCachedGradients;
+static size_t gCachedGradientBytes = 0;
+static std::mutex gCachedGradientsMutex;
+
+static uint64_t
+InputKey( const uchar* source, int width, int height, int channels )
+///
+/// @return
+///  A 64 bit hash of an image's pixels. Four independent lanes of 8 bytes at a time keep
+///  hashing close to memory speed, so it costs little next to the stages it saves.
+///
+{
+	const uint64_t prime = 0x100000001B3ULL;
+	uint64_t lanes[4] = { 0xCBF29CE484222325ULL, 0x84222325CBF29CE4ULL, 0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL };
+	size_t bytes = (size_t)width*height*channels;
+	size_t n = 0;
+	for( ; n + 32 <= bytes; n += 32 )
+	{
+		for( int l = 0; l < 4; l++ )
+		{
+			uint64_t word;
+			memcpy( &word, source + n + l*8, 8 );
+			lanes[l] = (lanes[l] ^ word)*prime;
+			lanes[l] ^= lanes[l] >> 29;
+		}
+	}
+	uint64_t key = lanes[0] ^ (lanes[1] << 1) ^ (lanes[2] << 2) ^ (lanes[3] << 3);
+	for( ; n < bytes; n++ )
+	{
+		key = (key ^ source[n])*prime;
+	}
+	return key;
+}
+
+static size_t
+CachedBytes( int width, int height, int channels )
+///
+/// @return
+///  The memory a cached gradient of an image of the given size takes: a copy of the image
+///  and a byte per pixel for the gradient.
+///
+{
+	return (size_t)width*height*(channels + 1);
+}
+
+static gradient_ptr
+FindGradient( const uchar* source, uint64_t input_key, int width, int height, int channels )
+///
+/// @return
+///  The cached thinned gradient of an image, or an empty pointer if it isn't cached. The
+///  hash only finds candidates; a hit is confirmed by comparing the stored image.
+///
+{
+	size_t bytes = (size_t)width*height*channels;
+	std::lock_guard<std::mutex> lock( gCachedGradientsMutex );
+	for( std::list<CachedGradient>::iterator it = gCachedGradients.begin(); it != gCachedGradients.end(); ++it )
+	{
+		if( it->input_key == input_key && it->width == width && it->height == height && it->channels == channels &&
+			memcmp( &it->input[0], source, bytes ) == 0 )
+		{
+			gCachedGradients.splice( gCachedGradients.begin(), gCachedGradients, it );
+			return it->suppressed;
+		}
+	}
+	return gradient_ptr();
+}
+
+static void
+StoreGradient( const uchar* source, uint64_t input_key, int width, int height, int channels, gradient_ptr suppressed )
+///
+/// Caches the thinned gradient of an image, dropping the least recently used ones until
+/// the cache is within MAX_CACHED_GRADIENT_BYTES. Images too large to fit aren't cached.
+///
+{
+	size_t bytes = CachedBytes( width, height, channels );
+	if( bytes > MAX_CACHED_GRADIENT_BYTES )
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock( gCachedGradientsMutex );
+	while( !gCachedGradients.empty() && gCachedGradientBytes + bytes > MAX_CACHED_GRADIENT_BYTES )
+	{
+		const CachedGradient& oldest = gCachedGradients.back();
+		gCachedGradientBytes -= CachedBytes( oldest.width, oldest.height, oldest.channels );
+		gCachedGradients.pop_back();
+	}
+
+	gCachedGradients.push_front( CachedGradient() );
+	CachedGradient& cached = gCachedGradients.front();
+	cached.input_key = input_key;
+	cached.width = width;
+	cached.height = height;
+	cached.channels = channels;
+	cached.input.assign( source, source + (size_t)width*height*channels );
+	cached.suppressed = suppressed;
+	gCachedGradientBytes += bytes;
+}
 
 void 
 NonmaximumSupression( uchar* gradient_magnitude, uchar* gradient_direction, uchar* edges, int width, int height )
@@ -168,14 +303,18 @@ Hysteresis( uchar* edges, int width, int height, int max_threshold, int min_thre
 	}
 }
 
-uchar*
-CannyEdge::RunFilter( uchar* source, int width, int height, int channels )
+void
+SuppressGradient( uchar* source, uchar* edges, int width, int height, int channels )
 ///
-/// Runs Canny edge detection on a given image and returns the result.
+/// Runs the Canny edge detection stages that don't depend on the thresholds: smoothing,
+/// finding the gradient and thinning it to the local maxima.
 ///
 /// @param source
 ///  The source image to perform the edge detection on.
 ///
+/// @param edges
+///  A one channel image that stores the thinned gradient magnitude, ready for Hysteresis.
+///
 /// @param width
 ///  The width of the image.
 ///
@@ -186,17 +325,18 @@ CannyEdge::RunFilter( uchar* source, int width, int height, int channels )
 ///  The number of color channels that the image contains.
 ///
 /// @return
-///  The image resulting from the edge detection in the same size and format as source.
+///  Nothing.
 ///
 {
-	uchar* result = new uchar[width*height*channels];
 	uchar* smoothed = new uchar[width*height*channels];
+	float* horizontal = new float[width*height*channels];
 
 	// Apply a Gaussian blur with kernel size 5 to get rid of any noise
 	double kernel[5] = {5.0/49, 12.0/49, 15.0/49, 12.0/49, 5.0/49};
 	int kernel_size = 5;
-	ImageAlgorithms::HorizontalConvo(source, smoothed, width, height, channels, kernel, kernel_size);
-	ImageAlgorithms::VerticalConvo(smoothed, smoothed, width, height, channels, kernel, kernel_size);
+	ImageAlgorithms::HorizontalConvo(source, horizontal, width, height, channels, kernel, kernel_size);
+	ImageAlgorithms::VerticalConvo(horizontal, smoothed, width, height, channels, kernel, kernel_size);
+	delete [] horizontal;
 
 	// Apply the sobel operator to the smoothed image to approximate the image gradients
 	uchar* gradient_magnitude = new uchar[width*height];
@@ -205,15 +345,213 @@ CannyEdge::RunFilter( uchar* source, int width, int height, int channels )
 	delete [] smoothed;
 
 	// Apply nonmaximum supression to thin edges
-	uchar* edges = new uchar[width*height];
 	NonmaximumSupression( gradient_magnitude, gradient_direction, edges, width, height );
 	delete [] gradient_magnitude;
 	delete [] gradient_direction;
+}
 
-	// Apply hysteresis to minimize streaking
-	double max_threshold = 80;
-	double min_threshold = 20;
-	Hysteresis( edges, width, height, max_threshold, min_threshold );
+CannyEdge::CannyEdge( int pyramid_level, int low_threshold, int high_threshold, bool cache_gradients )
+///
+/// Constructor.
+///
+/// @param pyramid_level
+///  The image pyramid level to detect edges at. 0 works at full resolution, each further
+///  level halves the resolution and picks up only coarser edges, at a quarter of the cost.
+///
+/// @param low_threshold
+///  The gradient magnitude that pixels connected to an edge need to be part of it.
+///
+/// @param high_threshold
+///  The gradient magnitude that makes a pixel an edge.
+///
+/// @param cache_gradients
+///  Keeps the thinned gradient of each image, so rerunning on the same image with other
+///  thresholds skips straight to the edge tracing. Worth its memory only when thresholds
+///  are being tried out interactively.
+///
+: mPyramidLevel( pyramid_level ),
+  mLowThreshold( low_threshold ),
+  mHighThreshold( high_threshold ),
+  mCacheGradients( cache_gradients )
+{
+}
+
+std::string
+CannyEdge::Parameters() const
+///
+/// @return
+///  The pyramid level edges are detected at and the thresholds. Caching gradients doesn't
+///  change the result, so it isn't listed.
+///
+{
+	char parameters[96];
+	snprintf( parameters, sizeof(parameters), "pyramid_level=%d low_threshold=%d high_threshold=%d", mPyramidLevel, mLowThreshold, mHighThreshold );
+	return parameters;
+}
+
+Filter*
+CannyEdge::WithParameters( const FilterParameters& parameters ) const
+///
+/// @param parameters
+///  Any of "pyramid_level" from 0 to MAX_PYRAMID_LEVEL, "low_threshold" and
+///  "high_threshold" from 0 to 255, and "cache_gradients" 0 or 1. All are whole numbers
+///  and the low threshold can't be above the high one.
+///
+/// @return
+///  An edge detector with the given settings, or NULL if the parameters aren't valid.
+///
+{
+	int pyramid_level = mPyramidLevel;
+	int low_threshold = mLowThreshold;
+	int high_threshold = mHighThreshold;
+	bool cache_gradients = mCacheGradients;
+	for( FilterParameters::const_iterator it = parameters.begin(); it != parameters.end(); ++it )
+	{
+		double value = it->second;
+		int limit = it->first == "pyramid_level" ? MAX_PYRAMID_LEVEL : it->first == "cache_gradients" ? 1 : 255;
+		if( !(value >= 0 && value <= limit) || value != floor( value ) )
+		{
+			return NULL;
+		}
+
+		if( it->first == "pyramid_level" )
+		{
+			pyramid_level = (int)value;
+		}
+		else if( it->first == "low_threshold" )
+		{
+			low_threshold = (int)value;
+		}
+		else if( it->first == "high_threshold" )
+		{
+			high_threshold = (int)value;
+		}
+		else if( it->first == "cache_gradients" )
+		{
+			cache_gradients = value != 0;
+		}
+		else
+		{
+			return NULL;
+		}
+	}
+	if( low_threshold > high_threshold )
+	{
+		return NULL;
+	}
+	return new CannyEdge( pyramid_level, low_threshold, high_threshold, cache_gradients );
+}
+
+FilterCapabilities
+CannyEdge::Capabilities() const
+///
+/// @return
+///  An 8 bit filter. Hysteresis can follow an edge across the whole image, so any input
+///  pixel can affect any output pixel. At full resolution the stages before it are local
+///  and hysteresis only needs the one byte thinned gradient, so large images are split
+///  there. Coarser levels already work on a fraction of the image and aren't split.
+///
+{
+	FilterCapabilities capabilities;
+	capabilities.formats = FILTER_FORMAT_GRAY8 | FILTER_FORMAT_RGBA8;
+	if( mPyramidLevel <= 0 )
+	{
+		capabilities.map_halo = SUPPRESSION_HALO;
+	}
+	return capabilities;
+}
+
+size_t
+CannyEdge::WorkingSetBytes( int width, int height, int channels ) const
+///
+/// @return
+///  The result and edge map, plus the most the edge detection needs at once: the smoothed
+///  image with its float intermediate and the thinned gradient. Coarser levels detect on a
+///  pyramid level instead, which costs the levels (a third of the image at most) and far
+///  smaller intermediates. Caching gradients adds a copy of the image edges are detected
+///  on, which stays in the cache after the run.
+///
+{
+	size_t pixels = (size_t)width*height;
+	size_t result = pixels*(channels + 1);
+	size_t cached = mCacheGradients ? (size_t)channels : 0;
+	if( mPyramidLevel <= 0 )
+	{
+		return result + pixels*(1 + cached) + pixels*channels*(1 + sizeof(float));
+	}
+	size_t level_pixels = (size_t)(width >> mPyramidLevel)*(height >> mPyramidLevel);
+	return result + pixels*channels/3 + level_pixels*(channels*(1 + sizeof(float)) + 2 + cached);
+}
+
+uchar*
+CannyEdge::RunFilter( uchar* source, int width, int height, int channels )
+///
+/// Runs Canny edge detection on a given image and returns the result.
+///
+/// @param source
+///  The source image to perform the edge detection on.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels that the image contains.
+///
+/// @return
+///  The image resulting from the edge detection in the same size and format as source.
+///
+{
+	uchar* result = new uchar[width*height*channels];
+	uchar* edges = new uchar[width*height];
+
+	ImagePyramid pyramid( source, width, height, channels );
+	int level = mPyramidLevel < pyramid.LevelCount() ? mPyramidLevel : pyramid.LevelCount() - 1;
+	int level_width = pyramid.LevelWidth( level );
+	int level_height = pyramid.LevelHeight( level );
+
+	// Only hysteresis depends on the thresholds. When asked to, the thinned gradient before
+	// it is kept, so rerunning on the same image with other thresholds skips straight to
+	// hysteresis. The gradient only depends on the level it's found on, which is the key.
+	uchar* level_source = pyramid.Level( level );
+	uint64_t input_key = mCacheGradients ? InputKey( level_source, level_width, level_height, channels ) : 0;
+	gradient_ptr suppressed = mCacheGradients ? FindGradient( level_source, input_key, level_width, level_height, channels ) : gradient_ptr();
+	if( !suppressed )
+	{
+		std::vector<uchar>* gradient = new std::vector<uchar>( (size_t)level_width*level_height );
+		SuppressGradient( level_source, &(*gradient)[0], level_width, level_height, channels );
+		suppressed.reset( gradient );
+		if( mCacheGradients )
+		{
+			StoreGradient( level_source, input_key, level_width, level_height, channels, suppressed );
+		}
+	}
+
+	uchar* level_edges = level <= 0 ? edges : new uchar[level_width*level_height];
+	memcpy( level_edges, &(*suppressed)[0], (size_t)level_width*level_height );
+	Hysteresis( level_edges, level_width, level_height, mHighThreshold, mLowThreshold );
+
+	if( level > 0 )
+	{
+		// Edges were detected on the coarse level, so expand the edge map back to full resolution
+		uchar* coarse_edges = level_edges;
+		while( level > 0 )
+		{
+			uchar* finer_edges = level == 1 ? edges : new uchar[pyramid.LevelWidth( level - 1 )*pyramid.LevelHeight( level - 1 )];
+			ImagePyramid::Expand( coarse_edges, pyramid.LevelWidth( level ), pyramid.LevelHeight( level ), finer_edges, pyramid.LevelWidth( level - 1 ), pyramid.LevelHeight( level - 1 ), 1 );
+			delete [] coarse_edges;
+			coarse_edges = finer_edges;
+			level--;
+		}
+
+		// Expanding softens the edges, so make them binary again
+		for( int n = 0; n < width*height; n++ )
+		{
+			edges[n] = edges[n] >= 128 ? 255 : 0;
+		}
+	}
 
 	// Convert the result back to a four channel image to be displayed
 	// This step is only necessary if the image is being displayed rather
@@ -223,4 +561,78 @@ CannyEdge::RunFilter( uchar* source, int width, int height, int channels )
 	delete [] edges;
 
 	return result;
-}
\ No newline at end of file
+}
+
+bool
+CannyEdge::RunMapBand( uchar* band, int width, int band_rows, int channels, int first_row, int rows, uchar* map )
+///
+/// Finds the thinned gradient of a band of the image at full resolution.
+///
+/// @param band
+///  The rows of the image the band needs, including its halo.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param band_rows
+///  The number of rows in band.
+///
+/// @param channels
+///  The number of color channels that the image contains.
+///
+/// @param first_row
+///  The first row of band to write to the map. The rows before it are halo.
+///
+/// @param rows
+///  The number of rows to write to the map.
+///
+/// @param map
+///  Where the thinned gradient of the rows goes, one byte per pixel.
+///
+/// @return
+///  True if the band was run, false if edges are detected on a coarser level.
+///
+{
+	if( mPyramidLevel > 0 )
+	{
+		return false;
+	}
+
+	uchar* suppressed = new uchar[(size_t)width*band_rows];
+	SuppressGradient( band, suppressed, width, band_rows, channels );
+	memcpy( map, suppressed + (size_t)first_row*width, (size_t)rows*width );
+	delete [] suppressed;
+	return true;
+}
+
+uchar*
+CannyEdge::FinishMap( uchar* map, int width, int height, int channels )
+///
+/// Traces edges through the thinned gradient of the whole image built by RunMapBand.
+///
+/// @param map
+///  The thinned gradient, which is overwritten by the edge map.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels that the image contains.
+///
+/// @return
+///  The edges in the same size and format as the image.
+///
+{
+	if( mPyramidLevel > 0 )
+	{
+		return NULL;
+	}
+
+	Hysteresis( map, width, height, mHighThreshold, mLowThreshold );
+	uchar* result = new uchar[width*height*channels];
+	ImageAlgorithms::ConvertFromOneChannel( map, result, width, height, channels );
+	return result;
+}
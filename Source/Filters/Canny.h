@@ -6,7 +6,22 @@
 class CannyEdge : public Filter
 {
 	public:
+		CannyEdge( int pyramid_level = 0, int low_threshold = 20, int high_threshold = 80, bool cache_gradients = false );
+
+		std::string Parameters() const;
+		Filter* WithParameters( const FilterParameters& parameters ) const;
+		FilterCapabilities Capabilities() const;
+		size_t WorkingSetBytes( int width, int height, int channels ) const;
+
 		uchar* RunFilter( uchar* source, int width, int height, int channels );
+		bool RunMapBand( uchar* band, int width, int band_rows, int channels, int first_row, int rows, uchar* map );
+		uchar* FinishMap( uchar* map, int width, int height, int channels );
+
+	private:
+		int mPyramidLevel;
+		int mLowThreshold;
+		int mHighThreshold;
+		bool mCacheGradients;
 };
 
 
@@ -0,0 +1,85 @@
+///
+/// Runtime detection of the SIMD instruction sets available on the current CPU.
+///
+
+#include "CpuFeatures.h"
+
+#include <atomic>
+
+static std::atomic<bool> gSimdEnabled( true );
+
+void
+CpuFeatures::SetSimdEnabled( bool enabled )
+///
+/// Turns every SIMD code path off, or back on where the CPU supports it, so results can
+/// be checked against the scalar code on the same machine.
+///
+/// @param enabled
+///  False to report every instruction set as unsupported.
+///
+/// @return
+///  Nothing.
+///
+{
+	gSimdEnabled.store( enabled );
+}
+
+bool
+CpuFeatures::HasSSE2()
+///
+/// @return
+///  True if the CPU supports SSE2.
+///
+{
+#ifdef FILTER_SIMD_X86
+	static const bool supported = __builtin_cpu_supports( "sse2" );
+	return supported && gSimdEnabled.load( std::memory_order_relaxed );
+#else
+	return false;
+#endif
+}
+
+bool
+CpuFeatures::HasSSSE3()
+///
+/// @return
+///  True if the CPU supports SSSE3 (needed for byte shuffles).
+///
+{
+#ifdef FILTER_SIMD_X86
+	static const bool supported = __builtin_cpu_supports( "ssse3" );
+	return supported && gSimdEnabled.load( std::memory_order_relaxed );
+#else
+	return false;
+#endif
+}
+
+bool
+CpuFeatures::HasSSE41()
+///
+/// @return
+///  True if the CPU supports SSE4.1.
+///
+{
+#ifdef FILTER_SIMD_X86
+	static const bool supported = __builtin_cpu_supports( "sse4.1" );
+	return supported && gSimdEnabled.load( std::memory_order_relaxed );
+#else
+	return false;
+#endif
+}
+
+bool
+CpuFeatures::HasAVX2()
+///
+/// @return
+///  True if the CPU supports AVX2 (needed for 256 bit shuffles and gathers).
+///
+{
+#ifdef FILTER_SIMD_X86
+	static const bool supported = __builtin_cpu_supports( "avx2" );
+	return supported && gSimdEnabled.load( std::memory_order_relaxed );
+#else
+	return false;
+#endif
+}
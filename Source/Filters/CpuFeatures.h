@@ -0,0 +1,23 @@
+#ifndef _CPU_FEATURES_H_
+#define _CPU_FEATURES_H_
+
+// SIMD code paths are compiled with per-function target attributes so the
+// project can still be built without any architecture flags, and the best
+// available path is chosen at runtime.
+#if ( defined(__GNUC__) || defined(__clang__) ) && ( defined(__x86_64__) || defined(__i386__) )
+#define FILTER_SIMD_X86 1
+#define FILTER_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+class CpuFeatures
+{
+	public:
+		static void SetSimdEnabled( bool enabled );
+
+		static bool HasSSE2();
+		static bool HasSSSE3();
+		static bool HasSSE41();
+		static bool HasAVX2();
+};
+
+#endif
@@ -0,0 +1,200 @@
+///
+/// A small in-tree radix 2 fast fourier transform, in 1D and on square 2D blocks.
+/// The twiddle factors and bit reversal permutation are computed once per size.
+///
+
+#include "FFT.h"
+
+#include <math.h>
+
+#define PI 3.14159265358979323846
+
+typedef std::complex<double> complex_t;
+
+FFT::FFT( int size )
+///
+/// Constructor.
+///
+/// @param size
+///  The transform size. Must be a power of two.
+///
+: mSize( size ),
+  mBitReversed( size ),
+  mTwiddles( size/2 )
+{
+	int bits = 0;
+	while( (1 << bits) < size )
+	{
+		bits++;
+	}
+	for( int i = 0; i < size; i++ )
+	{
+		int reversed = 0;
+		for( int b = 0; b < bits; b++ )
+		{
+			if( i & (1 << b) )
+			{
+				reversed |= 1 << (bits - 1 - b);
+			}
+		}
+		mBitReversed[i] = reversed;
+	}
+	for( int i = 0; i < size/2; i++ )
+	{
+		mTwiddles[i] = complex_t( cos( -2.0*PI*i/size ), sin( -2.0*PI*i/size ) );
+	}
+}
+
+int
+FFT::Size() const
+///
+/// @return
+///  The transform size.
+///
+{
+	return mSize;
+}
+
+int
+FFT::NextPowerOfTwo( int value )
+///
+/// @return
+///  The smallest power of two that is greater than or equal to value.
+///
+{
+	int power = 1;
+	while( power < value )
+	{
+		power <<= 1;
+	}
+	return power;
+}
+
+void
+FFT::Forward( complex_t* data ) const
+///
+/// Replaces data with its discrete fourier transform.
+///
+/// @param data
+///  Size() complex values.
+///
+/// @return
+///  Nothing.
+///
+{
+	Transform( data, false );
+}
+
+void
+FFT::Inverse( complex_t* data ) const
+///
+/// Replaces data with its inverse discrete fourier transform, including the 1/Size() scale.
+///
+/// @param data
+///  Size() complex values.
+///
+/// @return
+///  Nothing.
+///
+{
+	Transform( data, true );
+}
+
+void
+FFT::Forward2D( complex_t* data ) const
+///
+/// Replaces a Size() x Size() block with its 2D discrete fourier transform.
+///
+/// @param data
+///  Size()*Size() complex values stored row by row.
+///
+/// @return
+///  Nothing.
+///
+{
+	Transform2D( data, false );
+}
+
+void
+FFT::Inverse2D( complex_t* data ) const
+///
+/// Replaces a Size() x Size() block with its 2D inverse discrete fourier transform.
+///
+/// @param data
+///  Size()*Size() complex values stored row by row.
+///
+/// @return
+///  Nothing.
+///
+{
+	Transform2D( data, true );
+}
+
+void
+FFT::Transform( complex_t* data, bool inverse ) const
+///
+/// Iterative in place Cooley-Tukey transform.
+///
+{
+	for( int i = 0; i < mSize; i++ )
+	{
+		int j = mBitReversed[i];
+		if( i < j )
+		{
+			complex_t swap = data[i];
+			data[i] = data[j];
+			data[j] = swap;
+		}
+	}
+
+	for( int length = 2; length <= mSize; length <<= 1 )
+	{
+		int half = length/2;
+		int step = mSize/length;
+		for( int start = 0; start < mSize; start += length )
+		{
+			for( int k = 0; k < half; k++ )
+			{
+				complex_t twiddle = inverse ? conj( mTwiddles[k*step] ) : mTwiddles[k*step];
+				complex_t odd = data[start + k + half]*twiddle;
+				data[start + k + half] = data[start + k] - odd;
+				data[start + k] += odd;
+			}
+		}
+	}
+
+	if( inverse )
+	{
+		double scale = 1.0/mSize;
+		for( int i = 0; i < mSize; i++ )
+		{
+			data[i] *= scale;
+		}
+	}
+}
+
+void
+FFT::Transform2D( complex_t* data, bool inverse ) const
+///
+/// Transforms every row, then every column through a contiguous scratch buffer.
+///
+{
+	for( int j = 0; j < mSize; j++ )
+	{
+		Transform( data + (size_t)j*mSize, inverse );
+	}
+
+	std::vector<complex_t> column( mSize );
+	for( int i = 0; i < mSize; i++ )
+	{
+		for( int j = 0; j < mSize; j++ )
+		{
+			column[j] = data[(size_t)j*mSize + i];
+		}
+		Transform( &column[0], inverse );
+		for( int j = 0; j < mSize; j++ )
+		{
+			data[(size_t)j*mSize + i] = column[j];
+		}
+	}
+}
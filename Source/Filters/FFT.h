@@ -0,0 +1,31 @@
+#ifndef _FFT_H_
+#define _FFT_H_
+
+#include <complex>
+#include <vector>
+
+class FFT
+{
+	public:
+		FFT( int size );
+
+		int Size() const;
+
+		void Forward( std::complex<double>* data ) const;
+		void Inverse( std::complex<double>* data ) const;
+
+		void Forward2D( std::complex<double>* data ) const;
+		void Inverse2D( std::complex<double>* data ) const;
+
+		static int NextPowerOfTwo( int value );
+
+	private:
+		void Transform( std::complex<double>* data, bool inverse ) const;
+		void Transform2D( std::complex<double>* data, bool inverse ) const;
+
+		int mSize;
+		std::vector<int> mBitReversed;
+		std::vector< std::complex<double> > mTwiddles;
+};
+
+#endif
@@ -6,6 +6,132 @@
 
 #include "GaussianBlur.h"
 #include "ImageAlgorithms.h"
+#include "ImagePyramid.h"
+#include "KernelCache.h"
+
+#include <stdio.h>
+
+// Larger blurs are better done with a box blur
+#define MAX_SIGMA 256.0
+
+// The small blur, which approximates a gaussian in 3 taps
+static const double SMALL_KERNEL[3] = {1.0/4.0, 2.0/4.0, 1.0/4.0};
+
+template<typename T> static T*
+Blur( T* source, int width, int height, int channels, const double* kernel, int kernel_size )
+///
+/// Blurs an image of any pixel type with a separable kernel. The intermediate result
+/// between the horizontal and vertical passes is kept in float so nothing is rounded or
+/// clamped until the end.
+///
+{
+	T* result = new T[width*height*channels];
+	float* horizontal = new float[width*height*channels];
+
+	ImageAlgorithms::HorizontalConvo(source, horizontal, width, height, channels, kernel, kernel_size);
+	ImageAlgorithms::VerticalConvo(horizontal, result, width, height, channels, kernel, kernel_size);
+
+	delete [] horizontal;
+	return result;
+}
+
+template<typename T> static T*
+Blur( T* source, int width, int height, int channels, double sigma )
+///
+/// Blurs a high bit depth image at full resolution. 8 bit images use the pyramid instead.
+///
+{
+	if( sigma <= 0.0 )
+	{
+		return Blur( source, width, height, channels, SMALL_KERNEL, 3 );
+	}
+	kernel_ptr kernel = KernelCache::Gaussian( sigma );
+	return Blur( source, width, height, channels, &(*kernel)[0], (int)kernel->size() );
+}
+
+GaussianBlur::GaussianBlur( double sigma )
+///
+/// Constructor.
+///
+/// @param sigma
+///  The standard deviation of a large blur, which runs on a coarser pyramid level and is
+///  upsampled. 0 applies the small 3x3 blur at full resolution.
+///
+: mSigma( sigma )
+{
+}
+
+int
+GaussianBlur::Version() const
+///
+/// @return
+///  2 since large 16 bit blurs run at full resolution instead of through the 8 bit pyramid.
+///
+{
+	return 2;
+}
+
+std::string
+GaussianBlur::Parameters() const
+///
+/// @return
+///  The standard deviation of the blur.
+///
+{
+	char parameters[64];
+	snprintf( parameters, sizeof(parameters), "sigma=%.17g", mSigma );
+	return parameters;
+}
+
+Filter*
+GaussianBlur::WithParameters( const FilterParameters& parameters ) const
+///
+/// @param parameters
+///  "sigma", the standard deviation of the blur from 0 to MAX_SIGMA. 0 is the small 3x3 blur.
+///
+/// @return
+///  A gaussian blur with the given settings, or NULL if the parameters aren't valid.
+///
+{
+	double sigma = mSigma;
+	for( FilterParameters::const_iterator it = parameters.begin(); it != parameters.end(); ++it )
+	{
+		if( it->first != "sigma" || !(it->second >= 0.0 && it->second <= MAX_SIGMA) )
+		{
+			return NULL;
+		}
+		sigma = it->second;
+	}
+	return new GaussianBlur( sigma );
+}
+
+FilterCapabilities
+GaussianBlur::Capabilities() const
+///
+/// @return
+///  A neighbourhood filter with implementations for every pixel type. Large 8 bit blurs
+///  sample a pyramid aligned to the image origin, so they can't be split into tiles.
+///
+{
+	FilterCapabilities capabilities;
+	capabilities.halo = mSigma > 0.0 ? FILTER_HALO_GLOBAL : 1;
+	capabilities.per_channel = true;
+	capabilities.clamped_edges = true;
+	capabilities.formats = FILTER_FORMAT_GRAY8 | FILTER_FORMAT_RGBA8 | FILTER_FORMAT_RGBA16 | FILTER_FORMAT_FLOAT;
+	return capabilities;
+}
+
+size_t
+GaussianBlur::WorkingSetBytes( int width, int height, int channels ) const
+///
+/// @return
+///  The result and the float intermediate between the two passes. Large blurs also keep
+///  the pyramid levels, which add up to a third of the image.
+///
+{
+	size_t pixels = (size_t)width*height*channels;
+	return pixels*(1 + sizeof(float)) + (mSigma > 0.0 ? pixels/3 : 0);
+}
 
 uchar*
 GaussianBlur::RunFilter( uchar* source, int width, int height, int channels )
@@ -28,12 +154,31 @@ GaussianBlur::RunFilter( uchar* source, int width, int height, int channels )
 ///  The image resulting from the gaussian blur in the same size and format as source.
 ///
 {
-	uchar* result = new uchar[width*height*channels];
-	double kernel[3] = {1.0/4.0, 2.0/4.0, 1.0/4.0};
-	int kernel_size = 3;
+	if( mSigma > 0.0 )
+	{
+		uchar* result = new uchar[width*height*channels];
+		ImagePyramid::Blur( source, result, width, height, channels, mSigma );
+		return result;
+	}
+	return Blur( source, width, height, channels, SMALL_KERNEL, 3 );
+}
 
-	ImageAlgorithms::HorizontalConvo(source, result, width, height, channels, kernel, kernel_size);
-	ImageAlgorithms::VerticalConvo(result, result, width, height, channels, kernel, kernel_size);
+ushort*
+GaussianBlur::RunFilter16( ushort* source, int width, int height, int channels )
+///
+/// 16 bit version of RunFilter. Large blurs are done at full resolution with the whole
+/// gaussian kernel, which keeps full precision but takes time in proportion to sigma.
+///
+{
+	return Blur( source, width, height, channels, mSigma );
+}
 
-	return result;
+float*
+GaussianBlur::RunFilterFloat( float* source, int width, int height, int channels )
+///
+/// Floating point version of RunFilter. Large blurs are done at full resolution, as for
+/// RunFilter16.
+///
+{
+	return Blur( source, width, height, channels, mSigma );
 }
\ No newline at end of file
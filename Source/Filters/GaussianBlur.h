@@ -6,7 +6,20 @@
 class GaussianBlur : public Filter
 {
 	public:
+		GaussianBlur( double sigma = 0.0 );
+
+		int Version() const;
+		std::string Parameters() const;
+		Filter* WithParameters( const FilterParameters& parameters ) const;
+		FilterCapabilities Capabilities() const;
+		size_t WorkingSetBytes( int width, int height, int channels ) const;
+
 		uchar* RunFilter( uchar* source, int width, int height, int channels );
+		ushort* RunFilter16( ushort* source, int width, int height, int channels );
+		float* RunFilterFloat( float* source, int width, int height, int channels );
+
+	private:
+		double mSigma;
 };
 
 #endif
\ No newline at end of file
@@ -5,13 +5,125 @@
 ///
 
 #include "ImageAlgorithms.h"
+#include "CpuFeatures.h"
+#include "PixelConversion.h"
+#include "PixelTraits.h"
+#include "FFT.h"
+#include "KernelDecomposition.h"
+#include "ParallelRanges.h"
 
+#include <assert.h>
 #include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <complex>
+#include <functional>
+#include <vector>
 
 #define PI 3.14159265
 
-void
-ImageAlgorithms::HorizontalConvo( uchar* source, uchar* destination, int width, int height, int channels, double* kernel, int kernel_size )
+// Kernel size from which TwoDConvo hands over to FFTConvo. Picked by timing both on a
+// 1000x1000 four channel image, where 7x7 was still faster direct and 9x9 faster with FFTs.
+#define FFT_CROSSOVER_KERNEL_SIZE 9
+
+// Separable passes are preferred over the FFT path for kernels up to this many 1D taps
+// in total (2 * kernel size * rank), again picked by timing both.
+#define SEPARABLE_MAX_TAPS 128
+
+// Fewer rows or columns than this per thread cost more to start a thread for than they save
+#define MIN_PARALLEL_RANGE 64
+
+// Luma weights are fixed point with this many fraction bits
+#define LUMA_SHIFT 15
+
+#ifdef FILTER_SIMD_X86
+#include <immintrin.h>
+#endif
+
+int
+ImageAlgorithms::BorderIndex( int position, int size, BorderMode border )
+///
+/// Maps a row or column position that may lie outside the image to the position it
+/// takes its value from.
+///
+/// @param position
+///  The position, which may be negative or at least size.
+///
+/// @param size
+///  The width or height of the image.
+///
+/// @param border
+///  The border mode.
+///
+/// @return
+///  A position inside the image, or -1 if the pixel takes the constant border value.
+///
+{
+	if( position >= 0 && position < size )
+	{
+		return position;
+	}
+
+	switch( border )
+	{
+		case BORDER_REFLECT:
+		{
+			// Mirror about the edge pixels without repeating them, i.e. dcb|abcd|cba
+			if( size == 1 )
+			{
+				return 0;
+			}
+			int period = 2*(size - 1);
+			position %= period;
+			if( position < 0 ) position += period;
+			return position < size ? position : period - position;
+		}
+		case BORDER_WRAP:
+		{
+			position %= size;
+			return position < 0 ? position + size : position;
+		}
+		case BORDER_CONSTANT:
+			return -1;
+		case BORDER_CLAMP:
+		default:
+			return position < 0 ? 0 : size - 1;
+	}
+}
+
+template<typename S> static void
+PadRow( S* row, S* padded, int width, int channels, int radius, BorderMode border, S border_value )
+///
+/// Copies a row into a buffer with radius extra pixels either side and synthesizes those
+/// pixels according to the border mode, so the convolution taps never need to check bounds.
+///
+{
+	for( int n = 0; n < width*channels; n++ )
+	{
+		padded[radius*channels + n] = row[n];
+	}
+
+	for( int i = -radius; i < 0; i++ )
+	{
+		int x_pos = ImageAlgorithms::BorderIndex( i, width, border );
+		for( int c = 0; c < channels; c++ )
+		{
+			padded[(i + radius)*channels + c] = x_pos == -1 ? border_value : row[x_pos*channels + c];
+		}
+	}
+
+	for( int i = width; i < width + radius; i++ )
+	{
+		int x_pos = ImageAlgorithms::BorderIndex( i, width, border );
+		for( int c = 0; c < channels; c++ )
+		{
+			padded[(i + radius)*channels + c] = x_pos == -1 ? border_value : row[x_pos*channels + c];
+		}
+	}
+}
+
+template<typename S, typename D> void
+ImageAlgorithms::HorizontalConvo( S* source, D* destination, int width, int height, int channels, const double* kernel, int kernel_size, BorderMode border, double border_value )
 ///
 /// Performs a horizontal convolution using a given 1D kernel.
 ///
@@ -20,6 +132,7 @@ ImageAlgorithms::HorizontalConvo( uchar* source, uchar* destination, int width,
 ///
 /// @param destination
 ///  The image data where the result is to be stored (must be the same dimensions as source).
+///  This may be the same buffer as source.
 ///
 /// @param width
 ///  The width of the image.
@@ -36,35 +149,53 @@ ImageAlgorithms::HorizontalConvo( uchar* source, uchar* destination, int width,
 /// @param kernel_size
 ///  The size of the given kernel.
 ///
+/// @param border
+///  How pixels outside the image are synthesized. Clamp by default.
+///
+/// @param border_value
+///  The value of pixels outside the image when border is BORDER_CONSTANT.
+///
 /// @return
 ///  Nothing.
 ///
 {
+	int radius = kernel_size/2;
+	int row_length = width*channels;
+
+	// Each row is padded once, after which every tap is a branch free pass over contiguous data.
+	S* padded = new S[(width + 2*radius)*channels];
+	double* accumulator = new double[row_length];
+	S padding_value = PixelTraits<S>::FromDouble( border_value );
 	for( int j = 0; j < height; j++ )
 	{
-		for( int i = 0; i < width; i++ )
+		PadRow( source + (size_t)j*row_length, padded, width, channels, radius, border, padding_value );
+		for( int n = 0; n < row_length; n++ )
 		{
-			for( int c = 0; c < channels; c++ )
-			{
-				double total = 0.0;
-				for( int kx = 0; kx < kernel_size; kx++ )
-				{
-                    int x_pos = i + kx - kernel_size/2;
-                    if( x_pos < 0 ) x_pos = 0;
-                    if( x_pos >= width ) x_pos = width - 1;
+			accumulator[n] = 0.0;
+		}
 
-                    total += source[j*width*channels + x_pos*channels + c]*kernel[kx];
-				}
-                if( total > 255 ) total = 255;
-                if( total < 0 ) total = 0;
-				destination[(j)*width*channels + (i)*channels + c] = (uchar)total;
+		for( int kx = 0; kx < kernel_size; kx++ )
+		{
+			double weight = kernel[kx];
+			S* tap = padded + kx*channels;
+			for( int n = 0; n < row_length; n++ )
+			{
+				accumulator[n] += tap[n]*weight;
 			}
 		}
+
+		D* result_row = destination + (size_t)j*row_length;
+		for( int n = 0; n < row_length; n++ )
+		{
+			result_row[n] = PixelTraits<D>::FromDouble( accumulator[n] );
+		}
 	}
+	delete [] accumulator;
+	delete [] padded;
 }
 
-void
-ImageAlgorithms::VerticalConvo( uchar* source, uchar* destination, int width, int height, int channels, double* kernel, int kernel_size )
+template<typename S, typename D> void
+ImageAlgorithms::VerticalConvo( S* source, D* destination, int width, int height, int channels, const double* kernel, int kernel_size, BorderMode border, double border_value )
 ///
 /// Performs a vertical convolution using a given 1D kernel.
 ///
@@ -73,6 +204,7 @@ ImageAlgorithms::VerticalConvo( uchar* source, uchar* destination, int width, in
 ///
 /// @param destination
 ///  The image data where the result is to be stored (must be the same dimensions as source).
+///  Unlike the horizontal convolution this can't be the same buffer as source.
 ///
 /// @param width
 ///  The width of the image.
@@ -89,43 +221,72 @@ ImageAlgorithms::VerticalConvo( uchar* source, uchar* destination, int width, in
 /// @param kernel_size
 ///  The size of the given kernel.
 ///
+/// @param border
+///  How pixels outside the image are synthesized. Clamp by default.
+///
+/// @param border_value
+///  The value of pixels outside the image when border is BORDER_CONSTANT.
+///
 /// @return
 ///  Nothing.
 ///
 {
+	int radius = kernel_size/2;
+	int row_length = width*channels;
+
+	// Accumulate a whole row at a time so the inner loop runs over contiguous data.
+	// The border only decides which source row each tap reads, once per row.
+	double* accumulator = new double[row_length];
+	double padding_value = PixelTraits<S>::FromDouble( border_value );
 	for( int j = 0; j < height; j++ )
 	{
-		for( int i = 0; i < width; i++ )
+		for( int n = 0; n < row_length; n++ )
 		{
-			for( int c = 0; c < channels; c++ )
+			accumulator[n] = 0.0;
+		}
+
+		for( int ky = 0; ky < kernel_size; ky++ )
+		{
+			double weight = kernel[ky];
+			int y_pos = BorderIndex( j + ky - radius, height, border );
+			if( y_pos == -1 )
 			{
-				double total = 0.0;
-				for( int ky = 0; ky < kernel_size; ky++ )
+				for( int n = 0; n < row_length; n++ )
 				{
-                    int y_pos = j + ky - kernel_size/2;
-                    if( y_pos < 0 ) y_pos = 0;
-                    if( y_pos >= height ) y_pos = height - 1;
-
-                    total += source[y_pos*width*channels + i*channels + c]*kernel[ky];
+					accumulator[n] += padding_value*weight;
 				}
-                if( total > 255 ) total = 255;
-                if( total < 0 ) total = 0;
-				destination[(j)*width*channels + (i)*channels + c] = (uchar)total;
+				continue;
+			}
+
+			S* row = source + (size_t)y_pos*row_length;
+			for( int n = 0; n < row_length; n++ )
+			{
+				accumulator[n] += row[n]*weight;
 			}
 		}
+
+		D* result_row = destination + (size_t)j*row_length;
+		for( int n = 0; n < row_length; n++ )
+		{
+			result_row[n] = PixelTraits<D>::FromDouble( accumulator[n] );
+		}
 	}
+	delete [] accumulator;
 }
 
-void
-ImageAlgorithms::TwoDConvo( uchar* source, uchar* destination, int width, int height, int channels, double* kernel, int kernel_size )
+template<typename S, typename D> void
+ImageAlgorithms::TwoDConvo( S* source, D* destination, int width, int height, int channels, const double* kernel, int kernel_size, BorderMode border, double border_value )
 ///
-/// Performs a 2D convolution using a given 2D kernel.
+/// Performs a 2D convolution using a given 2D kernel. Kernels that are (close to) low rank are
+/// handed over to SeparableConvo, and other large kernels to FFTConvo. All three round results
+/// to the nearest value, so they give the same pixels for the same kernel.
 ///
 /// @param source
 ///  The source image data.
 ///
 /// @param destination
 ///  The image data where the result is to be stored (must be the same dimensions as source).
+///  This can't be the same buffer as source.
 ///
 /// @param width
 ///  The width of the image.
@@ -142,44 +303,672 @@ ImageAlgorithms::TwoDConvo( uchar* source, uchar* destination, int width, int he
 /// @param kernel_size
 ///  The width and height of the given kernel i.e the kernel is an kernel_size * kernel_size array.
 ///
+/// @param border
+///  How pixels outside the image are synthesized. Clamp by default.
+///
+/// @param border_value
+///  The value of pixels outside the image when border is BORDER_CONSTANT.
+///
 /// @return
 ///  Nothing.
 ///
 {
+	// Low rank kernels (e.g. Sobel, gaussians, box filters) are cheaper as 1D passes
+	if( kernel_size > 1 )
+	{
+		std::vector<SeparableTerm> terms = KernelDecomposition::CachedDecompose( kernel, kernel_size );
+		int separable_taps = 2*kernel_size*(int)terms.size();
+		if( !terms.empty() && separable_taps < kernel_size*kernel_size && (kernel_size < FFT_CROSSOVER_KERNEL_SIZE || separable_taps <= SEPARABLE_MAX_TAPS) )
+		{
+			SeparableConvo( source, destination, width, height, channels, terms, border, border_value );
+			return;
+		}
+	}
+
+	if( kernel_size >= FFT_CROSSOVER_KERNEL_SIZE )
+	{
+		FFTConvo( source, destination, width, height, channels, kernel, kernel_size, border, border_value );
+		return;
+	}
+
+	int radius = kernel_size/2;
+	int row_length = width*channels;
+	int padded_length = (width + 2*radius)*channels;
+
+	// Pad every row once up front so none of the k*k taps need bounds checks.
+	S padding_value = PixelTraits<S>::FromDouble( border_value );
+	S* padded = new S[(size_t)padded_length*height];
+	S* constant_row = new S[padded_length];
 	for( int j = 0; j < height; j++ )
 	{
-		for( int i = 0; i < width; i++ )
+		PadRow( source + (size_t)j*row_length, padded + (size_t)j*padded_length, width, channels, radius, border, padding_value );
+	}
+	for( int n = 0; n < padded_length; n++ )
+	{
+		constant_row[n] = padding_value;
+	}
+
+	double* accumulator = new double[row_length];
+	for( int j = 0; j < height; j++ )
+	{
+		for( int n = 0; n < row_length; n++ )
 		{
-			for( int c = 0; c < channels; c++ )
+			accumulator[n] = 0.0;
+		}
+
+		for( int ky = 0; ky < kernel_size; ky++ )
+		{
+			int y_pos = BorderIndex( j + ky - radius, height, border );
+			S* row = y_pos == -1 ? constant_row : padded + (size_t)y_pos*padded_length;
+			for( int kx = 0; kx < kernel_size; kx++ )
+			{
+				double weight = kernel[ky*kernel_size + kx];
+				S* tap = row + kx*channels;
+				for( int n = 0; n < row_length; n++ )
+				{
+					accumulator[n] += tap[n]*weight;
+				}
+			}
+		}
+
+		D* result_row = destination + (size_t)j*row_length;
+		for( int n = 0; n < row_length; n++ )
+		{
+			result_row[n] = PixelTraits<D>::RoundDouble( accumulator[n] );
+		}
+	}
+	delete [] accumulator;
+	delete [] constant_row;
+	delete [] padded;
+}
+
+template<typename S, typename D> void
+ImageAlgorithms::SeparableConvo( S* source, D* destination, int width, int height, int channels, const std::vector<SeparableTerm>& terms, BorderMode border, double border_value )
+///
+/// Performs a 2D convolution with a kernel given as a sum of separable terms, running a
+/// horizontal and a vertical pass per term. Intermediate results are kept in float.
+///
+/// @param source
+///  The source image data.
+///
+/// @param destination
+///  The image data where the result is to be stored (must be the same dimensions as source).
+///  This can't be the same buffer as source.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels in the image.
+///
+/// @param terms
+///  The separable terms of the kernel, as returned by KernelDecomposition.
+///
+/// @param border
+///  How pixels outside the image are synthesized. Clamp by default.
+///
+/// @param border_value
+///  The value of pixels outside the image when border is BORDER_CONSTANT.
+///
+/// @return
+///  Nothing.
+///
+{
+	size_t size = (size_t)width*height*channels;
+	float* horizontal = new float[size];
+	float* vertical = new float[size];
+	float* total = terms.size() > 1 ? new float[size] : vertical;
+
+	for( size_t t = 0; t < terms.size(); t++ )
+	{
+		std::vector<double> horizontal_kernel = terms[t].horizontal;
+		std::vector<double> vertical_kernel = terms[t].vertical;
+		int kernel_size = (int)horizontal_kernel.size();
+
+		// Rows entirely outside the image come out of the horizontal pass as the constant
+		// scaled by the horizontal kernel's sum.
+		double horizontal_sum = 0.0;
+		for( int k = 0; k < kernel_size; k++ )
+		{
+			horizontal_sum += horizontal_kernel[k];
+		}
+
+		HorizontalConvo( source, horizontal, width, height, channels, &horizontal_kernel[0], kernel_size, border, border_value );
+		VerticalConvo( horizontal, vertical, width, height, channels, &vertical_kernel[0], kernel_size, border, border_value*horizontal_sum );
+		if( total != vertical )
+		{
+			for( size_t n = 0; n < size; n++ )
+			{
+				total[n] = t == 0 ? vertical[n] : total[n] + vertical[n];
+			}
+		}
+	}
+
+	// Rounded like TwoDConvo, so the decomposition's rounding noise doesn't show
+	for( size_t n = 0; n < size; n++ )
+	{
+		destination[n] = PixelTraits<D>::RoundDouble( total[n] );
+	}
+
+	if( total != vertical )
+	{
+		delete [] total;
+	}
+	delete [] vertical;
+	delete [] horizontal;
+}
+
+template<typename S, typename D> void
+ImageAlgorithms::FFTConvo( S* source, D* destination, int width, int height, int channels, const double* kernel, int kernel_size, BorderMode border, double border_value )
+///
+/// Performs the same 2D convolution as TwoDConvo in the frequency domain, which costs
+/// O(log n) per pixel instead of O(kernel_size^2). The image is processed in square tiles
+/// (overlap-save): each tile's input block overlaps its neighbours by the kernel size, and
+/// only the part of the block's circular convolution that isn't wrapped around is kept.
+/// Two channels are transformed at once, one in the real part and one in the imaginary part.
+///
+/// @param source
+///  The source image data.
+///
+/// @param destination
+///  The image data where the result is to be stored (must be the same dimensions as source).
+///  This can't be the same buffer as source.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels in the image.
+///
+/// @param kernel
+///  A pointer to the 2D kernel to be used for convolution.
+///
+/// @param kernel_size
+///  The width and height of the given kernel i.e the kernel is an kernel_size * kernel_size array.
+///
+/// @param border
+///  How pixels outside the image are synthesized. Clamp by default.
+///
+/// @param border_value
+///  The value of pixels outside the image when border is BORDER_CONSTANT.
+///
+/// @return
+///  Nothing.
+///
+{
+	typedef std::complex<double> complex_t;
+
+	int radius = kernel_size/2;
+	int fft_size = FFT::NextPowerOfTwo( 2*kernel_size );
+	if( fft_size < 64 ) fft_size = 64;
+	int tile_size = fft_size - kernel_size + 1;
+	int tiles_x = (width + tile_size - 1)/tile_size;
+	int tiles_y = (height + tile_size - 1)/tile_size;
+	FFT fft( fft_size );
+
+	// The spectrum of the kernel, flipped so that multiplying by it gives the same
+	// correlation the direct loops compute.
+	std::vector<complex_t> kernel_spectrum( (size_t)fft_size*fft_size );
+	for( int ky = 0; ky < kernel_size; ky++ )
+	{
+		for( int kx = 0; kx < kernel_size; kx++ )
+		{
+			kernel_spectrum[(size_t)ky*fft_size + kx] = kernel[(kernel_size - 1 - ky)*kernel_size + (kernel_size - 1 - kx)];
+		}
+	}
+	fft.Forward2D( &kernel_spectrum[0] );
+
+	// Map the padded block coordinates to image coordinates once
+	std::vector<int> x_map( tiles_x*tile_size + fft_size );
+	std::vector<int> y_map( tiles_y*tile_size + fft_size );
+	for( size_t x = 0; x < x_map.size(); x++ )
+	{
+		x_map[x] = BorderIndex( (int)x - radius, width, border );
+	}
+	for( size_t y = 0; y < y_map.size(); y++ )
+	{
+		y_map[y] = BorderIndex( (int)y - radius, height, border );
+	}
+
+	double padding_value = PixelTraits<S>::FromDouble( border_value );
+	std::vector<complex_t> block( (size_t)fft_size*fft_size );
+	for( int c = 0; c < channels; c += 2 )
+	{
+		bool pair = c + 1 < channels;
+		for( int ty = 0; ty < tiles_y; ty++ )
+		{
+			for( int tx = 0; tx < tiles_x; tx++ )
 			{
-				double total = 0.0;
-				for( int ky = 0; ky < kernel_size; ky++ )
+				for( int y = 0; y < fft_size; y++ )
 				{
-					for( int kx = 0; kx < kernel_size; kx++ )
+					int y_pos = y_map[ty*tile_size + y];
+					complex_t* block_row = &block[(size_t)y*fft_size];
+					for( int x = 0; x < fft_size; x++ )
 					{
-                    	int y_pos = j + ky - kernel_size/2;
-                    	if( y_pos < 0 ) y_pos = 0;
-                    	if( y_pos >= height ) y_pos = height - 1;
+						int x_pos = x_map[tx*tile_size + x];
+						if( x_pos == -1 || y_pos == -1 )
+						{
+							block_row[x] = complex_t( padding_value, pair ? padding_value : 0.0 );
+						}
+						else
+						{
+							S* pixel = source + ((size_t)y_pos*width + x_pos)*channels + c;
+							block_row[x] = complex_t( pixel[0], pair ? (double)pixel[1] : 0.0 );
+						}
+					}
+				}
 
-                    	int x_pos = i + kx - kernel_size/2;
-                    	if( x_pos < 0 ) x_pos = 0;
-                    	if( x_pos >= width ) x_pos = width - 1;
+				fft.Forward2D( &block[0] );
+				for( size_t n = 0; n < block.size(); n++ )
+				{
+					block[n] *= kernel_spectrum[n];
+				}
+				fft.Inverse2D( &block[0] );
 
-                    	total += source[y_pos*width*channels + x_pos*channels + c]*kernel[ky*kernel_size + kx];
+				// Keep the samples that didn't wrap around
+				for( int y = kernel_size - 1; y < fft_size; y++ )
+				{
+					int j = ty*tile_size + y - (kernel_size - 1);
+					if( j >= height ) break;
+					for( int x = kernel_size - 1; x < fft_size; x++ )
+					{
+						int i = tx*tile_size + x - (kernel_size - 1);
+						if( i >= width ) break;
+						complex_t value = block[(size_t)y*fft_size + x];
+						D* result = destination + ((size_t)j*width + i)*channels + c;
+						result[0] = PixelTraits<D>::RoundDouble( value.real() );
+						if( pair )
+						{
+							result[1] = PixelTraits<D>::RoundDouble( value.imag() );
+						}
 					}
 				}
-                if( total > 255 ) total = 255;
-                if( total < 0 ) total = 0;
-				destination[(j)*width*channels + (i)*channels + c] = (uchar)total;
 			}
 		}
 	}
 }
 
+// The convolutions are instantiated for every combination of 8 bit, 16 bit and float data so
+// multi pass filters can keep their intermediate results in float.
+#define INSTANTIATE_CONVOLUTIONS( S, D ) \
+	template void ImageAlgorithms::HorizontalConvo<S, D>( S*, D*, int, int, int, const double*, int, BorderMode, double ); \
+	template void ImageAlgorithms::VerticalConvo<S, D>( S*, D*, int, int, int, const double*, int, BorderMode, double ); \
+	template void ImageAlgorithms::TwoDConvo<S, D>( S*, D*, int, int, int, const double*, int, BorderMode, double ); \
+	template void ImageAlgorithms::FFTConvo<S, D>( S*, D*, int, int, int, const double*, int, BorderMode, double ); \
+	template void ImageAlgorithms::SeparableConvo<S, D>( S*, D*, int, int, int, const std::vector<SeparableTerm>&, BorderMode, double );
+
+INSTANTIATE_CONVOLUTIONS( uchar, uchar )
+INSTANTIATE_CONVOLUTIONS( uchar, ushort )
+INSTANTIATE_CONVOLUTIONS( uchar, float )
+INSTANTIATE_CONVOLUTIONS( ushort, uchar )
+INSTANTIATE_CONVOLUTIONS( ushort, ushort )
+INSTANTIATE_CONVOLUTIONS( ushort, float )
+INSTANTIATE_CONVOLUTIONS( float, uchar )
+INSTANTIATE_CONVOLUTIONS( float, ushort )
+INSTANTIATE_CONVOLUTIONS( float, float )
+
+template<typename A> void
+ImageAlgorithms::IntegralImage( const uchar* source, A* sums, int width, int height, int channels, bool squared )
+///
+/// Builds a summed-area table, from which the sum of any box of pixels takes four lookups
+/// however large the box is. Rows are summed in parallel, then columns.
+///
+/// @param source
+///  The image.
+///
+/// @param sums
+///  Receives the table: (width + 1)*(height + 1)*channels values, where the value at
+///  column i and row j is the sum of the pixels above and left of pixel (i, j) in each
+///  channel. The first row and column are zero. 32 bit sums serve boxes of up to
+///  MAX_BOX_AREA_32 pixels, and squared sums need 64 bits.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels that the image contains. Each is summed on its own.
+///
+/// @param squared
+///  Sums the squares of the pixels rather than the pixels.
+///
+/// @return
+///  Nothing.
+///
+{
+	size_t stride = (size_t)(width + 1)*channels;
+	std::fill( sums, sums + stride, (A)0 );
+
+	ParallelRanges::Run( height, MIN_PARALLEL_RANGE, [&]( int first, int last )
+	{
+		for( int j = first; j < last; j++ )
+		{
+			const uchar* row = source + (size_t)j*width*channels;
+			A* sum_row = sums + (j + 1)*stride;
+			std::fill( sum_row, sum_row + channels, (A)0 );
+			for( int i = 0; i < width*channels; i++ )
+			{
+				A value = row[i];
+				sum_row[i + channels] = sum_row[i] + (squared ? value*value : value);
+			}
+		}
+	} );
+
+	// Each row of sums adds the one above. Splitting by columns keeps each thread's part of
+	// a row contiguous.
+	ParallelRanges::Run( (int)stride, MIN_PARALLEL_RANGE, [&]( int first, int last )
+	{
+		for( int j = 1; j < height; j++ )
+		{
+			const A* above = sums + j*stride;
+			A* sum_row = sums + (j + 1)*stride;
+			for( int k = first; k < last; k++ )
+			{
+				sum_row[k] += above[k];
+			}
+		}
+	} );
+}
+
+template<typename A> A
+ImageAlgorithms::BoxSum( const A* sums, int width, int height, int channels, int channel, int left, int top, int right, int bottom )
+///
+/// Sums a box of pixels in one channel using a table from IntegralImage.
+///
+/// @param sums
+///  The table.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels that the image contains.
+///
+/// @param channel
+///  The channel to sum.
+///
+/// @param left
+///  The first column of the box.
+///
+/// @param top
+///  The first row of the box.
+///
+/// @param right
+///  One past the last column of the box.
+///
+/// @param bottom
+///  One past the last row of the box.
+///
+/// @return
+///  The sum of the pixels of the box that lie inside the image.
+///
+{
+	left = std::max( left, 0 );
+	top = std::max( top, 0 );
+	right = std::min( right, width );
+	bottom = std::min( bottom, height );
+	if( left >= right || top >= bottom )
+	{
+		return 0;
+	}
+
+	size_t stride = (size_t)(width + 1)*channels;
+	const A* top_row = sums + top*stride + channel;
+	const A* bottom_row = sums + bottom*stride + channel;
+	return bottom_row[right*channels] - bottom_row[left*channels] - top_row[right*channels] + top_row[left*channels];
+}
+
+static int64_t
+ClippedArea( int width, int height, int left, int top, int right, int bottom )
+///
+/// @return
+///  The number of pixels of a box that lie inside the image.
+///
+{
+	int64_t columns = std::min( right, width ) - std::max( left, 0 );
+	int64_t rows = std::min( bottom, height ) - std::max( top, 0 );
+	return columns > 0 && rows > 0 ? columns*rows : 0;
+}
+
+template<typename A> double
+ImageAlgorithms::BoxMean( const A* sums, int width, int height, int channels, int channel, int left, int top, int right, int bottom )
+///
+/// Averages a box of pixels in one channel using a table from IntegralImage. The
+/// arguments are as for BoxSum, and a 32 bit table only serves boxes of up to
+/// MAX_BOX_AREA_32 pixels.
+///
+/// @return
+///  The mean of the pixels of the box that lie inside the image. 0 if none do.
+///
+{
+	int64_t area = ClippedArea( width, height, left, top, right, bottom );
+	if( area == 0 )
+	{
+		return 0.0;
+	}
+	assert( sizeof(A) >= sizeof(uint64_t) || area <= (int64_t)MAX_BOX_AREA_32 );
+	return (double)BoxSum( sums, width, height, channels, channel, left, top, right, bottom )/area;
+}
+
+template<typename A> double
+ImageAlgorithms::BoxVariance( const A* sums, const uint64_t* squared_sums, int width, int height, int channels, int channel, int left, int top, int right, int bottom )
+///
+/// Finds the variance of a box of pixels in one channel using a table and a 64 bit
+/// squared table from IntegralImage. The other arguments are as for BoxMean.
+///
+/// @return
+///  The variance of the pixels of the box that lie inside the image. 0 if none do.
+///
+{
+	int64_t area = ClippedArea( width, height, left, top, right, bottom );
+	if( area == 0 )
+	{
+		return 0.0;
+	}
+	double mean = BoxMean( sums, width, height, channels, channel, left, top, right, bottom );
+	double mean_square = (double)BoxSum( squared_sums, width, height, channels, channel, left, top, right, bottom )/area;
+	return std::max( mean_square - mean*mean, 0.0 );
+}
+
+template void ImageAlgorithms::IntegralImage<uint32_t>( const uchar*, uint32_t*, int, int, int, bool );
+template void ImageAlgorithms::IntegralImage<uint64_t>( const uchar*, uint64_t*, int, int, int, bool );
+template uint32_t ImageAlgorithms::BoxSum<uint32_t>( const uint32_t*, int, int, int, int, int, int, int, int );
+template uint64_t ImageAlgorithms::BoxSum<uint64_t>( const uint64_t*, int, int, int, int, int, int, int, int );
+template double ImageAlgorithms::BoxMean<uint32_t>( const uint32_t*, int, int, int, int, int, int, int, int );
+template double ImageAlgorithms::BoxMean<uint64_t>( const uint64_t*, int, int, int, int, int, int, int, int );
+template double ImageAlgorithms::BoxVariance<uint32_t>( const uint32_t*, const uint64_t*, int, int, int, int, int, int, int, int );
+template double ImageAlgorithms::BoxVariance<uint64_t>( const uint64_t*, const uint64_t*, int, int, int, int, int, int, int, int );
+
+#ifdef FILTER_SIMD_X86
+
+// Multiplying a sum of three bytes by this and keeping the high 16 bits divides it by 3,
+// rounding down, for every sum up to 765
+#define DIVIDE_BY_3_MULTIPLIER 21846
+
+static FILTER_TARGET("sse2") inline __m128i
+AverageColorSSE2( __m128i pixels )
+///
+/// Averages the first three bytes of each four byte pixel.
+///
+/// @return
+///  The average of each pixel in the low byte of its 32 bit lane, the rest zero.
+///
+{
+	const __m128i low_byte = _mm_set1_epi32( 0xFF );
+	__m128i sum = _mm_add_epi32( _mm_and_si128( pixels, low_byte ), _mm_and_si128( _mm_srli_epi32( pixels, 8 ), low_byte ) );
+	sum = _mm_add_epi32( sum, _mm_and_si128( _mm_srli_epi32( pixels, 16 ), low_byte ) );
+	return _mm_mulhi_epu16( sum, _mm_set1_epi32( DIVIDE_BY_3_MULTIPLIER ) );
+}
+
+static FILTER_TARGET("avx2") inline __m256i
+AverageColorAVX2( __m256i pixels )
+///
+/// Averages the first three bytes of each four byte pixel.
+///
+/// @return
+///  The average of each pixel in the low byte of its 32 bit lane, the rest zero.
+///
+{
+	const __m256i low_byte = _mm256_set1_epi32( 0xFF );
+	__m256i sum = _mm256_add_epi32( _mm256_and_si256( pixels, low_byte ), _mm256_and_si256( _mm256_srli_epi32( pixels, 8 ), low_byte ) );
+	sum = _mm256_add_epi32( sum, _mm256_and_si256( _mm256_srli_epi32( pixels, 16 ), low_byte ) );
+	return _mm256_mulhi_epu16( sum, _mm256_set1_epi32( DIVIDE_BY_3_MULTIPLIER ) );
+}
+
+static FILTER_TARGET("sse2") int
+GrayScaleRowSSE2( const uchar* source, uchar* destination, int width )
+///
+/// Replaces the first three bytes of each four byte pixel in a row with their average and
+/// keeps the fourth, 4 pixels at a time.
+///
+/// @return
+///  The number of pixels processed. The caller handles the remaining tail.
+///
+{
+	const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+	int i = 0;
+	for( ; i + 4 <= width; i += 4 )
+	{
+		__m128i pixels = _mm_loadu_si128( (const __m128i*)(source + i*4) );
+		__m128i gray = AverageColorSSE2( pixels );
+		gray = _mm_or_si128( _mm_or_si128( gray, _mm_slli_epi32( gray, 8 ) ), _mm_slli_epi32( gray, 16 ) );
+		_mm_storeu_si128( (__m128i*)(destination + i*4), _mm_or_si128( gray, _mm_and_si128( pixels, alpha ) ) );
+	}
+	return i;
+}
+
+static FILTER_TARGET("sse2") int
+AverageRowSSE2( const uchar* source, uchar* destination, int width )
+///
+/// Averages the first three bytes of each four byte pixel in a row into one byte, 16
+/// pixels at a time.
+///
+/// @return
+///  The number of pixels processed. The caller handles the remaining tail.
+///
+{
+	int i = 0;
+	for( ; i + 16 <= width; i += 16 )
+	{
+		const __m128i* pixels = (const __m128i*)(source + i*4);
+		__m128i first = _mm_packs_epi32( AverageColorSSE2( _mm_loadu_si128( pixels ) ), AverageColorSSE2( _mm_loadu_si128( pixels + 1 ) ) );
+		__m128i second = _mm_packs_epi32( AverageColorSSE2( _mm_loadu_si128( pixels + 2 ) ), AverageColorSSE2( _mm_loadu_si128( pixels + 3 ) ) );
+		_mm_storeu_si128( (__m128i*)(destination + i), _mm_packus_epi16( first, second ) );
+	}
+	return i;
+}
+
+static FILTER_TARGET("avx2") int
+AverageRowAVX2( const uchar* source, uchar* destination, int width )
+///
+/// Averages the first three bytes of each four byte pixel in a row into one byte, 32
+/// pixels at a time. The packs work within 128 bit halves, so a final permute puts the
+/// pixels back in order.
+///
+/// @return
+///  The number of pixels processed. The caller handles the remaining tail.
+///
+{
+	const __m256i order = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+	int i = 0;
+	for( ; i + 32 <= width; i += 32 )
+	{
+		const __m256i* pixels = (const __m256i*)(source + i*4);
+		__m256i first = _mm256_packs_epi32( AverageColorAVX2( _mm256_loadu_si256( pixels ) ), AverageColorAVX2( _mm256_loadu_si256( pixels + 1 ) ) );
+		__m256i second = _mm256_packs_epi32( AverageColorAVX2( _mm256_loadu_si256( pixels + 2 ) ), AverageColorAVX2( _mm256_loadu_si256( pixels + 3 ) ) );
+		__m256i gray = _mm256_permutevar8x32_epi32( _mm256_packus_epi16( first, second ), order );
+		_mm256_storeu_si256( (__m256i*)(destination + i), gray );
+	}
+	return i;
+}
+
+static FILTER_TARGET("ssse3") int
+LumaRowSSSE3( const uchar* source, uchar* destination, int width, const short* weights )
+///
+/// Weighs the first three bytes of each four byte pixel in a row into one byte, 16 pixels
+/// at a time. Pixels are widened to 16 bits so that a multiply-add weighs the first two
+/// bytes and the third, and a horizontal add brings the two together.
+///
+/// @param weights
+///  The weight of each of the first three bytes, out of 1 << LUMA_SHIFT.
+///
+/// @return
+///  The number of pixels processed. The caller handles the remaining tail.
+///
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i pixel_weights = _mm_setr_epi16( weights[0], weights[1], weights[2], 0, weights[0], weights[1], weights[2], 0 );
+	const __m128i round = _mm_set1_epi32( 1 << (LUMA_SHIFT - 1) );
+	int i = 0;
+	for( ; i + 16 <= width; i += 16 )
+	{
+		__m128i luma[4];
+		for( int k = 0; k < 4; k++ )
+		{
+			__m128i pixels = _mm_loadu_si128( (const __m128i*)(source + (i + 4*k)*4) );
+			__m128i low = _mm_madd_epi16( _mm_unpacklo_epi8( pixels, zero ), pixel_weights );
+			__m128i high = _mm_madd_epi16( _mm_unpackhi_epi8( pixels, zero ), pixel_weights );
+			luma[k] = _mm_srli_epi32( _mm_add_epi32( _mm_hadd_epi32( low, high ), round ), LUMA_SHIFT );
+		}
+		_mm_storeu_si128( (__m128i*)(destination + i), _mm_packus_epi16( _mm_packs_epi32( luma[0], luma[1] ), _mm_packs_epi32( luma[2], luma[3] ) ) );
+	}
+	return i;
+}
+
+static FILTER_TARGET("sse2") int
+AddRowSSE2( const uchar* first, const uchar* second, uchar* result, int count )
+///
+/// Adds two rows of bytes with saturation, 16 at a time.
+///
+/// @return
+///  The number of bytes processed. The caller handles the remaining tail.
+///
+{
+	int i = 0;
+	for( ; i + 16 <= count; i += 16 )
+	{
+		__m128i sum = _mm_adds_epu8( _mm_loadu_si128( (const __m128i*)(first + i) ), _mm_loadu_si128( (const __m128i*)(second + i) ) );
+		_mm_storeu_si128( (__m128i*)(result + i), sum );
+	}
+	return i;
+}
+
+static FILTER_TARGET("avx2") int
+AddRowAVX2( const uchar* first, const uchar* second, uchar* result, int count )
+///
+/// Adds two rows of bytes with saturation, 32 at a time.
+///
+/// @return
+///  The number of bytes processed. The caller handles the remaining tail.
+///
+{
+	int i = 0;
+	for( ; i + 32 <= count; i += 32 )
+	{
+		__m256i sum = _mm256_adds_epu8( _mm256_loadu_si256( (const __m256i*)(first + i) ), _mm256_loadu_si256( (const __m256i*)(second + i) ) );
+		_mm256_storeu_si256( (__m256i*)(result + i), sum );
+	}
+	return i;
+}
+
+#endif
+
 void
 ImageAlgorithms::GrayScale(uchar* source, uchar* destination, int width, int height, int channels, int alpha_channel )
 ///
-/// Converts an RGB image to gray scale by averaging each color component while retaining the same number of channels.
+/// Converts an RGB image to gray scale by averaging each color component, rounding down, while retaining the same
+/// number of channels. source and destination may be the same buffer.
 ///
 /// @param source
 ///  The image to be converted.
@@ -203,31 +992,36 @@ ImageAlgorithms::GrayScale(uchar* source, uchar* destination, int width, int hei
 ///  Nothing.
 ///
 {
+	// An alpha index outside the pixel means the image has no alpha, e.g. one channel images
+	if( alpha_channel >= channels ) alpha_channel = -1;
+	int color_channels = alpha_channel == -1 ? channels : channels - 1;
+
 	for( int j = 0; j < height; j++ )
 	{
-		for( int i = 0; i < width; i++ )
+		const uchar* row = source + (size_t)j*width*channels;
+		uchar* result_row = destination + (size_t)j*width*channels;
+		int i = 0;
+#ifdef FILTER_SIMD_X86
+		if( channels == 4 && alpha_channel == 3 && CpuFeatures::HasSSE2() )
+		{
+			i = GrayScaleRowSSE2( row, result_row, width );
+		}
+#endif
+		for( ; i < width; i++ )
 		{
-			double average = 0;
+			const uchar* pixel = row + i*channels;
+			int sum = 0;
 			for( int c = 0; c < channels; c++ )
 			{
-				if( c%channels != alpha_channel || alpha_channel == -1 ) // don't include the alpha channel
+				if( c != alpha_channel ) // don't include the alpha channel
 				{
-					average += source[j*width*channels + i*channels + c];
+					sum += pixel[c];
 				}
 			}
-			average /= alpha_channel == - 1 ? channels : channels - 1;
-			if( average > 255 ) average = 255;
-			if( average < 0 ) average = 0;
+			uchar average = (uchar)(sum/color_channels);
 			for( int c = 0; c < channels; c++ )
 			{
-				if( c%channels != alpha_channel || alpha_channel == -1 ) // don't include the alpha channel
-				{
-					destination[j*width*channels + i*channels + c] = (uchar)average;
-				}
-				else
-				{
-					destination[j*width*channels + i*channels + c] = source[j*width*channels + i*channels + c];
-				}
+				result_row[i*channels + c] = c == alpha_channel ? pixel[c] : average;
 			}
 		}
 	}
@@ -236,7 +1030,8 @@ ImageAlgorithms::GrayScale(uchar* source, uchar* destination, int width, int hei
 void
 ImageAlgorithms::ConvertToOneChannel(uchar *source, uchar *destination, int width, int height, int channels, int alpha_channel)
 ///
-/// Converts a multichannel image to a one channel image by averaging each color component excluding the alpha channel.
+/// Converts a multichannel image to a one channel image by averaging each color component excluding the alpha channel,
+/// rounding down.
 ///
 /// @param source
 ///  The image to be converted.
@@ -260,22 +1055,119 @@ ImageAlgorithms::ConvertToOneChannel(uchar *source, uchar *destination, int widt
 ///  Nothing.
 ///
 {
+	if( alpha_channel >= channels ) alpha_channel = -1;
+	int color_channels = alpha_channel == -1 ? channels : channels - 1;
+
+	if( color_channels == 1 && channels == 1 )
+	{
+		memcpy( destination, source, (size_t)width*height );
+		return;
+	}
+
 	for( int j = 0; j < height; j++ )
 	{
-		for( int i = 0; i < width; i++ )
+		const uchar* row = source + (size_t)j*width*channels;
+		uchar* result_row = destination + (size_t)j*width;
+		int i = 0;
+#ifdef FILTER_SIMD_X86
+		if( channels == 4 && alpha_channel == 3 )
 		{
-			double average = 0.0;
+			if( CpuFeatures::HasAVX2() )
+			{
+				i = AverageRowAVX2( row, result_row, width );
+			}
+			else if( CpuFeatures::HasSSE2() )
+			{
+				i = AverageRowSSE2( row, result_row, width );
+			}
+		}
+#endif
+		for( ; i < width; i++ )
+		{
+			const uchar* pixel = row + i*channels;
+			int sum = 0;
 			for( int c = 0; c < channels; c++ )
 			{
-				if( c%channels != alpha_channel || alpha_channel == -1) // don't include the alpha channel
+				if( c != alpha_channel ) // don't include the alpha channel
 				{
-					average += source[j*width*channels + i*channels + c];
+					sum += pixel[c];
 				}
 			}
-			average /= alpha_channel == -1 ? channels : channels - 1;
-			if( average < 0 ) average = 0;
-			if( average > 255 ) average = 255;
-			destination[j*width + i] = average;
+			result_row[i] = (uchar)(sum/color_channels);
+		}
+	}
+}
+
+void
+ImageAlgorithms::ConvertToLuma( uchar* source, uchar* destination, int width, int height, LumaStandard standard, int channels, bool blue_first )
+///
+/// Converts a color image to a one channel image of its luma, the weighted sum of its color
+/// components that matches how bright they look, in integer arithmetic rounded to nearest.
+///
+/// @param source
+///  The image to be converted. Its first three channels are the colors.
+///
+/// @param destination
+///  The image that will store the resulting one channel image.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param standard
+///  The standard whose weights are used. LUMA_BT601 by default.
+///
+/// @param channels
+///  The number of channels that the source image contains, 3 or 4. 4 by default. One
+///  channel images are copied.
+///
+/// @param blue_first
+///  True if the colors are in BGR order rather than RGB. False by default.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( channels < 3 )
+	{
+		for( size_t i = 0; i < (size_t)width*height; i++ )
+		{
+			destination[i] = source[i*channels];
+		}
+		return;
+	}
+
+	// Red, green and blue weights out of 1 << LUMA_SHIFT, rounded so that each set adds up to
+	// exactly that and white stays white
+	static const short LUMA_WEIGHTS[2][3] =
+	{
+		{ 9798, 19235, 3735 },		// 0.299, 0.587, 0.114
+		{ 6966, 23436, 2366 }		// 0.2126, 0.7152, 0.0722
+	};
+	short weights[3];
+	for( int c = 0; c < 3; c++ )
+	{
+		weights[c] = LUMA_WEIGHTS[standard][blue_first ? 2 - c : c];
+	}
+
+	for( int j = 0; j < height; j++ )
+	{
+		const uchar* row = source + (size_t)j*width*channels;
+		uchar* result_row = destination + (size_t)j*width;
+		int i = 0;
+#ifdef FILTER_SIMD_X86
+		if( channels == 4 && CpuFeatures::HasSSSE3() )
+		{
+			i = LumaRowSSSE3( row, result_row, width, weights );
+		}
+#endif
+		for( ; i < width; i++ )
+		{
+			const uchar* pixel = row + i*channels;
+			int luma = weights[0]*pixel[0] + weights[1]*pixel[1] + weights[2]*pixel[2];
+			result_row[i] = (uchar)((luma + (1 << (LUMA_SHIFT - 1))) >> LUMA_SHIFT);
 		}
 	}
 }
@@ -308,21 +1200,25 @@ ImageAlgorithms::ConvertFromOneChannel(uchar *source, uchar *destination, int wi
 ///  Nothing.
 ///
 {
-	for( int j = 0; j < height; j++ )
+	if( alpha_channel >= channels ) alpha_channel = -1;
+
+	if( channels == 1 && alpha_channel == -1 )
 	{
-		for( int i = 0; i < width; i++ )
+		memcpy( destination, source, (size_t)width*height );
+		return;
+	}
+	if( channels == 4 && alpha_channel == 3 )
+	{
+		// The same layout as gray pixels egressed to RGBA, which has its own SIMD path
+		PixelConversion::ExpandGray( source, width, destination, width*4, width, height );
+		return;
+	}
+
+	for( size_t i = 0; i < (size_t)width*height; i++ )
+	{
+		for( int c = 0; c < channels; c++ )
 		{
-			for( int c = 0; c < channels; c++ )
-			{
-				if( c%channels != alpha_channel || alpha_channel == -1 ) // don't include the alpha channel
-				{
-					destination[j*width*channels + i*channels + c] = source[j*width + i];
-				}
-				else
-				{
-					destination[j*width*channels + i*channels + c] = 255;
-				}
-			}
+			destination[i*channels + c] = c == alpha_channel ? 255 : source[i];
 		}
 	}
 }
@@ -339,7 +1235,7 @@ ImageAlgorithms::AddImages(uchar *image1, uchar *image2, uchar *result, int widt
 ///  The second image to be added.
 ///
 /// @param result
-///  The image that results from adding the two images.
+///  The image that results from adding the two images. May be either of the images.
 ///
 /// @param width
 ///  The width of the images.
@@ -354,18 +1250,25 @@ ImageAlgorithms::AddImages(uchar *image1, uchar *image2, uchar *result, int widt
 ///  Nothing.
 ///
 {
+	int row_bytes = width*channels;
 	for( int j = 0; j < height; j++ )
 	{
-		for( int i = 0; i < width; i++ )
+		size_t offset = (size_t)j*row_bytes;
+		int i = 0;
+#ifdef FILTER_SIMD_X86
+		if( CpuFeatures::HasAVX2() )
 		{
-			for( int c = 0; c < channels; c++ )
-			{
-				int pixel = j*width*channels + i*channels + c;
-				int total = image1[pixel] + image2[pixel];
-				if( total < 0 ) total = 0;
-				if( total > 255 ) total = 255;
-				result[pixel] = total;
-			}
+			i = AddRowAVX2( image1 + offset, image2 + offset, result + offset, row_bytes );
+		}
+		else if( CpuFeatures::HasSSE2() )
+		{
+			i = AddRowSSE2( image1 + offset, image2 + offset, result + offset, row_bytes );
+		}
+#endif
+		for( ; i < row_bytes; i++ )
+		{
+			int total = image1[offset + i] + image2[offset + i];
+			result[offset + i] = (uchar)std::min( total, 255 );
 		}
 	}
 }
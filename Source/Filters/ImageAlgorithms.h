@@ -1,17 +1,63 @@
 #ifndef _IMAGE_ALGORITHMS_H_
 #define _IMAGE_ALGORITHMS_H_
 
+#include <stdint.h>
+#include <vector>
+
 #include "Filter.h"
+#include "KernelDecomposition.h"
+
+// How convolutions synthesize the pixels outside the image.
+enum BorderMode
+{
+	BORDER_CLAMP,		// repeat the edge pixel
+	BORDER_REFLECT,		// mirror about the edge pixel
+	BORDER_WRAP,		// continue from the opposite edge
+	BORDER_CONSTANT		// use a fixed value
+};
+
+// Which weights ConvertToLuma gives the color components.
+enum LumaStandard
+{
+	LUMA_BT601,			// standard definition video, and most gray conversions
+	LUMA_BT709			// HD video and sRGB
+};
+
+// The largest box of 8 bit pixels whose sum fits in a 32 bit summed-area table
+#define MAX_BOX_AREA_32 (UINT32_MAX/255)
 
 class ImageAlgorithms
 {
 	public:
-		static void HorizontalConvo( uchar* source, uchar* destination, int width, int height, int channels, double* kernel, int kernel_size );
-		static void VerticalConvo( uchar* source, uchar* destination, int width, int height, int channels, double* kernel, int kernel_size );
-		static void TwoDConvo( uchar* source, uchar* destination, int width, int height, int channels, double* kernel, int kernel_size );
+		static int BorderIndex( int position, int size, BorderMode border );
+
+		template<typename S, typename D>
+		static void HorizontalConvo( S* source, D* destination, int width, int height, int channels, const double* kernel, int kernel_size, BorderMode border = BORDER_CLAMP, double border_value = 0.0 );
+		template<typename S, typename D>
+		static void VerticalConvo( S* source, D* destination, int width, int height, int channels, const double* kernel, int kernel_size, BorderMode border = BORDER_CLAMP, double border_value = 0.0 );
+		template<typename S, typename D>
+		static void TwoDConvo( S* source, D* destination, int width, int height, int channels, const double* kernel, int kernel_size, BorderMode border = BORDER_CLAMP, double border_value = 0.0 );
+		template<typename S, typename D>
+		static void SeparableConvo( S* source, D* destination, int width, int height, int channels, const std::vector<SeparableTerm>& terms, BorderMode border = BORDER_CLAMP, double border_value = 0.0 );
+		template<typename S, typename D>
+		static void FFTConvo( S* source, D* destination, int width, int height, int channels, const double* kernel, int kernel_size, BorderMode border = BORDER_CLAMP, double border_value = 0.0 );
+
+		// Summed-area tables. Unsigned sums wrap around, but a box sum is the difference of
+		// four of them and comes out exact as long as the box's own sum fits: 32 bits hold
+		// the sum of any box of up to MAX_BOX_AREA_32 8 bit pixels, 64 bits any box's sum
+		// and squared sum.
+		template<typename A>
+		static void IntegralImage( const uchar* source, A* sums, int width, int height, int channels, bool squared = false );
+		template<typename A>
+		static A BoxSum( const A* sums, int width, int height, int channels, int channel, int left, int top, int right, int bottom );
+		template<typename A>
+		static double BoxMean( const A* sums, int width, int height, int channels, int channel, int left, int top, int right, int bottom );
+		template<typename A>
+		static double BoxVariance( const A* sums, const uint64_t* squared_sums, int width, int height, int channels, int channel, int left, int top, int right, int bottom );
 
 		static void GrayScale( uchar* source, uchar* destination, int width, int height, int channels = 4, int alpha_channel = 3);
 		static void ConvertToOneChannel( uchar* source, uchar* destination, int width, int height, int channels = 4, int alpha_channel = 3);
+		static void ConvertToLuma( uchar* source, uchar* destination, int width, int height, LumaStandard standard = LUMA_BT601, int channels = 4, bool blue_first = false );
 		static void ConvertFromOneChannel( uchar* source, uchar* destination, int width, int height, int channels = 4, int alpha_channel = 3);
 		static void AddImages(uchar* image1, uchar* image2, uchar* result, int width, int height, int channels = 4);
 
@@ -0,0 +1,394 @@
+///
+/// A lazily built gaussian pyramid of reduced resolution copies of an image, with the
+/// 2x reduce and expand kernels used to build and collapse it. Used for fast zoomed out
+/// display and for running large scale filters at a coarser level.
+///
+
+#include "ImagePyramid.h"
+#include "ImageAlgorithms.h"
+#include "KernelCache.h"
+
+#include <math.h>
+#include <string.h>
+
+static inline int
+Clamp( int value, int low, int high )
+{
+	return value < low ? low : (value > high ? high : value);
+}
+
+ImagePyramid::ImagePyramid( uchar* source, int width, int height, int channels )
+///
+/// Constructor. No levels are computed until they are asked for.
+///
+/// @param source
+///  The full resolution image. It is not copied and must outlive the pyramid.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels in the image.
+///
+: mChannels( channels )
+{
+	mLevels.push_back( source );
+	mWidths.push_back( width );
+	mHeights.push_back( height );
+	while( width > 1 || height > 1 )
+	{
+		width = (width + 1)/2;
+		height = (height + 1)/2;
+		mLevels.push_back( NULL );
+		mWidths.push_back( width );
+		mHeights.push_back( height );
+	}
+}
+
+ImagePyramid::~ImagePyramid()
+///
+/// Destructor.
+///
+{
+	for( size_t level = 1; level < mLevels.size(); level++ )
+	{
+		delete [] mLevels[level];
+	}
+}
+
+int
+ImagePyramid::LevelCount() const
+///
+/// @return
+///  The number of levels, including the full resolution image, down to a single pixel.
+///
+{
+	return (int)mLevels.size();
+}
+
+int
+ImagePyramid::LevelWidth( int level ) const
+///
+/// @return
+///  The width of the given level.
+///
+{
+	return mWidths[level];
+}
+
+int
+ImagePyramid::LevelHeight( int level ) const
+///
+/// @return
+///  The height of the given level.
+///
+{
+	return mHeights[level];
+}
+
+int
+ImagePyramid::Channels() const
+///
+/// @return
+///  The number of color channels in every level.
+///
+{
+	return mChannels;
+}
+
+uchar*
+ImagePyramid::Level( int level )
+///
+/// Returns a level of the pyramid, building it and any missing levels above it first.
+/// Levels are cached for the lifetime of the pyramid. Not thread safe.
+///
+/// @param level
+///  The level to return. Level 0 is the full resolution image, each further level is half the size.
+///
+/// @return
+///  The image data for the level.
+///
+{
+	if( mLevels[level] == NULL )
+	{
+		uchar* parent = Level( level - 1 );
+		mLevels[level] = new uchar[mWidths[level]*mHeights[level]*mChannels];
+		Reduce( parent, mLevels[level], mWidths[level - 1], mHeights[level - 1], mChannels );
+	}
+	return mLevels[level];
+}
+
+int
+ImagePyramid::LevelCountFor( int width, int height )
+///
+/// @param width
+///  The width of an image.
+///
+/// @param height
+///  The height of an image.
+///
+/// @return
+///  The number of levels a pyramid of the image has, down to a single pixel, without
+///  making one.
+///
+{
+	int level_count = 1;
+	while( width > 1 || height > 1 )
+	{
+		width = (width + 1)/2;
+		height = (height + 1)/2;
+		level_count++;
+	}
+	return level_count;
+}
+
+int
+ImagePyramid::ChooseLevel( double scale, int level_count )
+///
+/// Picks the smallest level that still has at least the requested resolution.
+///
+/// @param scale
+///  The scale the image will be shown or processed at, relative to full resolution.
+///
+/// @param level_count
+///  The number of levels available.
+///
+/// @return
+///  The level to use.
+///
+{
+	int level = 0;
+	while( level + 1 < level_count && scale <= 1.0/(1 << (level + 1)) )
+	{
+		level++;
+	}
+	return level;
+}
+
+void
+ImagePyramid::Reduce( uchar* source, uchar* destination, int width, int height, int channels )
+///
+/// Blurs an image with a 5 tap binomial kernel and halves its size. Only the samples
+/// that survive the decimation are computed.
+///
+/// @param source
+///  The image to be reduced.
+///
+/// @param destination
+///  The image data where the result is stored. Must be (width + 1)/2 by (height + 1)/2.
+///
+/// @param width
+///  The width of the source image.
+///
+/// @param height
+///  The height of the source image.
+///
+/// @param channels
+///  The number of color channels in the image.
+///
+/// @return
+///  Nothing.
+///
+{
+	int half_width = (width + 1)/2;
+	int half_height = (height + 1)/2;
+	int half_row = half_width*channels;
+
+	// Horizontal pass. The weights 1 4 6 4 1 sum to 16 so every value fits in 16 bits.
+	ushort* horizontal = new ushort[half_row*height];
+	for( int j = 0; j < height; j++ )
+	{
+		uchar* row = source + (size_t)j*width*channels;
+		ushort* result_row = horizontal + (size_t)j*half_row;
+		for( int i = 0; i < half_width; i++ )
+		{
+			int x = 2*i;
+			int x0 = Clamp( x - 2, 0, width - 1 )*channels;
+			int x1 = Clamp( x - 1, 0, width - 1 )*channels;
+			int x2 = Clamp( x, 0, width - 1 )*channels;
+			int x3 = Clamp( x + 1, 0, width - 1 )*channels;
+			int x4 = Clamp( x + 2, 0, width - 1 )*channels;
+			for( int c = 0; c < channels; c++ )
+			{
+				result_row[i*channels + c] = row[x0 + c] + 4*row[x1 + c] + 6*row[x2 + c] + 4*row[x3 + c] + row[x4 + c];
+			}
+		}
+	}
+
+	// Vertical pass over whole rows. The total weight is 256, so round and shift.
+	for( int j = 0; j < half_height; j++ )
+	{
+		int y = 2*j;
+		ushort* r0 = horizontal + (size_t)Clamp( y - 2, 0, height - 1 )*half_row;
+		ushort* r1 = horizontal + (size_t)Clamp( y - 1, 0, height - 1 )*half_row;
+		ushort* r2 = horizontal + (size_t)Clamp( y, 0, height - 1 )*half_row;
+		ushort* r3 = horizontal + (size_t)Clamp( y + 1, 0, height - 1 )*half_row;
+		ushort* r4 = horizontal + (size_t)Clamp( y + 2, 0, height - 1 )*half_row;
+		uchar* result_row = destination + (size_t)j*half_row;
+		for( int n = 0; n < half_row; n++ )
+		{
+			result_row[n] = (uchar)((r0[n] + 4*r1[n] + 6*r2[n] + 4*r3[n] + r4[n] + 128) >> 8);
+		}
+	}
+
+	delete [] horizontal;
+}
+
+void
+ImagePyramid::Expand( uchar* source, int width, int height, uchar* destination, int destination_width, int destination_height, int channels )
+///
+/// Doubles the size of an image by interpolating with the same binomial kernel used by Reduce.
+///
+/// @param source
+///  The image to be expanded.
+///
+/// @param width
+///  The width of the source image.
+///
+/// @param height
+///  The height of the source image.
+///
+/// @param destination
+///  The image data where the result is stored.
+///
+/// @param destination_width
+///  The width of the result, at most twice the source width (usually the width of the next finer level).
+///
+/// @param destination_height
+///  The height of the result, at most twice the source height.
+///
+/// @param channels
+///  The number of color channels in the image.
+///
+/// @return
+///  Nothing.
+///
+{
+	int row_length = destination_width*channels;
+
+	// Horizontal pass. Even samples weigh 1 6 1, odd samples 4 4, so each sums to 8.
+	ushort* horizontal = new ushort[row_length*height];
+	for( int j = 0; j < height; j++ )
+	{
+		uchar* row = source + (size_t)j*width*channels;
+		ushort* result_row = horizontal + (size_t)j*row_length;
+		for( int i = 0; i < destination_width; i++ )
+		{
+			int k = i/2;
+			int left = Clamp( k - 1, 0, width - 1 )*channels;
+			int centre = Clamp( k, 0, width - 1 )*channels;
+			int right = Clamp( k + 1, 0, width - 1 )*channels;
+			for( int c = 0; c < channels; c++ )
+			{
+				if( i % 2 == 0 )
+				{
+					result_row[i*channels + c] = row[left + c] + 6*row[centre + c] + row[right + c];
+				}
+				else
+				{
+					result_row[i*channels + c] = 4*(row[centre + c] + row[right + c]);
+				}
+			}
+		}
+	}
+
+	// Vertical pass over whole rows. The total weight is 64, so round and shift.
+	for( int j = 0; j < destination_height; j++ )
+	{
+		int k = j/2;
+		ushort* above = horizontal + (size_t)Clamp( k - 1, 0, height - 1 )*row_length;
+		ushort* centre = horizontal + (size_t)Clamp( k, 0, height - 1 )*row_length;
+		ushort* below = horizontal + (size_t)Clamp( k + 1, 0, height - 1 )*row_length;
+		uchar* result_row = destination + (size_t)j*row_length;
+		if( j % 2 == 0 )
+		{
+			for( int n = 0; n < row_length; n++ )
+			{
+				result_row[n] = (uchar)((above[n] + 6*centre[n] + below[n] + 32) >> 6);
+			}
+		}
+		else
+		{
+			for( int n = 0; n < row_length; n++ )
+			{
+				result_row[n] = (uchar)((4*(centre[n] + below[n]) + 32) >> 6);
+			}
+		}
+	}
+
+	delete [] horizontal;
+}
+
+void
+ImagePyramid::Blur( uchar* source, uchar* destination, int width, int height, int channels, double sigma )
+///
+/// Approximates a large gaussian blur by reducing the image to the coarsest level that
+/// can still represent the blur, blurring the remainder there and expanding back up.
+/// Every level skipped cuts the work of the blur by 4x.
+///
+/// @param source
+///  The image to be blurred.
+///
+/// @param destination
+///  The image data where the result is to be stored (must be the same dimensions as source).
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels in the image.
+///
+/// @param sigma
+///  The standard deviation of the blur in full resolution pixels.
+///
+/// @return
+///  Nothing.
+///
+{
+	ImagePyramid pyramid( source, width, height, channels );
+
+	// Each reduce, and the matching expand, adds a blur of variance 1 at the finer of its two
+	// levels, i.e. 4^level full resolution pixels. Stop going down once less than one coarse
+	// pixel of blur would be left to apply.
+	int level = 0;
+	double pyramid_variance = 0.0;
+	while( level + 1 < pyramid.LevelCount() && pyramid.LevelWidth( level + 1 ) >= 8 && pyramid.LevelHeight( level + 1 ) >= 8 )
+	{
+		double next_variance = pyramid_variance + 2.0*pow( 4.0, level );
+		if( sigma*sigma - next_variance < pow( 4.0, level + 1 ) )
+		{
+			break;
+		}
+		pyramid_variance = next_variance;
+		level++;
+	}
+
+	int level_width = pyramid.LevelWidth( level );
+	int level_height = pyramid.LevelHeight( level );
+	int level_size = level_width*level_height*channels;
+
+	double residual_sigma = sqrt( sigma*sigma - pyramid_variance )/(1 << level);
+	kernel_ptr kernel = KernelCache::Gaussian( residual_sigma > 0.0 ? residual_sigma : 0.5 );
+
+	uchar* blurred = level == 0 ? destination : new uchar[level_size];
+	float* horizontal = new float[level_size];
+	ImageAlgorithms::HorizontalConvo( pyramid.Level( level ), horizontal, level_width, level_height, channels, &(*kernel)[0], (int)kernel->size() );
+	ImageAlgorithms::VerticalConvo( horizontal, blurred, level_width, level_height, channels, &(*kernel)[0], (int)kernel->size() );
+	delete [] horizontal;
+
+	// Collapse back to full resolution
+	while( level > 0 )
+	{
+		uchar* finer = level == 1 ? destination : new uchar[pyramid.LevelWidth( level - 1 )*pyramid.LevelHeight( level - 1 )*channels];
+		Expand( blurred, pyramid.LevelWidth( level ), pyramid.LevelHeight( level ), finer, pyramid.LevelWidth( level - 1 ), pyramid.LevelHeight( level - 1 ), channels );
+		delete [] blurred;
+		blurred = finer;
+		level--;
+	}
+}
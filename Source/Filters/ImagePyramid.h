@@ -0,0 +1,38 @@
+#ifndef _IMAGE_PYRAMID_H_
+#define _IMAGE_PYRAMID_H_
+
+#include <vector>
+
+#include "Filter.h"
+
+class ImagePyramid
+{
+	public:
+		ImagePyramid( uchar* source, int width, int height, int channels );
+		~ImagePyramid();
+
+		int LevelCount() const;
+		int LevelWidth( int level ) const;
+		int LevelHeight( int level ) const;
+		int Channels() const;
+		uchar* Level( int level );
+
+		static int LevelCountFor( int width, int height );
+		static int ChooseLevel( double scale, int level_count );
+
+		static void Reduce( uchar* source, uchar* destination, int width, int height, int channels );
+		static void Expand( uchar* source, int width, int height, uchar* destination, int destination_width, int destination_height, int channels );
+		static void Blur( uchar* source, uchar* destination, int width, int height, int channels, double sigma );
+
+	private:
+		// Levels point into memory owned by the pyramid, except level 0 which is the caller's source.
+		ImagePyramid( const ImagePyramid& );
+		ImagePyramid& operator=( const ImagePyramid& );
+
+		std::vector<uchar*> mLevels;
+		std::vector<int> mWidths;
+		std::vector<int> mHeights;
+		int mChannels;
+};
+
+#endif
@@ -5,6 +5,61 @@
 ///
 
 #include "InvertFilter.h"
+#include "LookupTable.h"
+#include "PixelTraits.h"
+
+template<typename T> static T*
+Invert( T* source, int width, int height, int channels )
+///
+/// Inverts a high bit depth image in place. 8 bit images go through a lookup table instead.
+///
+{
+	T max_value = (T)PixelTraits<T>::MaxValue();
+	int alpha_channel = channels == 4 ? 3 : -1;
+	for( int j = 0; j < height; j++ )
+	{
+		T* row = source + (size_t)j*width*channels;
+		for( int i = 0; i < width; i++ )
+		{
+			for( int c = 0; c < channels; c++ )
+			{
+				if( c != alpha_channel )
+				{
+					row[i*channels + c] = max_value - row[i*channels + c];
+				}
+			}
+		}
+	}
+	return source;
+}
+
+FilterCapabilities
+InvertFilter::Capabilities() const
+///
+/// @return
+///  A pointwise filter that works in place on every pixel type, vectorized through the
+///  lookup table for 8 bit images.
+///
+{
+	FilterCapabilities capabilities;
+	capabilities.halo = 0;
+	capabilities.pointwise = true;
+	capabilities.in_place = true;
+	capabilities.per_channel = true;
+	capabilities.formats = FILTER_FORMAT_GRAY8 | FILTER_FORMAT_RGBA8 | FILTER_FORMAT_RGBA16 | FILTER_FORMAT_FLOAT;
+	capabilities.simd = FILTER_SIMD_SSSE3 | FILTER_SIMD_AVX2;
+	return capabilities;
+}
+
+size_t
+InvertFilter::WorkingSetBytes( int, int, int ) const
+///
+/// @return
+///  Nothing, as the image is inverted in place.
+///
+{
+	return 0;
+}
 
 uchar*
 InvertFilter::RunFilter( uchar* source, int width, int height, int channels )
@@ -24,20 +79,29 @@ InvertFilter::RunFilter( uchar* source, int width, int height, int channels )
 ///  The number of color channels that the image contains.
 ///
 /// @return
-///  The image resulting from the inversion in the same size and format as source.
+///  The source, inverted in place.
 ///
 {
-	uchar* result = new uchar[width*height*channels];
-	for( int i = 0; i < width*height*channels; i++ )
-	{
-		if( i%4 != 3 ) // alpha
-		{
-			result[i] = 255 - source[i];
-		}
-		else
-		{
-			result[i] = source[i];
-		}
-	}
-	return result;
+	// Four channel images carry alpha in the last channel, which is left as is.
+	LookupTable::Invert().Apply( source, source, width, height, channels, channels == 4 ? 3 : -1 );
+
+	return source;
+}
+
+ushort*
+InvertFilter::RunFilter16( ushort* source, int width, int height, int channels )
+///
+/// 16 bit version of RunFilter.
+///
+{
+	return Invert( source, width, height, channels );
+}
+
+float*
+InvertFilter::RunFilterFloat( float* source, int width, int height, int channels )
+///
+/// Floating point version of RunFilter. Values are expected in the range 0 to 1.
+///
+{
+	return Invert( source, width, height, channels );
 }
\ No newline at end of file
@@ -6,7 +6,12 @@
 class InvertFilter : public Filter
 {
 	public:
+		FilterCapabilities Capabilities() const;
+		size_t WorkingSetBytes( int width, int height, int channels ) const;
+
 		uchar* RunFilter( uchar* source, int width, int height, int channels );
+		ushort* RunFilter16( ushort* source, int width, int height, int channels );
+		float* RunFilterFloat( float* source, int width, int height, int channels );
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+///
+/// Builds the 1D convolution kernels filters use and keeps them for reuse, so a filter run
+/// with the same parameters again, e.g. from a parameter slider or on every image of a
+/// batch, never recomputes or reallocates its kernel.
+///
+
+#include "KernelCache.h"
+
+#include <math.h>
+#include <map>
+#include <mutex>
+
+// A parameter slider can create many distinct kernels, so the cache is emptied when full.
+// Kernels already handed out stay valid as they are shared.
+#define MAX_CACHED_KERNELS 64
+
+kernel_ptr
+KernelCache::Gaussian( double sigma )
+///
+/// @param sigma
+///  The standard deviation of the gaussian, greater than 0.
+///
+/// @return
+///  A normalized 1D gaussian kernel that covers three standard deviations either side.
+///
+{
+	return Find( KERNEL_GAUSSIAN, sigma );
+}
+
+kernel_ptr
+KernelCache::Box( int radius )
+///
+/// @param radius
+///  The number of pixels either side of the centre the box covers.
+///
+/// @return
+///  A normalized 1D box kernel of size 2*radius + 1.
+///
+{
+	return Find( KERNEL_BOX, radius );
+}
+
+kernel_ptr
+KernelCache::Find( KernelType type, double parameter )
+///
+/// Looks up a kernel, building it the first time it is asked for. Thread safe.
+///
+{
+	typedef std::pair<int, double> cache_key;
+	static std::map<cache_key, kernel_ptr> cache;
+	static std::mutex cache_mutex;
+
+	cache_key key( type, parameter );
+	{
+		std::lock_guard<std::mutex> lock( cache_mutex );
+		std::map<cache_key, kernel_ptr>::iterator it = cache.find( key );
+		if( it != cache.end() )
+		{
+			return it->second;
+		}
+	}
+
+	// Built outside the lock. If two threads race, both build the same kernel and the
+	// first one stored is kept.
+	kernel_ptr kernel = Build( type, parameter );
+
+	std::lock_guard<std::mutex> lock( cache_mutex );
+	if( cache.size() >= MAX_CACHED_KERNELS )
+	{
+		cache.clear();
+	}
+	return cache.insert( std::make_pair( key, kernel ) ).first->second;
+}
+
+kernel_ptr
+KernelCache::Build( KernelType type, double parameter )
+///
+/// @return
+///  A newly built kernel.
+///
+{
+	std::vector<double>* kernel = NULL;
+	if( type == KERNEL_GAUSSIAN )
+	{
+		double sigma = parameter;
+		int radius = (int)ceil( 3.0*sigma );
+		kernel = new std::vector<double>( 2*radius + 1 );
+		double total = 0.0;
+		for( int k = -radius; k <= radius; k++ )
+		{
+			(*kernel)[k + radius] = exp( -(k*k)/(2.0*sigma*sigma) );
+			total += (*kernel)[k + radius];
+		}
+		for( size_t k = 0; k < kernel->size(); k++ )
+		{
+			(*kernel)[k] /= total;
+		}
+	}
+	else
+	{
+		int size = 2*(int)parameter + 1;
+		kernel = new std::vector<double>( size, 1.0/size );
+	}
+	return kernel_ptr( kernel );
+}
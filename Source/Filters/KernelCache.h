@@ -0,0 +1,27 @@
+#ifndef _KERNEL_CACHE_H_
+#define _KERNEL_CACHE_H_
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+// A built kernel. Shared and never modified, so any number of threads can use it at once.
+typedef boost::shared_ptr< const std::vector<double> > kernel_ptr;
+
+class KernelCache
+{
+	public:
+		static kernel_ptr Gaussian( double sigma );
+		static kernel_ptr Box( int radius );
+
+	private:
+		enum KernelType
+		{
+			KERNEL_GAUSSIAN,
+			KERNEL_BOX
+		};
+
+		static kernel_ptr Find( KernelType type, double parameter );
+		static kernel_ptr Build( KernelType type, double parameter );
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,186 @@
+///
+/// Splits 2D convolution kernels into sums of separable (horizontal x vertical) terms using a
+/// singular value decomposition, so a rank r kernel of size k costs 2*k*r taps per pixel
+/// instead of k*k.
+///
+
+#include "KernelDecomposition.h"
+
+#include <math.h>
+#include <map>
+#include <mutex>
+
+// The cache only ever sees a handful of distinct kernels, so it is simply emptied when full.
+#define MAX_CACHED_KERNELS 64
+
+// Smaller kernels, such as Sobel's, decompose in less time than it takes to copy them into
+// a key and take the cache's lock, so they aren't cached
+#define MIN_CACHED_KERNEL_SIZE 7
+
+static double
+Snap( double value )
+///
+/// Rounds values that are within floating point noise of a multiple of 1/1024, so integer
+/// and simple fractional kernels such as Sobel decompose into exact factors.
+///
+{
+	double snapped = floor( value*1024.0 + 0.5 )/1024.0;
+	return fabs( snapped - value ) < 1e-9 ? snapped : value;
+}
+
+std::vector<SeparableTerm>
+KernelDecomposition::Decompose( const double* kernel, int kernel_size, double tolerance )
+///
+/// Decomposes a kernel with a one sided Jacobi SVD and keeps the fewest terms that
+/// reproduce it within the tolerance.
+///
+/// @param kernel
+///  A kernel_size * kernel_size kernel stored row by row.
+///
+/// @param kernel_size
+///  The width and height of the kernel.
+///
+/// @param tolerance
+///  The largest allowed error of the decomposition, relative to the size (Frobenius norm)
+///  of the kernel.
+///
+/// @return
+///  The separable terms, largest first, that sum to the kernel.
+///
+{
+	int n = kernel_size;
+
+	// Orthogonalize the columns of a copy of the kernel by plane rotations, accumulating
+	// the rotations in v. Afterwards kernel = a * transpose(v), with a's columns orthogonal.
+	std::vector<double> a( kernel, kernel + n*n );
+	std::vector<double> v( n*n, 0.0 );
+	for( int i = 0; i < n; i++ )
+	{
+		v[i*n + i] = 1.0;
+	}
+
+	for( int sweep = 0; sweep < 60; sweep++ )
+	{
+		bool rotated = false;
+		for( int p = 0; p < n - 1; p++ )
+		{
+			for( int q = p + 1; q < n; q++ )
+			{
+				double alpha = 0.0, beta = 0.0, gamma = 0.0;
+				for( int i = 0; i < n; i++ )
+				{
+					alpha += a[i*n + p]*a[i*n + p];
+					beta += a[i*n + q]*a[i*n + q];
+					gamma += a[i*n + p]*a[i*n + q];
+				}
+				if( fabs( gamma ) <= 1e-15*sqrt( alpha*beta ) || gamma == 0.0 )
+				{
+					continue;
+				}
+				rotated = true;
+
+				double zeta = (beta - alpha)/(2.0*gamma);
+				double t = (zeta >= 0 ? 1.0 : -1.0)/(fabs( zeta ) + sqrt( 1.0 + zeta*zeta ));
+				double c = 1.0/sqrt( 1.0 + t*t );
+				double s = c*t;
+				for( int i = 0; i < n; i++ )
+				{
+					double ap = a[i*n + p];
+					double aq = a[i*n + q];
+					a[i*n + p] = c*ap - s*aq;
+					a[i*n + q] = s*ap + c*aq;
+					double vp = v[i*n + p];
+					double vq = v[i*n + q];
+					v[i*n + p] = c*vp - s*vq;
+					v[i*n + q] = s*vp + c*vq;
+				}
+			}
+		}
+		if( !rotated )
+		{
+			break;
+		}
+	}
+
+	// The singular values are the column norms. Order the columns from largest to smallest.
+	std::multimap<double, int> order;
+	double total = 0.0;
+	for( int j = 0; j < n; j++ )
+	{
+		double norm = 0.0;
+		for( int i = 0; i < n; i++ )
+		{
+			norm += a[i*n + j]*a[i*n + j];
+		}
+		total += norm;
+		order.insert( std::make_pair( -norm, j ) );
+	}
+
+	// Keep terms until what's left is within the tolerance
+	std::vector<SeparableTerm> terms;
+	double remaining = total;
+	for( std::multimap<double, int>::iterator it = order.begin(); it != order.end(); ++it )
+	{
+		if( remaining <= tolerance*tolerance*total || -it->first == 0.0 )
+		{
+			break;
+		}
+		remaining -= -it->first;
+
+		int j = it->second;
+		SeparableTerm term;
+		term.horizontal.resize( n );
+		term.vertical.resize( n );
+
+		// Scale so the largest horizontal tap is exactly +-1, then snap away rounding noise
+		double largest = 0.0;
+		for( int i = 0; i < n; i++ )
+		{
+			if( fabs( v[i*n + j] ) > fabs( largest ) ) largest = v[i*n + j];
+		}
+		for( int i = 0; i < n; i++ )
+		{
+			term.horizontal[i] = Snap( v[i*n + j]/largest );
+			term.vertical[i] = Snap( a[i*n + j]*largest );
+		}
+		terms.push_back( term );
+	}
+	return terms;
+}
+
+std::vector<SeparableTerm>
+KernelDecomposition::CachedDecompose( const double* kernel, int kernel_size, double tolerance )
+///
+/// Same as Decompose, but remembers the decomposition of each kernel so repeated
+/// convolutions with the same kernel only pay for the SVD once. Thread safe.
+///
+{
+	if( kernel_size < MIN_CACHED_KERNEL_SIZE )
+	{
+		return Decompose( kernel, kernel_size, tolerance );
+	}
+
+	typedef std::pair< std::vector<double>, double > cache_key;
+	static std::map< cache_key, std::vector<SeparableTerm> > cache;
+	static std::mutex cache_mutex;
+
+	cache_key key( std::vector<double>( kernel, kernel + kernel_size*kernel_size ), tolerance );
+	{
+		std::lock_guard<std::mutex> lock( cache_mutex );
+		std::map< cache_key, std::vector<SeparableTerm> >::iterator it = cache.find( key );
+		if( it != cache.end() )
+		{
+			return it->second;
+		}
+	}
+
+	std::vector<SeparableTerm> terms = Decompose( kernel, kernel_size, tolerance );
+
+	std::lock_guard<std::mutex> lock( cache_mutex );
+	if( cache.size() >= MAX_CACHED_KERNELS )
+	{
+		cache.clear();
+	}
+	cache[key] = terms;
+	return terms;
+}
@@ -0,0 +1,20 @@
+#ifndef _KERNEL_DECOMPOSITION_H_
+#define _KERNEL_DECOMPOSITION_H_
+
+#include <vector>
+
+// One rank 1 part of a 2D kernel: kernel[ky][kx] += vertical[ky]*horizontal[kx]
+struct SeparableTerm
+{
+	std::vector<double> horizontal;
+	std::vector<double> vertical;
+};
+
+class KernelDecomposition
+{
+	public:
+		static std::vector<SeparableTerm> Decompose( const double* kernel, int kernel_size, double tolerance = 1e-6 );
+		static std::vector<SeparableTerm> CachedDecompose( const double* kernel, int kernel_size, double tolerance = 1e-6 );
+};
+
+#endif
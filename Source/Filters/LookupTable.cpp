@@ -0,0 +1,418 @@
+///
+/// A set of 256 entry per-channel lookup tables for pointwise 8 bit operations.
+/// Any chain of tone adjustments (invert, gamma, levels, threshold, ...) can be composed
+/// into a single table so the whole chain costs one pass over the image.
+///
+
+#include "LookupTable.h"
+#include "CpuFeatures.h"
+
+#include <math.h>
+#include <string.h>
+#include <stddef.h>
+
+#ifdef FILTER_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#ifdef FILTER_SIMD_X86
+
+static FILTER_TARGET("ssse3") size_t
+ApplyUniformSSSE3( const uchar* table, const uchar* source, uchar* destination, size_t count, const uchar* keep_mask )
+///
+/// Applies a single 256 entry table to every byte using 16 byte shuffles. The table is split
+/// into 16 sub-tables of 16 entries, and each byte only picks up a value from the sub-table
+/// that matches its high nibble.
+///
+/// @param keep_mask
+///  A 16 byte pattern that is 0xFF for bytes that must be passed through untouched (alpha).
+///
+/// @return
+///  The number of bytes processed. The caller handles the remaining tail.
+///
+{
+	__m128i sub_tables[16];
+	for( int h = 0; h < 16; h++ )
+	{
+		sub_tables[h] = _mm_loadu_si128( (const __m128i*)(table + 16*h) );
+	}
+	const __m128i keep = _mm_loadu_si128( (const __m128i*)keep_mask );
+	const __m128i sixteen = _mm_set1_epi8( 16 );
+	const __m128i out_of_range = _mm_set1_epi8( 0x70 );
+
+	size_t i = 0;
+	for( ; i + 16 <= count; i += 16 )
+	{
+		__m128i value = _mm_loadu_si128( (const __m128i*)(source + i) );
+		__m128i index = value;
+		__m128i result = _mm_setzero_si128();
+		for( int h = 0; h < 16; h++ )
+		{
+			// Indices outside 0..15 saturate into the 0x80 range, which makes the shuffle output zero.
+			result = _mm_or_si128( result, _mm_shuffle_epi8( sub_tables[h], _mm_adds_epu8( index, out_of_range ) ) );
+			index = _mm_sub_epi8( index, sixteen );
+		}
+		result = _mm_or_si128( _mm_and_si128( keep, value ), _mm_andnot_si128( keep, result ) );
+		_mm_storeu_si128( (__m128i*)(destination + i), result );
+	}
+	return i;
+}
+
+static FILTER_TARGET("avx2") size_t
+ApplyUniformAVX2( const uchar* table, const uchar* source, uchar* destination, size_t count, const uchar* keep_mask )
+///
+/// The 32 byte version of ApplyUniformSSSE3.
+///
+{
+	__m256i sub_tables[16];
+	for( int h = 0; h < 16; h++ )
+	{
+		sub_tables[h] = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)(table + 16*h) ) );
+	}
+	const __m128i keep_half = _mm_loadu_si128( (const __m128i*)keep_mask );
+	const __m256i keep = _mm256_broadcastsi128_si256( keep_half );
+	const __m256i sixteen = _mm256_set1_epi8( 16 );
+	const __m256i out_of_range = _mm256_set1_epi8( 0x70 );
+
+	size_t i = 0;
+	for( ; i + 32 <= count; i += 32 )
+	{
+		__m256i value = _mm256_loadu_si256( (const __m256i*)(source + i) );
+		__m256i index = value;
+		__m256i result = _mm256_setzero_si256();
+		for( int h = 0; h < 16; h++ )
+		{
+			result = _mm256_or_si256( result, _mm256_shuffle_epi8( sub_tables[h], _mm256_adds_epu8( index, out_of_range ) ) );
+			index = _mm256_sub_epi8( index, sixteen );
+		}
+		result = _mm256_blendv_epi8( result, value, keep );
+		_mm256_storeu_si256( (__m256i*)(destination + i), result );
+	}
+	return i;
+}
+
+static FILTER_TARGET("avx2") size_t
+ApplyInterleavedAVX2( const int* table32, const uchar* source, uchar* destination, size_t count )
+///
+/// Applies four different tables to interleaved four channel data with 32 bit gathers.
+///
+/// @param table32
+///  The four channel tables widened to ints and stored back to back (4 * 256 entries).
+///
+/// @return
+///  The number of bytes processed. The caller handles the remaining tail.
+///
+{
+	const __m256i channel_offsets = _mm256_setr_epi32( 0, 256, 512, 768, 0, 256, 512, 768 );
+	const __m256i order = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+
+	size_t i = 0;
+	for( ; i + 32 <= count; i += 32 )
+	{
+		__m256i gathered[4];
+		for( int g = 0; g < 4; g++ )
+		{
+			__m256i index = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(source + i + 8*g) ) );
+			gathered[g] = _mm256_i32gather_epi32( table32, _mm256_add_epi32( index, channel_offsets ), 4 );
+		}
+		__m256i low = _mm256_packus_epi32( gathered[0], gathered[1] );
+		__m256i high = _mm256_packus_epi32( gathered[2], gathered[3] );
+		__m256i result = _mm256_permutevar8x32_epi32( _mm256_packus_epi16( low, high ), order );
+		_mm256_storeu_si256( (__m256i*)(destination + i), result );
+	}
+	return i;
+}
+
+#endif
+
+LookupTable::LookupTable()
+///
+/// Constructor. Initializes every channel to the identity mapping.
+///
+{
+	for( int c = 0; c < MAX_CHANNELS; c++ )
+	{
+		for( int v = 0; v < 256; v++ )
+		{
+			mTables[c][v] = (uchar)v;
+		}
+	}
+}
+
+LookupTable
+LookupTable::Identity()
+///
+/// @return
+///  A table that leaves every value unchanged.
+///
+{
+	return LookupTable();
+}
+
+LookupTable
+LookupTable::Invert()
+///
+/// @return
+///  A table that maps each value v to 255 - v.
+///
+{
+	LookupTable lut;
+	for( int c = 0; c < MAX_CHANNELS; c++ )
+	{
+		for( int v = 0; v < 256; v++ )
+		{
+			lut.mTables[c][v] = (uchar)(255 - v);
+		}
+	}
+	return lut;
+}
+
+LookupTable
+LookupTable::Gamma( double gamma )
+///
+/// @param gamma
+///  The gamma exponent. Values greater than 1 brighten the image.
+///
+/// @return
+///  A table that applies gamma correction.
+///
+{
+	LookupTable lut;
+	if( gamma <= 0.0 )
+	{
+		return lut;
+	}
+	for( int v = 0; v < 256; v++ )
+	{
+		double corrected = 255.0 * pow( v / 255.0, 1.0 / gamma ) + 0.5;
+		if( corrected > 255 ) corrected = 255;
+		if( corrected < 0 ) corrected = 0;
+		for( int c = 0; c < MAX_CHANNELS; c++ )
+		{
+			lut.mTables[c][v] = (uchar)corrected;
+		}
+	}
+	return lut;
+}
+
+LookupTable
+LookupTable::Levels( int black_point, int white_point )
+///
+/// @param black_point
+///  Values at or below this become 0.
+///
+/// @param white_point
+///  Values at or above this become 255.
+///
+/// @return
+///  A table that linearly stretches the range [black_point, white_point] to [0, 255].
+///
+{
+	LookupTable lut;
+	if( white_point <= black_point )
+	{
+		return Threshold( black_point );
+	}
+	for( int v = 0; v < 256; v++ )
+	{
+		double stretched = (v - black_point) * 255.0 / (white_point - black_point) + 0.5;
+		if( stretched > 255 ) stretched = 255;
+		if( stretched < 0 ) stretched = 0;
+		for( int c = 0; c < MAX_CHANNELS; c++ )
+		{
+			lut.mTables[c][v] = (uchar)stretched;
+		}
+	}
+	return lut;
+}
+
+LookupTable
+LookupTable::Threshold( int threshold )
+///
+/// @param threshold
+///  Values greater than or equal to this become 255, everything else becomes 0.
+///
+/// @return
+///  A binary threshold table.
+///
+{
+	LookupTable lut;
+	for( int c = 0; c < MAX_CHANNELS; c++ )
+	{
+		for( int v = 0; v < 256; v++ )
+		{
+			lut.mTables[c][v] = v >= threshold ? 255 : 0;
+		}
+	}
+	return lut;
+}
+
+void
+LookupTable::SetChannelTable( int channel, const uchar* table )
+///
+/// Replaces the table used for a single channel.
+///
+/// @param channel
+///  The channel index, less than MAX_CHANNELS.
+///
+/// @param table
+///  A 256 entry table.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( channel >= 0 && channel < MAX_CHANNELS )
+	{
+		memcpy( mTables[channel], table, 256 );
+	}
+}
+
+const uchar*
+LookupTable::ChannelTable( int channel ) const
+///
+/// @return
+///  The 256 entry table for the given channel.
+///
+{
+	return mTables[channel];
+}
+
+LookupTable
+LookupTable::Then( const LookupTable& next ) const
+///
+/// Composes two tables so that applying the result is the same as applying this table
+/// followed by next.
+///
+/// @param next
+///  The table to apply after this one.
+///
+/// @return
+///  The composed table.
+///
+{
+	LookupTable composed;
+	for( int c = 0; c < MAX_CHANNELS; c++ )
+	{
+		for( int v = 0; v < 256; v++ )
+		{
+			composed.mTables[c][v] = next.mTables[c][mTables[c][v]];
+		}
+	}
+	return composed;
+}
+
+void
+LookupTable::Apply( uchar* source, uchar* destination, int width, int height, int channels, int alpha_channel ) const
+///
+/// Maps every byte of an image through the table for its channel. The alpha channel is
+/// passed through untouched. Source and destination may be the same buffer.
+///
+/// @param source
+///  The image to be mapped.
+///
+/// @param destination
+///  The image data where the result is to be stored (must be the same dimensions as source).
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels in the image, at most MAX_CHANNELS. 4 by default.
+///
+/// @param alpha_channel
+///  The index of the image's alpha channel. -1 if it has no alpha. 3 by default.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( channels < 1 || channels > MAX_CHANNELS )
+	{
+		return;
+	}
+
+	// Give the alpha channel an identity table so it needs no special casing per byte.
+	uchar tables[MAX_CHANNELS][256];
+	memcpy( tables, mTables, sizeof(tables) );
+	if( alpha_channel >= 0 && alpha_channel < channels )
+	{
+		for( int v = 0; v < 256; v++ )
+		{
+			tables[alpha_channel][v] = (uchar)v;
+		}
+	}
+
+	size_t count = (size_t)width * height * channels;
+	size_t done = 0;
+
+#ifdef FILTER_SIMD_X86
+	// A 16 byte block holds a whole number of pixels for 1, 2 and 4 channel images.
+	if( channels != 3 )
+	{
+		bool uniform = true;
+		int first_colour = alpha_channel == 0 && channels > 1 ? 1 : 0;
+		for( int c = 0; c < channels; c++ )
+		{
+			if( c != alpha_channel && memcmp( tables[c], tables[first_colour], 256 ) != 0 )
+			{
+				uniform = false;
+			}
+		}
+
+		if( uniform )
+		{
+			uchar keep_mask[16];
+			for( int i = 0; i < 16; i++ )
+			{
+				keep_mask[i] = (i % channels == alpha_channel) ? 0xFF : 0x00;
+			}
+			if( CpuFeatures::HasAVX2() )
+			{
+				done = ApplyUniformAVX2( tables[first_colour], source, destination, count, keep_mask );
+			}
+			else if( CpuFeatures::HasSSSE3() )
+			{
+				done = ApplyUniformSSSE3( tables[first_colour], source, destination, count, keep_mask );
+			}
+		}
+		else if( channels == 4 && CpuFeatures::HasAVX2() )
+		{
+			int table32[4*256];
+			for( int c = 0; c < 4; c++ )
+			{
+				for( int v = 0; v < 256; v++ )
+				{
+					table32[c*256 + v] = tables[c][v];
+				}
+			}
+			done = ApplyInterleavedAVX2( table32, source, destination, count );
+		}
+	}
+#endif
+
+	// Scalar path and tail. done is always a multiple of channels.
+	if( channels == 4 )
+	{
+		for( size_t i = done; i < count; i += 4 )
+		{
+			destination[i] = tables[0][source[i]];
+			destination[i + 1] = tables[1][source[i + 1]];
+			destination[i + 2] = tables[2][source[i + 2]];
+			destination[i + 3] = tables[3][source[i + 3]];
+		}
+	}
+	else
+	{
+		for( size_t i = done; i < count; i += channels )
+		{
+			for( int c = 0; c < channels; c++ )
+			{
+				destination[i + c] = tables[c][source[i + c]];
+			}
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef _LOOKUP_TABLE_H_
+#define _LOOKUP_TABLE_H_
+
+#include "Filter.h"
+
+class LookupTable
+{
+	public:
+		static const int MAX_CHANNELS = 4;
+
+		LookupTable();
+
+		static LookupTable Identity();
+		static LookupTable Invert();
+		static LookupTable Gamma( double gamma );
+		static LookupTable Levels( int black_point, int white_point );
+		static LookupTable Threshold( int threshold );
+
+		void SetChannelTable( int channel, const uchar* table );
+		const uchar* ChannelTable( int channel ) const;
+
+		LookupTable Then( const LookupTable& next ) const;
+
+		void Apply( uchar* source, uchar* destination, int width, int height, int channels = 4, int alpha_channel = 3 ) const;
+
+	private:
+		uchar mTables[MAX_CHANNELS][256];
+};
+
+#endif
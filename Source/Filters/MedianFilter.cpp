@@ -0,0 +1,334 @@
+///
+/// A filter that replaces each pixel with the median of the square around it, which
+/// removes noise while keeping edges sharp. The cost per pixel doesn't depend on the
+/// radius (Perreault and Hebert, "Median Filtering in Constant Time"): every column keeps
+/// a histogram of the rows in the window, updated with one pixel in and one out per row,
+/// and the window's histogram slides along the row by adding one column histogram and
+/// subtracting another. Histograms are split into 16 coarse bins that are updated every
+/// pixel and 256 fine bins that are only brought up to date in the coarse bin holding the
+/// median. The image is split into strips of columns that are filtered in parallel.
+///
+
+#include "MedianFilter.h"
+#include "CpuFeatures.h"
+#include "ParallelRanges.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef FILTER_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Window histograms count in 16 bits, which holds (2*127 + 1)^2 pixels
+#define MAX_RADIUS 127
+
+// Narrower strips spend more time building column histograms than filtering
+#define MIN_STRIP_COLUMNS 64
+
+#define COARSE_BINS 16
+#define FINE_BINS 256
+
+struct ScalarBins
+{
+	static void
+	Update( ushort* bins, const ushort* add, const ushort* subtract )
+	///
+	/// Adds one 16 bin histogram to another and subtracts a third.
+	///
+	{
+		for( int i = 0; i < 16; i++ )
+		{
+			bins[i] = (ushort)(bins[i] + add[i] - subtract[i]);
+		}
+	}
+
+	static void
+	Add( ushort* bins, const ushort* add )
+	///
+	/// Adds one 16 bin histogram to another.
+	///
+	{
+		for( int i = 0; i < 16; i++ )
+		{
+			bins[i] = (ushort)(bins[i] + add[i]);
+		}
+	}
+};
+
+#ifdef FILTER_SIMD_X86
+
+struct SSE2Bins
+{
+	static FILTER_TARGET("sse2") void
+	Update( ushort* bins, const ushort* add, const ushort* subtract )
+	///
+	/// Adds one 16 bin histogram to another and subtracts a third, 8 bins at a time.
+	///
+	{
+		__m128i* b = (__m128i*)bins;
+		const __m128i* a = (const __m128i*)add;
+		const __m128i* s = (const __m128i*)subtract;
+		_mm_storeu_si128( b, _mm_sub_epi16( _mm_add_epi16( _mm_loadu_si128( b ), _mm_loadu_si128( a ) ), _mm_loadu_si128( s ) ) );
+		_mm_storeu_si128( b + 1, _mm_sub_epi16( _mm_add_epi16( _mm_loadu_si128( b + 1 ), _mm_loadu_si128( a + 1 ) ), _mm_loadu_si128( s + 1 ) ) );
+	}
+
+	static FILTER_TARGET("sse2") void
+	Add( ushort* bins, const ushort* add )
+	///
+	/// Adds one 16 bin histogram to another, 8 bins at a time.
+	///
+	{
+		__m128i* b = (__m128i*)bins;
+		const __m128i* a = (const __m128i*)add;
+		_mm_storeu_si128( b, _mm_add_epi16( _mm_loadu_si128( b ), _mm_loadu_si128( a ) ) );
+		_mm_storeu_si128( b + 1, _mm_add_epi16( _mm_loadu_si128( b + 1 ), _mm_loadu_si128( a + 1 ) ) );
+	}
+};
+
+#endif
+
+template<typename Bins> static void
+MedianStrip( const uchar* source, uchar* result, int width, int height, int channels, int radius, int first_column, int last_column )
+///
+/// Median filters the columns first_column to last_column - 1 of an image, one channel at
+/// a time. Pixels beyond the edges of the image repeat the edge pixels.
+///
+{
+	int diameter = 2*radius + 1;
+	int rank = diameter*diameter/2;
+	int strip_columns = last_column - first_column;
+	int columns = strip_columns + 2*radius;
+
+	// Column histograms, covering the strip and radius columns either side of it
+	std::vector<ushort> column_coarse( (size_t)columns*COARSE_BINS );
+	std::vector<ushort> column_fine( (size_t)columns*FINE_BINS );
+	std::vector<int> source_columns( columns );
+	for( int k = 0; k < columns; k++ )
+	{
+		source_columns[k] = std::min( std::max( first_column - radius + k, 0 ), width - 1 );
+	}
+
+	ushort window_coarse[COARSE_BINS];
+	ushort window_fine[FINE_BINS];
+	int fine_column[COARSE_BINS];
+
+	for( int c = 0; c < channels; c++ )
+	{
+		std::fill( column_coarse.begin(), column_coarse.end(), 0 );
+		std::fill( column_fine.begin(), column_fine.end(), 0 );
+		for( int j = -radius; j <= radius; j++ )
+		{
+			const uchar* row = source + (size_t)std::min( std::max( j, 0 ), height - 1 )*width*channels + c;
+			for( int k = 0; k < columns; k++ )
+			{
+				uchar value = row[source_columns[k]*channels];
+				column_coarse[k*COARSE_BINS + (value >> 4)]++;
+				column_fine[k*FINE_BINS + value]++;
+			}
+		}
+
+		for( int j = 0; j < height; j++ )
+		{
+			// Slide the column histograms down a row
+			int leaving_row = std::max( j - radius - 1, 0 );
+			int entering_row = std::min( j + radius, height - 1 );
+			if( j > 0 && leaving_row != entering_row )
+			{
+				const uchar* leaving = source + (size_t)leaving_row*width*channels + c;
+				const uchar* entering = source + (size_t)entering_row*width*channels + c;
+				for( int k = 0; k < columns; k++ )
+				{
+					uchar out = leaving[source_columns[k]*channels];
+					uchar in = entering[source_columns[k]*channels];
+					column_coarse[k*COARSE_BINS + (out >> 4)]--;
+					column_fine[k*FINE_BINS + out]--;
+					column_coarse[k*COARSE_BINS + (in >> 4)]++;
+					column_fine[k*FINE_BINS + in]++;
+				}
+			}
+
+			// The window of the first pixel. Fine bins are filled in when first needed.
+			memset( window_coarse, 0, sizeof(window_coarse) );
+			for( int k = 0; k < diameter; k++ )
+			{
+				Bins::Add( window_coarse, &column_coarse[k*COARSE_BINS] );
+			}
+			for( int b = 0; b < COARSE_BINS; b++ )
+			{
+				fine_column[b] = -diameter;
+			}
+
+			uchar* result_row = result + (size_t)j*width*channels + c;
+			for( int i = 0; i < strip_columns; i++ )
+			{
+				// The window covers column histograms i to i + diameter - 1
+				if( i > 0 )
+				{
+					Bins::Update( window_coarse, &column_coarse[(i + diameter - 1)*COARSE_BINS], &column_coarse[(i - 1)*COARSE_BINS] );
+				}
+
+				int count = 0;
+				int b = 0;
+				while( count + window_coarse[b] <= rank )
+				{
+					count += window_coarse[b];
+					b++;
+				}
+
+				// Bring the fine bins of that coarse bin up to date, by sliding them along from
+				// where they were last used or rebuilding them if that's less work
+				ushort* fine = window_fine + b*16;
+				if( 2*(i - fine_column[b]) > diameter )
+				{
+					memset( fine, 0, 16*sizeof(ushort) );
+					for( int k = i; k < i + diameter; k++ )
+					{
+						Bins::Add( fine, &column_fine[k*FINE_BINS + b*16] );
+					}
+				}
+				else
+				{
+					for( int k = fine_column[b] + 1; k <= i; k++ )
+					{
+						Bins::Update( fine, &column_fine[(k + diameter - 1)*FINE_BINS + b*16], &column_fine[(k - 1)*FINE_BINS + b*16] );
+					}
+				}
+				fine_column[b] = i;
+
+				int f = 0;
+				while( count + fine[f] <= rank )
+				{
+					count += fine[f];
+					f++;
+				}
+				result_row[(first_column + i)*channels] = (uchar)(b*16 + f);
+			}
+		}
+	}
+}
+
+static int
+StripCount( int width )
+///
+/// @return
+///  The number of strips to split an image of the given width into: one per processor,
+///  as long as the strips aren't too narrow.
+///
+{
+	return ParallelRanges::RangeCount( width, MIN_STRIP_COLUMNS );
+}
+
+MedianFilter::MedianFilter( int radius )
+///
+/// Constructor.
+///
+/// @param radius
+///  The number of pixels either side of the centre the square covers. The default of 2
+///  takes the median of a 5x5 square.
+///
+: mRadius( radius )
+{
+}
+
+std::string
+MedianFilter::Parameters() const
+///
+/// @return
+///  The radius of the square.
+///
+{
+	char parameters[64];
+	snprintf( parameters, sizeof(parameters), "radius=%d", mRadius );
+	return parameters;
+}
+
+Filter*
+MedianFilter::WithParameters( const FilterParameters& parameters ) const
+///
+/// @param parameters
+///  "radius", a whole number of pixels from 1 to MAX_RADIUS.
+///
+/// @return
+///  A median filter with the given radius, or NULL if the parameters aren't valid.
+///
+{
+	int radius = mRadius;
+	for( FilterParameters::const_iterator it = parameters.begin(); it != parameters.end(); ++it )
+	{
+		if( it->first != "radius" || it->second < 1 || it->second > MAX_RADIUS || it->second != floor( it->second ) )
+		{
+			return NULL;
+		}
+		radius = (int)it->second;
+	}
+	return new MedianFilter( radius );
+}
+
+FilterCapabilities
+MedianFilter::Capabilities() const
+///
+/// @return
+///  A neighbourhood filter for 8 bit images, with SSE2 histogram updates.
+///
+{
+	FilterCapabilities capabilities;
+	capabilities.halo = mRadius;
+	capabilities.per_channel = true;
+	capabilities.clamped_edges = true;
+	capabilities.formats = FILTER_FORMAT_GRAY8 | FILTER_FORMAT_RGBA8;
+	capabilities.simd = FILTER_SIMD_SSE2;
+	return capabilities;
+}
+
+size_t
+MedianFilter::WorkingSetBytes( int width, int height, int channels ) const
+///
+/// @return
+///  The result and the column histograms of every strip.
+///
+{
+	size_t histogram_columns = (size_t)width + (size_t)StripCount( width )*2*mRadius;
+	return (size_t)width*height*channels + histogram_columns*(COARSE_BINS + FINE_BINS)*sizeof(ushort);
+}
+
+uchar*
+MedianFilter::RunFilter( uchar* source, int width, int height, int channels )
+///
+/// Runs the median filter on an image and returns the result.
+///
+/// @param source
+///  The image to be filtered.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels that the image contains. Every channel, including alpha,
+///  is filtered on its own.
+///
+/// @return
+///  The filtered image in the same size and format as source.
+///
+{
+	void (*strip)( const uchar*, uchar*, int, int, int, int, int, int ) = MedianStrip<ScalarBins>;
+#ifdef FILTER_SIMD_X86
+	if( CpuFeatures::HasSSE2() )
+	{
+		strip = MedianStrip<SSE2Bins>;
+	}
+#endif
+
+	uchar* result = new uchar[(size_t)width*height*channels];
+	ParallelRanges::Run( width, MIN_STRIP_COLUMNS, [&]( int first, int last )
+	{
+		strip( source, result, width, height, channels, mRadius, first, last );
+	} );
+	return result;
+}
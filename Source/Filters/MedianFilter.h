@@ -0,0 +1,22 @@
+#ifndef _MEDIAN_FILTER_H_
+#define _MEDIAN_FILTER_H_
+
+#include "Filter.h"
+
+class MedianFilter : public Filter
+{
+	public:
+		MedianFilter( int radius = 2 );
+
+		std::string Parameters() const;
+		Filter* WithParameters( const FilterParameters& parameters ) const;
+		FilterCapabilities Capabilities() const;
+		size_t WorkingSetBytes( int width, int height, int channels ) const;
+
+		uchar* RunFilter( uchar* source, int width, int height, int channels );
+
+	private:
+		int mRadius;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+///
+/// The thread pool filters split their loops across. It has one thread per processor
+/// besides the caller's and is started the first time a filter needs it. The caller works
+/// through the ranges too, so every range gets done even when other filters keep the pool
+/// busy, and work started from a pool thread runs on that thread alone.
+///
+
+#include "ParallelRanges.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One call's ranges, claimed in turn by the caller and the pool threads that help it.
+// Held by a shared pointer, as a pool thread may reach it after the caller has returned.
+struct RangeBatch
+{
+	RangeBatch( int count, int ranges, const std::function<void(int, int)>& work )
+	: count( count ), ranges( ranges ), work( work ), next( 0 ), finished( 0 )
+	{
+	}
+
+	int count;
+	int ranges;
+	const std::function<void(int, int)>& work;
+	std::atomic<int> next;
+	int finished;
+	std::mutex mutex;
+	std::condition_variable done;
+};
+
+class RangePool
+{
+	public:
+		RangePool();
+
+		static RangePool& Instance();
+		static bool OnPoolThread() { return sOnPoolThread; }
+
+		int ThreadCount() const { return (int)mThreads.size(); }
+		void Start( const std::shared_ptr<RangeBatch>& batch, int helpers );
+
+	private:
+		void ThreadMain();
+
+		std::vector<std::thread> mThreads;
+		std::deque< std::shared_ptr<RangeBatch> > mQueue;
+		std::mutex mMutex;
+		std::condition_variable mWake;
+
+		static thread_local bool sOnPoolThread;
+};
+
+thread_local bool RangePool::sOnPoolThread = false;
+
+static void
+RunRanges( RangeBatch& batch )
+///
+/// Runs ranges of a batch until none are left to claim.
+///
+{
+	int r;
+	while( (r = batch.next++) < batch.ranges )
+	{
+		batch.work( (int)((long long)r*batch.count/batch.ranges), (int)((long long)(r + 1)*batch.count/batch.ranges) );
+
+		std::lock_guard<std::mutex> lock( batch.mutex );
+		if( ++batch.finished == batch.ranges )
+		{
+			batch.done.notify_all();
+		}
+	}
+}
+
+RangePool::RangePool()
+///
+/// Constructor. Starts a thread for every processor but the one the caller runs on. The
+/// threads live as long as the process.
+///
+{
+	int processors = (int)std::thread::hardware_concurrency();
+	for( int t = 1; t < processors; t++ )
+	{
+		mThreads.push_back( std::thread( &RangePool::ThreadMain, this ) );
+		mThreads.back().detach();
+	}
+}
+
+RangePool&
+RangePool::Instance()
+///
+/// @return
+///  The pool, started on first use. Never destroyed, so threads still waiting for work
+///  at exit don't outlive it.
+///
+{
+	static RangePool* pool = new RangePool();
+	return *pool;
+}
+
+void
+RangePool::Start( const std::shared_ptr<RangeBatch>& batch, int helpers )
+///
+/// Asks pool threads to help with a batch.
+///
+/// @param helpers
+///  The number of pool threads to wake for it.
+///
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	for( int h = 0; h < helpers; h++ )
+	{
+		mQueue.push_back( batch );
+	}
+	mWake.notify_all();
+}
+
+void
+RangePool::ThreadMain()
+///
+/// Runs batches as they are queued, for the life of the process.
+///
+{
+	sOnPoolThread = true;
+	for( ;; )
+	{
+		std::shared_ptr<RangeBatch> batch;
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mWake.wait( lock, [this]{ return !mQueue.empty(); } );
+			batch = mQueue.front();
+			mQueue.pop_front();
+		}
+		RunRanges( *batch );
+	}
+}
+
+int
+ParallelRanges::RangeCount( int count, int min_range )
+///
+/// @param count
+///  The number of rows or columns to split.
+///
+/// @param min_range
+///  The fewest rows or columns worth handing to another thread.
+///
+/// @return
+///  How many ranges Run splits the loop into from this thread: one per processor, as long
+///  as each range gets at least min_range, and one on a pool thread.
+///
+{
+	if( RangePool::OnPoolThread() )
+	{
+		return 1;
+	}
+	int processors = (int)std::thread::hardware_concurrency();
+	return std::max( 1, std::min( processors, count/std::max( min_range, 1 ) ) );
+}
+
+void
+ParallelRanges::Run( int count, int min_range, const std::function<void(int, int)>& work )
+///
+/// Splits 0 to count - 1 into contiguous ranges and calls work( first, last ) for each in
+/// parallel, with last one past the end. Returns when all are done.
+///
+/// @param count
+///  The number of rows or columns to split.
+///
+/// @param min_range
+///  The fewest rows or columns worth handing to another thread.
+///
+/// @param work
+///  Processes one range. Called from several threads at once.
+///
+/// @return
+///  Nothing.
+///
+{
+	int ranges = RangeCount( count, min_range );
+	if( ranges <= 1 )
+	{
+		work( 0, count );
+		return;
+	}
+
+	RangePool& pool = RangePool::Instance();
+	std::shared_ptr<RangeBatch> batch = std::make_shared<RangeBatch>( count, ranges, work );
+	pool.Start( batch, std::min( ranges - 1, pool.ThreadCount() ) );
+	RunRanges( *batch );
+
+	std::unique_lock<std::mutex> lock( batch->mutex );
+	batch->done.wait( lock, [&]{ return batch->finished == batch->ranges; } );
+}
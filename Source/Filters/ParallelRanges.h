@@ -0,0 +1,16 @@
+#ifndef _PARALLEL_RANGES_H_
+#define _PARALLEL_RANGES_H_
+
+#include <functional>
+
+// Splits loops over rows or columns across one thread pool shared by every filter in the
+// process, so filters running at once on several threads share the processors rather
+// than each starting a thread per processor.
+class ParallelRanges
+{
+	public:
+		static int RangeCount( int count, int min_range );
+		static void Run( int count, int min_range, const std::function<void(int, int)>& work );
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,482 @@
+///
+/// Converters between the pixel layouts images arrive in and the tightly packed layout
+/// the filters work on. Every function takes a stride for both sides, so padded rows on
+/// either side are handled explicitly rather than assumed away.
+///
+
+#include "PixelConversion.h"
+#include "CpuFeatures.h"
+
+#include <string.h>
+
+// Pixels looked at in the quick pass of IsGrayOpaque, spread over the image
+#define GRAY_SAMPLE_ROWS 32
+#define GRAY_SAMPLE_COLUMNS 32
+
+#ifdef FILTER_SIMD_X86
+#include <immintrin.h>
+
+static FILTER_TARGET("ssse3") int
+SwapRedBlueRowSSSE3( const uchar* source, uchar* destination, int width )
+///
+/// Swaps the first and third byte of each four byte pixel in a row, 4 pixels at a time.
+///
+/// @return
+///  The number of pixels processed. The caller handles the remaining tail.
+///
+{
+	const __m128i order = _mm_setr_epi8( 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15 );
+	int i = 0;
+	for( ; i + 4 <= width; i += 4 )
+	{
+		__m128i pixels = _mm_loadu_si128( (const __m128i*)(source + i*4) );
+		_mm_storeu_si128( (__m128i*)(destination + i*4), _mm_shuffle_epi8( pixels, order ) );
+	}
+	return i;
+}
+
+static FILTER_TARGET("ssse3") int
+ExpandRGBToRGBARowSSSE3( const uchar* source, uchar* destination, int width )
+///
+/// Expands a row of three byte pixels to four byte pixels with an opaque alpha, 4 pixels
+/// at a time. Each load reads 16 bytes but only uses 12, so it stops early enough not to
+/// read past the end of the row.
+///
+/// @return
+///  The number of pixels processed. The caller handles the remaining tail.
+///
+{
+	const __m128i order = _mm_setr_epi8( 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 );
+	const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+	int i = 0;
+	for( ; i*3 + 16 <= width*3; i += 4 )
+	{
+		__m128i pixels = _mm_loadu_si128( (const __m128i*)(source + i*3) );
+		_mm_storeu_si128( (__m128i*)(destination + i*4), _mm_or_si128( _mm_shuffle_epi8( pixels, order ), alpha ) );
+	}
+	return i;
+}
+
+static FILTER_TARGET("sse2") bool
+IsGrayOpaqueRowSSE2( const uchar* source, int width, int* processed )
+///
+/// Checks 4 pixels at a time that the first three bytes of each four byte pixel are equal
+/// and the last is 255, by rebuilding each pixel from its first byte and comparing.
+///
+/// @param processed
+///  Receives the number of pixels checked. The caller checks the remaining tail.
+///
+/// @return
+///  False as soon as a pixel fails the check.
+///
+{
+	const __m128i low_byte = _mm_set1_epi32( 0xFF );
+	const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+	int i = 0;
+	for( ; i + 4 <= width; i += 4 )
+	{
+		__m128i pixels = _mm_loadu_si128( (const __m128i*)(source + i*4) );
+		__m128i gray = _mm_and_si128( pixels, low_byte );
+		__m128i expected = _mm_or_si128( _mm_or_si128( gray, _mm_slli_epi32( gray, 8 ) ), _mm_or_si128( _mm_slli_epi32( gray, 16 ), alpha ) );
+		if( _mm_movemask_epi8( _mm_cmpeq_epi32( pixels, expected ) ) != 0xFFFF )
+		{
+			*processed = i;
+			return false;
+		}
+	}
+	*processed = i;
+	return true;
+}
+
+static FILTER_TARGET("sse2") int
+ExtractGrayRowSSE2( const uchar* source, uchar* destination, int width )
+///
+/// Keeps the first byte of each four byte pixel in a row, 16 pixels at a time.
+///
+/// @return
+///  The number of pixels processed. The caller handles the remaining tail.
+///
+{
+	const __m128i low_byte = _mm_set1_epi32( 0xFF );
+	int i = 0;
+	for( ; i + 16 <= width; i += 16 )
+	{
+		const __m128i* pixels = (const __m128i*)(source + i*4);
+		__m128i first = _mm_packs_epi32( _mm_and_si128( _mm_loadu_si128( pixels ), low_byte ), _mm_and_si128( _mm_loadu_si128( pixels + 1 ), low_byte ) );
+		__m128i second = _mm_packs_epi32( _mm_and_si128( _mm_loadu_si128( pixels + 2 ), low_byte ), _mm_and_si128( _mm_loadu_si128( pixels + 3 ), low_byte ) );
+		_mm_storeu_si128( (__m128i*)(destination + i), _mm_packus_epi16( first, second ) );
+	}
+	return i;
+}
+
+static FILTER_TARGET("sse2") int
+ExpandGrayRowSSE2( const uchar* source, uchar* destination, int width )
+///
+/// Repeats each byte of a row into the first three bytes of a four byte pixel with an
+/// opaque alpha, 16 pixels at a time.
+///
+/// @return
+///  The number of pixels processed. The caller handles the remaining tail.
+///
+{
+	const __m128i alpha = _mm_set1_epi32( 0xFF000000 );
+	int i = 0;
+	for( ; i + 16 <= width; i += 16 )
+	{
+		__m128i gray = _mm_loadu_si128( (const __m128i*)(source + i) );
+		__m128i low = _mm_unpacklo_epi8( gray, gray );
+		__m128i high = _mm_unpackhi_epi8( gray, gray );
+		__m128i* pixels = (__m128i*)(destination + i*4);
+		_mm_storeu_si128( pixels, _mm_or_si128( _mm_unpacklo_epi16( low, low ), alpha ) );
+		_mm_storeu_si128( pixels + 1, _mm_or_si128( _mm_unpackhi_epi16( low, low ), alpha ) );
+		_mm_storeu_si128( pixels + 2, _mm_or_si128( _mm_unpacklo_epi16( high, high ), alpha ) );
+		_mm_storeu_si128( pixels + 3, _mm_or_si128( _mm_unpackhi_epi16( high, high ), alpha ) );
+	}
+	return i;
+}
+
+#endif
+
+void
+PixelConversion::CopyRows( const uchar* source, int source_stride, uchar* destination, int destination_stride, int row_bytes, int height )
+///
+/// Copies image rows between buffers with different strides.
+///
+/// @param source
+///  The source image data.
+///
+/// @param source_stride
+///  The number of bytes between the start of each source row.
+///
+/// @param destination
+///  The buffer the rows are copied to.
+///
+/// @param destination_stride
+///  The number of bytes between the start of each destination row.
+///
+/// @param row_bytes
+///  The number of bytes of pixel data in each row.
+///
+/// @param height
+///  The number of rows.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( source_stride == row_bytes && destination_stride == row_bytes )
+	{
+		memcpy( destination, source, (size_t)row_bytes*height );
+		return;
+	}
+	for( int j = 0; j < height; j++ )
+	{
+		memcpy( destination + (size_t)j*destination_stride, source + (size_t)j*source_stride, row_bytes );
+	}
+}
+
+void
+PixelConversion::SwapRedBlue( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height )
+///
+/// Converts four byte pixels between BGRA and RGBA byte order. The conversion is its own inverse.
+///
+/// @param source
+///  The source image data.
+///
+/// @param source_stride
+///  The number of bytes between the start of each source row.
+///
+/// @param destination
+///  The buffer the result is stored in. May be the same as source if the strides match.
+///
+/// @param destination_stride
+///  The number of bytes between the start of each destination row.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @return
+///  Nothing.
+///
+{
+	for( int j = 0; j < height; j++ )
+	{
+		const uchar* row = source + (size_t)j*source_stride;
+		uchar* result_row = destination + (size_t)j*destination_stride;
+		int i = 0;
+#ifdef FILTER_SIMD_X86
+		if( CpuFeatures::HasSSSE3() )
+		{
+			i = SwapRedBlueRowSSSE3( row, result_row, width );
+		}
+#endif
+		for( ; i < width; i++ )
+		{
+			uchar red = row[i*4 + 2];
+			result_row[i*4 + 2] = row[i*4];
+			result_row[i*4 + 1] = row[i*4 + 1];
+			result_row[i*4] = red;
+			result_row[i*4 + 3] = row[i*4 + 3];
+		}
+	}
+}
+
+void
+PixelConversion::ExpandRGBToRGBA( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height )
+///
+/// Converts three byte RGB pixels to four byte RGBA pixels with an opaque alpha.
+///
+/// @param source
+///  The source image data.
+///
+/// @param source_stride
+///  The number of bytes between the start of each source row.
+///
+/// @param destination
+///  The buffer the result is stored in.
+///
+/// @param destination_stride
+///  The number of bytes between the start of each destination row.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @return
+///  Nothing.
+///
+{
+	for( int j = 0; j < height; j++ )
+	{
+		const uchar* row = source + (size_t)j*source_stride;
+		uchar* result_row = destination + (size_t)j*destination_stride;
+		int i = 0;
+#ifdef FILTER_SIMD_X86
+		if( CpuFeatures::HasSSSE3() )
+		{
+			i = ExpandRGBToRGBARowSSSE3( row, result_row, width );
+		}
+#endif
+		for( ; i < width; i++ )
+		{
+			result_row[i*4] = row[i*3];
+			result_row[i*4 + 1] = row[i*3 + 1];
+			result_row[i*4 + 2] = row[i*3 + 2];
+			result_row[i*4 + 3] = 255;
+		}
+	}
+}
+
+void
+PixelConversion::MapIndexed( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height, const uchar* table )
+///
+/// Maps one byte palette indices to one byte values through a 256 entry table, e.g. to
+/// turn a grayscale palette image into a one channel image.
+///
+/// @param source
+///  The source palette indices.
+///
+/// @param source_stride
+///  The number of bytes between the start of each source row.
+///
+/// @param destination
+///  The buffer the result is stored in.
+///
+/// @param destination_stride
+///  The number of bytes between the start of each destination row.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param table
+///  The value for each of the 256 possible indices.
+///
+/// @return
+///  Nothing.
+///
+{
+	for( int j = 0; j < height; j++ )
+	{
+		const uchar* row = source + (size_t)j*source_stride;
+		uchar* result_row = destination + (size_t)j*destination_stride;
+		for( int i = 0; i < width; i++ )
+		{
+			result_row[i] = table[row[i]];
+		}
+	}
+}
+
+static bool
+IsGrayOpaqueRow( const uchar* row, int width )
+///
+/// @return
+///  True if every four byte pixel in the row has equal color bytes and an opaque alpha.
+///
+{
+	int i = 0;
+#ifdef FILTER_SIMD_X86
+	if( CpuFeatures::HasSSE2() && !IsGrayOpaqueRowSSE2( row, width, &i ) )
+	{
+		return false;
+	}
+#endif
+	for( ; i < width; i++ )
+	{
+		const uchar* pixel = row + i*4;
+		if( pixel[1] != pixel[0] || pixel[2] != pixel[0] || pixel[3] != 255 )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool
+PixelConversion::IsGrayOpaque( const uchar* source, int source_stride, int width, int height )
+///
+/// Checks whether a four byte per pixel image is really a grayscale image: every pixel has
+/// equal red, green and blue and an opaque alpha. Alpha must be the last byte of each
+/// pixel; the order of the color bytes doesn't matter. A sample of pixels spread over the
+/// image is checked first, so most color images are turned down without reading them all.
+///
+/// @param source
+///  The source image data.
+///
+/// @param source_stride
+///  The number of bytes between the start of each source row.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @return
+///  True if every pixel is gray and opaque.
+///
+{
+	for( int j = 0; j < GRAY_SAMPLE_ROWS; j++ )
+	{
+		const uchar* row = source + (size_t)(j*(height - 1)/GRAY_SAMPLE_ROWS)*source_stride;
+		for( int i = 0; i < GRAY_SAMPLE_COLUMNS; i++ )
+		{
+			const uchar* pixel = row + (i*(width - 1)/GRAY_SAMPLE_COLUMNS)*4;
+			if( pixel[1] != pixel[0] || pixel[2] != pixel[0] || pixel[3] != 255 )
+			{
+				return false;
+			}
+		}
+	}
+
+	for( int j = 0; j < height; j++ )
+	{
+		if( !IsGrayOpaqueRow( source + (size_t)j*source_stride, width ) )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+PixelConversion::ExtractGray( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height )
+///
+/// Converts four byte pixels that IsGrayOpaque accepted to one byte gray pixels by keeping
+/// the first byte of each.
+///
+/// @param source
+///  The source image data.
+///
+/// @param source_stride
+///  The number of bytes between the start of each source row.
+///
+/// @param destination
+///  The buffer the result is stored in.
+///
+/// @param destination_stride
+///  The number of bytes between the start of each destination row.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @return
+///  Nothing.
+///
+{
+	for( int j = 0; j < height; j++ )
+	{
+		const uchar* row = source + (size_t)j*source_stride;
+		uchar* result_row = destination + (size_t)j*destination_stride;
+		int i = 0;
+#ifdef FILTER_SIMD_X86
+		if( CpuFeatures::HasSSE2() )
+		{
+			i = ExtractGrayRowSSE2( row, result_row, width );
+		}
+#endif
+		for( ; i < width; i++ )
+		{
+			result_row[i] = row[i*4];
+		}
+	}
+}
+
+void
+PixelConversion::ExpandGray( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height )
+///
+/// Converts one byte gray pixels to four byte pixels with equal color bytes and an opaque
+/// alpha, which reads the same as RGBA or BGRA.
+///
+/// @param source
+///  The source image data.
+///
+/// @param source_stride
+///  The number of bytes between the start of each source row.
+///
+/// @param destination
+///  The buffer the result is stored in.
+///
+/// @param destination_stride
+///  The number of bytes between the start of each destination row.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @return
+///  Nothing.
+///
+{
+	for( int j = 0; j < height; j++ )
+	{
+		const uchar* row = source + (size_t)j*source_stride;
+		uchar* result_row = destination + (size_t)j*destination_stride;
+		int i = 0;
+#ifdef FILTER_SIMD_X86
+		if( CpuFeatures::HasSSE2() )
+		{
+			i = ExpandGrayRowSSE2( row, result_row, width );
+		}
+#endif
+		for( ; i < width; i++ )
+		{
+			result_row[i*4] = row[i];
+			result_row[i*4 + 1] = row[i];
+			result_row[i*4 + 2] = row[i];
+			result_row[i*4 + 3] = 255;
+		}
+	}
+}
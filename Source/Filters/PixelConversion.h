@@ -0,0 +1,19 @@
+#ifndef _PIXEL_CONVERSION_H_
+#define _PIXEL_CONVERSION_H_
+
+#include "Filter.h"
+
+class PixelConversion
+{
+	public:
+		static void CopyRows( const uchar* source, int source_stride, uchar* destination, int destination_stride, int row_bytes, int height );
+		static void SwapRedBlue( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height );
+		static void ExpandRGBToRGBA( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height );
+		static void MapIndexed( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height, const uchar* table );
+
+		static bool IsGrayOpaque( const uchar* source, int source_stride, int width, int height );
+		static void ExtractGray( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height );
+		static void ExpandGray( const uchar* source, int source_stride, uchar* destination, int destination_stride, int width, int height );
+};
+
+#endif
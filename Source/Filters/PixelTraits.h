@@ -0,0 +1,62 @@
+#ifndef _PIXEL_TRAITS_H_
+#define _PIXEL_TRAITS_H_
+
+#include "Filter.h"
+
+#include <math.h>
+
+// Describes the value range of each supported pixel component type so the
+// image algorithms can be written once and instantiated for 8 bit, 16 bit and
+// floating point data. Float data is not clamped so intermediate results keep
+// their full precision between passes. FromDouble truncates like a cast, RoundDouble
+// rounds to nearest, which hides the rounding noise of results computed different ways.
+template<typename T> struct PixelTraits;
+
+template<> struct PixelTraits<uchar>
+{
+	static double MaxValue() { return 255.0; }
+	static uchar FromDouble( double value )
+	{
+		if( value > 255 ) value = 255;
+		if( value < 0 ) value = 0;
+		return (uchar)value;
+	}
+	static uchar RoundDouble( double value )
+	{
+		if( value > 255 ) value = 255;
+		if( value < 0 ) value = 0;
+		return (uchar)lround( value );
+	}
+};
+
+template<> struct PixelTraits<ushort>
+{
+	static double MaxValue() { return 65535.0; }
+	static ushort FromDouble( double value )
+	{
+		if( value > 65535 ) value = 65535;
+		if( value < 0 ) value = 0;
+		return (ushort)value;
+	}
+	static ushort RoundDouble( double value )
+	{
+		if( value > 65535 ) value = 65535;
+		if( value < 0 ) value = 0;
+		return (ushort)lround( value );
+	}
+};
+
+template<> struct PixelTraits<float>
+{
+	static double MaxValue() { return 1.0; }
+	static float FromDouble( double value )
+	{
+		return (float)value;
+	}
+	static float RoundDouble( double value )
+	{
+		return (float)value;
+	}
+};
+
+#endif
@@ -0,0 +1,286 @@
+///
+/// A filter that sharpens an image with an unsharp mask: each pixel moves away from a
+/// gaussian blur of its neighbourhood by amount times the difference, unless the difference
+/// is below a threshold, which leaves smooth areas and fine noise alone. The blur, the
+/// difference and the sum are fused into one pass over the image. Each thread keeps a ring
+/// of horizontally blurred rows, one per kernel tap, and blurs them vertically a row at a
+/// time, so the blurred image is never stored and the cost is about that of the blur alone.
+///
+
+#include "UnsharpMask.h"
+#include "KernelCache.h"
+#include "ParallelRanges.h"
+#include "PixelTraits.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Sharpening more than this only amplifies noise
+#define MAX_AMOUNT 10.0
+#define MAX_RADIUS 32.0
+
+// Every strip blurs kernel size - 1 rows beyond its own, so strips are kept well above that
+#define MIN_STRIP_ROWS 64
+
+template<typename T> static void
+SharpenStrip( const T* source, T* result, int width, int height, int channels, const std::vector<double>& kernel,
+	double amount, double threshold, int first_row, int last_row )
+///
+/// Sharpens the rows first_row to last_row - 1 of an image. Pixels beyond the edges of the
+/// image repeat the edge pixels. Four channel images carry alpha in the last channel, which
+/// is copied as is.
+///
+{
+	int alpha_channel = channels == 4 ? 3 : -1;
+	int kernel_size = (int)kernel.size();
+	int radius = kernel_size/2;
+	int row_values = width*channels;
+	std::vector<float> weights( kernel.begin(), kernel.end() );
+
+	// A source row with radius edge pixels repeated either side, the ring of horizontally
+	// blurred rows, and the blurred row being output
+	std::vector<float> padded( (size_t)(width + 2*radius)*channels );
+	std::vector<float> ring( (size_t)kernel_size*row_values );
+	std::vector<float> blurred( row_values );
+	double rounding = std::numeric_limits<T>::is_integer ? 0.5 : 0.0;
+
+	// Row r of the image is blurred horizontally into ring slot r mod kernel_size
+	int next_row = first_row - radius;
+	for( int j = first_row; j < last_row; j++ )
+	{
+		for( ; next_row <= j + radius; next_row++ )
+		{
+			const T* row = source + (size_t)std::min( std::max( next_row, 0 ), height - 1 )*row_values;
+			for( int i = -radius; i < width + radius; i++ )
+			{
+				const T* pixel = row + std::min( std::max( i, 0 ), width - 1 )*channels;
+				for( int c = 0; c < channels; c++ )
+				{
+					padded[(i + radius)*channels + c] = pixel[c];
+				}
+			}
+
+			float* horizontal = &ring[(size_t)(((next_row % kernel_size) + kernel_size) % kernel_size)*row_values];
+			std::fill( horizontal, horizontal + row_values, 0.0f );
+			for( int k = 0; k < kernel_size; k++ )
+			{
+				const float* taps = &padded[k*channels];
+				float weight = weights[k];
+				for( int i = 0; i < row_values; i++ )
+				{
+					horizontal[i] += weight*taps[i];
+				}
+			}
+		}
+
+		std::fill( blurred.begin(), blurred.end(), 0.0f );
+		for( int k = 0; k < kernel_size; k++ )
+		{
+			const float* horizontal = &ring[(size_t)((((j - radius + k) % kernel_size) + kernel_size) % kernel_size)*row_values];
+			float weight = weights[k];
+			for( int i = 0; i < row_values; i++ )
+			{
+				blurred[i] += weight*horizontal[i];
+			}
+		}
+
+		const T* source_row = source + (size_t)j*row_values;
+		T* result_row = result + (size_t)j*row_values;
+		for( int i = 0; i < row_values; i++ )
+		{
+			double difference = source_row[i] - (double)blurred[i];
+			if( i % channels == alpha_channel || fabs( difference ) < threshold )
+			{
+				result_row[i] = source_row[i];
+			}
+			else
+			{
+				result_row[i] = PixelTraits<T>::FromDouble( source_row[i] + amount*difference + rounding );
+			}
+		}
+	}
+}
+
+static int
+StripCount( int height, int kernel_size )
+///
+/// @return
+///  The number of strips an image of the given height is split into: one per processor,
+///  as long as each strip is tall enough for the rows it blurs twice not to matter.
+///
+{
+	return ParallelRanges::RangeCount( height, std::max( MIN_STRIP_ROWS, 4*kernel_size ) );
+}
+
+UnsharpMask::UnsharpMask( double amount, double radius, int threshold )
+///
+/// Constructor.
+///
+/// @param amount
+///  How far each pixel moves away from the blur, as a multiple of its difference from it.
+///
+/// @param radius
+///  The standard deviation of the gaussian blur in pixels, which sets how wide the edges
+///  that are sharpened are.
+///
+/// @param threshold
+///  The smallest difference from the blur, in 8 bit levels, that is sharpened. 0 sharpens
+///  every pixel.
+///
+: mAmount( amount ),
+  mRadius( radius ),
+  mThreshold( threshold )
+{
+}
+
+int
+UnsharpMask::Version() const
+///
+/// @return
+///  2 since the alpha channel of four channel images is left as is. 1 sharpened it too.
+///
+{
+	return 2;
+}
+
+std::string
+UnsharpMask::Parameters() const
+///
+/// @return
+///  The amount, radius and threshold.
+///
+{
+	char parameters[128];
+	snprintf( parameters, sizeof(parameters), "amount=%.17g radius=%.17g threshold=%d", mAmount, mRadius, mThreshold );
+	return parameters;
+}
+
+Filter*
+UnsharpMask::WithParameters( const FilterParameters& parameters ) const
+///
+/// @param parameters
+///  Any of "amount" from 0 to MAX_AMOUNT, "radius" above 0 up to MAX_RADIUS, and
+///  "threshold", a whole number from 0 to 255.
+///
+/// @return
+///  An unsharp mask with the given settings, or NULL if the parameters aren't valid.
+///
+{
+	double amount = mAmount;
+	double radius = mRadius;
+	int threshold = mThreshold;
+	for( FilterParameters::const_iterator it = parameters.begin(); it != parameters.end(); ++it )
+	{
+		double value = it->second;
+		if( it->first == "amount" && value >= 0.0 && value <= MAX_AMOUNT )
+		{
+			amount = value;
+		}
+		else if( it->first == "radius" && value > 0.0 && value <= MAX_RADIUS )
+		{
+			radius = value;
+		}
+		else if( it->first == "threshold" && value >= 0 && value <= 255 && value == floor( value ) )
+		{
+			threshold = (int)value;
+		}
+		else
+		{
+			return NULL;
+		}
+	}
+	return new UnsharpMask( amount, radius, threshold );
+}
+
+FilterCapabilities
+UnsharpMask::Capabilities() const
+///
+/// @return
+///  A neighbourhood filter as wide as the gaussian kernel, with implementations for every
+///  pixel type.
+///
+{
+	FilterCapabilities capabilities;
+	capabilities.halo = (int)ceil( 3.0*mRadius );
+	capabilities.per_channel = true;
+	capabilities.clamped_edges = true;
+	capabilities.formats = FILTER_FORMAT_GRAY8 | FILTER_FORMAT_RGBA8 | FILTER_FORMAT_RGBA16 | FILTER_FORMAT_FLOAT;
+	return capabilities;
+}
+
+size_t
+UnsharpMask::WorkingSetBytes( int width, int height, int channels ) const
+///
+/// @return
+///  The result and, for every strip, a float ring of rows as deep as the kernel.
+///
+{
+	int kernel_size = 2*(int)ceil( 3.0*mRadius ) + 1;
+	size_t row_bytes = ((size_t)width + kernel_size)*channels*sizeof(float);
+	return (size_t)width*height*channels + (size_t)StripCount( height, kernel_size )*(kernel_size + 2)*row_bytes;
+}
+
+template<typename T> T*
+UnsharpMask::Sharpen( T* source, int width, int height, int channels )
+///
+/// Sharpens an image of any pixel type, splitting it into strips of rows that are
+/// sharpened in parallel.
+///
+{
+	kernel_ptr kernel = KernelCache::Gaussian( mRadius );
+	double threshold = mThreshold*PixelTraits<T>::MaxValue()/255.0;
+
+	T* result = new T[(size_t)width*height*channels];
+	ParallelRanges::Run( height, std::max( MIN_STRIP_ROWS, 4*(int)kernel->size() ), [&]( int first, int last )
+	{
+		SharpenStrip<T>( source, result, width, height, channels, *kernel, mAmount, threshold, first, last );
+	} );
+	return result;
+}
+
+uchar*
+UnsharpMask::RunFilter( uchar* source, int width, int height, int channels )
+///
+/// Runs the unsharp mask on an image and returns the result.
+///
+/// @param source
+///  The image to be sharpened.
+///
+/// @param width
+///  The width of the image.
+///
+/// @param height
+///  The height of the image.
+///
+/// @param channels
+///  The number of color channels that the image contains. Each color channel is sharpened
+///  on its own, and the alpha channel of four channel images is left as is.
+///
+/// @return
+///  The sharpened image in the same size and format as source.
+///
+{
+	return Sharpen( source, width, height, channels );
+}
+
+ushort*
+UnsharpMask::RunFilter16( ushort* source, int width, int height, int channels )
+///
+/// 16 bit version of RunFilter. The threshold is scaled to the 16 bit range.
+///
+{
+	return Sharpen( source, width, height, channels );
+}
+
+float*
+UnsharpMask::RunFilterFloat( float* source, int width, int height, int channels )
+///
+/// Floating point version of RunFilter. The threshold is scaled to the 0 to 1 range and
+/// results aren't clamped.
+///
+{
+	return Sharpen( source, width, height, channels );
+}
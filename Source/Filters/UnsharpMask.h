@@ -0,0 +1,29 @@
+#ifndef _UNSHARP_MASK_H_
+#define _UNSHARP_MASK_H_
+
+#include "Filter.h"
+
+class UnsharpMask : public Filter
+{
+	public:
+		UnsharpMask( double amount = 1.0, double radius = 1.0, int threshold = 0 );
+
+		int Version() const;
+		std::string Parameters() const;
+		Filter* WithParameters( const FilterParameters& parameters ) const;
+		FilterCapabilities Capabilities() const;
+		size_t WorkingSetBytes( int width, int height, int channels ) const;
+
+		uchar* RunFilter( uchar* source, int width, int height, int channels );
+		ushort* RunFilter16( ushort* source, int width, int height, int channels );
+		float* RunFilterFloat( float* source, int width, int height, int channels );
+
+	private:
+		template<typename T> T* Sharpen( T* source, int width, int height, int channels );
+
+		double mAmount;
+		double mRadius;
+		int mThreshold;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,633 @@
+///
+/// Watches input folders and runs a recipe of filters on every image that appears or changes
+/// in them. On Linux the folders are watched through inotify for files closed after writing
+/// or moved in, and only the files named are looked at. Elsewhere QFileSystemWatcher says a
+/// folder changed and its listing is read. Either way nothing is polled while no files
+/// arrive. A file is only picked up once it has stopped changing for a moment, so images
+/// still being written aren't read half finished.
+///
+/// Each output folder keeps a small manifest of the content hash, recipe key, size and
+/// modification time of every input processed. Files whose size and time match their entry
+/// are skipped without being read, and files that were only touched are skipped after
+/// hashing. New entries are appended to the manifest, so the work done is proportional to
+/// new data rather than to the folder size.
+///
+
+#include "FolderWatcher.h"
+#include "BatchProcessor.h"
+#include "FilterCache.h"
+#include "ImageEncoder.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// How long a file must stay the same size and age before it is processed
+#define DEBOUNCE_MS 1000
+
+#define MANIFEST_FILE_NAME ".filter-manifest"
+
+typedef boost::shared_ptr<Filter> filter_ptr;
+
+class WatchJob : public QRunnable
+{
+	public:
+		WatchJob( FolderWatcher* watcher, QString input_file, QString output_file, std::vector<filter_ptr> recipe, QString known_hash, qint64 memory_budget )
+		: mWatcher( watcher ),
+		  mInputFile( input_file ),
+		  mOutputFile( output_file ),
+		  mRecipe( recipe ),
+		  mKnownHash( known_hash ),
+		  mMemoryBudget( memory_budget )
+		{
+		}
+
+		void run();
+
+	private:
+		FolderWatcher* mWatcher;
+		QString mInputFile;
+		QString mOutputFile;
+		std::vector<filter_ptr> mRecipe;
+		QString mKnownHash;
+		qint64 mMemoryBudget;
+};
+
+void
+WatchJob::run()
+///
+/// Hashes the input file and, unless it matches what was processed before, filters it and
+/// saves the result. Reports back to the watcher on its thread.
+///
+/// @return
+///  Nothing.
+///
+{
+	QString hash;
+	bool processed = false;
+	bool success = false;
+
+	QFile file( mInputFile );
+	if( file.open( QIODevice::ReadOnly ) )
+	{
+		QByteArray contents = file.readAll();
+		hash = QCryptographicHash::hash( contents, QCryptographicHash::Sha1 ).toHex();
+		if( hash == mKnownHash )
+		{
+			success = true;
+		}
+		else
+		{
+			processed = true;
+			QImage image;
+			success = image.loadFromData( contents );
+			contents.clear();
+			for( size_t f = 0; f < mRecipe.size() && success; f++ )
+			{
+				image = FilterProcessor::ApplyFilter( mRecipe[f].get(), image, NULL, mMemoryBudget );
+				success = !image.isNull();
+			}
+			success = success && ImageEncoder::Save( image, mOutputFile );
+		}
+	}
+
+	QMetaObject::invokeMethod( mWatcher, "JobFinished", Qt::QueuedConnection,
+		Q_ARG(QString, mInputFile), Q_ARG(QString, hash), Q_ARG(bool, processed), Q_ARG(bool, success) );
+}
+
+FolderWatcher::FolderWatcher( FilterProcessor* filter_processor, QObject* parent )
+///
+/// Constructor.
+///
+/// @param filter_processor
+///  The filter processor whose filter library the recipe is taken from.
+///
+/// @param parent
+///  The owner of this object.
+///
+: QObject( parent ),
+  mFilterProcessor( filter_processor ),
+  mEventQueue( -1 ),
+  mEventNotifier( NULL )
+{
+#ifdef Q_OS_LINUX
+	mEventQueue = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if( mEventQueue >= 0 )
+	{
+		mEventNotifier = new QSocketNotifier( mEventQueue, QSocketNotifier::Read, this );
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+		connect( mEventNotifier, SIGNAL( activated(QSocketDescriptor, QSocketNotifier::Type) ), this, SLOT( ReadFileEvents() ) );
+#else
+		connect( mEventNotifier, SIGNAL( activated(int) ), this, SLOT( ReadFileEvents() ) );
+#endif
+	}
+#endif
+	connect( &mWatcher, SIGNAL( directoryChanged(QString) ), this, SLOT( ScanFolder(QString) ) );
+
+	mDebounceTimer.setInterval( DEBOUNCE_MS/4 );
+	connect( &mDebounceTimer, SIGNAL( timeout() ), this, SLOT( CheckPendingFiles() ) );
+}
+
+FolderWatcher::~FolderWatcher()
+///
+/// Destructor. Waits for running jobs to finish.
+///
+{
+	mThreadPool.waitForDone();
+	delete mEventNotifier;
+#ifdef Q_OS_LINUX
+	if( mEventQueue >= 0 )
+	{
+		close( mEventQueue );
+	}
+#endif
+}
+
+bool
+FolderWatcher::SetRecipe( QStringList recipe )
+///
+/// Sets the filters run on each new file. Must be called before folders are added. Files
+/// were processed with the same recipe if their manifest entry has the same recipe key,
+/// made like the filter cache's keys from each filter's name, version and parameters.
+///
+/// @param recipe
+///  The names of the filters to apply, in order.
+///
+/// @return
+///  True if every filter exists.
+///
+{
+	mRecipe.clear();
+	QByteArray key;
+	for( int f = 0; f < recipe.size(); f++ )
+	{
+		filter_ptr filter = mFilterProcessor->GetFilter( recipe[f].toStdString() );
+		if( !filter )
+		{
+			mRecipe.clear();
+			return false;
+		}
+		mRecipe.push_back( filter );
+		key = FilterCache::StageKey( key, recipe[f], filter.get() );
+	}
+	mRecipeKey = QString::fromLatin1( key );
+	return !mRecipe.empty();
+}
+
+bool
+FolderWatcher::AddFolder( QString input_dir, QString output_dir )
+///
+/// Starts watching a folder. Images already in it that aren't in the manifest, or were
+/// processed with a different recipe, are processed straight away.
+///
+/// @param input_dir
+///  The folder to watch.
+///
+/// @param output_dir
+///  The folder results are written to, using the same file names. The manifest is kept here.
+///
+/// @return
+///  True if the folder is being watched. False if there is no recipe, the folder doesn't
+///  exist or is already watched, or the output folder is the folder itself.
+///
+{
+	QString input_path = QDir( input_dir ).absolutePath();
+	if( mRecipe.empty() || !QDir( input_path ).exists() || mFolders.contains( input_path ) )
+	{
+		return false;
+	}
+
+	// Results written into the watched folder would no longer match the manifest and be
+	// processed again, over and over, replacing the originals. A folder that doesn't exist
+	// yet has an empty canonical path, so it never matches.
+	if( QDir( input_path ).canonicalPath() == QDir( output_dir ).canonicalPath() || !QDir( output_dir ).mkpath( "." ) )
+	{
+		return false;
+	}
+
+	Folder folder;
+	folder.output_dir = QDir( output_dir ).absolutePath();
+	LoadManifest( folder );
+#ifdef Q_OS_LINUX
+	if( mEventQueue >= 0 )
+	{
+		int watch = inotify_add_watch( mEventQueue, QFile::encodeName( input_path ).constData(), IN_CLOSE_WRITE | IN_MOVED_TO );
+		if( watch < 0 )
+		{
+			return false;
+		}
+		mWatchedFolders[watch] = input_path;
+	}
+#endif
+	if( mEventQueue < 0 && !mWatcher.addPath( input_path ) )
+	{
+		return false;
+	}
+	mFolders[input_path] = folder;
+
+	emit WatchStatus( tr("Watching %1 (%2 files in manifest).").arg( input_path ).arg( folder.manifest.size() ) );
+	ScanFolder( input_path );
+	return true;
+}
+
+void
+FolderWatcher::ScanFolder( QString input_dir )
+///
+/// Looks for files in a folder that are new or have changed since they were processed,
+/// and starts waiting for them to settle. Only the directory listing is read here. Used
+/// when a folder is added, where there is no inotify, and when inotify lost events.
+///
+/// @param input_dir
+///  The folder that changed.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( !mFolders.contains( input_dir ) )
+	{
+		return;
+	}
+	const Folder& folder = mFolders[input_dir];
+
+	QFileInfoList files = QDir( input_dir ).entryInfoList( BatchProcessor::ImageFileFilters(), QDir::Files );
+	for( int i = 0; i < files.size(); i++ )
+	{
+		QueueFile( folder, files[i] );
+	}
+}
+
+void
+FolderWatcher::ReadFileEvents()
+///
+/// Looks at the files inotify reports as closed after writing, which includes images
+/// rewritten in place, or moved into a watched folder. Nothing else in the folder is read.
+/// If the kernel dropped events, every folder is scanned instead.
+///
+/// @return
+///  Nothing.
+///
+{
+#ifdef Q_OS_LINUX
+	char buffer[4096] __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+	bool overflowed = false;
+	for( ;; )
+	{
+		ssize_t length = read( mEventQueue, buffer, sizeof(buffer) );
+		if( length <= 0 )
+		{
+			break;
+		}
+
+		ssize_t offset = 0;
+		while( offset < length )
+		{
+			const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+			offset += sizeof(struct inotify_event) + event->len;
+			if( event->mask & IN_Q_OVERFLOW )
+			{
+				overflowed = true;
+				continue;
+			}
+			if( event->mask & IN_IGNORED )
+			{
+				// The folder was deleted or unmounted
+				mWatchedFolders.remove( event->wd );
+				continue;
+			}
+
+			QMap<int, QString>::const_iterator input_dir = mWatchedFolders.find( event->wd );
+			if( input_dir == mWatchedFolders.end() || event->len == 0 || !mFolders.contains( input_dir.value() ) )
+			{
+				continue;
+			}
+			QString file_name = QFile::decodeName( event->name );
+			if( IsImageFile( file_name ) )
+			{
+				QueueFile( mFolders[input_dir.value()], QFileInfo( QDir( input_dir.value() ).absoluteFilePath( file_name ) ) );
+			}
+		}
+	}
+
+	if( overflowed )
+	{
+		QStringList input_dirs = mFolders.keys();
+		for( int i = 0; i < input_dirs.size(); i++ )
+		{
+			ScanFolder( input_dirs[i] );
+		}
+	}
+#endif
+}
+
+bool
+FolderWatcher::IsImageFile( QString file_name )
+///
+/// @param file_name
+///  The name of a file.
+///
+/// @return
+///  True if the name matches one of the batch processor's image file patterns.
+///
+{
+	return BatchProcessor::ImageFileFilters().contains( "*." + QFileInfo( file_name ).suffix().toLower() );
+}
+
+void
+FolderWatcher::QueueFile( const Folder& folder, const QFileInfo& file )
+///
+/// Starts waiting for a file to settle, unless it is already waiting or being processed,
+/// or it was processed with the current recipe and hasn't changed since.
+///
+/// @param folder
+///  The watched folder the file is in.
+///
+/// @param file
+///  The file.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( !file.exists() || !file.isFile() )
+	{
+		return;
+	}
+
+	QString path = file.absoluteFilePath();
+	qint64 size = file.size();
+	qint64 modified_ms = file.lastModified().toMSecsSinceEpoch();
+
+	QMap<QString, ManifestEntry>::const_iterator known = folder.manifest.find( file.fileName() );
+	if( known != folder.manifest.end() && known->recipe == mRecipeKey && known->size == size && known->modified_ms == modified_ms )
+	{
+		return;
+	}
+
+	QMap<QString, PendingFile>::iterator pending = mPendingFiles.find( path );
+	if( pending != mPendingFiles.end() && pending->size == size && pending->modified_ms == modified_ms )
+	{
+		return;
+	}
+	QMap<QString, PendingFile>::iterator running = mRunningFiles.find( path );
+	if( running != mRunningFiles.end() && running->size == size && running->modified_ms == modified_ms )
+	{
+		return;
+	}
+
+	PendingFile& pending_file = mPendingFiles[path];
+	pending_file.size = size;
+	pending_file.modified_ms = modified_ms;
+	pending_file.unchanged.start();
+
+	if( !mDebounceTimer.isActive() )
+	{
+		mDebounceTimer.start();
+	}
+}
+
+void
+FolderWatcher::CheckPendingFiles()
+///
+/// Starts processing the pending files that have stopped changing.
+///
+/// @return
+///  Nothing.
+///
+{
+	QMap<QString, PendingFile>::iterator it = mPendingFiles.begin();
+	while( it != mPendingFiles.end() )
+	{
+		QFileInfo info( it.key() );
+		if( !info.exists() )
+		{
+			it = mPendingFiles.erase( it );
+			continue;
+		}
+
+		// Still being written
+		qint64 modified_ms = info.lastModified().toMSecsSinceEpoch();
+		if( info.size() != it->size || modified_ms != it->modified_ms )
+		{
+			it->size = info.size();
+			it->modified_ms = modified_ms;
+			it->unchanged.start();
+			++it;
+			continue;
+		}
+
+		// A file changed again while its last version is being processed waits its turn
+		if( it->unchanged.elapsed() < DEBOUNCE_MS || mRunningFiles.contains( it.key() ) )
+		{
+			++it;
+			continue;
+		}
+
+		StartJob( it.key(), it.value() );
+		it = mPendingFiles.erase( it );
+	}
+
+	if( mPendingFiles.isEmpty() )
+	{
+		mDebounceTimer.stop();
+	}
+}
+
+void
+FolderWatcher::StartJob( QString input_file, const PendingFile& pending )
+///
+/// Queues a settled file to be hashed and, if its contents are new, filtered.
+///
+/// @param input_file
+///  The file to process.
+///
+/// @param pending
+///  The size and modification time the file settled at.
+///
+/// @return
+///  Nothing.
+///
+{
+	QFileInfo info( input_file );
+	const Folder& folder = mFolders[info.absolutePath()];
+
+	QString known_hash;
+	QMap<QString, ManifestEntry>::const_iterator known = folder.manifest.find( info.fileName() );
+	if( known != folder.manifest.end() && known->recipe == mRecipeKey )
+	{
+		known_hash = known->hash;
+	}
+
+	mRunningFiles[input_file] = pending;
+	// Files being filtered at the same time share the memory budget
+	qint64 memory_budget = ExecutionPlanner::DefaultBudget()/mThreadPool.maxThreadCount();
+	mThreadPool.start( new WatchJob( this, input_file, QDir( folder.output_dir ).absoluteFilePath( info.fileName() ), mRecipe, known_hash, memory_budget ) );
+}
+
+void
+FolderWatcher::JobFinished( QString input_file, QString hash, bool processed, bool success )
+///
+/// Records the outcome of a job in the manifest. Files that failed are recorded too, so a
+/// corrupt file isn't retried until it changes.
+///
+/// @param input_file
+///  The file that was processed.
+///
+/// @param hash
+///  The hash of the file's contents, or an empty string if it couldn't be read.
+///
+/// @param processed
+///  False if the contents matched the manifest and the file was skipped.
+///
+/// @param success
+///  True if the result was saved, or the file was skipped.
+///
+/// @return
+///  Nothing.
+///
+{
+	PendingFile pending = mRunningFiles.take( input_file );
+	QFileInfo info( input_file );
+	QMap<QString, Folder>::iterator folder = mFolders.find( info.absolutePath() );
+	if( folder == mFolders.end() || hash.isEmpty() )
+	{
+		emit WatchStatus( tr("Couldn't read %1.").arg( input_file ) );
+		return;
+	}
+
+	// Skipped files always have an entry already, and keep its outcome
+	ManifestEntry& entry = folder->manifest[info.fileName()];
+	entry.hash = hash;
+	entry.recipe = mRecipeKey;
+	entry.size = pending.size;
+	entry.modified_ms = pending.modified_ms;
+	if( processed )
+	{
+		entry.success = success;
+	}
+	AppendManifest( folder.value(), info.fileName(), entry );
+
+	if( processed )
+	{
+		emit WatchStatus( success ? tr("Processed %1.").arg( input_file ) : tr("Failed to process %1.").arg( input_file ) );
+	}
+}
+
+bool
+FolderWatcher::LoadManifest( Folder& folder )
+///
+/// Reads the manifest of an output folder. Each line holds the hash, the recipe key, the size,
+/// the modification time, whether processing succeeded and the file name, separated by
+/// tabs. A file name may appear several times, in which case the last line is current.
+///
+/// @param folder
+///  The folder whose manifest is loaded.
+///
+/// @return
+///  True if a manifest was read.
+///
+{
+	QFile file( QDir( folder.output_dir ).absoluteFilePath( MANIFEST_FILE_NAME ) );
+	if( !file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+	{
+		return false;
+	}
+
+	int lines = 0;
+	QTextStream in( &file );
+	while( !in.atEnd() )
+	{
+		QStringList fields = in.readLine().split( '\t' );
+		if( fields.size() != 6 )
+		{
+			continue;
+		}
+		lines++;
+		ManifestEntry entry;
+		entry.hash = fields[0];
+		entry.recipe = fields[1];
+		entry.size = fields[2].toLongLong();
+		entry.modified_ms = fields[3].toLongLong();
+		entry.success = fields[4] == "1";
+		folder.manifest[fields[5]] = entry;
+	}
+	file.close();
+
+	// Later lines replace earlier ones. Drop the replaced lines once they dominate.
+	if( lines > 2*folder.manifest.size() )
+	{
+		SaveManifest( folder );
+	}
+	return true;
+}
+
+bool
+FolderWatcher::SaveManifest( const Folder& folder )
+///
+/// Writes the whole manifest of an output folder with one line per file, replacing the old
+/// one only once the new one is complete.
+///
+/// @param folder
+///  The folder whose manifest is saved.
+///
+/// @return
+///  True if the manifest was written.
+///
+{
+	QSaveFile file( QDir( folder.output_dir ).absoluteFilePath( MANIFEST_FILE_NAME ) );
+	if( !file.open( QIODevice::WriteOnly | QIODevice::Text ) )
+	{
+		return false;
+	}
+
+	QTextStream out( &file );
+	for( QMap<QString, ManifestEntry>::const_iterator it = folder.manifest.begin(); it != folder.manifest.end(); ++it )
+	{
+		WriteManifestLine( out, it.key(), it.value() );
+	}
+	out.flush();
+	return file.commit();
+}
+
+bool
+FolderWatcher::AppendManifest( const Folder& folder, QString file_name, const ManifestEntry& entry )
+///
+/// Adds one entry to the end of the manifest of an output folder.
+///
+/// @param folder
+///  The folder whose manifest is updated.
+///
+/// @param file_name
+///  The name of the input file.
+///
+/// @param entry
+///  What is now known about the file.
+///
+/// @return
+///  True if the entry was written.
+///
+{
+	QFile file( QDir( folder.output_dir ).absoluteFilePath( MANIFEST_FILE_NAME ) );
+	if( !file.open( QIODevice::Append | QIODevice::Text ) )
+	{
+		return false;
+	}
+
+	QTextStream out( &file );
+	WriteManifestLine( out, file_name, entry );
+	return true;
+}
+
+void
+FolderWatcher::WriteManifestLine( QTextStream& out, QString file_name, const ManifestEntry& entry )
+///
+/// Writes one manifest line.
+///
+/// @return
+///  Nothing.
+///
+{
+	out << entry.hash << '\t' << entry.recipe << '\t' << entry.size << '\t' << entry.modified_ms << '\t'
+		<< (entry.success ? "1" : "0") << '\t' << file_name << '\n';
+}
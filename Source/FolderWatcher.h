@@ -0,0 +1,85 @@
+#ifndef _FOLDER_WATCHER_H_
+#define _FOLDER_WATCHER_H_
+
+#include <QApplication>
+#include <QtWidgets>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "Filter.h"
+#include "FilterProcessor.h"
+
+// What the manifest remembers about one input file.
+struct ManifestEntry
+{
+	QString hash;
+	QString recipe;		// Key of the filters' names, versions and parameters, in order
+	qint64 size;
+	qint64 modified_ms;
+	bool success;
+};
+
+class FolderWatcher : public QObject
+{
+	Q_OBJECT
+
+	public:
+		FolderWatcher( FilterProcessor* filter_processor, QObject* parent = 0 );
+		~FolderWatcher();
+
+		bool SetRecipe( QStringList recipe );
+		bool AddFolder( QString input_dir, QString output_dir );
+
+	signals:
+		void WatchStatus( QString status_text );
+
+	public slots:
+		void JobFinished( QString input_file, QString hash, bool processed, bool success );
+
+	private slots:
+		void ScanFolder( QString input_dir );
+		void ReadFileEvents();
+		void CheckPendingFiles();
+
+	private:
+		// A file seen changing, waiting for writes to it to settle
+		struct PendingFile
+		{
+			qint64 size;
+			qint64 modified_ms;
+			QElapsedTimer unchanged;
+		};
+
+		// A watched input folder and the results that have been written for it
+		struct Folder
+		{
+			QString output_dir;
+			QMap<QString, ManifestEntry> manifest;
+		};
+
+		static bool IsImageFile( QString file_name );
+		void QueueFile( const Folder& folder, const QFileInfo& file );
+
+		bool LoadManifest( Folder& folder );
+		bool SaveManifest( const Folder& folder );
+		bool AppendManifest( const Folder& folder, QString file_name, const ManifestEntry& entry );
+		static void WriteManifestLine( QTextStream& out, QString file_name, const ManifestEntry& entry );
+		void StartJob( QString input_file, const PendingFile& pending );
+
+		FilterProcessor* mFilterProcessor;
+		std::vector< boost::shared_ptr<Filter> > mRecipe;
+		QString mRecipeKey;
+
+		QFileSystemWatcher mWatcher;
+		int mEventQueue;			// inotify descriptor, or -1 where mWatcher is used
+		QSocketNotifier* mEventNotifier;
+		QMap<int, QString> mWatchedFolders;	// Input folder of each inotify watch
+		QTimer mDebounceTimer;
+		QThreadPool mThreadPool;
+
+		QMap<QString, Folder> mFolders;
+		QMap<QString, PendingFile> mPendingFiles;
+		QMap<QString, PendingFile> mRunningFiles;
+};
+
+#endif
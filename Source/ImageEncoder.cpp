@@ -0,0 +1,569 @@
+///
+/// Writes images with explicit control over quality and compression effort. PNG is written
+/// by our own encoder, which splits large images into strips of rows and compresses the
+/// strips on separate threads. Images with more than 8 bits per channel are written as 16
+/// bit PNGs. Each strip is an independent deflate block sequence, so the
+/// strips simply join into one valid zlib stream, and the checksums are combined rather
+/// than recomputed. Other formats go through QImageWriter with the requested settings.
+///
+
+#include "ImageEncoder.h"
+
+#include <zlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define DEFAULT_PNG_COMPRESSION 6
+#define FAST_PNG_COMPRESSION 1
+
+// Each strip holds at least this many bytes of pixels, so it is worth a thread
+#define MIN_STRIP_BYTES (1 << 20)
+
+// How much deflate output is produced per call
+#define DEFLATE_CHUNK_BYTES (256*1024)
+
+enum PngFilterType
+{
+	PNG_FILTER_NONE = 0,
+	PNG_FILTER_SUB,
+	PNG_FILTER_UP,
+	PNG_FILTER_AVERAGE,
+	PNG_FILTER_PAETH,
+	PNG_FILTER_COUNT
+};
+
+EncodeSettings::EncodeSettings()
+///
+/// Constructor. Uses the default settings of each format.
+///
+: quality( -1 ),
+  compression( -1 ),
+  fast( false )
+{
+}
+
+static void
+AppendUInt32( QByteArray& data, quint32 value )
+///
+/// Appends a big endian 32 bit value, as PNG and zlib store them.
+///
+{
+	char bytes[4] = { (char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value };
+	data.append( bytes, 4 );
+}
+
+static bool
+WriteChunk( QIODevice* device, const char* type, const QByteArray& data )
+///
+/// Writes one PNG chunk: its length, type, data and CRC.
+///
+/// @return
+///  True if the chunk was written.
+///
+{
+	QByteArray chunk;
+	AppendUInt32( chunk, data.size() );
+	chunk.append( type, 4 );
+	chunk.append( data );
+	AppendUInt32( chunk, crc32( 0, (const Bytef*)chunk.constData() + 4, chunk.size() - 4 ) );
+	return device->write( chunk ) == chunk.size();
+}
+
+static uchar
+Paeth( int left, int up, int up_left )
+///
+/// @return
+///  Whichever neighbour is closest to left + up - up_left, as the PNG Paeth filter predicts.
+///
+{
+	int estimate = left + up - up_left;
+	int distance_left = abs( estimate - left );
+	int distance_up = abs( estimate - up );
+	int distance_up_left = abs( estimate - up_left );
+	if( distance_left <= distance_up && distance_left <= distance_up_left )
+	{
+		return left;
+	}
+	return distance_up <= distance_up_left ? up : up_left;
+}
+
+static void
+ApplyFilter( int type, const uchar* row, const uchar* previous, int row_bytes, int bytes_per_pixel, uchar* result )
+///
+/// Runs one of the PNG filters on a row.
+///
+/// @param previous
+///  The row above, or NULL for the first row of the image.
+///
+{
+	for( int i = 0; i < row_bytes; i++ )
+	{
+		int left = i >= bytes_per_pixel ? row[i - bytes_per_pixel] : 0;
+		int up = previous != NULL ? previous[i] : 0;
+		int up_left = previous != NULL && i >= bytes_per_pixel ? previous[i - bytes_per_pixel] : 0;
+
+		int prediction = 0;
+		switch( type )
+		{
+			case PNG_FILTER_SUB: prediction = left; break;
+			case PNG_FILTER_UP: prediction = up; break;
+			case PNG_FILTER_AVERAGE: prediction = (left + up)/2; break;
+			case PNG_FILTER_PAETH: prediction = Paeth( left, up, up_left ); break;
+		}
+		result[i] = (uchar)(row[i] - prediction);
+	}
+}
+
+static void
+FilterRow( const uchar* row, const uchar* previous, int row_bytes, int bytes_per_pixel, bool adaptive, uchar* result, uchar* scratch )
+///
+/// Filters a row for compression. Adaptive filtering tries every filter and keeps the one
+/// with the smallest sum of absolute differences, the usual heuristic. Otherwise the Sub
+/// filter is used, which is cheap and works well on photographs.
+///
+/// @param result
+///  Receives the filter type followed by the row_bytes filtered bytes.
+///
+/// @param scratch
+///  row_bytes bytes of working space.
+///
+{
+	if( !adaptive )
+	{
+		result[0] = PNG_FILTER_SUB;
+		ApplyFilter( PNG_FILTER_SUB, row, previous, row_bytes, bytes_per_pixel, result + 1 );
+		return;
+	}
+
+	long best_sum = -1;
+	for( int type = PNG_FILTER_NONE; type < PNG_FILTER_COUNT; type++ )
+	{
+		ApplyFilter( type, row, previous, row_bytes, bytes_per_pixel, scratch );
+		long sum = 0;
+		for( int i = 0; i < row_bytes; i++ )
+		{
+			sum += abs( (signed char)scratch[i] );
+		}
+		if( best_sum < 0 || sum < best_sum )
+		{
+			best_sum = sum;
+			result[0] = (uchar)type;
+			memcpy( result + 1, scratch, row_bytes );
+		}
+	}
+}
+
+static void
+Deflate( z_stream& stream, const uchar* data, uInt size, int flush, QByteArray& output )
+///
+/// Compresses data onto the end of output.
+///
+{
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = size;
+	do
+	{
+		int used = output.size();
+		output.resize( used + DEFLATE_CHUNK_BYTES );
+		stream.next_out = (Bytef*)output.data() + used;
+		stream.avail_out = DEFLATE_CHUNK_BYTES;
+		deflate( &stream, flush );
+		output.resize( output.size() - stream.avail_out );
+	}
+	while( stream.avail_out == 0 );
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+static bool
+HasHighBitDepth( const QImage& image )
+///
+/// @return
+///  True if the image stores more than 8 bits per channel.
+///
+{
+	// The 64 and 128 bit formats hold 16 bit or floating point channels
+	if( image.depth() > 32 )
+	{
+		return true;
+	}
+	switch( image.format() )
+	{
+		case QImage::Format_BGR30:
+		case QImage::Format_A2BGR30_Premultiplied:
+		case QImage::Format_RGB30:
+		case QImage::Format_A2RGB30_Premultiplied:
+			return true;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+		case QImage::Format_Grayscale16:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+static void
+PackSixteenBit( const QImage& image, std::vector<uchar>& rows, int& color_type, int& bytes_per_pixel )
+///
+/// Converts an image to the rows of a 16 bit PNG: big endian, unpremultiplied and without
+/// padding, in the smallest color type that holds the image.
+///
+/// @param rows
+///  Receives the rows.
+///
+/// @param color_type
+///  Receives the PNG color type of the rows.
+///
+/// @param bytes_per_pixel
+///  Receives the size of a pixel in the rows.
+///
+{
+	QImage source;
+	int channels = 0;
+	int source_channels = 0;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+	if( !image.hasAlphaChannel() && image.isGrayscale() )
+	{
+		source = image.convertToFormat( QImage::Format_Grayscale16 );
+		color_type = 0;
+		channels = 1;
+		source_channels = 1;
+	}
+	else
+#endif
+	if( image.hasAlphaChannel() )
+	{
+		source = image.convertToFormat( QImage::Format_RGBA64 );
+		color_type = 6;
+		channels = 4;
+		source_channels = 4;
+	}
+	else
+	{
+		source = image.convertToFormat( QImage::Format_RGBX64 );
+		color_type = 2;
+		channels = 3;
+		source_channels = 4;
+	}
+
+	int width = source.width();
+	bytes_per_pixel = channels*2;
+	rows.resize( (size_t)width*bytes_per_pixel*source.height() );
+	uchar* output = &rows[0];
+	for( int j = 0; j < source.height(); j++ )
+	{
+		const quint16* input = (const quint16*)source.constScanLine( j );
+		for( int i = 0; i < width; i++ )
+		{
+			for( int c = 0; c < channels; c++ )
+			{
+				quint16 value = input[i*source_channels + c];
+				*output++ = (uchar)(value >> 8);
+				*output++ = (uchar)value;
+			}
+		}
+	}
+}
+#endif
+
+class StripJob : public QRunnable
+{
+	public:
+		StripJob( const uchar* bits, int bytes_per_line, int first_row, int rows, int row_bytes, int bytes_per_pixel, int level, bool adaptive, bool last, QSemaphore* done )
+		: mBits( bits ),
+		  mBytesPerLine( bytes_per_line ),
+		  mFirstRow( first_row ),
+		  mRows( rows ),
+		  mRowBytes( row_bytes ),
+		  mBytesPerPixel( bytes_per_pixel ),
+		  mLevel( level ),
+		  mAdaptive( adaptive ),
+		  mLast( last ),
+		  mDone( done ),
+		  mAdler( adler32( 0, NULL, 0 ) )
+		{
+			setAutoDelete( false );
+		}
+
+		void run();
+
+		const QByteArray& Output() const { return mOutput; }
+		uLong Adler() const { return mAdler; }
+		uLong UncompressedSize() const { return (uLong)mRows*(mRowBytes + 1); }
+
+	private:
+		const uchar* mBits;
+		int mBytesPerLine;
+		int mFirstRow;
+		int mRows;
+		int mRowBytes;
+		int mBytesPerPixel;
+		int mLevel;
+		bool mAdaptive;
+		bool mLast;
+		QSemaphore* mDone;
+
+		QByteArray mOutput;
+		uLong mAdler;
+};
+
+void
+StripJob::run()
+///
+/// Filters and compresses a strip of rows as raw deflate data. Strips other than the last
+/// end on a byte boundary with a sync flush, so the next strip's data can follow directly.
+///
+/// @return
+///  Nothing.
+///
+{
+	z_stream stream;
+	memset( &stream, 0, sizeof(stream) );
+	deflateInit2( &stream, mLevel, Z_DEFLATED, -MAX_WBITS, 8, mAdaptive ? Z_FILTERED : Z_DEFAULT_STRATEGY );
+
+	std::vector<uchar> filtered( mRowBytes + 1 );
+	std::vector<uchar> scratch( mRowBytes );
+	for( int j = mFirstRow; j < mFirstRow + mRows; j++ )
+	{
+		// Filters look at the row above, which for the first row of a strip belongs to the
+		// previous strip. It is only read, so the strips stay independent.
+		const uchar* row = mBits + (size_t)j*mBytesPerLine;
+		const uchar* previous = j > 0 ? row - mBytesPerLine : NULL;
+		FilterRow( row, previous, mRowBytes, mBytesPerPixel, mAdaptive, &filtered[0], &scratch[0] );
+		mAdler = adler32( mAdler, &filtered[0], mRowBytes + 1 );
+		Deflate( stream, &filtered[0], mRowBytes + 1, Z_NO_FLUSH, mOutput );
+	}
+	Deflate( stream, NULL, 0, mLast ? Z_FINISH : Z_SYNC_FLUSH, mOutput );
+	deflateEnd( &stream );
+
+	if( mDone != NULL )
+	{
+		mDone->release();
+	}
+}
+
+bool
+ImageEncoder::Save( const QImage& image, QString file_name, const EncodeSettings& settings )
+///
+/// Saves an image to a file, picking the format from the file name.
+///
+/// @param image
+///  The image to save.
+///
+/// @param file_name
+///  The file to write.
+///
+/// @param settings
+///  How hard to work at making the file small.
+///
+/// @return
+///  True if the image was saved.
+///
+{
+	// Written to a temporary file and renamed, so a failed save never leaves a truncated image
+	// in place of the old one
+	QSaveFile file( file_name );
+	if( !file.open( QIODevice::WriteOnly ) )
+	{
+		return false;
+	}
+	if( !Write( image, &file, QFileInfo( file_name ).suffix().toLower().toLatin1(), settings ) )
+	{
+		file.cancelWriting();
+		return false;
+	}
+	return file.commit();
+}
+
+bool
+ImageEncoder::Write( const QImage& image, QIODevice* device, QByteArray format, const EncodeSettings& settings )
+///
+/// Encodes an image to a device.
+///
+/// @param image
+///  The image to encode.
+///
+/// @param device
+///  Where the encoded image is written.
+///
+/// @param format
+///  The image format, as a file name suffix such as "png" or "jpg".
+///
+/// @param settings
+///  How hard to work at making the output small.
+///
+/// @return
+///  True if the image was encoded.
+///
+{
+	if( image.isNull() )
+	{
+		return false;
+	}
+
+	if( format == "png" )
+	{
+		return WritePNG( image, device, settings );
+	}
+
+	QImageWriter writer( device, format );
+	if( settings.quality >= 0 )
+	{
+		writer.setQuality( settings.quality );
+	}
+	if( format == "tif" || format == "tiff" )
+	{
+		writer.setCompression( settings.fast ? 0 : 1 );
+	}
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	if( format == "jpg" || format == "jpeg" )
+	{
+		writer.setOptimizedWrite( !settings.fast );
+	}
+#endif
+	return writer.write( image );
+}
+
+bool
+ImageEncoder::WritePNG( const QImage& image, QIODevice* device, const EncodeSettings& settings )
+///
+/// Encodes a PNG, compressing large images in parallel strips. Images with more than 8 bits
+/// per channel are written at 16 bits per channel, the others at 8.
+///
+/// @return
+///  True if the image was encoded.
+///
+{
+	// Pick the smallest PNG color type that holds the image
+	QImage source;
+	std::vector<uchar> packed;
+	int color_type = 0;
+	int bytes_per_pixel = 0;
+	int bit_depth = 8;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	if( HasHighBitDepth( image ) )
+	{
+		PackSixteenBit( image, packed, color_type, bytes_per_pixel );
+		bit_depth = 16;
+	}
+	else
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	if( !image.hasAlphaChannel() && image.isGrayscale() )
+	{
+		source = image.convertToFormat( QImage::Format_Grayscale8 );
+		color_type = 0;
+		bytes_per_pixel = 1;
+	}
+	else
+#endif
+	if( image.hasAlphaChannel() )
+	{
+		source = image.convertToFormat( QImage::Format_RGBA8888 );
+		color_type = 6;
+		bytes_per_pixel = 4;
+	}
+	else
+	{
+		source = image.convertToFormat( QImage::Format_RGB888 );
+		color_type = 2;
+		bytes_per_pixel = 3;
+	}
+
+	int width = image.width();
+	int height = image.height();
+	int row_bytes = width*bytes_per_pixel;
+	const uchar* bits = bit_depth == 16 ? &packed[0] : source.constBits();
+	int bytes_per_line = bit_depth == 16 ? row_bytes : source.bytesPerLine();
+
+	int level = settings.compression >= 0 ? qMin( settings.compression, 9 ) : (settings.fast ? FAST_PNG_COMPRESSION : DEFAULT_PNG_COMPRESSION);
+	bool adaptive = !settings.fast;
+
+	// Split into strips
+	qint64 total_bytes = (qint64)row_bytes*height;
+	int max_strips = QThread::idealThreadCount() > 1 ? QThread::idealThreadCount()*2 : 1;
+	int strip_count = (int)qBound( (qint64)1, total_bytes/MIN_STRIP_BYTES, (qint64)qMin( height, max_strips ) );
+	int rows_per_strip = (height + strip_count - 1)/strip_count;
+	strip_count = (height + rows_per_strip - 1)/rows_per_strip;
+
+	std::vector<StripJob*> strips;
+	QSemaphore done;
+	for( int s = 0; s < strip_count; s++ )
+	{
+		int first_row = s*rows_per_strip;
+		int rows = qMin( rows_per_strip, height - first_row );
+		strips.push_back( new StripJob( bits, bytes_per_line, first_row, rows, row_bytes, bytes_per_pixel, level, adaptive, s == strip_count - 1, &done ) );
+	}
+
+	// Compress the first strip here while the pool works on the rest
+	for( int s = 1; s < strip_count; s++ )
+	{
+		QThreadPool::globalInstance()->start( strips[s] );
+	}
+	strips[0]->run();
+	done.acquire( strip_count );
+
+	// Header
+	bool success = device->write( "\x89PNG\r\n\x1a\n", 8 ) == 8;
+
+	QByteArray header;
+	AppendUInt32( header, width );
+	AppendUInt32( header, height );
+	header.append( (char)bit_depth );
+	header.append( (char)color_type );
+	header.append( (char)0 );
+	header.append( (char)0 );
+	header.append( (char)0 );
+	success = success && WriteChunk( device, "IHDR", header );
+
+	if( image.dotsPerMeterX() > 0 && image.dotsPerMeterY() > 0 )
+	{
+		QByteArray physical;
+		AppendUInt32( physical, image.dotsPerMeterX() );
+		AppendUInt32( physical, image.dotsPerMeterY() );
+		physical.append( (char)1 );
+		success = success && WriteChunk( device, "pHYs", physical );
+	}
+
+	QStringList keys = image.textKeys();
+	for( int k = 0; k < keys.size(); k++ )
+	{
+		QByteArray text = keys[k].left( 79 ).toLatin1();
+		text.append( '\0' );
+		text.append( image.text( keys[k] ).toLatin1() );
+		success = success && WriteChunk( device, "tEXt", text );
+	}
+
+	// Image data: the zlib header, each strip's deflate data, then the combined checksum
+	int level_flags = level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+	int cmf = 0x78;
+	int flg = level_flags << 6;
+	flg += 31 - (cmf*256 + flg) % 31;
+
+	uLong adler = strips[0]->Adler();
+	for( int s = 0; s < strip_count; s++ )
+	{
+		if( s > 0 )
+		{
+			adler = adler32_combine( adler, strips[s]->Adler(), strips[s]->UncompressedSize() );
+		}
+
+		QByteArray data;
+		if( s == 0 )
+		{
+			data.append( (char)cmf );
+			data.append( (char)flg );
+		}
+		data.append( strips[s]->Output() );
+		if( s == strip_count - 1 )
+		{
+			AppendUInt32( data, adler );
+		}
+		success = success && WriteChunk( device, "IDAT", data );
+		delete strips[s];
+	}
+
+	success = success && WriteChunk( device, "IEND", QByteArray() );
+	return success;
+}
@@ -0,0 +1,27 @@
+#ifndef _IMAGE_ENCODER_H_
+#define _IMAGE_ENCODER_H_
+
+#include <QApplication>
+#include <QtWidgets>
+
+// How hard to work at making output files small.
+struct EncodeSettings
+{
+	EncodeSettings();
+
+	int quality;		// JPEG and other lossy formats, 0-100. -1 uses the format's default.
+	int compression;	// PNG zlib level, 0-9. -1 uses the default of 6.
+	bool fast;			// Favour encode speed over file size.
+};
+
+class ImageEncoder
+{
+	public:
+		static bool Save( const QImage& image, QString file_name, const EncodeSettings& settings = EncodeSettings() );
+		static bool Write( const QImage& image, QIODevice* device, QByteArray format, const EncodeSettings& settings = EncodeSettings() );
+
+	private:
+		static bool WritePNG( const QImage& image, QIODevice* device, const EncodeSettings& settings );
+};
+
+#endif
@@ -0,0 +1,350 @@
+///
+/// Decodes and encodes image files on background threads, so large or slow files don't
+/// freeze the main window. Loading reports progress as the file is read, and both loads and
+/// saves can be cancelled part way through. Loads can ask for a reduced resolution preview,
+/// which formats that can scale while decoding (e.g. JPEG) produce far faster than the
+/// full image.
+///
+
+#include "ImageIO.h"
+
+// A file that reports how far a decoder has read through it, and fails reads once the
+// load is cancelled so the decoder gives up.
+class LoadFile : public QFile
+{
+	public:
+		LoadFile( QString file_name, ImageIO* io, int generation )
+		: QFile( file_name ),
+		  mIO( io ),
+		  mGeneration( generation ),
+		  mLastPercent( -1 )
+		{
+		}
+
+	protected:
+		qint64 readData( char* data, qint64 max_size )
+		{
+			if( mIO->IsLoadCancelled( mGeneration ) )
+			{
+				return -1;
+			}
+
+			qint64 read = QFile::readData( data, max_size );
+			int percent = size() > 0 ? (int)(pos()*100/size()) : 0;
+			if( percent != mLastPercent )
+			{
+				mLastPercent = percent;
+				QMetaObject::invokeMethod( mIO, "LoadJobProgress", Qt::QueuedConnection, Q_ARG(int, mGeneration), Q_ARG(int, percent) );
+			}
+			return read;
+		}
+
+	private:
+		ImageIO* mIO;
+		int mGeneration;
+		int mLastPercent;
+};
+
+// A file that fails writes once the save is cancelled, so the encoder gives up.
+class SaveFile : public QSaveFile
+{
+	public:
+		SaveFile( QString file_name, ImageIO* io, int generation )
+		: QSaveFile( file_name ),
+		  mIO( io ),
+		  mGeneration( generation )
+		{
+		}
+
+	protected:
+		qint64 writeData( const char* data, qint64 size )
+		{
+			if( mIO->IsSaveCancelled( mGeneration ) )
+			{
+				return -1;
+			}
+			return QSaveFile::writeData( data, size );
+		}
+
+	private:
+		ImageIO* mIO;
+		int mGeneration;
+};
+
+class LoadJob : public QRunnable
+{
+	public:
+		LoadJob( ImageIO* io, QString file_name, int generation, QSize preview_size )
+		: mIO( io ),
+		  mFileName( file_name ),
+		  mGeneration( generation ),
+		  mPreviewSize( preview_size )
+		{
+		}
+
+		void run();
+
+	private:
+		ImageIO* mIO;
+		QString mFileName;
+		int mGeneration;
+		QSize mPreviewSize;
+};
+
+void
+LoadJob::run()
+///
+/// Decodes the file and hands the image back to the GUI thread. When a preview is asked
+/// for and the format can scale while decoding, the image is decoded straight to the
+/// preview size. Otherwise the full image is decoded, as decoding it and scaling it down
+/// would save nothing.
+///
+/// @return
+///  Nothing.
+///
+{
+	QImage image;
+	bool preview = false;
+	LoadFile file( mFileName, mIO, mGeneration );
+	if( !mIO->IsLoadCancelled( mGeneration ) && file.open( QIODevice::ReadOnly ) )
+	{
+		QImageReader reader( &file );
+		QSize size = reader.size();
+		if( mPreviewSize.isValid() && size.isValid() && reader.supportsOption( QImageIOHandler::ScaledSize ) &&
+			(size.width() > mPreviewSize.width() || size.height() > mPreviewSize.height()) )
+		{
+			reader.setScaledSize( size.scaled( mPreviewSize, Qt::KeepAspectRatio ) );
+			preview = true;
+		}
+		image = reader.read();
+	}
+
+	QMetaObject::invokeMethod( mIO, "LoadJobFinished", Qt::QueuedConnection, Q_ARG(int, mGeneration), Q_ARG(QString, mFileName), Q_ARG(QImage, image), Q_ARG(bool, preview) );
+}
+
+class SaveJob : public QRunnable
+{
+	public:
+		SaveJob( ImageIO* io, QImage image, QString file_name, EncodeSettings settings, int generation )
+		: mIO( io ),
+		  mImage( image ),
+		  mFileName( file_name ),
+		  mSettings( settings ),
+		  mGeneration( generation )
+		{
+		}
+
+		void run();
+
+	private:
+		ImageIO* mIO;
+		QImage mImage;
+		QString mFileName;
+		EncodeSettings mSettings;
+		int mGeneration;
+};
+
+void
+SaveJob::run()
+///
+/// Encodes the image. The file is only replaced once the whole image has been written,
+/// so a cancelled or failed save leaves any existing file untouched.
+///
+/// @return
+///  Nothing.
+///
+{
+	bool success = false;
+	SaveFile file( mFileName, mIO, mGeneration );
+	if( !mIO->IsSaveCancelled( mGeneration ) && file.open( QIODevice::WriteOnly ) )
+	{
+		QByteArray format = QFileInfo( mFileName ).suffix().toLower().toLatin1();
+		success = ImageEncoder::Write( mImage, &file, format, mSettings ) && !mIO->IsSaveCancelled( mGeneration ) && file.commit();
+	}
+
+	QMetaObject::invokeMethod( mIO, "SaveJobFinished", Qt::QueuedConnection, Q_ARG(QString, mFileName), Q_ARG(bool, success) );
+}
+
+ImageIO::ImageIO( QObject* parent )
+///
+/// Constructor.
+///
+/// @param parent
+///  The owner of this object.
+///
+: QObject( parent ),
+  mLoadGeneration( 0 ),
+  mSaveGeneration( 0 ),
+  mLoading( false ),
+  mSavesPending( 0 )
+{
+	// Separate threads for loads and saves keep a slow save from holding up an open
+	mLoadThreadPool.setMaxThreadCount( 1 );
+	mSaveThreadPool.setMaxThreadCount( 1 );
+}
+
+ImageIO::~ImageIO()
+///
+/// Destructor. Abandons a load, but lets saves finish so no file is left half written.
+///
+{
+	CancelLoad();
+	mLoadThreadPool.waitForDone();
+	mSaveThreadPool.waitForDone();
+}
+
+void
+ImageIO::Load( QString file_name, QSize preview_size )
+///
+/// Starts decoding an image file, cancelling the load that is running if there is one.
+/// LoadProgress is emitted as the file is read and LoadFinished once it is decoded.
+///
+/// @param file_name
+///  The file to load.
+///
+/// @param preview_size
+///  If valid, a quick preview that fits in this size is enough. LoadFinished says whether
+///  a preview or the full image was decoded.
+///
+/// @return
+///  Nothing.
+///
+{
+	int generation = mLoadGeneration.fetchAndAddOrdered( 1 ) + 1;
+	mLoading = true;
+	mLoadThreadPool.start( new LoadJob( this, file_name, generation, preview_size ) );
+}
+
+void
+ImageIO::Save( QImage image, QString file_name, const EncodeSettings& settings )
+///
+/// Starts encoding an image to a file. SaveFinished is emitted once it is written.
+///
+/// @param image
+///  The image to save. Images share their data, so this doesn't copy the pixels.
+///
+/// @param file_name
+///  The file to write. The format is picked from the file name.
+///
+/// @param settings
+///  How hard to work at making the file small.
+///
+/// @return
+///  Nothing.
+///
+{
+	mSavesPending++;
+	mSaveThreadPool.start( new SaveJob( this, image, file_name, settings, mSaveGeneration.load() ) );
+}
+
+void
+ImageIO::CancelLoad()
+///
+/// Cancels the running load. LoadFinished won't be emitted for it.
+///
+/// @return
+///  Nothing.
+///
+{
+	mLoadGeneration.fetchAndAddOrdered( 1 );
+	mLoading = false;
+}
+
+void
+ImageIO::CancelSaves()
+///
+/// Cancels the running saves. Each still emits SaveFinished, as a failure.
+///
+/// @return
+///  Nothing.
+///
+{
+	mSaveGeneration.fetchAndAddOrdered( 1 );
+}
+
+bool
+ImageIO::IsLoading() const
+///
+/// @return
+///  True while a load is running.
+///
+{
+	return mLoading;
+}
+
+int
+ImageIO::SavesPending() const
+///
+/// @return
+///  The number of saves that haven't finished yet.
+///
+{
+	return mSavesPending;
+}
+
+bool
+ImageIO::IsLoadCancelled( int generation ) const
+///
+/// @return
+///  True if the load started as the given generation has been cancelled or superseded.
+///  Safe to call from any thread.
+///
+{
+	return mLoadGeneration.load() != generation;
+}
+
+bool
+ImageIO::IsSaveCancelled( int generation ) const
+///
+/// @return
+///  True if the saves started as the given generation have been cancelled. Safe to call
+///  from any thread.
+///
+{
+	return mSaveGeneration.load() != generation;
+}
+
+void
+ImageIO::LoadJobProgress( int generation, int percent )
+///
+/// Passes on the progress of the current load. Called on the GUI thread.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( !IsLoadCancelled( generation ) )
+	{
+		emit LoadProgress( percent );
+	}
+}
+
+void
+ImageIO::LoadJobFinished( int generation, QString file_name, QImage image, bool preview )
+///
+/// Passes on the result of the current load. Results of cancelled loads are dropped.
+/// Called on the GUI thread.
+///
+/// @return
+///  Nothing.
+///
+{
+	if( !IsLoadCancelled( generation ) )
+	{
+		mLoading = false;
+		emit LoadFinished( file_name, image, preview );
+	}
+}
+
+void
+ImageIO::SaveJobFinished( QString file_name, bool success )
+///
+/// Passes on the result of a save. Called on the GUI thread.
+///
+/// @return
+///  Nothing.
+///
+{
+	mSavesPending--;
+	emit SaveFinished( file_name, success );
+}
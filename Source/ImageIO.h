@@ -0,0 +1,51 @@
+#ifndef _IMAGE_IO_H_
+#define _IMAGE_IO_H_
+
+#include <QApplication>
+#include <QtWidgets>
+
+#include "ImageEncoder.h"
+
+class ImageIO : public QObject
+{
+	Q_OBJECT
+
+	public:
+		ImageIO( QObject* parent = 0 );
+		~ImageIO();
+
+		void Load( QString file_name, QSize preview_size = QSize() );
+		void Save( QImage image, QString file_name, const EncodeSettings& settings = EncodeSettings() );
+
+		void CancelLoad();
+		void CancelSaves();
+
+		bool IsLoading() const;
+		int SavesPending() const;
+
+		bool IsLoadCancelled( int generation ) const;
+		bool IsSaveCancelled( int generation ) const;
+
+	signals:
+		void LoadProgress( int percent );
+		void LoadFinished( QString file_name, QImage image, bool preview );
+		void SaveFinished( QString file_name, bool success );
+
+	public slots:
+		void LoadJobProgress( int generation, int percent );
+		void LoadJobFinished( int generation, QString file_name, QImage image, bool preview );
+		void SaveJobFinished( QString file_name, bool success );
+
+	private:
+		QThreadPool mLoadThreadPool;
+		QThreadPool mSaveThreadPool;
+
+		// Bumped to cancel the jobs started before
+		QAtomicInt mLoadGeneration;
+		QAtomicInt mSaveGeneration;
+
+		bool mLoading;
+		int mSavesPending;
+};
+
+#endif
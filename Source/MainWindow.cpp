@@ -11,9 +11,14 @@ MainWindow::MainWindow()
 ///
 /// Constructor
 ///
-: mCurrentImage( NULL ),
+: mBatchDialog( NULL ),
+  mCurrentImage( NULL ),
   mPreviousImage( NULL ),
-  mNextImage( NULL )
+  mNextImage( NULL ),
+  mFullImageTarget( NULL ),
+  mDisplayPyramid( NULL ),
+  mDisplaySourceKey( 0 ),
+  mZoom( 1.0 )
 {
     setWindowTitle( tr( "Image Filter Collection" ) );
     
@@ -21,6 +26,7 @@ MainWindow::MainWindow()
     setMinimumSize( QSize( 200, 200 ) );
 
     mFilterProcessor = new FilterProcessor();
+    mFilterProcessor->SetMemoryBudget( (qint64)QSettings().value( "memory_budget_mb", 0 ).toInt() << 20 );
 
     connect( mFilterProcessor, SIGNAL( FilterDone(QImage) ), this, SLOT( LoadNewImage(QImage) ) );
 
@@ -29,6 +35,7 @@ MainWindow::MainWindow()
 	InitFileMenu();
 	InitEditMenu();
 	InitFilterMenu();
+	InitViewMenu();
 
 	setCentralWidget( mScrollArea );
 	setMinimumSize( mScrollArea->minimumSize() );
@@ -36,6 +43,20 @@ MainWindow::MainWindow()
 	mStatusText = new QLabel;
 	statusBar()->addWidget(mStatusText);
 	connect( mFilterProcessor, SIGNAL( FilterStatus(QString) ), this, SLOT( StatusBarUpdated(QString) ) );
+
+	// Files are decoded and encoded in the background, with their progress in the status bar
+	mImageIO = new ImageIO( this );
+	connect( mImageIO, SIGNAL( LoadProgress(int) ), this, SLOT( OpenProgress(int) ) );
+	connect( mImageIO, SIGNAL( LoadFinished(QString, QImage, bool) ), this, SLOT( OpenFinished(QString, QImage, bool) ) );
+	connect( mImageIO, SIGNAL( SaveFinished(QString, bool) ), this, SLOT( SaveFinished(QString, bool) ) );
+
+	mFileProgress = new QProgressBar;
+	mFileProgress->setMaximumWidth( 150 );
+	mCancelFileButton = new QPushButton( tr("Cancel") );
+	connect( mCancelFileButton, SIGNAL( clicked() ), this, SLOT( CancelFileOperations() ) );
+	statusBar()->addPermanentWidget( mFileProgress );
+	statusBar()->addPermanentWidget( mCancelFileButton );
+	UpdateFileProgress();
 }
 
 MainWindow::~MainWindow()
@@ -45,6 +66,8 @@ MainWindow::~MainWindow()
 {
 	delete mOpenAction;
 	delete mSaveAction;
+	delete mFastSaveAction;
+	delete mBatchAction;
 	delete mFileMenu;
 
 	delete mUndoAction;
@@ -55,13 +78,31 @@ MainWindow::~MainWindow()
 	delete mCannyAction;
 	delete mGaussianAction;
 	delete mInvertAction;
+	delete mMedianAction;
+	delete mUnsharpMaskAction;
+	delete mLargeGaussianAction;
+	delete mCustomGaussianAction;
+	delete mCustomCannyAction;
+	delete mCoarseCannyAction;
 	delete mFilterMenu;
 
+	delete mZoomInAction;
+	delete mZoomOutAction;
+	delete mNormalSizeAction;
+	delete mViewMenu;
+
+	// Let saves that are still being written finish
+	delete mImageIO;
+
+	// The batch dialog has to stop its jobs before the filter library goes away
+	delete mBatchDialog;
 	delete mFilterProcessor;
 
 	delete mPreviousImage;
 	delete mCurrentImage;
 	delete mNextImage;
+
+	delete mDisplayPyramid;
 }
 
 void
@@ -77,22 +118,21 @@ MainWindow::Open()
 	QSettings app_settings;
 
 	// Display an open file dialog at the default folder in the application setting
-	QString file_name = QFileDialog::getOpenFileName( this, tr("Open File"), app_settings.value(default_dir_key).toString(), "Images (*.png *.bmp *.jpg)" );
+	QString file_name = QFileDialog::getOpenFileName( this, tr("Open File"), app_settings.value(default_dir_key).toString(), "Images (*.png *.bmp *.jpg *.tif *.tiff)" );
     if( file_name != "" )
     {
     	// Save the chosen folder as the default in the application settings
     	QDir current_dir;
         app_settings.setValue(default_dir_key, current_dir.absoluteFilePath(file_name));
 
-        // Load the chosen file as the unprocessed image
-        QImage image;
-        image.load( file_name );
-
-        // Update the current image to this image
-        LoadNewImage( image );
-
-        // Resize window to fit new image
-        Resize();
+        // Decode the chosen file in the background. It becomes the current image when done.
+        // A preview at the largest size the window shows is enough to start with.
+        mPendingFilter = "";
+        mPendingSaveFile = "";
+        mFullImageTarget = NULL;
+        mImageIO->Load( file_name, mScrollArea->maximumSize() );
+        StatusBarUpdated( tr("Opening %1...").arg( QFileInfo( file_name ).fileName() ) );
+        UpdateFileProgress();
     }
 }
 
@@ -105,11 +145,279 @@ MainWindow::Save()
 ///  Nothing
 ///
 {
-	QString file_name = QFileDialog::getSaveFileName( this, tr("Save File"), "", "Image (*.png *.bmp *.jpg" );
-    if( file_name != "" && mCurrentImage != NULL && !mCurrentImage->isNull() )
+	QString file_name = QFileDialog::getSaveFileName( this, tr("Save File"), "", "Image (*.png *.bmp *.jpg *.tif *.tiff)" );
+    if( file_name != "" && mCurrentImage != NULL && mPreviewFiles.contains( mCurrentImage ) )
     {
-        mCurrentImage->save( file_name );
+        // Saved once the full image has been decoded
+        LoadFullImage( mCurrentImage );
+        mPendingSaveFile = file_name;
     }
+    else if( file_name != "" && mCurrentImage != NULL && !mCurrentImage->isNull() )
+    {
+        // Encode in the background. Filtering can carry on, as filters never modify the
+        // image being saved.
+        mImageIO->Save( *mCurrentImage, file_name, SaveSettings() );
+        UpdateFileProgress();
+    }
+}
+
+void
+MainWindow::FastCompressionToggled( bool fast )
+///
+/// Remembers whether saves should favour speed over file size.
+///
+/// @return
+///  Nothing
+///
+{
+	QSettings().setValue( "fast_compression", fast );
+}
+
+EncodeSettings
+MainWindow::SaveSettings() const
+///
+/// @return
+///  The encoder settings for saving the current image. The JPEG quality and PNG
+///  compression level can be set in the application settings.
+///
+{
+	QSettings app_settings;
+	EncodeSettings settings;
+	settings.quality = app_settings.value( "save_quality", settings.quality ).toInt();
+	settings.compression = app_settings.value( "save_compression", settings.compression ).toInt();
+	settings.fast = mFastSaveAction->isChecked();
+	return settings;
+}
+
+void
+MainWindow::OpenProgress( int percent )
+///
+/// Shows how far through the file the image being opened has been read.
+///
+/// @param percent
+///  The percentage of the file read so far.
+///
+/// @return
+///  Nothing
+///
+{
+	mFileProgress->setRange( 0, 100 );
+	mFileProgress->setValue( percent );
+}
+
+void
+MainWindow::OpenFinished( QString file_name, QImage image, bool preview )
+///
+/// Makes a newly opened image the current image, or replaces a preview with the full
+/// resolution image and carries out what was waiting for it. The preview may have moved to
+/// another undo slot in the meantime, but the waiting filter or save still applies to it.
+///
+/// @param file_name
+///  The file that was opened.
+///
+/// @param image
+///  The decoded image, or a null image if the file couldn't be decoded.
+///
+/// @param preview
+///  True if the image is a reduced resolution preview.
+///
+/// @return
+///  Nothing
+///
+{
+	QImage* target = mFullImageTarget;
+	mFullImageTarget = NULL;
+	UpdateFileProgress();
+	if( image.isNull() )
+	{
+		StatusBarUpdated( tr("Couldn't open %1.").arg( QFileInfo( file_name ).fileName() ) );
+		mPendingFilter = "";
+		mPendingSaveFile = "";
+		return;
+	}
+	StatusBarUpdated( "" );
+
+	if( target != NULL )
+	{
+		// Keep the image the same size on screen
+		if( target == mCurrentImage )
+		{
+			mZoom *= (double)target->width()/image.width();
+		}
+		*target = image;
+		if( target == mCurrentImage )
+		{
+			UpdateVisibleImage( *mCurrentImage );
+		}
+		mPreviewFiles.remove( target );
+
+		if( mPendingFilter != "" )
+		{
+			StatusBarUpdated( QString("Processing...") );
+			mFilterProcessor->StartFilter( mPendingFilter.toStdString(), *target );
+			mPendingFilter = "";
+		}
+		if( mPendingSaveFile != "" )
+		{
+			mImageIO->Save( *target, mPendingSaveFile, SaveSettings() );
+			mPendingSaveFile = "";
+			UpdateFileProgress();
+		}
+		return;
+	}
+
+	// Update the current image to this image
+	LoadNewImage( image );
+	if( preview )
+	{
+		mPreviewFiles[mCurrentImage] = file_name;
+	}
+
+	// Resize window to fit new image
+	Resize();
+}
+
+void
+MainWindow::LoadFullImage( QImage* preview )
+///
+/// Starts decoding the full resolution version of a preview. A full decode already under
+/// way for another preview is dropped, along with the filter and save waiting for it, as
+/// only one file is loaded at a time. Callers set what waits for this preview afterwards.
+///
+/// @param preview
+///  The undo slot holding the preview.
+///
+/// @return
+///  Nothing
+///
+{
+	if( mFullImageTarget != preview )
+	{
+		mPendingFilter = "";
+		mPendingSaveFile = "";
+		mImageIO->Load( mPreviewFiles.value( preview ) );
+		mFullImageTarget = preview;
+	}
+	StatusBarUpdated( tr("Loading full resolution image...") );
+	UpdateFileProgress();
+}
+
+void
+MainWindow::ReleaseImage( QImage* image )
+///
+/// Deletes one of the undo images, forgetting it was a preview if it was one. A full
+/// decode waiting to replace it is cancelled, along with what was waiting for that.
+///
+/// @param image
+///  The image to delete. May be NULL.
+///
+/// @return
+///  Nothing
+///
+{
+	if( image != NULL )
+	{
+		mPreviewFiles.remove( image );
+		if( image == mFullImageTarget )
+		{
+			mImageIO->CancelLoad();
+			mFullImageTarget = NULL;
+			mPendingFilter = "";
+			mPendingSaveFile = "";
+			UpdateFileProgress();
+		}
+	}
+	delete image;
+}
+
+void
+MainWindow::SaveFinished( QString file_name, bool success )
+///
+/// Reports the outcome of a save.
+///
+/// @param file_name
+///  The file that was written.
+///
+/// @param success
+///  True if the image was saved.
+///
+/// @return
+///  Nothing
+///
+{
+	UpdateFileProgress();
+	if( success )
+	{
+		StatusBarUpdated( tr("Saved %1.").arg( QFileInfo( file_name ).fileName() ) );
+	}
+	else
+	{
+		StatusBarUpdated( tr("%1 was not saved.").arg( QFileInfo( file_name ).fileName() ) );
+	}
+}
+
+void
+MainWindow::CancelFileOperations()
+///
+/// Cancels the files being opened and saved.
+///
+/// @return
+///  Nothing
+///
+{
+	if( mImageIO->IsLoading() )
+	{
+		StatusBarUpdated( tr("Open cancelled.") );
+	}
+	mImageIO->CancelLoad();
+	mFullImageTarget = NULL;
+	mPendingFilter = "";
+	mPendingSaveFile = "";
+	mImageIO->CancelSaves();
+	UpdateFileProgress();
+}
+
+void
+MainWindow::UpdateFileProgress()
+///
+/// Shows the file progress bar and cancel button while files are being opened or saved.
+/// Saves don't report how far along they are, so they show a busy bar.
+///
+/// @return
+///  Nothing
+///
+{
+	bool busy = mImageIO->IsLoading() || mImageIO->SavesPending() > 0;
+	if( !mImageIO->IsLoading() )
+	{
+		mFileProgress->setRange( 0, 0 );
+	}
+	else if( mFileProgress->maximum() == 0 )
+	{
+		mFileProgress->setRange( 0, 100 );
+		mFileProgress->setValue( 0 );
+	}
+	mFileProgress->setVisible( busy );
+	mCancelFileButton->setVisible( busy );
+}
+
+void
+MainWindow::BatchApply()
+///
+/// Displays the batch dialog for filtering a whole folder of images. The dialog is not
+/// modal, so the current image can still be worked on while a batch runs.
+///
+/// @return
+///  Nothing
+///
+{
+	if( mBatchDialog == NULL )
+	{
+		mBatchDialog = new BatchDialog( mFilterProcessor, mFilterMenu->actions(), this );
+	}
+	mBatchDialog->show();
+	mBatchDialog->raise();
+	mBatchDialog->activateWindow();
 }
 
 void
@@ -125,10 +433,54 @@ MainWindow::FilterTriggered( QAction* action )
 ///  Nothing. The filter processor is in charge of letting us know when the filtering is done.
 ///
 {
-	if( mCurrentImage != NULL && !mCurrentImage->isNull() && action != NULL )
+	QString filter_name = action != NULL ? action->objectName() : "";
+	if( action == mCustomGaussianAction )
+	{
+		QSettings app_settings;
+		bool accepted = false;
+		double sigma = QInputDialog::getDouble( this, tr("Gaussian Blur"), tr("Sigma (pixels):"),
+			app_settings.value( "custom_sigma", 2.0 ).toDouble(), 0.0, 256.0, 2, &accepted );
+		if( !accepted )
+		{
+			return;
+		}
+		app_settings.setValue( "custom_sigma", sigma );
+		filter_name = QString( "gaussian:sigma=%1" ).arg( sigma );
+	}
+	else if( action == mCustomCannyAction )
+	{
+		// Trying other thresholds on the same image (undo, then run again) only reruns the
+		// edge tracing, so it takes a fraction of the first run. Only this path keeps the
+		// gradients for that, as other runs rarely see the same image twice.
+		QSettings app_settings;
+		bool accepted = false;
+		int high_threshold = QInputDialog::getInt( this, tr("Canny Edge Detection"), tr("Gradient that starts an edge (0-255):"),
+			app_settings.value( "custom_canny_high", 80 ).toInt(), 0, 255, 1, &accepted );
+		if( !accepted )
+		{
+			return;
+		}
+		int low_threshold = QInputDialog::getInt( this, tr("Canny Edge Detection"), tr("Gradient that continues an edge (0-%1):").arg( high_threshold ),
+			qMin( app_settings.value( "custom_canny_low", 20 ).toInt(), high_threshold ), 0, high_threshold, 1, &accepted );
+		if( !accepted )
+		{
+			return;
+		}
+		app_settings.setValue( "custom_canny_high", high_threshold );
+		app_settings.setValue( "custom_canny_low", low_threshold );
+		filter_name = QString( "canny:low_threshold=%1:high_threshold=%2:cache_gradients=1" ).arg( low_threshold ).arg( high_threshold );
+	}
+
+	if( mCurrentImage != NULL && mPreviewFiles.contains( mCurrentImage ) && action != NULL )
+	{
+		// Filtered once the full image has been decoded
+		LoadFullImage( mCurrentImage );
+		mPendingFilter = filter_name;
+	}
+	else if( mCurrentImage != NULL && !mCurrentImage->isNull() && action != NULL )
 	{
 		StatusBarUpdated( QString("Processing...") );
-		mFilterProcessor->StartFilter( action->objectName().toStdString(), *mCurrentImage );
+		mFilterProcessor->StartFilter( filter_name.toStdString(), *mCurrentImage );
 	}
 	else
 	{
@@ -147,10 +499,7 @@ MainWindow::Undo()
 {
 	// Move current image to the next image slot so we can return to it
 	// with a redo
-	if( mNextImage != NULL )
-	{
-		delete mNextImage;
-	}
+	ReleaseImage( mNextImage );
 	mNextImage = mCurrentImage;
 
 	// Set previous image as the current image
@@ -172,10 +521,7 @@ MainWindow::Redo()
 ///
 {
 	// Move the current image to the previous image slot
-	if( mPreviousImage != NULL )
-	{
-		delete mPreviousImage;
-	}
+	ReleaseImage( mPreviousImage );
 	mPreviousImage = mCurrentImage;
 
 	// Set next image as the current image
@@ -187,6 +533,54 @@ MainWindow::Redo()
 	UpdateEditMenuStates();
 }
 
+void
+MainWindow::ZoomIn()
+///
+/// Doubles the zoom level of the visible image, up to 4x.
+///
+/// @return
+///  Nothing
+///
+{
+	if( mZoom < 4.0 && mCurrentImage != NULL )
+	{
+		mZoom *= 2.0;
+		UpdateVisibleImage( *mCurrentImage );
+	}
+}
+
+void
+MainWindow::ZoomOut()
+///
+/// Halves the zoom level of the visible image, down to 1/64.
+///
+/// @return
+///  Nothing
+///
+{
+	if( mZoom > 1.0/64.0 && mCurrentImage != NULL )
+	{
+		mZoom /= 2.0;
+		UpdateVisibleImage( *mCurrentImage );
+	}
+}
+
+void
+MainWindow::NormalSize()
+///
+/// Shows the visible image at its actual size.
+///
+/// @return
+///  Nothing
+///
+{
+	if( mCurrentImage != NULL )
+	{
+		mZoom = 1.0;
+		UpdateVisibleImage( *mCurrentImage );
+	}
+}
+
 void 
 MainWindow::LoadNewImage( QImage image )
 ///
@@ -200,19 +594,13 @@ MainWindow::LoadNewImage( QImage image )
 ///
 {
 	// Move the past image to be the previous image
-	if( mPreviousImage != NULL )
-	{
-		delete mPreviousImage;
-	}
+	ReleaseImage( mPreviousImage );
 
 	mPreviousImage = mCurrentImage;
 
 	// Delete next image if it exists, redo functionality will be reset.
-	if( mNextImage != NULL )
-	{
-		delete mNextImage;
-		mNextImage = NULL;
-	}
+	ReleaseImage( mNextImage );
+	mNextImage = NULL;
 
 	// Set this image as the current image
 	mCurrentImage = new QImage();
@@ -236,8 +624,37 @@ MainWindow::UpdateVisibleImage( QImage image )
 /// @return
 ///  Nothing
 {
-	mImageContainer->setPixmap( QPixmap::fromImage( image ) );
-    mImageContainer->adjustSize();
+	// A display pyramid made for an earlier image is of no further use
+	if( mDisplayPyramid != NULL && image.cacheKey() != mDisplaySourceKey )
+	{
+		delete mDisplayPyramid;
+		mDisplayPyramid = NULL;
+		mDisplayImage = QImage();
+	}
+
+	// When zoomed out, show the smallest pyramid level that still has enough resolution
+	// rather than scaling down the full image every time the view is painted. Level 0 is
+	// the image itself, so the display copy and its pyramid are only made for a smaller one.
+	int level = ImagePyramid::ChooseLevel( mZoom, ImagePyramid::LevelCountFor( image.width(), image.height() ) );
+	if( level == 0 )
+	{
+		mImageContainer->setPixmap( QPixmap::fromImage( image ) );
+	}
+	else
+	{
+		if( mDisplayPyramid == NULL )
+		{
+			mDisplaySourceKey = image.cacheKey();
+			mDisplayImage = image.convertToFormat( QImage::Format_ARGB32 );
+			mDisplayPyramid = new ImagePyramid( const_cast<uchar*>( mDisplayImage.constBits() ), mDisplayImage.width(), mDisplayImage.height(), 4 );
+		}
+
+		int level_width = mDisplayPyramid->LevelWidth( level );
+		int level_height = mDisplayPyramid->LevelHeight( level );
+		QImage level_image( mDisplayPyramid->Level( level ), level_width, level_height, level_width*4, QImage::Format_ARGB32 );
+		mImageContainer->setPixmap( QPixmap::fromImage( level_image ) );
+	}
+	mImageContainer->resize( image.size()*mZoom );
 }
 
 void
@@ -299,6 +716,12 @@ MainWindow::InitFileMenu()
 {
 	mOpenAction = new QAction( tr("&Open"), this );
 	mSaveAction = new QAction( tr("&Save"), this );	
+	mFastSaveAction = new QAction( tr("&Fast Compression"), this );
+	mBatchAction = new QAction( tr("&Batch Apply..."), this );
+
+	// Trades file size for save speed. Remembered between runs.
+	mFastSaveAction->setCheckable( true );
+	mFastSaveAction->setChecked( QSettings().value( "fast_compression", false ).toBool() );
 
 	// Ghost the save action as it needs an image to be loaded to function correctly.
 	// Connect the action so it turns back on when an image is set successfully.
@@ -308,10 +731,15 @@ MainWindow::InitFileMenu()
 	// Connect the actions to their slots
 	connect( mOpenAction, SIGNAL( triggered() ), this, SLOT( Open() ) );
 	connect( mSaveAction, SIGNAL( triggered() ), this, SLOT( Save() ) );
+	connect( mFastSaveAction, SIGNAL( toggled(bool) ), this, SLOT( FastCompressionToggled(bool) ) );
+	connect( mBatchAction, SIGNAL( triggered() ), this, SLOT( BatchApply() ) );
 
 	mFileMenu = menuBar()->addMenu( tr("&File") );
 	mFileMenu->addAction( mOpenAction );
 	mFileMenu->addAction( mSaveAction );
+	mFileMenu->addAction( mFastSaveAction );
+	mFileMenu->addSeparator();
+	mFileMenu->addAction( mBatchAction );
 }
 
 void
@@ -361,12 +789,45 @@ MainWindow::InitFilterMenu()
 	mGaussianAction->setObjectName("gaussian");
 	mInvertAction = new QAction( tr("&Invert"), this);
 	mInvertAction->setObjectName("invert");
+	mMedianAction = new QAction( tr("&Median"), this);
+	mMedianAction->setObjectName("median");
+	mUnsharpMaskAction = new QAction( tr("&Unsharp Mask"), this);
+	mUnsharpMaskAction->setObjectName("unsharp_mask");
+	mLargeGaussianAction = new QAction( tr("&Large Gaussian Blur"), this);
+	mLargeGaussianAction->setObjectName("gaussian_large");
+	mCoarseCannyAction = new QAction( tr("C&oarse Canny Edge Detection"), this);
+	mCoarseCannyAction->setObjectName("canny_coarse");
+
+	// Ask for their parameters, so they have no fixed filter name
+	mCustomGaussianAction = new QAction( tr("Gaussian Blur with &Sigma..."), this);
+	mCustomCannyAction = new QAction( tr("Canny Edge Detection with &Thresholds..."), this);
 
 	mFilterMenu = menuBar()->addMenu( tr("&Filters") );
 	mFilterMenu->addAction( mBoxBlurAction );
 	mFilterMenu->addAction( mCannyAction );
 	mFilterMenu->addAction( mGaussianAction );
 	mFilterMenu->addAction( mInvertAction );
+	mFilterMenu->addAction( mMedianAction );
+	mFilterMenu->addAction( mUnsharpMaskAction );
+	mFilterMenu->addAction( mLargeGaussianAction );
+	mFilterMenu->addAction( mCoarseCannyAction );
+	mFilterMenu->addAction( mCustomGaussianAction );
+	mFilterMenu->addAction( mCustomCannyAction );
+
+	// Filters loaded from plugins follow the built in ones. Their actions belong to the
+	// window, which deletes them.
+	const std::vector<PluginFilter>& plugin_filters = mFilterProcessor->PluginFilters();
+	if( !plugin_filters.empty() )
+	{
+		mFilterMenu->addSeparator();
+	}
+	for( size_t f = 0; f < plugin_filters.size(); f++ )
+	{
+		QAction* action = new QAction( plugin_filters[f].menu_text, this );
+		action->setObjectName( QString::fromStdString( plugin_filters[f].name ) );
+		action->setStatusTip( tr("From %1").arg( QFileInfo( plugin_filters[f].library ).fileName() ) );
+		mFilterMenu->addAction( action );
+	}
 
 	// Call the filter triggered slot when any menu item is triggered.
 	connect( mFilterMenu, SIGNAL( triggered(QAction*) ), this, SLOT( FilterTriggered(QAction*) ) );
@@ -376,6 +837,36 @@ MainWindow::InitFilterMenu()
 	connect( this, SIGNAL( ImageLoaded(bool) ), mFilterMenu, SLOT( setEnabled(bool) ) );
 }
 
+void
+MainWindow::InitViewMenu()
+///
+/// Initializes the view menu and it's associated actions
+///
+/// @return
+///  Nothing
+///
+{
+	mZoomInAction = new QAction( tr("Zoom &In"), this );
+	mZoomInAction->setShortcut( QKeySequence::ZoomIn );
+	mZoomOutAction = new QAction( tr("Zoom &Out"), this );
+	mZoomOutAction->setShortcut( QKeySequence::ZoomOut );
+	mNormalSizeAction = new QAction( tr("&Normal Size"), this );
+	mNormalSizeAction->setShortcut( tr("Ctrl+0") );
+
+	mViewMenu = menuBar()->addMenu( tr("&View") );
+	mViewMenu->addAction( mZoomInAction );
+	mViewMenu->addAction( mZoomOutAction );
+	mViewMenu->addAction( mNormalSizeAction );
+
+	connect( mZoomInAction, SIGNAL( triggered() ), this, SLOT( ZoomIn() ) );
+	connect( mZoomOutAction, SIGNAL( triggered() ), this, SLOT( ZoomOut() ) );
+	connect( mNormalSizeAction, SIGNAL( triggered() ), this, SLOT( NormalSize() ) );
+
+	// Disable the view menu when no image is loaded
+	mViewMenu->setDisabled( true );
+	connect( this, SIGNAL( ImageLoaded(bool) ), mViewMenu, SLOT( setEnabled(bool) ) );
+}
+
 void
 MainWindow::InitImagePane()
 ///
@@ -4,7 +4,10 @@
 #include <QApplication>
 #include <QtWidgets>
 
+#include "BatchDialog.h"
 #include "FilterProcessor.h"
+#include "ImageIO.h"
+#include "Filters/ImagePyramid.h"
 
 class MainWindow : public QMainWindow
 {
@@ -20,13 +23,23 @@ class MainWindow : public QMainWindow
 	public slots:
     	void Open();
     	void Save();
+    	void BatchApply();
     	void LoadNewImage( QImage image );
     	void FilterTriggered( QAction* action );
     	void Undo();
     	void Redo();
+    	void ZoomIn();
+    	void ZoomOut();
+    	void NormalSize();
 
     	void StatusBarUpdated(QString);
 
+    	void OpenProgress( int percent );
+    	void OpenFinished( QString file_name, QImage image, bool preview );
+    	void SaveFinished( QString file_name, bool success );
+    	void CancelFileOperations();
+    	void FastCompressionToggled( bool fast );
+
     signals:
     	void UndoIsActive(bool active);
     	void RedoIsActive(bool active);
@@ -35,28 +48,56 @@ class MainWindow : public QMainWindow
 	private:
 		void UpdateVisibleImage( QImage image );
 		void UpdateEditMenuStates();
+		void UpdateFileProgress();
+		void LoadFullImage( QImage* preview );
+		void ReleaseImage( QImage* image );
+		EncodeSettings SaveSettings() const;
 
         void InitImagePane();
 		void InitFileMenu();
 		void InitEditMenu();
 		void InitFilterMenu();
+		void InitViewMenu();
 
 		FilterProcessor* mFilterProcessor;
+		BatchDialog* mBatchDialog;
+		ImageIO* mImageIO;
 
 		QImage* mCurrentImage;
 		QImage* mPreviousImage;
 		QImage* mNextImage;
 
+		// Images opened as reduced resolution previews, whose full decode is put off until a
+		// filter or a save needs the full resolution pixels. Every undo slot holding a preview
+		// is listed with its file, so no preview is ever filtered or saved in place of the
+		// full image. mFullImageTarget is the preview being decoded in full, and the pending
+		// filter and save are waiting for it.
+		QMap<QImage*, QString> mPreviewFiles;
+		QImage* mFullImageTarget;
+		QString mPendingFilter;
+		QString mPendingSaveFile;
+
+		// Reduced resolution copies of the visible image used when zoomed out
+		ImagePyramid* mDisplayPyramid;
+		QImage mDisplayImage;
+		qint64 mDisplaySourceKey;
+		double mZoom;
+
 		QScrollArea* mScrollArea;
 		QLabel* mImageContainer;
 		QLabel* mStatusText;
+		QProgressBar* mFileProgress;
+		QPushButton* mCancelFileButton;
 
 		QMenu* mFileMenu;
 		QMenu* mEditMenu;
 		QMenu* mFilterMenu;
+		QMenu* mViewMenu;
 
 		QAction* mOpenAction;
 		QAction* mSaveAction;
+		QAction* mFastSaveAction;
+		QAction* mBatchAction;
 
 		QAction* mUndoAction;
 		QAction* mRedoAction;
@@ -65,6 +106,16 @@ class MainWindow : public QMainWindow
 		QAction* mCannyAction;
 		QAction* mGaussianAction;
 		QAction* mInvertAction;
+		QAction* mMedianAction;
+		QAction* mUnsharpMaskAction;
+		QAction* mLargeGaussianAction;
+		QAction* mCoarseCannyAction;
+		QAction* mCustomGaussianAction;
+		QAction* mCustomCannyAction;
+
+		QAction* mZoomInAction;
+		QAction* mZoomOutAction;
+		QAction* mNormalSizeAction;
 };
 
 #endif
\ No newline at end of file
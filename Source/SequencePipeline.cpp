@@ -0,0 +1,292 @@
+///
+/// Applies a recipe of filters to a sequence of frames, such as a time-lapse, as a
+/// pipeline. Decoding, filtering and encoding run as separate stages on their own
+/// threads, handing frames on through queues, so every stage works on a different frame
+/// at the same time and the slowest stage sets the pace. A fixed set of decode buffers
+/// goes round the pipeline: a frame takes one to be decoded into and gives it back once
+/// it is saved. That bounds the number of frames in flight and the memory they use, and
+/// frames of the same size and format are decoded into the previous frame's pixels
+/// without allocating. Frames are handed to the encoders in sequence order.
+///
+
+#include "SequencePipeline.h"
+#include "BatchProcessor.h"
+#include "ExecutionPlanner.h"
+#include "FilterProcessor.h"
+
+class StageJob : public QRunnable
+{
+	public:
+		StageJob( SequencePipeline* pipeline, SequencePipeline::Stage stage )
+		: mPipeline( pipeline ),
+		  mStage( stage )
+		{
+		}
+
+		void run()
+		{
+			mPipeline->RunStage( mStage );
+		}
+
+	private:
+		SequencePipeline* mPipeline;
+		SequencePipeline::Stage mStage;
+};
+
+SequencePipeline::SequencePipeline( BatchProcessor* processor )
+///
+/// Constructor.
+///
+/// @param processor
+///  The batch processor that is told as each frame finishes, and whose cancel flag stops
+///  the pipeline.
+///
+: mProcessor( processor ),
+  mMemoryBudget( 0 ),
+  mNextDecode( 0 ),
+  mDecodersRunning( 0 ),
+  mNextEncode( 0 )
+{
+}
+
+SequencePipeline::~SequencePipeline()
+///
+/// Destructor. Waits for the stages to finish. Cancel the batch first to make that quick.
+///
+{
+	WaitForDone();
+}
+
+void
+SequencePipeline::Start( QStringList input_files, QStringList output_files, std::vector< boost::shared_ptr<Filter> > recipe, EncodeSettings settings, int concurrency )
+///
+/// Starts filtering a sequence of frames in the background.
+///
+/// @param input_files
+///  The frames, in sequence order.
+///
+/// @param output_files
+///  The file each frame's result is saved to.
+///
+/// @param recipe
+///  The filters to apply to each frame, in order.
+///
+/// @param settings
+///  How the results are encoded.
+///
+/// @param concurrency
+///  The number of threads in each stage. Twice as many frames are in flight, so every
+///  stage has work queued while the others are busy.
+///
+/// @return
+///  Nothing.
+///
+{
+	WaitForDone();
+
+	concurrency = qMax( 1, concurrency );
+	mInputFiles = input_files;
+	mOutputFiles = output_files;
+	mRecipe = recipe;
+	mSettings = settings;
+	mMemoryBudget = ExecutionPlanner::DefaultBudget()/(2*concurrency);
+
+	mBuffers.assign( 2*concurrency, QImage() );
+	mFreeBuffers.clear();
+	for( int b = 0; b < (int)mBuffers.size(); b++ )
+	{
+		mFreeBuffers << b;
+	}
+	mNextDecode = 0;
+	mDecodersRunning = concurrency;
+	mDecoded.clear();
+	mFiltered.clear();
+	mNextEncode = 0;
+
+	// Idle stages wait on their queue, so a thread per stage slot doesn't oversubscribe
+	// the processors. Whichever stage is the bottleneck gets them all.
+	mThreadPool.setMaxThreadCount( 3*concurrency );
+	for( int t = 0; t < concurrency; t++ )
+	{
+		mThreadPool.start( new StageJob( this, STAGE_ENCODE ) );
+		mThreadPool.start( new StageJob( this, STAGE_FILTER ) );
+		mThreadPool.start( new StageJob( this, STAGE_DECODE ) );
+	}
+}
+
+void
+SequencePipeline::WaitForDone()
+///
+/// Waits until every frame of the current sequence has been through the pipeline.
+///
+/// @return
+///  Nothing.
+///
+{
+	mThreadPool.waitForDone();
+}
+
+void
+SequencePipeline::RunStage( Stage stage )
+///
+/// Runs one thread of a stage until the sequence is done.
+///
+/// @param stage
+///  The stage.
+///
+/// @return
+///  Nothing.
+///
+{
+	switch( stage )
+	{
+		case STAGE_DECODE:
+			DecodeFrames();
+			break;
+		case STAGE_FILTER:
+			FilterFrames();
+			break;
+		case STAGE_ENCODE:
+			EncodeFrames();
+			break;
+	}
+}
+
+void
+SequencePipeline::DecodeFrames()
+///
+/// Decodes frames in sequence order into free buffers and queues them to be filtered.
+/// Once the batch is cancelled the remaining frames go through the pipeline undecoded,
+/// so that each is still reported as failed.
+///
+/// @return
+///  Nothing.
+///
+{
+	QMutexLocker locker( &mMutex );
+	while( true )
+	{
+		while( mNextDecode < mInputFiles.size() && mFreeBuffers.isEmpty() )
+		{
+			mBufferFreed.wait( &mMutex );
+		}
+		if( mNextDecode >= mInputFiles.size() )
+		{
+			break;
+		}
+
+		Frame frame;
+		frame.index = mNextDecode++;
+		frame.buffer = mFreeBuffers.takeFirst();
+		if( mNextDecode >= mInputFiles.size() )
+		{
+			mBufferFreed.wakeAll();
+		}
+		locker.unlock();
+
+		frame.success = false;
+		if( !mProcessor->IsCancelled() )
+		{
+			QImageReader reader( mInputFiles[frame.index] );
+			frame.success = reader.read( &mBuffers[frame.buffer] );
+		}
+
+		locker.relock();
+		mDecoded.enqueue( frame );
+		mFrameDecoded.wakeOne();
+	}
+
+	// The filter threads stop once the last decoder is done and the queue is empty
+	mDecodersRunning--;
+	if( mDecodersRunning == 0 )
+	{
+		mFrameDecoded.wakeAll();
+	}
+}
+
+void
+SequencePipeline::FilterFrames()
+///
+/// Runs the recipe on decoded frames, in whatever order they arrive, and queues the
+/// results to be encoded.
+///
+/// @return
+///  Nothing.
+///
+{
+	QMutexLocker locker( &mMutex );
+	while( true )
+	{
+		while( mDecoded.isEmpty() && mDecodersRunning > 0 )
+		{
+			mFrameDecoded.wait( &mMutex );
+		}
+		if( mDecoded.isEmpty() )
+		{
+			break;
+		}
+		Frame frame = mDecoded.dequeue();
+		locker.unlock();
+
+		// The result must not share pixels with the decode buffer, or the next frame
+		// decoded into the buffer would have to allocate a copy
+		if( frame.success )
+		{
+			QImage image = mBuffers[frame.buffer];
+			for( size_t f = 0; f < mRecipe.size() && frame.success && !mProcessor->IsCancelled(); f++ )
+			{
+				image = FilterProcessor::ApplyFilter( mRecipe[f].get(), image, NULL, mMemoryBudget );
+				frame.success = !image.isNull();
+			}
+			frame.success = frame.success && !mProcessor->IsCancelled();
+			if( frame.success )
+			{
+				frame.result = image;
+			}
+		}
+
+		locker.relock();
+		mFiltered.insert( frame.index, frame );
+		mFrameFiltered.wakeAll();
+	}
+}
+
+void
+SequencePipeline::EncodeFrames()
+///
+/// Takes filtered frames in sequence order, saves them, reports them to the batch
+/// processor and frees their buffers for the frames to come.
+///
+/// @return
+///  Nothing.
+///
+{
+	QMutexLocker locker( &mMutex );
+	while( true )
+	{
+		while( mNextEncode < mInputFiles.size() && !mFiltered.contains( mNextEncode ) )
+		{
+			mFrameFiltered.wait( &mMutex );
+		}
+		if( mNextEncode >= mInputFiles.size() )
+		{
+			break;
+		}
+
+		Frame frame = mFiltered.take( mNextEncode++ );
+		if( mNextEncode >= mInputFiles.size() || mFiltered.contains( mNextEncode ) )
+		{
+			// Another encoder can start on the next frame, or stop if this was the last
+			mFrameFiltered.wakeAll();
+		}
+		locker.unlock();
+
+		bool success = frame.success && !mProcessor->IsCancelled() && ImageEncoder::Save( frame.result, mOutputFiles[frame.index], mSettings );
+		frame.result = QImage();
+		QMetaObject::invokeMethod( mProcessor, "JobFinished", Qt::QueuedConnection, Q_ARG(QString, mInputFiles[frame.index]), Q_ARG(bool, success) );
+
+		locker.relock();
+		mFreeBuffers << frame.buffer;
+		mBufferFreed.wakeOne();
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef _SEQUENCE_PIPELINE_H_
+#define _SEQUENCE_PIPELINE_H_
+
+#include <QApplication>
+#include <QtWidgets>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "Filter.h"
+#include "ImageEncoder.h"
+
+class BatchProcessor;
+
+class SequencePipeline
+{
+	public:
+		SequencePipeline( BatchProcessor* processor );
+		~SequencePipeline();
+
+		void Start( QStringList input_files, QStringList output_files, std::vector< boost::shared_ptr<Filter> > recipe, EncodeSettings settings, int concurrency );
+		void WaitForDone();
+
+	private:
+		friend class StageJob;
+
+		enum Stage
+		{
+			STAGE_DECODE,
+			STAGE_FILTER,
+			STAGE_ENCODE
+		};
+
+		struct Frame
+		{
+			int index;
+			int buffer;			// The decode buffer the frame holds until it is saved
+			QImage result;
+			bool success;
+		};
+
+		void RunStage( Stage stage );
+		void DecodeFrames();
+		void FilterFrames();
+		void EncodeFrames();
+
+		BatchProcessor* mProcessor;
+		QThreadPool mThreadPool;
+
+		QStringList mInputFiles;
+		QStringList mOutputFiles;
+		std::vector< boost::shared_ptr<Filter> > mRecipe;
+		EncodeSettings mSettings;
+		qint64 mMemoryBudget;
+
+		// Everything below is shared between the stages and guarded by mMutex
+		QMutex mMutex;
+		QWaitCondition mBufferFreed;
+		QWaitCondition mFrameDecoded;
+		QWaitCondition mFrameFiltered;
+
+		std::vector<QImage> mBuffers;
+		QList<int> mFreeBuffers;
+		int mNextDecode;
+		int mDecodersRunning;
+		QQueue<Frame> mDecoded;
+		QMap<int, Frame> mFiltered;
+		int mNextEncode;
+};
+
+#endif
\ No newline at end of file
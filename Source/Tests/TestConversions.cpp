@@ -0,0 +1,224 @@
+///
+/// Checks the lookup tables and the gray, luma and add conversions, whose SIMD code paths
+/// must give exactly the bytes of their scalar code, and the summed-area table queries
+/// against sums taken pixel by pixel.
+///
+
+#include "TestConversions.h"
+#include "TestImages.h"
+
+#include "Filters/CpuFeatures.h"
+#include "Filters/ImageAlgorithms.h"
+#include "Filters/LookupTable.h"
+
+#include <algorithm>
+
+void
+TestConversions::cleanup()
+///
+/// Turns SIMD back on after a test that turned it off, even if the test failed.
+///
+{
+	CpuFeatures::SetSimdEnabled( true );
+}
+
+void
+TestConversions::LookupTableMatchesScalar()
+///
+/// Applies a table that is the same for every color channel and one that differs per
+/// channel, to images of one, two and four channels with and without alpha.
+///
+{
+	uchar ramp[256];
+	for( int v = 0; v < 256; v++ )
+	{
+		ramp[v] = (uchar)(v*7 + 3);
+	}
+	LookupTable per_channel = LookupTable::Gamma( 0.6 );
+	per_channel.SetChannelTable( 1, ramp );
+
+	LookupTable tables[2] = { LookupTable::Gamma( 2.2 ), per_channel };
+	int channel_counts[3] = { 1, 2, 4 };
+	for( int t = 0; t < 2; t++ )
+	{
+		for( int c = 0; c < 3; c++ )
+		{
+			int channels = channel_counts[c];
+			for( int alpha_channel = -1; alpha_channel < channels; alpha_channel += channels )
+			{
+				size_t count = (size_t)TEST_WIDTH*TEST_HEIGHT*channels;
+				std::vector<uchar> source = RandomPixels( count, 1 );
+				std::vector<uchar> simd( count );
+				std::vector<uchar> scalar( count );
+				tables[t].Apply( &source[0], &simd[0], TEST_WIDTH, TEST_HEIGHT, channels, alpha_channel );
+				CpuFeatures::SetSimdEnabled( false );
+				tables[t].Apply( &source[0], &scalar[0], TEST_WIDTH, TEST_HEIGHT, channels, alpha_channel );
+				CpuFeatures::SetSimdEnabled( true );
+				QVERIFY( simd == scalar );
+
+				for( size_t n = 0; n < count; n++ )
+				{
+					int channel = (int)(n % channels);
+					uchar expected = channel == alpha_channel ? source[n] : tables[t].ChannelTable( channel )[source[n]];
+					QCOMPARE( scalar[n], expected );
+				}
+			}
+		}
+	}
+}
+
+void
+TestConversions::LookupTableComposes()
+///
+/// A composed table gives what applying its parts one after the other does.
+///
+{
+	LookupTable first = LookupTable::Levels( 20, 230 );
+	LookupTable second = LookupTable::Invert();
+	LookupTable composed = first.Then( second );
+
+	size_t count = (size_t)TEST_WIDTH*TEST_HEIGHT*4;
+	std::vector<uchar> source = RandomPixels( count, 2 );
+	std::vector<uchar> stepwise( count );
+	std::vector<uchar> once( count );
+	first.Apply( &source[0], &stepwise[0], TEST_WIDTH, TEST_HEIGHT );
+	second.Apply( &stepwise[0], &stepwise[0], TEST_WIDTH, TEST_HEIGHT );
+	composed.Apply( &source[0], &once[0], TEST_WIDTH, TEST_HEIGHT );
+	QVERIFY( once == stepwise );
+}
+
+void
+TestConversions::GrayScaleMatchesScalar()
+///
+/// Converts four channel images with alpha, which have a SIMD path, and three channel ones.
+///
+{
+	for( int channels = 3; channels <= 4; channels++ )
+	{
+		size_t count = (size_t)TEST_WIDTH*TEST_HEIGHT*channels;
+		std::vector<uchar> source = RandomPixels( count, 3 );
+		std::vector<uchar> simd( count );
+		std::vector<uchar> scalar( count );
+		ImageAlgorithms::GrayScale( &source[0], &simd[0], TEST_WIDTH, TEST_HEIGHT, channels, 3 );
+		CpuFeatures::SetSimdEnabled( false );
+		ImageAlgorithms::GrayScale( &source[0], &scalar[0], TEST_WIDTH, TEST_HEIGHT, channels, 3 );
+		CpuFeatures::SetSimdEnabled( true );
+		QVERIFY( simd == scalar );
+	}
+}
+
+void
+TestConversions::LumaMatchesScalar()
+///
+/// Converts with both standards, from three and four channels in either color order.
+///
+{
+	LumaStandard standards[2] = { LUMA_BT601, LUMA_BT709 };
+	for( int s = 0; s < 2; s++ )
+	{
+		for( int channels = 3; channels <= 4; channels++ )
+		{
+			for( int blue_first = 0; blue_first < 2; blue_first++ )
+			{
+				size_t pixels = (size_t)TEST_WIDTH*TEST_HEIGHT;
+				std::vector<uchar> source = RandomPixels( pixels*channels, 4 );
+				std::vector<uchar> simd( pixels );
+				std::vector<uchar> scalar( pixels );
+				ImageAlgorithms::ConvertToLuma( &source[0], &simd[0], TEST_WIDTH, TEST_HEIGHT, standards[s], channels, blue_first != 0 );
+				CpuFeatures::SetSimdEnabled( false );
+				ImageAlgorithms::ConvertToLuma( &source[0], &scalar[0], TEST_WIDTH, TEST_HEIGHT, standards[s], channels, blue_first != 0 );
+				CpuFeatures::SetSimdEnabled( true );
+				QVERIFY( simd == scalar );
+			}
+		}
+	}
+
+	// White stays white and black stays black with either set of weights
+	uchar white[4] = { 255, 255, 255, 255 };
+	uchar black[4] = { 0, 0, 0, 255 };
+	uchar luma = 0;
+	ImageAlgorithms::ConvertToLuma( white, &luma, 1, 1, LUMA_BT709 );
+	QCOMPARE( luma, (uchar)255 );
+	ImageAlgorithms::ConvertToLuma( black, &luma, 1, 1, LUMA_BT601 );
+	QCOMPARE( luma, (uchar)0 );
+}
+
+void
+TestConversions::AddImagesMatchesScalar()
+///
+/// Adds two noise images, which saturates about half of the sums.
+///
+{
+	for( int channels = 1; channels <= 4; channels += 3 )
+	{
+		size_t count = (size_t)TEST_WIDTH*TEST_HEIGHT*channels;
+		std::vector<uchar> first = RandomPixels( count, 5 );
+		std::vector<uchar> second = RandomPixels( count, 6 );
+		std::vector<uchar> simd( count );
+		std::vector<uchar> scalar( count );
+		ImageAlgorithms::AddImages( &first[0], &second[0], &simd[0], TEST_WIDTH, TEST_HEIGHT, channels );
+		CpuFeatures::SetSimdEnabled( false );
+		ImageAlgorithms::AddImages( &first[0], &second[0], &scalar[0], TEST_WIDTH, TEST_HEIGHT, channels );
+		CpuFeatures::SetSimdEnabled( true );
+		QVERIFY( simd == scalar );
+
+		for( size_t n = 0; n < count; n++ )
+		{
+			QCOMPARE( (int)scalar[n], std::min( first[n] + second[n], 255 ) );
+		}
+	}
+}
+
+void
+TestConversions::SummedAreaMatchesPixelSums()
+///
+/// Queries boxes inside the image, boxes clipped by its edges and a box outside it.
+///
+{
+	int width = 41;
+	int height = 29;
+	int channels = 4;
+	std::vector<uchar> source = RandomPixels( (size_t)width*height*channels, 7 );
+	size_t table_size = (size_t)(width + 1)*(height + 1)*channels;
+	std::vector<uint32_t> sums( table_size );
+	std::vector<uint64_t> wide_sums( table_size );
+	std::vector<uint64_t> squared_sums( table_size );
+	ImageAlgorithms::IntegralImage( &source[0], &sums[0], width, height, channels );
+	ImageAlgorithms::IntegralImage( &source[0], &wide_sums[0], width, height, channels );
+	ImageAlgorithms::IntegralImage( &source[0], &squared_sums[0], width, height, channels, true );
+
+	int boxes[5][4] = { { 0, 0, width, height }, { 3, 5, 20, 6 }, { -7, -2, 4, 9 }, { 30, 20, 60, 50 }, { 50, 0, 60, 10 } };
+	for( int b = 0; b < 5; b++ )
+	{
+		int left = boxes[b][0];
+		int top = boxes[b][1];
+		int right = boxes[b][2];
+		int bottom = boxes[b][3];
+		for( int channel = 0; channel < channels; channel++ )
+		{
+			uint64_t sum = 0;
+			uint64_t squared_sum = 0;
+			int area = 0;
+			for( int j = std::max( top, 0 ); j < std::min( bottom, height ); j++ )
+			{
+				for( int i = std::max( left, 0 ); i < std::min( right, width ); i++ )
+				{
+					uint64_t value = source[((size_t)j*width + i)*channels + channel];
+					sum += value;
+					squared_sum += value*value;
+					area++;
+				}
+			}
+
+			QCOMPARE( (uint64_t)ImageAlgorithms::BoxSum( &sums[0], width, height, channels, channel, left, top, right, bottom ), sum );
+			QCOMPARE( ImageAlgorithms::BoxSum( &wide_sums[0], width, height, channels, channel, left, top, right, bottom ), sum );
+			QCOMPARE( ImageAlgorithms::BoxSum( &squared_sums[0], width, height, channels, channel, left, top, right, bottom ), squared_sum );
+
+			double mean = area > 0 ? (double)sum/area : 0.0;
+			double variance = area > 0 ? (double)squared_sum/area - mean*mean : 0.0;
+			QVERIFY( qAbs( ImageAlgorithms::BoxMean( &sums[0], width, height, channels, channel, left, top, right, bottom ) - mean ) < 1e-9 );
+			QVERIFY( qAbs( ImageAlgorithms::BoxMean( &wide_sums[0], width, height, channels, channel, left, top, right, bottom ) - mean ) < 1e-9 );
+			QVERIFY( qAbs( ImageAlgorithms::BoxVariance( &sums[0], &squared_sums[0], width, height, channels, channel, left, top, right, bottom ) - variance ) < 1e-6 );
+		}
+	}
+}
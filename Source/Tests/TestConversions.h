@@ -0,0 +1,21 @@
+#ifndef _TEST_CONVERSIONS_H_
+#define _TEST_CONVERSIONS_H_
+
+#include <QtTest>
+
+class TestConversions : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void cleanup();
+
+		void LookupTableMatchesScalar();
+		void LookupTableComposes();
+		void GrayScaleMatchesScalar();
+		void LumaMatchesScalar();
+		void AddImagesMatchesScalar();
+		void SummedAreaMatchesPixelSums();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+///
+/// Checks the mode the execution planner picks on either side of each budget boundary:
+/// the smallest budget that fits the whole image, and the smallest that fits bands of a
+/// single row. Every plan that isn't refused must give the full frame result.
+///
+
+#include "TestExecutionPlanner.h"
+#include "TestImages.h"
+
+#include "ExecutionPlanner.h"
+#include "Filters/BoxBlur.h"
+#include "Filters/Canny.h"
+
+#include <string.h>
+
+// Comfortably more than any test image needs
+#define LARGE_BUDGET ((qint64)1 << 40)
+
+// Inverts the image into a new buffer, but declares nothing, so the planner has to treat
+// it as global. Its working set is the default, a result and a float intermediate.
+class GlobalFilter : public Filter
+{
+	public:
+		uchar* RunFilter( uchar* source, int width, int height, int channels )
+		{
+			size_t count = (size_t)width*height*channels;
+			uchar* result = new uchar[count];
+			for( size_t n = 0; n < count; n++ )
+			{
+				result[n] = 255 - source[n];
+			}
+			return result;
+		}
+};
+
+// The same filter, declared pointwise
+class PointwiseFilter : public GlobalFilter
+{
+	public:
+		FilterCapabilities Capabilities() const
+		{
+			FilterCapabilities capabilities;
+			capabilities.halo = 0;
+			capabilities.pointwise = true;
+			return capabilities;
+		}
+};
+
+static bool
+MatchesFullFrame( Filter* filter, const ExecutionPlan& plan, int width, int height, int channels )
+///
+/// @return
+///  True if running a filter as planned gives what running it on the whole image does.
+///
+{
+	size_t count = (size_t)width*height*channels;
+	std::vector<uchar> full_source = RandomPixels( count, 13 );
+	std::vector<uchar> planned_source = full_source;
+
+	uchar* full = filter->RunFilter( &full_source[0], width, height, channels );
+	uchar* planned = ExecutionPlanner::Run( filter, plan, &planned_source[0], width, height, channels );
+	bool matches = full != NULL && planned != NULL && memcmp( full, planned, count ) == 0;
+	if( full != &full_source[0] )
+	{
+		delete [] full;
+	}
+	if( planned != &planned_source[0] )
+	{
+		delete [] planned;
+	}
+	return matches;
+}
+
+static void
+CheckBoundaries( Filter* filter, int width, int height, int channels, ExecutionMode split_mode )
+///
+/// Checks that the whole image is run at once exactly when its peak fits the budget, that
+/// smaller budgets split it into the tallest bands that fit down to bands of one row, and
+/// that budgets below that are refused.
+///
+{
+	ExecutionPlan full = ExecutionPlanner::Plan( filter, width, height, channels, LARGE_BUDGET );
+	QCOMPARE( full.mode, EXECUTE_FULL_FRAME );
+	QCOMPARE( ExecutionPlanner::Plan( filter, width, height, channels, full.peak_bytes ).mode, EXECUTE_FULL_FRAME );
+
+	ExecutionPlan split = ExecutionPlanner::Plan( filter, width, height, channels, full.peak_bytes - 1 );
+	QCOMPARE( split.mode, split_mode );
+	QVERIFY( split.band_rows >= 1 && split.band_rows < height );
+	QCOMPARE( split.band_count, (height + split.band_rows - 1)/split.band_rows );
+	QVERIFY( split.peak_bytes <= split.budget_bytes );
+	QVERIFY( MatchesFullFrame( filter, split, width, height, channels ) );
+
+	// Planning for exactly the peak of the chosen bands can't pick shorter ones
+	QCOMPARE( ExecutionPlanner::Plan( filter, width, height, channels, split.peak_bytes ).band_rows, split.band_rows );
+
+	// A budget of nothing is refused, with the peak of single row bands as what it needs
+	ExecutionPlan refused = ExecutionPlanner::Plan( filter, width, height, channels, 0 );
+	QCOMPARE( refused.mode, EXECUTE_REFUSED );
+	QCOMPARE( ExecutionPlanner::Plan( filter, width, height, channels, refused.peak_bytes - 1 ).mode, EXECUTE_REFUSED );
+
+	ExecutionPlan smallest = ExecutionPlanner::Plan( filter, width, height, channels, refused.peak_bytes );
+	QCOMPARE( smallest.mode, split_mode );
+	QVERIFY( smallest.peak_bytes <= refused.peak_bytes );
+	QVERIFY( MatchesFullFrame( filter, smallest, width, height, channels ) );
+	QVERIFY( ExecutionPlanner::Run( filter, refused, NULL, width, height, channels ) == NULL );
+}
+
+void
+TestExecutionPlanner::StreamsPointwiseFilters()
+///
+/// A pointwise filter needs no halo, so it's streamed through the image, and its float
+/// intermediate is only ever as large as a band.
+///
+{
+	PointwiseFilter pointwise;
+	CheckBoundaries( &pointwise, TEST_WIDTH, TEST_HEIGHT, 4, EXECUTE_STREAMING );
+}
+
+void
+TestExecutionPlanner::TilesNeighbourhoodFilters()
+///
+/// A box blur needs a halo of its radius, so it's run in overlapping bands.
+///
+{
+	BoxBlur blur( 3 );
+	CheckBoundaries( &blur, TEST_WIDTH, TEST_HEIGHT, 4, EXECUTE_TILED );
+	CheckBoundaries( &blur, TEST_WIDTH, TEST_HEIGHT, 1, EXECUTE_TILED );
+}
+
+void
+TestExecutionPlanner::TilesGlobalFiltersWithMaps()
+///
+/// Canny traces edges across the whole image, but only on its one byte gradient map, which
+/// is built in bands.
+///
+{
+	CannyEdge canny;
+	CheckBoundaries( &canny, TEST_WIDTH, TEST_HEIGHT, 4, EXECUTE_TILED );
+}
+
+void
+TestExecutionPlanner::RefusesGlobalFilters()
+///
+/// A filter that declares nothing can't be split, so any budget below its full frame peak
+/// is refused.
+///
+{
+	GlobalFilter global;
+	ExecutionPlan full = ExecutionPlanner::Plan( &global, TEST_WIDTH, TEST_HEIGHT, 4, LARGE_BUDGET );
+	QCOMPARE( full.mode, EXECUTE_FULL_FRAME );
+	QVERIFY( MatchesFullFrame( &global, full, TEST_WIDTH, TEST_HEIGHT, 4 ) );
+	QCOMPARE( ExecutionPlanner::Plan( &global, TEST_WIDTH, TEST_HEIGHT, 4, full.peak_bytes ).mode, EXECUTE_FULL_FRAME );
+	QCOMPARE( ExecutionPlanner::Plan( &global, TEST_WIDTH, TEST_HEIGHT, 4, full.peak_bytes - 1 ).mode, EXECUTE_REFUSED );
+}
@@ -0,0 +1,17 @@
+#ifndef _TEST_EXECUTION_PLANNER_H_
+#define _TEST_EXECUTION_PLANNER_H_
+
+#include <QtTest>
+
+class TestExecutionPlanner : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void StreamsPointwiseFilters();
+		void TilesNeighbourhoodFilters();
+		void TilesGlobalFiltersWithMaps();
+		void RefusesGlobalFilters();
+};
+
+#endif
\ No newline at end of file
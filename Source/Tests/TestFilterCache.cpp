@@ -0,0 +1,137 @@
+///
+/// Checks that the filter cache gives back the images stored in it, across instances on the
+/// same folder, that it evicts the least recently used images first, and that a stage's
+/// key changes with the filter's settings.
+///
+
+#include "TestFilterCache.h"
+#include "TestImages.h"
+
+#include "FilterCache.h"
+#include "Filters/BoxBlur.h"
+
+#include <string.h>
+
+static QImage
+NoiseImage( QImage::Format format, unsigned seed )
+///
+/// @return
+///  An image of noise, with a gray color table if it is indexed.
+///
+{
+	QImage image( TEST_WIDTH, TEST_HEIGHT, format );
+	int row_bytes = TEST_WIDTH*image.depth()/8;
+	std::vector<uchar> noise = RandomPixels( (size_t)row_bytes*TEST_HEIGHT, seed );
+	for( int j = 0; j < TEST_HEIGHT; j++ )
+	{
+		memcpy( image.scanLine( j ), &noise[(size_t)j*row_bytes], row_bytes );
+	}
+	if( format == QImage::Format_Indexed8 )
+	{
+		QVector<QRgb> colors;
+		for( int i = 0; i < 256; i++ )
+		{
+			colors.append( qRgb( i, i, i ) );
+		}
+		image.setColorTable( colors );
+	}
+	return image;
+}
+
+void
+TestFilterCache::LoadsStoredImages()
+///
+/// Stores a color and an indexed image, and loads them from the same cache and from a new
+/// one on the same folder, as a rerun would.
+///
+{
+	QTemporaryDir directory;
+	QVERIFY( directory.isValid() );
+	QImage color = NoiseImage( QImage::Format_ARGB32, 18 );
+	QImage indexed = NoiseImage( QImage::Format_Indexed8, 19 );
+	QByteArray color_key = FilterCache::ContentKey( "color" );
+	QByteArray indexed_key = FilterCache::ContentKey( "indexed" );
+
+	{
+		FilterCache cache( directory.path(), (qint64)1 << 30 );
+		QVERIFY( cache.Store( color_key, color ) );
+		QVERIFY( cache.Store( indexed_key, indexed ) );
+
+		QImage loaded;
+		QVERIFY( cache.Load( color_key, loaded ) );
+		QVERIFY( loaded == color );
+		QVERIFY( !cache.Load( FilterCache::ContentKey( "missing" ), loaded ) );
+	}
+
+	FilterCache rerun( directory.path(), (qint64)1 << 30 );
+	QImage loaded;
+	QVERIFY( rerun.Load( color_key, loaded ) );
+	QVERIFY( loaded == color );
+	QVERIFY( rerun.Load( indexed_key, loaded ) );
+	QCOMPARE( loaded.format(), QImage::Format_Indexed8 );
+	QVERIFY( loaded.colorTable() == indexed.colorTable() );
+	QVERIFY( loaded == indexed );
+}
+
+void
+TestFilterCache::EvictsLeastRecentlyUsed()
+///
+/// In a cache with room for two images, storing a third evicts the one used least recently,
+/// which a load counts as a use of.
+///
+{
+	QTemporaryDir directory;
+	QVERIFY( directory.isValid() );
+	QImage images[3];
+	QByteArray keys[3];
+	for( int i = 0; i < 3; i++ )
+	{
+		images[i] = NoiseImage( QImage::Format_ARGB32, 20 + i );
+		keys[i] = FilterCache::ContentKey( QByteArray::number( i ) );
+	}
+
+	qint64 image_bytes;
+	{
+		QTemporaryDir measure;
+		FilterCache cache( measure.path(), (qint64)1 << 30 );
+		QVERIFY( cache.Store( keys[0], images[0] ) );
+		image_bytes = cache.Size();
+		QVERIFY( image_bytes > 0 );
+	}
+
+	QImage loaded;
+	FilterCache bounded( directory.path(), 2*image_bytes );
+	QVERIFY( bounded.Store( keys[0], images[0] ) );
+	QTest::qWait( 10 );
+	QVERIFY( bounded.Store( keys[1], images[1] ) );
+	QTest::qWait( 10 );
+	QVERIFY( bounded.Load( keys[0], loaded ) );
+	QTest::qWait( 10 );
+	QVERIFY( bounded.Store( keys[2], images[2] ) );
+
+	QCOMPARE( bounded.Size(), 2*image_bytes );
+	QVERIFY( !bounded.Load( keys[1], loaded ) );
+	QVERIFY( bounded.Load( keys[0], loaded ) );
+	QVERIFY( loaded == images[0] );
+	QVERIFY( bounded.Load( keys[2], loaded ) );
+	QVERIFY( loaded == images[2] );
+}
+
+void
+TestFilterCache::KeysFollowSettings()
+///
+/// The same filter with the same settings on the same input has the same key, and a
+/// different parameter or input gives a different one.
+///
+{
+	BoxBlur small( 1 );
+	BoxBlur same( 1 );
+	BoxBlur large( 2 );
+	QByteArray input = FilterCache::ContentKey( "input" );
+	QByteArray other_input = FilterCache::ContentKey( "other input" );
+
+	QCOMPARE( FilterCache::StageKey( input, "box_blur", &small ), FilterCache::StageKey( input, "box_blur", &same ) );
+	QVERIFY( FilterCache::StageKey( input, "box_blur", &small ) != FilterCache::StageKey( input, "box_blur", &large ) );
+	QVERIFY( FilterCache::StageKey( input, "box_blur", &small ) != FilterCache::StageKey( other_input, "box_blur", &small ) );
+	QVERIFY( FilterCache::StageKey( input, "box_blur", &small ) != FilterCache::StageKey( input, "blur", &small ) );
+}
@@ -0,0 +1,16 @@
+#ifndef _TEST_FILTER_CACHE_H_
+#define _TEST_FILTER_CACHE_H_
+
+#include <QtTest>
+
+class TestFilterCache : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void LoadsStoredImages();
+		void EvictsLeastRecentlyUsed();
+		void KeysFollowSettings();
+};
+
+#endif
\ No newline at end of file
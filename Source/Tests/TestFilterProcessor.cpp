@@ -0,0 +1,75 @@
+///
+/// Checks that filtering a batch of images packed into atlases gives each image exactly
+/// what filtering it on its own gives.
+///
+
+#include "TestFilterProcessor.h"
+#include "TestImages.h"
+
+#include "FilterProcessor.h"
+#include "Filters/BoxBlur.h"
+#include "Filters/GaussianBlur.h"
+#include "Filters/InvertFilter.h"
+#include "Filters/MedianFilter.h"
+#include "Filters/UnsharpMask.h"
+
+#include <string.h>
+#include <boost/shared_ptr.hpp>
+
+static QImage
+NoiseImage( int width, int height, QImage::Format format, unsigned seed )
+///
+/// @return
+///  An image of noise.
+///
+{
+	QImage image( width, height, format );
+	int row_bytes = width*image.depth()/8;
+	std::vector<uchar> noise = RandomPixels( (size_t)row_bytes*height, seed );
+	for( int j = 0; j < height; j++ )
+	{
+		memcpy( image.scanLine( j ), &noise[(size_t)j*row_bytes], row_bytes );
+	}
+	return image;
+}
+
+void
+TestFilterProcessor::BatchesMatchSingleImages()
+///
+/// Thumbnails of many sizes, down to a single pixel, are packed into atlases with halos of
+/// their own edge pixels, so neighbourhood filters must not see their neighbours in the
+/// atlas. Gray images go in an atlas of their own, images too large to pack run alone,
+/// and null images stay null.
+///
+{
+	QVector<QImage> images;
+	images << NoiseImage( 1, 1, QImage::Format_ARGB32, 30 );
+	images << NoiseImage( 17, 9, QImage::Format_RGB32, 31 );
+	images << QImage();
+	images << NoiseImage( TEST_WIDTH, TEST_HEIGHT, QImage::Format_ARGB32, 32 );
+	images << NoiseImage( 3, 64, QImage::Format_ARGB32, 33 );
+	images << NoiseImage( 300, 240, QImage::Format_ARGB32, 34 );
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	images << NoiseImage( 40, 25, QImage::Format_Grayscale8, 35 );
+	images << NoiseImage( 2, 2, QImage::Format_Grayscale8, 36 );
+#endif
+
+	QList< boost::shared_ptr<Filter> > filters;
+	filters << boost::shared_ptr<Filter>( new InvertFilter() );
+	filters << boost::shared_ptr<Filter>( new BoxBlur( 3 ) );
+	filters << boost::shared_ptr<Filter>( new GaussianBlur() );
+	filters << boost::shared_ptr<Filter>( new MedianFilter( 2 ) );
+	filters << boost::shared_ptr<Filter>( new UnsharpMask( 1.5, 2.0, 0 ) );
+	for( int f = 0; f < filters.size(); f++ )
+	{
+		QVector<QImage> batch = FilterProcessor::ApplyFilterBatch( filters[f].get(), images );
+		QCOMPARE( batch.size(), images.size() );
+		for( int i = 0; i < images.size(); i++ )
+		{
+			QImage single = FilterProcessor::ApplyFilter( filters[f].get(), images[i] );
+			QCOMPARE( batch[i].isNull(), single.isNull() );
+			QCOMPARE( batch[i].format(), single.format() );
+			QVERIFY2( batch[i] == single, qPrintable( QString( "filter %1, image %2" ).arg( f ).arg( i ) ) );
+		}
+	}
+}
@@ -0,0 +1,14 @@
+#ifndef _TEST_FILTER_PROCESSOR_H_
+#define _TEST_FILTER_PROCESSOR_H_
+
+#include <QtTest>
+
+class TestFilterProcessor : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void BatchesMatchSingleImages();
+};
+
+#endif
\ No newline at end of file
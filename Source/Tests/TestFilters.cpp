@@ -0,0 +1,369 @@
+///
+/// Checks filters against straightforward versions of what they compute: the median filter
+/// against sorting each window, the FFT convolution against direct convolution, and the
+/// unsharp mask against what sharpening should do to flat areas, edges and alpha, and Canny
+/// reruns from a cached gradient against fresh runs. Also checks the shared thread pool the
+/// filters split their work across.
+///
+
+#include "TestFilters.h"
+#include "TestImages.h"
+
+#include "ExecutionPlanner.h"
+#include "Filters/Canny.h"
+#include "Filters/CpuFeatures.h"
+#include "Filters/ImageAlgorithms.h"
+#include "Filters/MedianFilter.h"
+#include "Filters/ParallelRanges.h"
+#include "Filters/UnsharpMask.h"
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+static int
+Clamp( int position, int size )
+///
+/// @return
+///  The position moved inside 0 to size - 1, as the filters clamp at the edges.
+///
+{
+	return std::min( std::max( position, 0 ), size - 1 );
+}
+
+void
+TestFilters::cleanup()
+///
+/// Turns SIMD back on after a test that turned it off, even if the test failed.
+///
+{
+	CpuFeatures::SetSimdEnabled( true );
+}
+
+void
+TestFilters::MedianMatchesSort()
+///
+/// Filters with the SIMD and the scalar histograms, on images wide enough to be split into
+/// strips of columns.
+///
+{
+	int radii[3] = { 1, 2, 5 };
+	int channel_counts[2] = { 1, 4 };
+	for( int r = 0; r < 3; r++ )
+	{
+		for( int c = 0; c < 2; c++ )
+		{
+			int radius = radii[r];
+			int channels = channel_counts[c];
+			std::vector<uchar> source = RandomPixels( (size_t)TEST_WIDTH*TEST_HEIGHT*channels, 8 );
+			MedianFilter median( radius );
+			uchar* simd = median.RunFilter( &source[0], TEST_WIDTH, TEST_HEIGHT, channels );
+			CpuFeatures::SetSimdEnabled( false );
+			uchar* scalar = median.RunFilter( &source[0], TEST_WIDTH, TEST_HEIGHT, channels );
+			CpuFeatures::SetSimdEnabled( true );
+
+			bool matches = true;
+			std::vector<uchar> window;
+			for( int j = 0; j < TEST_HEIGHT && matches; j++ )
+			{
+				for( int i = 0; i < TEST_WIDTH && matches; i++ )
+				{
+					for( int k = 0; k < channels; k++ )
+					{
+						window.clear();
+						for( int y = j - radius; y <= j + radius; y++ )
+						{
+							for( int x = i - radius; x <= i + radius; x++ )
+							{
+								window.push_back( source[((size_t)Clamp( y, TEST_HEIGHT )*TEST_WIDTH + Clamp( x, TEST_WIDTH ))*channels + k] );
+							}
+						}
+						std::nth_element( window.begin(), window.begin() + window.size()/2, window.end() );
+						size_t n = ((size_t)j*TEST_WIDTH + i)*channels + k;
+						matches = matches && simd[n] == window[window.size()/2] && scalar[n] == window[window.size()/2];
+					}
+				}
+			}
+			delete [] simd;
+			delete [] scalar;
+			QVERIFY( matches );
+		}
+	}
+}
+
+void
+TestFilters::FFTMatchesDirect()
+///
+/// Convolves with a kernel that isn't separable, through FFTConvo and through TwoDConvo,
+/// and compares both with a direct sum in double precision. Float results agree to well
+/// under a level. 8 bit results are the rounded sums, so they may only differ where a sum
+/// lands within float error of halfway between two levels.
+///
+{
+	int width = 61;
+	int height = 47;
+	int channels = 4;
+	int kernel_size = 7;
+	int radius = kernel_size/2;
+	std::vector<uchar> source = RandomPixels( (size_t)width*height*channels, 9 );
+	std::vector<uchar> noise = RandomPixels( (size_t)kernel_size*kernel_size, 10 );
+	std::vector<double> kernel( kernel_size*kernel_size );
+	for( int n = 0; n < kernel_size*kernel_size; n++ )
+	{
+		kernel[n] = (noise[n] - 96)/(255.0*kernel_size*kernel_size);
+	}
+
+	size_t count = (size_t)width*height*channels;
+	std::vector<float> fft( count );
+	std::vector<float> direct( count );
+	std::vector<uchar> fft_bytes( count );
+	std::vector<uchar> direct_bytes( count );
+	ImageAlgorithms::FFTConvo( &source[0], &fft[0], width, height, channels, &kernel[0], kernel_size );
+	ImageAlgorithms::TwoDConvo( &source[0], &direct[0], width, height, channels, &kernel[0], kernel_size );
+	ImageAlgorithms::FFTConvo( &source[0], &fft_bytes[0], width, height, channels, &kernel[0], kernel_size );
+	ImageAlgorithms::TwoDConvo( &source[0], &direct_bytes[0], width, height, channels, &kernel[0], kernel_size );
+
+	double largest_error = 0.0;
+	int byte_differences = 0;
+	for( int j = 0; j < height; j++ )
+	{
+		for( int i = 0; i < width; i++ )
+		{
+			for( int c = 0; c < channels; c++ )
+			{
+				double sum = 0.0;
+				for( int ky = 0; ky < kernel_size; ky++ )
+				{
+					for( int kx = 0; kx < kernel_size; kx++ )
+					{
+						int y = Clamp( j + ky - radius, height );
+						int x = Clamp( i + kx - radius, width );
+						sum += kernel[ky*kernel_size + kx]*source[((size_t)y*width + x)*channels + c];
+					}
+				}
+
+				size_t n = ((size_t)j*width + i)*channels + c;
+				largest_error = std::max( largest_error, fabs( fft[n] - sum ) );
+				largest_error = std::max( largest_error, fabs( direct[n] - sum ) );
+				int rounded = (int)floor( std::min( std::max( sum, 0.0 ), 255.0 ) + 0.5 );
+				bool near_half = fabs( sum - floor( sum ) - 0.5 ) < 1e-3;
+				if( fft_bytes[n] != direct_bytes[n] )
+				{
+					byte_differences++;
+				}
+				QVERIFY( fft_bytes[n] == rounded || (near_half && abs( fft_bytes[n] - rounded ) <= 1) );
+				QVERIFY( direct_bytes[n] == rounded || (near_half && abs( direct_bytes[n] - rounded ) <= 1) );
+			}
+		}
+	}
+	QVERIFY( largest_error < 1e-2 );
+	QVERIFY( byte_differences <= (int)(count/1000) );
+}
+
+void
+TestFilters::UnsharpMaskKeepsFlatAreas()
+///
+/// A flat image has nothing to sharpen, and neither has any image with no amount or a
+/// threshold above every difference from the blur.
+///
+{
+	std::vector<uchar> flat( (size_t)TEST_WIDTH*TEST_HEIGHT*4, 77 );
+	UnsharpMask strong( 3.0, 2.0, 0 );
+	uchar* result = strong.RunFilter( &flat[0], TEST_WIDTH, TEST_HEIGHT, 4 );
+	bool unchanged = std::equal( flat.begin(), flat.end(), result );
+	delete [] result;
+	QVERIFY( unchanged );
+
+	std::vector<uchar> noise = RandomPixels( (size_t)TEST_WIDTH*TEST_HEIGHT*4, 11 );
+	UnsharpMask none( 0.0, 2.0, 0 );
+	result = none.RunFilter( &noise[0], TEST_WIDTH, TEST_HEIGHT, 4 );
+	unchanged = std::equal( noise.begin(), noise.end(), result );
+	delete [] result;
+	QVERIFY( unchanged );
+
+	UnsharpMask thresholded( 3.0, 2.0, 255 );
+	result = thresholded.RunFilter( &noise[0], TEST_WIDTH, TEST_HEIGHT, 4 );
+	unchanged = std::equal( noise.begin(), noise.end(), result );
+	delete [] result;
+	QVERIFY( unchanged );
+}
+
+void
+TestFilters::UnsharpMaskSteepensEdges()
+///
+/// Across a vertical step, the dark side gets darker and the light side lighter near the
+/// step, and pixels far from it are left alone.
+///
+{
+	int width = 64;
+	int height = 8;
+	std::vector<uchar> step( (size_t)width*height );
+	for( int j = 0; j < height; j++ )
+	{
+		for( int i = 0; i < width; i++ )
+		{
+			step[j*width + i] = i < width/2 ? 60 : 180;
+		}
+	}
+
+	UnsharpMask sharpen( 1.0, 1.0, 0 );
+	uchar* result = sharpen.RunFilter( &step[0], width, height, 1 );
+	bool steeper = true;
+	for( int j = 0; j < height; j++ )
+	{
+		const uchar* row = result + j*width;
+		steeper = steeper && row[width/2 - 1] < 60 && row[width/2] > 180;
+		steeper = steeper && row[0] == 60 && row[width - 1] == 180;
+		for( int i = 0; i < width; i++ )
+		{
+			steeper = steeper && (i < width/2 ? row[i] <= 60 : row[i] >= 180);
+		}
+	}
+	delete [] result;
+	QVERIFY( steeper );
+}
+
+void
+TestFilters::UnsharpMaskTiles()
+///
+/// Sharpening in bands with the declared halo gives exactly the full frame result.
+///
+{
+	int channels = 4;
+	size_t count = (size_t)TEST_WIDTH*TEST_HEIGHT*channels;
+	std::vector<uchar> source = RandomPixels( count, 12 );
+	UnsharpMask sharpen( 1.5, 1.5, 4 );
+	uchar* full = sharpen.RunFilter( &source[0], TEST_WIDTH, TEST_HEIGHT, channels );
+
+	ExecutionPlan plan;
+	plan.mode = EXECUTE_TILED;
+	plan.band_rows = 5;
+	uchar* tiled = ExecutionPlanner::Run( &sharpen, plan, &source[0], TEST_WIDTH, TEST_HEIGHT, channels );
+	QVERIFY( tiled != NULL );
+	bool matches = std::equal( full, full + count, tiled );
+	delete [] full;
+	delete [] tiled;
+	QVERIFY( matches );
+}
+
+void
+TestFilters::UnsharpMaskKeepsAlpha()
+///
+/// Four channel images keep their alpha exactly, however noisy it is, while the color
+/// channels are sharpened. One, two and three channel images have no alpha, so every
+/// channel is sharpened.
+///
+{
+	for( int channels = 1; channels <= 4; channels++ )
+	{
+		size_t count = (size_t)TEST_WIDTH*TEST_HEIGHT*channels;
+		std::vector<uchar> source = RandomPixels( count, 13 );
+		UnsharpMask sharpen( 2.0, 1.5, 0 );
+		uchar* result = sharpen.RunFilter( &source[0], TEST_WIDTH, TEST_HEIGHT, channels );
+
+		std::vector<bool> changed( channels, false );
+		bool alpha_kept = true;
+		for( size_t n = 0; n < count; n++ )
+		{
+			int channel = (int)(n % channels);
+			changed[channel] = changed[channel] || result[n] != source[n];
+			alpha_kept = alpha_kept && (channels != 4 || channel != 3 || result[n] == source[n]);
+		}
+		delete [] result;
+
+		QVERIFY( alpha_kept );
+		for( int c = 0; c < channels; c++ )
+		{
+			QVERIFY( changed[c] == (channels != 4 || c != 3) );
+		}
+	}
+}
+
+void
+TestFilters::CannyThresholdRerunsMatchFreshRuns()
+///
+/// A Canny filter that caches its gradient reruns with new thresholds from the cache, and
+/// must give exactly what a filter that finds the gradient again gives, at full resolution
+/// and on a pyramid level. Another image of the same size must not pick up the first
+/// image's gradient.
+///
+{
+	int channels = 4;
+	size_t count = (size_t)TEST_WIDTH*TEST_HEIGHT*channels;
+	std::vector<uchar> images[2] = { RandomPixels( count, 14 ), RandomPixels( count, 15 ) };
+	int thresholds[3][2] = { { 20, 80 }, { 10, 40 }, { 30, 120 } };
+	for( int level = 0; level <= 1; level++ )
+	{
+		for( int image = 0; image < 2; image++ )
+		{
+			std::vector<uchar>& source = images[image];
+			std::vector<uchar> previous;
+			for( int t = 0; t < 3; t++ )
+			{
+				CannyEdge cached( level, thresholds[t][0], thresholds[t][1], true );
+				CannyEdge fresh( level, thresholds[t][0], thresholds[t][1], false );
+				uchar* rerun = cached.RunFilter( &source[0], TEST_WIDTH, TEST_HEIGHT, channels );
+				uchar* expected = fresh.RunFilter( &source[0], TEST_WIDTH, TEST_HEIGHT, channels );
+				bool matches = std::equal( expected, expected + count, rerun );
+
+				// Other thresholds find other edges, so the reruns aren't all the same image
+				bool changed = previous.empty() || !std::equal( previous.begin(), previous.end(), expected );
+				previous.assign( expected, expected + count );
+				delete [] rerun;
+				delete [] expected;
+				QVERIFY( matches );
+				QVERIFY( changed );
+			}
+		}
+	}
+}
+
+void
+TestFilters::ParallelRangesCoverEachIndexOnce()
+///
+/// Several threads split loops across the shared pool at once, and each range starts a
+/// loop of its own, as a filter running a convolution per strip does. Every index must be
+/// visited exactly once and every call must return.
+///
+{
+	const int count = 5000;
+	std::atomic<int> errors( 0 );
+	std::vector<std::thread> callers;
+	for( int c = 0; c < 4; c++ )
+	{
+		callers.push_back( std::thread( [&]()
+		{
+			std::vector< std::atomic<int> > visits( count );
+			ParallelRanges::Run( count, 64, [&]( int first, int last )
+			{
+				for( int i = first; i < last; i++ )
+				{
+					visits[i]++;
+				}
+
+				std::atomic<int> nested( 0 );
+				ParallelRanges::Run( 1000, 64, [&]( int nested_first, int nested_last )
+				{
+					nested += nested_last - nested_first;
+				} );
+				if( nested != 1000 )
+				{
+					errors++;
+				}
+			} );
+			for( int i = 0; i < count; i++ )
+			{
+				if( visits[i] != 1 )
+				{
+					errors++;
+				}
+			}
+		} ) );
+	}
+	for( size_t c = 0; c < callers.size(); c++ )
+	{
+		callers[c].join();
+	}
+	QCOMPARE( (int)errors, 0 );
+}
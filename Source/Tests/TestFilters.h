@@ -0,0 +1,23 @@
+#ifndef _TEST_FILTERS_H_
+#define _TEST_FILTERS_H_
+
+#include <QtTest>
+
+class TestFilters : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void cleanup();
+
+		void MedianMatchesSort();
+		void FFTMatchesDirect();
+		void UnsharpMaskKeepsFlatAreas();
+		void UnsharpMaskSteepensEdges();
+		void UnsharpMaskTiles();
+		void UnsharpMaskKeepsAlpha();
+		void CannyThresholdRerunsMatchFreshRuns();
+		void ParallelRangesCoverEachIndexOnce();
+};
+
+#endif
\ No newline at end of file
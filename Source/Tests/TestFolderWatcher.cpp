@@ -0,0 +1,142 @@
+///
+/// Checks that a watch folder processes a file once it has stopped changing, again when it
+/// is rewritten in place, and skips files its manifest says were processed with the same
+/// filters, versions and parameters.
+///
+
+#include "TestFolderWatcher.h"
+#include "TestImages.h"
+
+#include "FilterProcessor.h"
+#include "FolderWatcher.h"
+
+// Longer than a file has to stay unchanged, plus the time to process it
+#define WATCH_TIMEOUT_MS 10000
+
+// Shorter than a file has to stay unchanged before it's processed
+#define SETTLING_MS 300
+
+static QImage
+NoiseImage( unsigned seed )
+///
+/// @return
+///  An opaque image of noise.
+///
+{
+	QImage image( TEST_WIDTH, TEST_HEIGHT, QImage::Format_RGB32 );
+	std::vector<uchar> noise = RandomPixels( (size_t)TEST_WIDTH*TEST_HEIGHT*3, seed );
+	for( int j = 0; j < TEST_HEIGHT; j++ )
+	{
+		for( int i = 0; i < TEST_WIDTH; i++ )
+		{
+			const uchar* pixel = &noise[((size_t)j*TEST_WIDTH + i)*3];
+			image.setPixel( i, j, qRgb( pixel[0], pixel[1], pixel[2] ) );
+		}
+	}
+	return image;
+}
+
+static bool
+HasInvertedImage( const QString& file_name, const QImage& image )
+///
+/// @return
+///  True if the file holds the image with its colors inverted.
+///
+{
+	QImage inverted = image;
+	inverted.invertPixels();
+	QImage result( file_name );
+	return !result.isNull() && result.convertToFormat( QImage::Format_RGB32 ) == inverted;
+}
+
+static bool
+HasStatus( const QSignalSpy& statuses, const QString& prefix )
+///
+/// @return
+///  True if a watcher reported a status starting with prefix.
+///
+{
+	for( int i = 0; i < statuses.count(); i++ )
+	{
+		if( statuses.at( i ).at( 0 ).toString().startsWith( prefix ) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+TestFolderWatcher::ProcessesSettledFiles()
+///
+/// A file already in the folder is processed only after it has had time to settle, and
+/// again when it is rewritten.
+///
+{
+	QTemporaryDir input;
+	QTemporaryDir output;
+	QVERIFY( input.isValid() && output.isValid() );
+	QString input_file = input.path() + "/noise.png";
+	QString output_file = output.path() + "/noise.png";
+	QImage image = NoiseImage( 15 );
+	QVERIFY( image.save( input_file ) );
+
+	FilterProcessor processor;
+	FolderWatcher watcher( &processor );
+	QSignalSpy statuses( &watcher, SIGNAL( WatchStatus(QString) ) );
+	QVERIFY( watcher.SetRecipe( QStringList() << "invert" ) );
+	QVERIFY( watcher.AddFolder( input.path(), output.path() ) );
+
+	QTest::qWait( SETTLING_MS );
+	QVERIFY( !HasStatus( statuses, "Processed" ) );
+	QVERIFY( !QFile::exists( output_file ) );
+
+	QTRY_VERIFY_WITH_TIMEOUT( HasStatus( statuses, "Processed" ), WATCH_TIMEOUT_MS );
+	QVERIFY( HasInvertedImage( output_file, image ) );
+
+	// Rewriting the file in place is seen without the folder being listed again
+	statuses.clear();
+	QImage changed = NoiseImage( 16 );
+	QVERIFY( changed.save( input_file ) );
+	QTRY_VERIFY_WITH_TIMEOUT( HasStatus( statuses, "Processed" ), WATCH_TIMEOUT_MS );
+	QVERIFY( HasInvertedImage( output_file, changed ) );
+}
+
+void
+TestFolderWatcher::SkipsFilesInManifest()
+///
+/// A watcher started on a folder processed before skips the files in its manifest, unless
+/// a filter's parameters have changed since.
+///
+{
+	QTemporaryDir input;
+	QTemporaryDir output;
+	QVERIFY( input.isValid() && output.isValid() );
+	QString output_file = output.path() + "/noise.png";
+	QVERIFY( NoiseImage( 17 ).save( input.path() + "/noise.png" ) );
+
+	FilterProcessor processor;
+	const char* recipes[3] = { "box_blur:radius=1", "box_blur:radius=1", "box_blur:radius=2" };
+	for( int r = 0; r < 3; r++ )
+	{
+		QFile::remove( output_file );
+
+		FolderWatcher watcher( &processor );
+		QSignalSpy statuses( &watcher, SIGNAL( WatchStatus(QString) ) );
+		QVERIFY( watcher.SetRecipe( QStringList() << recipes[r] ) );
+		QVERIFY( watcher.AddFolder( input.path(), output.path() ) );
+
+		if( r == 1 )
+		{
+			// Long enough for the file to have settled and been processed, had it been queued
+			QTest::qWait( WATCH_TIMEOUT_MS/4 );
+			QVERIFY( !HasStatus( statuses, "Processed" ) );
+			QVERIFY( !QFile::exists( output_file ) );
+		}
+		else
+		{
+			QTRY_VERIFY_WITH_TIMEOUT( HasStatus( statuses, "Processed" ), WATCH_TIMEOUT_MS );
+			QVERIFY( QFile::exists( output_file ) );
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef _TEST_FOLDER_WATCHER_H_
+#define _TEST_FOLDER_WATCHER_H_
+
+#include <QtTest>
+
+class TestFolderWatcher : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void ProcessesSettledFiles();
+		void SkipsFilesInManifest();
+};
+
+#endif
\ No newline at end of file
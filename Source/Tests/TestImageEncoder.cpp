@@ -0,0 +1,156 @@
+///
+/// Checks that PNGs from the parallel encoder decode to the pixels they were made from,
+/// including images large enough to be compressed in several strips, in every color type
+/// and bit depth it writes and at every effort setting.
+///
+
+#include "TestImageEncoder.h"
+#include "TestImages.h"
+
+#include "ImageEncoder.h"
+
+#include <string.h>
+
+static QImage
+NoiseImage( int width, int height, QImage::Format format, unsigned seed )
+///
+/// @return
+///  An image whose left half is noise and right half a gradient, so both the filters
+///  that suit noise and those that suit smooth areas get picked.
+///
+{
+	QImage image( width, height, format );
+	int bytes_per_pixel = image.depth()/8;
+	std::vector<uchar> noise = RandomPixels( (size_t)width*height*bytes_per_pixel, seed );
+	for( int j = 0; j < height; j++ )
+	{
+		uchar* row = image.scanLine( j );
+		memcpy( row, &noise[(size_t)j*width*bytes_per_pixel], (size_t)width*bytes_per_pixel );
+		for( int n = width/2*bytes_per_pixel; n < width*bytes_per_pixel; n++ )
+		{
+			row[n] = (uchar)(n + j);
+		}
+	}
+	return image;
+}
+
+static void
+CheckRoundTrip( const QImage& image )
+///
+/// Encodes an image at default, fast and maximum compression and checks each PNG decodes
+/// to the same pixels.
+///
+{
+	EncodeSettings settings[3];
+	settings[1].fast = true;
+	settings[2].compression = 9;
+	for( int s = 0; s < 3; s++ )
+	{
+		QBuffer buffer;
+		buffer.open( QIODevice::WriteOnly );
+		QVERIFY( ImageEncoder::Write( image, &buffer, "png", settings[s] ) );
+
+		QImage decoded;
+		QVERIFY( decoded.loadFromData( buffer.data(), "PNG" ) );
+		QCOMPARE( decoded.size(), image.size() );
+		QVERIFY( decoded.convertToFormat( image.format() ) == image );
+	}
+}
+
+void
+TestImageEncoder::SmallImagesRoundTrip()
+///
+/// Images far below the strip size, including a single pixel, are written as one strip.
+///
+{
+	QList<QImage::Format> formats;
+	formats << QImage::Format_ARGB32 << QImage::Format_RGB888;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	formats << QImage::Format_Grayscale8;
+#endif
+	for( int f = 0; f < formats.size(); f++ )
+	{
+		CheckRoundTrip( NoiseImage( 1, 1, formats[f], 14 ) );
+		CheckRoundTrip( NoiseImage( TEST_WIDTH, TEST_HEIGHT, formats[f], 15 ) );
+	}
+}
+
+void
+TestImageEncoder::StripedImagesRoundTrip()
+///
+/// Images of several megabytes are split into strips whenever there is more than one
+/// thread, and the strips must join into one valid stream.
+///
+{
+	CheckRoundTrip( NoiseImage( 1031, 997, QImage::Format_ARGB32, 16 ) );
+	CheckRoundTrip( NoiseImage( 1501, 811, QImage::Format_RGB888, 17 ) );
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	CheckRoundTrip( NoiseImage( 2003, 1201, QImage::Format_Grayscale8, 18 ) );
+#endif
+}
+
+void
+TestImageEncoder::SixteenBitImagesRoundTrip()
+///
+/// Images with more than 8 bits per channel are written as 16 bit PNGs, which decode to
+/// exactly the same values.
+///
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	QImage opaque = NoiseImage( 1031, 257, QImage::Format_RGBX64, 19 );
+	for( int j = 0; j < opaque.height(); j++ )
+	{
+		quint16* row = (quint16*)opaque.scanLine( j );
+		for( int i = 0; i < opaque.width(); i++ )
+		{
+			row[i*4 + 3] = 0xffff;
+		}
+	}
+
+	QList<QImage> images;
+	images << NoiseImage( TEST_WIDTH, TEST_HEIGHT, QImage::Format_RGBA64, 20 ) << opaque;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+	images << NoiseImage( 2003, 1201, QImage::Format_Grayscale16, 21 );
+#endif
+	for( int i = 0; i < images.size(); i++ )
+	{
+		CheckRoundTrip( images[i] );
+
+		QBuffer buffer;
+		buffer.open( QIODevice::WriteOnly );
+		QVERIFY( ImageEncoder::Write( images[i], &buffer, "png" ) );
+		QImage decoded;
+		QVERIFY( decoded.loadFromData( buffer.data(), "PNG" ) );
+		QCOMPARE( decoded.depth(), images[i].depth() );
+	}
+#else
+	QSKIP( "16 bit images need Qt 5.12" );
+#endif
+}
+
+void
+TestImageEncoder::SaveReplacesWholeFiles()
+///
+/// A save replaces the file only once the image is written, so a failed save leaves the
+/// old file alone.
+///
+{
+	QTemporaryDir directory;
+	QVERIFY( directory.isValid() );
+	QString file_name = directory.path() + "/image.png";
+	QImage image = NoiseImage( TEST_WIDTH, TEST_HEIGHT, QImage::Format_ARGB32, 22 );
+
+	QVERIFY( ImageEncoder::Save( image, file_name ) );
+	QByteArray saved;
+	{
+		QFile file( file_name );
+		QVERIFY( file.open( QIODevice::ReadOnly ) );
+		saved = file.readAll();
+	}
+
+	QVERIFY( !ImageEncoder::Save( QImage(), file_name ) );
+	QFile file( file_name );
+	QVERIFY( file.open( QIODevice::ReadOnly ) );
+	QCOMPARE( file.readAll(), saved );
+	QCOMPARE( QDir( directory.path() ).entryList( QDir::Files ).size(), 1 );
+}
@@ -0,0 +1,17 @@
+#ifndef _TEST_IMAGE_ENCODER_H_
+#define _TEST_IMAGE_ENCODER_H_
+
+#include <QtTest>
+
+class TestImageEncoder : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void SmallImagesRoundTrip();
+		void StripedImagesRoundTrip();
+		void SixteenBitImagesRoundTrip();
+		void SaveReplacesWholeFiles();
+};
+
+#endif
\ No newline at end of file
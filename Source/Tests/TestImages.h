@@ -0,0 +1,30 @@
+#ifndef _TEST_IMAGES_H_
+#define _TEST_IMAGES_H_
+
+#include <stddef.h>
+#include <random>
+#include <vector>
+
+#include "Filter.h"
+
+// Odd sizes leave tails after every SIMD block and split unevenly into strips and bands
+#define TEST_WIDTH 203
+#define TEST_HEIGHT 37
+
+inline std::vector<uchar>
+RandomPixels( size_t count, unsigned seed )
+///
+/// @return
+///  count bytes of noise, the same for the same seed on every run.
+///
+{
+	std::mt19937 generator( seed );
+	std::vector<uchar> pixels( count );
+	for( size_t n = 0; n < count; n++ )
+	{
+		pixels[n] = (uchar)(generator() >> 24);
+	}
+	return pixels;
+}
+
+#endif
\ No newline at end of file
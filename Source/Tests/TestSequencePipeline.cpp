@@ -0,0 +1,182 @@
+///
+/// Checks that a sequence pipeline saves frames in sequence order even when they are
+/// filtered out of order, and that its decode buffers go round the pipeline: no more
+/// frames are in flight than there are buffers, and frames of different sizes decoded
+/// into the same buffer each come out as themselves.
+///
+
+#include "TestSequencePipeline.h"
+
+#include "BatchProcessor.h"
+#include "FilterProcessor.h"
+#include "SequencePipeline.h"
+
+#include <string.h>
+
+// Each frame is one gray level, which tells the filter which frame it has
+#define FRAME_LEVEL( index ) (10 + 7*(index))
+
+static QString
+FrameFile( const QString& directory, int index )
+///
+/// @return
+///  The file of a frame, named so the frames sort in sequence order.
+///
+{
+	return QString( "%1/frame%2.png" ).arg( directory ).arg( index, 3, 10, QChar( '0' ) );
+}
+
+// Inverts frames, holding some up so later ones overtake them, and checks which frames
+// have been saved while each one is filtered.
+class FrameCheckFilter : public Filter
+{
+	public:
+		FrameCheckFilter( QString output_dir, int frame_count, int buffer_count )
+		: mOutputDir( output_dir ),
+		  mFrameCount( frame_count ),
+		  mBufferCount( buffer_count )
+		{
+		}
+
+		uchar* RunFilter( uchar* source, int width, int height, int channels )
+		{
+			int index = (source[0] - FRAME_LEVEL( 0 ))/7;
+			if( index % 3 == 0 )
+			{
+				QThread::msleep( 30 );
+			}
+
+			for( int j = 0; j < mFrameCount; j++ )
+			{
+				bool saved = QFile::exists( FrameFile( mOutputDir, j ) );
+
+				// A later frame can't be saved before this one
+				if( j > index && saved )
+				{
+					mSavedEarly.ref();
+				}
+
+				// With one encoder, this frame was decoded into a buffer given back by a
+				// frame at least as many frames back as there are buffers, which was saved
+				// first. Several encoders can give buffers back while an earlier frame is
+				// still being saved, so then this only holds for frames already taken to
+				// be saved, which can't be seen from here.
+				if( mBufferCount > 0 && j <= index - mBufferCount && !saved )
+				{
+					mTooManyInFlight.ref();
+				}
+			}
+
+			size_t count = (size_t)width*height*channels;
+			uchar* result = new uchar[count];
+			for( size_t n = 0; n < count; n++ )
+			{
+				result[n] = 255 - source[n];
+			}
+			return result;
+		}
+
+		int SavedEarly() const { return mSavedEarly.load(); }
+		int TooManyInFlight() const { return mTooManyInFlight.load(); }
+
+	private:
+		QString mOutputDir;
+		int mFrameCount;
+		int mBufferCount;
+		QAtomicInt mSavedEarly;
+		QAtomicInt mTooManyInFlight;
+};
+
+static QSize
+FrameSize( int index )
+///
+/// @return
+///  The size of a frame. Sizes change every few frames, so buffers are sometimes reused
+///  as they are and sometimes reallocated.
+///
+{
+	return (index/3) % 2 == 0 ? QSize( 64, 48 ) : QSize( 41, 77 );
+}
+
+static void
+RunSequence( int frame_count, int concurrency, int& saved_early, int& too_many_in_flight )
+///
+/// Runs a sequence through the pipeline and checks every frame was saved as its own
+/// inverse.
+///
+/// @param saved_early
+///  Receives the number of times a frame was saved before an earlier one.
+///
+/// @param too_many_in_flight
+///  Receives the number of times a frame was decoded before the frame whose buffer it
+///  needed was saved. Only counted with one thread per stage.
+///
+{
+	QTemporaryDir input;
+	QTemporaryDir output;
+	QVERIFY( input.isValid() && output.isValid() );
+
+	QStringList input_files;
+	QStringList output_files;
+	for( int i = 0; i < frame_count; i++ )
+	{
+		QImage frame( FrameSize( i ), QImage::Format_RGB32 );
+		frame.fill( qRgb( FRAME_LEVEL( i ), FRAME_LEVEL( i ), FRAME_LEVEL( i ) ) );
+		input_files << FrameFile( input.path(), i );
+		output_files << FrameFile( output.path(), i );
+		QVERIFY( frame.save( input_files[i] ) );
+	}
+
+	FrameCheckFilter* filter = new FrameCheckFilter( output.path(), frame_count, concurrency == 1 ? 2 : 0 );
+	std::vector< boost::shared_ptr<Filter> > recipe( 1, boost::shared_ptr<Filter>( filter ) );
+
+	// The batch processor is only told about finished frames, and never started
+	FilterProcessor filter_processor;
+	BatchProcessor processor( &filter_processor );
+	SequencePipeline pipeline( &processor );
+	pipeline.Start( input_files, output_files, recipe, EncodeSettings(), concurrency );
+	pipeline.WaitForDone();
+
+	saved_early = filter->SavedEarly();
+	too_many_in_flight = filter->TooManyInFlight();
+	for( int i = 0; i < frame_count; i++ )
+	{
+		QImage result( output_files[i] );
+		QCOMPARE( result.size(), FrameSize( i ) );
+		int level = 255 - FRAME_LEVEL( i );
+		QImage expected( FrameSize( i ), QImage::Format_RGB32 );
+		expected.fill( qRgb( level, level, level ) );
+		QVERIFY( result.convertToFormat( QImage::Format_RGB32 ) == expected );
+	}
+}
+
+void
+TestSequencePipeline::SavesFramesInOrder()
+///
+/// Every third frame is held up in the filter stage while the frames after it are
+/// filtered, but none of them is saved before it.
+///
+{
+	int saved_early = 0;
+	int too_many_in_flight = 0;
+	RunSequence( 24, 3, saved_early, too_many_in_flight );
+	QCOMPARE( saved_early, 0 );
+}
+
+void
+TestSequencePipeline::RecyclesDecodeBuffers()
+///
+/// With one and two threads per stage, many more frames than buffers go through, each
+/// taking a buffer a saved frame gave back, and frames of another size decoded into it
+/// still come out whole.
+///
+{
+	for( int concurrency = 1; concurrency <= 2; concurrency++ )
+	{
+		int saved_early = 0;
+		int too_many_in_flight = 0;
+		RunSequence( 20, concurrency, saved_early, too_many_in_flight );
+		QCOMPARE( too_many_in_flight, 0 );
+		QCOMPARE( saved_early, 0 );
+	}
+}
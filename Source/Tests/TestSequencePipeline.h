@@ -0,0 +1,15 @@
+#ifndef _TEST_SEQUENCE_PIPELINE_H_
+#define _TEST_SEQUENCE_PIPELINE_H_
+
+#include <QtTest>
+
+class TestSequencePipeline : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void SavesFramesInOrder();
+		void RecyclesDecodeBuffers();
+};
+
+#endif
\ No newline at end of file
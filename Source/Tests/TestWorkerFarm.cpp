@@ -0,0 +1,194 @@
+///
+/// Checks that a worker farm fails only the job a worker crashed on and carries on with a
+/// restarted worker, and that it gives up a slot whose workers crash before saying hello.
+/// The farm starts this program as its workers, which then run RunTestWorker.
+///
+
+#include "TestWorkerFarm.h"
+#include "TestImages.h"
+
+#include "FilterWorker.h"
+#include "WorkerFarm.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Set in the environment of workers that are to crash before saying hello
+#define CRASH_ON_START_VARIABLE "FILTER_TEST_CRASH_ON_START"
+
+// The recipe a test worker crashes on
+#define CRASH_RECIPE "crash"
+
+// Long enough for every restart delay of a slot to pass
+#define FARM_TIMEOUT_MS 20000
+
+// More crashes in a row than a farm takes to give up a slot
+#define CRASHES_IN_A_ROW 6
+
+int
+RunTestWorker( const QString& server_name, int worker_index )
+///
+/// Runs a stand-in for FilterWorker that inverts the pixels of every job, and crashes
+/// when the recipe is CRASH_RECIPE, or before saying hello when CRASH_ON_START_VARIABLE is
+/// set.
+///
+/// @param server_name
+///  The name of the farm's local socket server.
+///
+/// @param worker_index
+///  The slot of this worker in the farm.
+///
+/// @return
+///  The exit code of the worker.
+///
+{
+	if( qgetenv( CRASH_ON_START_VARIABLE ) == "1" )
+	{
+		_exit( 1 );
+	}
+
+	QLocalSocket socket;
+	socket.connectToServer( server_name );
+	if( !socket.waitForConnected( 5000 ) )
+	{
+		return 1;
+	}
+
+	QByteArray hello;
+	QDataStream out( &hello, QIODevice::WriteOnly );
+	out << (qint32)WORKER_HELLO << (qint32)worker_index;
+	FilterWorker::WriteMessage( &socket, hello );
+	socket.flush();
+
+	QByteArray message;
+	while( socket.state() == QLocalSocket::ConnectedState )
+	{
+		if( !FilterWorker::ReadMessage( &socket, message ) )
+		{
+			socket.waitForReadyRead( 1000 );
+			continue;
+		}
+
+		QDataStream in( message );
+		qint32 type = 0, job_id = 0, width = 0, height = 0, channels = 0;
+		qint64 memory_budget = 0;
+		QString memory_key;
+		QStringList recipe;
+		in >> type >> job_id >> memory_key >> width >> height >> channels >> memory_budget >> recipe;
+		if( type != WORKER_JOB )
+		{
+			continue;
+		}
+		if( recipe.contains( CRASH_RECIPE ) )
+		{
+			_exit( 1 );
+		}
+
+		// Jobs always come with the worker's share of the memory budget
+		QSharedMemory memory( memory_key );
+		bool success = memory_budget > 0 && memory.attach();
+		if( success )
+		{
+			uchar* pixels = (uchar*)memory.data();
+			for( size_t n = 0; n < (size_t)width*height*channels; n++ )
+			{
+				pixels[n] = 255 - pixels[n];
+			}
+			memory.detach();
+		}
+
+		QByteArray reply;
+		QDataStream reply_out( &reply, QIODevice::WriteOnly );
+		reply_out << (qint32)WORKER_RESULT << job_id << success;
+		FilterWorker::WriteMessage( &socket, reply );
+		socket.flush();
+	}
+	return 0;
+}
+
+static QImage
+TestImage()
+///
+/// @return
+///  An RGBA image of noise.
+///
+{
+	QImage image( TEST_WIDTH, TEST_HEIGHT, QImage::Format_RGBA8888 );
+	std::vector<uchar> noise = RandomPixels( (size_t)TEST_WIDTH*TEST_HEIGHT*4, 14 );
+	for( int j = 0; j < TEST_HEIGHT; j++ )
+	{
+		memcpy( image.scanLine( j ), &noise[(size_t)j*TEST_WIDTH*4], TEST_WIDTH*4 );
+	}
+	return image;
+}
+
+void
+TestWorkerFarm::cleanup()
+///
+/// Lets the workers of the next test start normally, even if a test failed.
+///
+{
+	qunsetenv( CRASH_ON_START_VARIABLE );
+}
+
+void
+TestWorkerFarm::CrashedJobsFailAlone()
+///
+/// Jobs that crash their worker each fail on their own, more times in a row than it takes
+/// to give up a slot whose workers crash on start up, and the restarted worker then runs
+/// the next job.
+///
+{
+	WorkerFarm farm;
+	QSignalSpy finished( &farm, SIGNAL( JobFinished(int, QImage, bool) ) );
+	QVERIFY( farm.Start( 1 ) );
+
+	QImage image = TestImage();
+	for( int n = 0; n < CRASHES_IN_A_ROW; n++ )
+	{
+		int job_id = farm.Submit( image, QStringList() << CRASH_RECIPE );
+		QVERIFY( job_id >= 0 );
+		QTRY_COMPARE_WITH_TIMEOUT( finished.count(), n + 1, FARM_TIMEOUT_MS );
+		QCOMPARE( finished.last().at( 0 ).toInt(), job_id );
+		QCOMPARE( finished.last().at( 2 ).toBool(), false );
+	}
+
+	int job_id = farm.Submit( image, QStringList() << "invert" );
+	QVERIFY( job_id >= 0 );
+	QTRY_COMPARE_WITH_TIMEOUT( finished.count(), CRASHES_IN_A_ROW + 1, FARM_TIMEOUT_MS );
+	QCOMPARE( finished.last().at( 0 ).toInt(), job_id );
+	QCOMPARE( finished.last().at( 2 ).toBool(), true );
+
+	QImage expected = image;
+	expected.invertPixels( QImage::InvertRgba );
+	QVERIFY( finished.last().at( 1 ).value<QImage>() == expected );
+
+	WorkerStats stats = farm.Stats()[0];
+	QCOMPARE( stats.jobs_failed, CRASHES_IN_A_ROW );
+	QCOMPARE( stats.jobs_done, 1 );
+	QCOMPARE( stats.restarts, CRASHES_IN_A_ROW );
+}
+
+void
+TestWorkerFarm::StartupCrashesRetireSlots()
+///
+/// A slot whose workers crash before saying hello is given up after a few tries, and the
+/// job waiting for it fails instead of waiting forever.
+///
+{
+	qputenv( CRASH_ON_START_VARIABLE, "1" );
+	WorkerFarm farm;
+	QSignalSpy finished( &farm, SIGNAL( JobFinished(int, QImage, bool) ) );
+	QVERIFY( farm.Start( 1 ) );
+
+	int job_id = farm.Submit( TestImage(), QStringList() << "invert" );
+	QVERIFY( job_id >= 0 );
+	QTRY_COMPARE_WITH_TIMEOUT( finished.count(), 1, FARM_TIMEOUT_MS );
+	QCOMPARE( finished.last().at( 0 ).toInt(), job_id );
+	QCOMPARE( finished.last().at( 2 ).toBool(), false );
+
+	// No worker ran the job, and none is left to take another
+	QCOMPARE( farm.Stats()[0].jobs_failed, 0 );
+	QVERIFY( farm.Submit( TestImage(), QStringList() << "invert" ) < 0 );
+}
@@ -0,0 +1,19 @@
+#ifndef _TEST_WORKER_FARM_H_
+#define _TEST_WORKER_FARM_H_
+
+#include <QtTest>
+
+int RunTestWorker( const QString& server_name, int worker_index );
+
+class TestWorkerFarm : public QObject
+{
+	Q_OBJECT
+
+	private slots:
+		void cleanup();
+
+		void CrashedJobsFailAlone();
+		void StartupCrashesRetireSlots();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+include (../boost.pri)
+
+TARGET = FilterTests
+QT += widgets network testlib
+CONFIG += c++11 testcase
+DESTDIR = ../../Build
+LIBS += -lz
+INCLUDEPATH += ..
+
+HEADERS += \
+	TestConversions.h \
+	TestExecutionPlanner.h \
+	TestFilterCache.h \
+	TestFilterProcessor.h \
+	TestFilters.h \
+	TestFolderWatcher.h \
+	TestImageEncoder.h \
+	TestImages.h \
+	TestSequencePipeline.h \
+	TestWorkerFarm.h \
+	../BatchProcessor.h \
+	../ExecutionPlanner.h \
+	../Filter.h \
+	../FilterCache.h \
+	../FilterPlugin.h \
+	../FilterProcessor.h \
+	../Filters/BoxBlur.h \
+	../Filters/Canny.h \
+	../Filters/CpuFeatures.h \
+	../Filters/FFT.h \
+	../Filters/GaussianBlur.h \
+	../Filters/ImageAlgorithms.h \
+	../Filters/ImagePyramid.h \
+	../Filters/InvertFilter.h \
+	../Filters/KernelCache.h \
+	../Filters/KernelDecomposition.h \
+	../Filters/LookupTable.h \
+	../Filters/MedianFilter.h \
+	../Filters/ParallelRanges.h \
+	../Filters/PixelConversion.h \
+	../Filters/PixelTraits.h \
+	../Filters/UnsharpMask.h \
+	../FilterWorker.h \
+	../FolderWatcher.h \
+	../ImageEncoder.h \
+	../SequencePipeline.h \
+	../WorkerFarm.h \
+
+SOURCES += \
+	main.cpp \
+	TestConversions.cpp \
+	TestExecutionPlanner.cpp \
+	TestFilterCache.cpp \
+	TestFilterProcessor.cpp \
+	TestFilters.cpp \
+	TestFolderWatcher.cpp \
+	TestImageEncoder.cpp \
+	TestSequencePipeline.cpp \
+	TestWorkerFarm.cpp \
+	../BatchProcessor.cpp \
+	../ExecutionPlanner.cpp \
+	../FilterCache.cpp \
+	../FilterProcessor.cpp \
+	../Filters/BoxBlur.cpp \
+	../Filters/Canny.cpp \
+	../Filters/CpuFeatures.cpp \
+	../Filters/FFT.cpp \
+	../Filters/GaussianBlur.cpp \
+	../Filters/ImageAlgorithms.cpp \
+	../Filters/ImagePyramid.cpp \
+	../Filters/InvertFilter.cpp \
+	../Filters/KernelCache.cpp \
+	../Filters/KernelDecomposition.cpp \
+	../Filters/LookupTable.cpp \
+	../Filters/MedianFilter.cpp \
+	../Filters/ParallelRanges.cpp \
+	../Filters/PixelConversion.cpp \
+	../Filters/UnsharpMask.cpp \
+	../FilterWorker.cpp \
+	../FolderWatcher.cpp \
+	../ImageEncoder.cpp \
+	../SequencePipeline.cpp \
+	../WorkerFarm.cpp \
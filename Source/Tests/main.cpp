@@ -0,0 +1,51 @@
+///
+/// Runs every test class in turn, passing the arguments on to each as a single Qt test
+/// would take them, e.g. -v2 for verbose output.
+///
+
+#include <QCoreApplication>
+#include <QtTest>
+
+#include "TestConversions.h"
+#include "TestExecutionPlanner.h"
+#include "TestFilterCache.h"
+#include "TestFilterProcessor.h"
+#include "TestFilters.h"
+#include "TestFolderWatcher.h"
+#include "TestImageEncoder.h"
+#include "TestSequencePipeline.h"
+#include "TestWorkerFarm.h"
+
+int
+main( int argc, char* argv[] )
+{
+	QCoreApplication app( argc, argv );
+
+	// The worker farm tests start this program as their workers
+	if( argc == 4 && QString( argv[1] ) == "--worker" )
+	{
+		return RunTestWorker( argv[2], QString( argv[3] ).toInt() );
+	}
+
+	TestConversions conversions;
+	TestFilters filters;
+	TestExecutionPlanner planner;
+	TestImageEncoder encoder;
+	TestFolderWatcher watcher;
+	TestFilterCache cache;
+	TestSequencePipeline pipeline;
+	TestFilterProcessor processor;
+	TestWorkerFarm farm;
+
+	int failed = 0;
+	failed += QTest::qExec( &conversions, argc, argv ) != 0;
+	failed += QTest::qExec( &filters, argc, argv ) != 0;
+	failed += QTest::qExec( &planner, argc, argv ) != 0;
+	failed += QTest::qExec( &encoder, argc, argv ) != 0;
+	failed += QTest::qExec( &watcher, argc, argv ) != 0;
+	failed += QTest::qExec( &cache, argc, argv ) != 0;
+	failed += QTest::qExec( &pipeline, argc, argv ) != 0;
+	failed += QTest::qExec( &processor, argc, argv ) != 0;
+	failed += QTest::qExec( &farm, argc, argv ) != 0;
+	return failed;
+}
@@ -0,0 +1,547 @@
+///
+/// Runs filter recipes in a set of worker processes on the same machine. Jobs are sent to
+/// the workers over a local socket, while the pixels themselves go through shared memory
+/// so frames are never copied through the socket. A worker that crashes on a bad image
+/// fails only that job and is restarted, so the rest of a batch carries on.
+///
+
+#include "WorkerFarm.h"
+#include "FilterWorker.h"
+#include "ExecutionPlanner.h"
+
+#include <limits.h>
+#include <string.h>
+
+// A crashed worker is restarted after a delay that doubles with each crash in a row, up
+// to a limit, and its slot is given up after MAX_WORKER_CRASHES crashes in a row. Only
+// crashes before a worker says hello, or while it has no job, count: a worker that
+// crashes on start up then can't keep a processor busy restarting it, while one that
+// crashes on a bad image fails only that job.
+#define RESTART_DELAY_MS 100
+#define MAX_RESTART_DELAY_MS 5000
+#define MAX_WORKER_CRASHES 5
+
+WorkerFarm::WorkerFarm( QObject* parent )
+///
+/// Constructor.
+///
+/// @param parent
+///  The owner of this object.
+///
+: QObject( parent ),
+  mNextJobId( 0 ),
+  mRunning( false ),
+  mGeneration( 0 )
+{
+	connect( &mServer, SIGNAL( newConnection() ), this, SLOT( NewConnection() ) );
+}
+
+WorkerFarm::~WorkerFarm()
+///
+/// Destructor. Shuts down the worker processes.
+///
+{
+	Stop();
+}
+
+bool
+WorkerFarm::Start( int worker_count )
+///
+/// Starts the worker processes.
+///
+/// @param worker_count
+///  The number of worker processes to run.
+///
+/// @return
+///  True if the farm was started. False if it is already running or no worker could be started.
+///
+{
+	if( mRunning || worker_count <= 0 )
+	{
+		return false;
+	}
+
+	QString server_name = QString("image-filter-farm-%1").arg( QCoreApplication::applicationPid() );
+	QLocalServer::removeServer( server_name );
+	if( !mServer.listen( server_name ) )
+	{
+		return false;
+	}
+
+	mRunning = true;
+	mGeneration++;
+	mWorkers.resize( worker_count );
+	bool started = false;
+	for( int i = 0; i < worker_count; i++ )
+	{
+		memset( &mWorkers[i].stats, 0, sizeof(WorkerStats) );
+		mWorkers[i].crashes = 0;
+		mWorkers[i].retired = false;
+		LaunchWorker( i );
+		started = started || mWorkers[i].process != NULL;
+	}
+
+	if( !started )
+	{
+		Stop();
+	}
+	return started;
+}
+
+void
+WorkerFarm::Stop()
+///
+/// Shuts down the worker processes. Jobs that haven't finished are dropped without
+/// JobFinished being emitted.
+///
+/// @return
+///  Nothing.
+///
+{
+	mRunning = false;
+	mGeneration++;
+	for( int i = 0; i < mWorkers.size(); i++ )
+	{
+		Worker& worker = mWorkers[i];
+		if( worker.process != NULL )
+		{
+			disconnect( worker.process, 0, this, 0 );
+		}
+
+		// Workers exit by themselves once the connection closes
+		if( worker.socket != NULL )
+		{
+			worker.socket->disconnectFromServer();
+			delete worker.socket;
+		}
+		if( worker.process != NULL )
+		{
+			if( !worker.process->waitForFinished( 2000 ) )
+			{
+				worker.process->kill();
+				worker.process->waitForFinished( 1000 );
+			}
+			delete worker.process;
+		}
+		worker.socket = NULL;
+		worker.process = NULL;
+	}
+	mWorkers.clear();
+
+	for( QMap<int, Job>::iterator it = mJobs.begin(); it != mJobs.end(); ++it )
+	{
+		delete it->memory;
+	}
+	mJobs.clear();
+	mQueue.clear();
+	mServer.close();
+}
+
+bool
+WorkerFarm::IsRunning() const
+///
+/// @return
+///  True if the farm has been started.
+///
+{
+	return mRunning;
+}
+
+int
+WorkerFarm::Capacity() const
+///
+/// @return
+///  The number of jobs the farm accepts at once. Each worker gets one running and one
+///  waiting job, so no worker sits idle between jobs while memory use stays bounded.
+///
+{
+	return mWorkers.size()*2;
+}
+
+bool
+WorkerFarm::IsFull() const
+///
+/// @return
+///  True if Submit will refuse new jobs until one of the current jobs finishes.
+///
+{
+	return mJobs.size() >= Capacity();
+}
+
+QVector<WorkerStats>
+WorkerFarm::Stats() const
+///
+/// @return
+///  The statistics of each worker slot. Restarted workers keep the counts of their slot.
+///
+{
+	QVector<WorkerStats> stats;
+	for( int i = 0; i < mWorkers.size(); i++ )
+	{
+		stats.append( mWorkers[i].stats );
+	}
+	return stats;
+}
+
+int
+WorkerFarm::Submit( const QImage& image, QStringList recipe )
+///
+/// Queues a recipe to be run on an image by the next free worker. JobFinished is emitted
+/// with the returned job id once it is done.
+///
+/// @param image
+///  The image to be filtered. It is not modified.
+///
+/// @param recipe
+///  The names of the filters to apply, in order.
+///
+/// @return
+///  The id of the job, or -1 if the farm isn't running, is full, has given up on every worker
+///  or the image can't be used.
+///
+{
+	if( !mRunning || IsFull() || recipe.isEmpty() || !HasWorkers() )
+	{
+		return -1;
+	}
+
+	Job job;
+	if( !FilterProcessor::Ingest( image, job.ingested ) )
+	{
+		return -1;
+	}
+
+	int job_id = mNextJobId++;
+	qint64 size = (qint64)job.ingested.width*job.ingested.height*job.ingested.channels;
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+	// Shared memory segments are sized with an int before Qt 6
+	if( size > INT_MAX )
+	{
+		return -1;
+	}
+#endif
+	job.memory = new QSharedMemory( QString("image-filter-job-%1-%2").arg( QCoreApplication::applicationPid() ).arg( job_id ) );
+	if( !job.memory->create( size ) )
+	{
+		delete job.memory;
+		return -1;
+	}
+	job.memory->lock();
+	memcpy( job.memory->data(), job.ingested.data.get(), size );
+	job.memory->unlock();
+
+	// The pixels live in shared memory from here on
+	job.ingested.data.reset();
+	job.recipe = recipe;
+
+	mJobs[job_id] = job;
+	mQueue.enqueue( job_id );
+	Dispatch();
+	return job_id;
+}
+
+void
+WorkerFarm::LaunchWorker( int index )
+///
+/// Starts the worker process for a slot. It is handed jobs once it has connected back.
+///
+/// @param index
+///  The worker slot.
+///
+/// @return
+///  Nothing.
+///
+{
+	Worker& worker = mWorkers[index];
+	worker.socket = NULL;
+	worker.job_id = -1;
+	worker.process = new QProcess( this );
+	worker.process->setProcessChannelMode( QProcess::ForwardedChannels );
+	connect( worker.process, SIGNAL( finished(int, QProcess::ExitStatus) ), this, SLOT( WorkerExited(int, QProcess::ExitStatus) ) );
+
+	worker.process->start( QCoreApplication::applicationFilePath(),
+		QStringList() << "--worker" << mServer.serverName() << QString::number( index ) );
+	if( !worker.process->waitForStarted() )
+	{
+		delete worker.process;
+		worker.process = NULL;
+	}
+}
+
+void
+WorkerFarm::RestartWorker( int index, bool count_crash )
+///
+/// Schedules a new worker process for a slot whose worker crashed or couldn't be started,
+/// after a delay that grows with the counted crashes in a row. Once the slot has crashed
+/// too often it is given up, and if no slot is left the queued jobs fail.
+///
+/// @param index
+///  The worker slot.
+///
+/// @param count_crash
+///  True if the worker couldn't be started, or crashed before saying hello or while it had
+///  no job. A crash during a job is put down to the job's image and isn't counted.
+///
+/// @return
+///  Nothing.
+///
+{
+	Worker& worker = mWorkers[index];
+	if( count_crash )
+	{
+		worker.crashes++;
+	}
+	if( worker.crashes >= MAX_WORKER_CRASHES )
+	{
+		worker.retired = true;
+		if( !HasWorkers() )
+		{
+			FailQueuedJobs();
+		}
+		return;
+	}
+
+	worker.stats.restarts++;
+	int delay = qMin( RESTART_DELAY_MS << qMax( worker.crashes - 1, 0 ), MAX_RESTART_DELAY_MS );
+	int generation = mGeneration;
+	QTimer::singleShot( delay, this, [this, index, generation]()
+	{
+		if( !mRunning || generation != mGeneration || mWorkers[index].process != NULL )
+		{
+			return;
+		}
+		LaunchWorker( index );
+		if( mWorkers[index].process == NULL )
+		{
+			RestartWorker( index, true );
+		}
+	} );
+}
+
+bool
+WorkerFarm::HasWorkers() const
+///
+/// @return
+///  True if at least one slot has a worker or will restart one.
+///
+{
+	for( int i = 0; i < mWorkers.size(); i++ )
+	{
+		if( !mWorkers[i].retired )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+WorkerFarm::FailQueuedJobs()
+///
+/// Fails every job that is waiting for a worker, as none is left to run it.
+///
+/// @return
+///  Nothing.
+///
+{
+	while( !mQueue.isEmpty() )
+	{
+		int job_id = mQueue.dequeue();
+		delete mJobs.take( job_id ).memory;
+		emit JobFinished( job_id, QImage(), false );
+	}
+}
+
+void
+WorkerFarm::Dispatch()
+///
+/// Hands queued jobs to the idle workers.
+///
+/// @return
+///  Nothing.
+///
+{
+	// Each worker plans its filters against its share of the memory budget, as the
+	// application's own threads do
+	qint64 memory_budget = ExecutionPlanner::DefaultBudget()/qMax( (int)mWorkers.size(), 1 );
+	for( int i = 0; i < mWorkers.size() && !mQueue.isEmpty(); i++ )
+	{
+		Worker& worker = mWorkers[i];
+		if( worker.socket == NULL || worker.job_id != -1 )
+		{
+			continue;
+		}
+
+		int job_id = mQueue.dequeue();
+		const Job& job = mJobs[job_id];
+
+		QByteArray message;
+		QDataStream out( &message, QIODevice::WriteOnly );
+		out << (qint32)WORKER_JOB << (qint32)job_id << job.memory->key()
+			<< (qint32)job.ingested.width << (qint32)job.ingested.height << (qint32)job.ingested.channels
+			<< memory_budget << job.recipe;
+		FilterWorker::WriteMessage( worker.socket, message );
+
+		worker.job_id = job_id;
+		worker.job_timer.start();
+	}
+}
+
+void
+WorkerFarm::FinishJob( int index, bool success )
+///
+/// Collects the result of the job a worker was running and reports it.
+///
+/// @param index
+///  The worker slot.
+///
+/// @param success
+///  True if the worker finished the job without errors.
+///
+/// @return
+///  Nothing.
+///
+{
+	Worker& worker = mWorkers[index];
+	int job_id = worker.job_id;
+	worker.job_id = -1;
+	worker.stats.busy_ms += worker.job_timer.elapsed();
+
+	Job job = mJobs.take( job_id );
+	QImage result;
+	if( success )
+	{
+		job.memory->lock();
+		result = FilterProcessor::Egress( (uchar*)job.memory->data(), job.ingested );
+		job.memory->unlock();
+	}
+	delete job.memory;
+
+	if( success )
+	{
+		worker.stats.jobs_done++;
+	}
+	else
+	{
+		worker.stats.jobs_failed++;
+	}
+
+	emit JobFinished( job_id, result, success );
+}
+
+void
+WorkerFarm::NewConnection()
+///
+/// Accepts connections from workers. A worker is matched to its slot when its hello
+/// message arrives.
+///
+/// @return
+///  Nothing.
+///
+{
+	while( mServer.hasPendingConnections() )
+	{
+		QLocalSocket* socket = mServer.nextPendingConnection();
+		connect( socket, SIGNAL( readyRead() ), this, SLOT( ReadyRead() ) );
+	}
+}
+
+void
+WorkerFarm::ReadyRead()
+///
+/// Handles messages from a worker.
+///
+/// @return
+///  Nothing.
+///
+{
+	QLocalSocket* socket = qobject_cast<QLocalSocket*>( sender() );
+	QByteArray message;
+	while( socket != NULL && FilterWorker::ReadMessage( socket, message ) )
+	{
+		QDataStream in( message );
+		qint32 type = 0;
+		in >> type;
+
+		if( type == WORKER_HELLO )
+		{
+			qint32 index = -1;
+			in >> index;
+			if( index < 0 || index >= mWorkers.size() || mWorkers[index].process == NULL )
+			{
+				socket->deleteLater();
+				return;
+			}
+			mWorkers[index].socket = socket;
+			mWorkers[index].crashes = 0;
+		}
+		else if( type == WORKER_RESULT )
+		{
+			qint32 job_id = -1;
+			bool success = false;
+			in >> job_id >> success;
+			for( int i = 0; i < mWorkers.size(); i++ )
+			{
+				if( mWorkers[i].socket == socket && mWorkers[i].job_id == job_id )
+				{
+					FinishJob( i, success );
+					break;
+				}
+			}
+		}
+	}
+	Dispatch();
+}
+
+void
+WorkerFarm::WorkerExited( int exit_code, QProcess::ExitStatus exit_status )
+///
+/// Called when a worker process ends while the farm is running, which means it crashed.
+/// The job it was running fails, as retrying a corrupt image would only crash the next
+/// worker, and a new worker is started in its place after a delay. Only crashes outside
+/// a job count toward giving up the slot.
+///
+/// @param exit_code
+///  The exit code of the worker.
+///
+/// @param exit_status
+///  Whether the worker crashed or exited.
+///
+/// @return
+///  Nothing.
+///
+{
+	Q_UNUSED( exit_code );
+	Q_UNUSED( exit_status );
+
+	QProcess* process = qobject_cast<QProcess*>( sender() );
+	for( int i = 0; i < mWorkers.size(); i++ )
+	{
+		Worker& worker = mWorkers[i];
+		if( worker.process != process )
+		{
+			continue;
+		}
+
+		bool count_crash = worker.socket == NULL || worker.job_id == -1;
+
+		// Take the worker out of rotation before reporting, as the report may queue more work
+		worker.process->deleteLater();
+		worker.process = NULL;
+		if( worker.socket != NULL )
+		{
+			worker.socket->deleteLater();
+			worker.socket = NULL;
+		}
+		if( worker.job_id != -1 )
+		{
+			FinishJob( i, false );
+		}
+
+		if( mRunning )
+		{
+			RestartWorker( i, count_crash );
+		}
+		break;
+	}
+}
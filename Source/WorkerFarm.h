@@ -0,0 +1,80 @@
+#ifndef _WORKER_FARM_H_
+#define _WORKER_FARM_H_
+
+#include <QApplication>
+#include <QtWidgets>
+#include <QtNetwork>
+
+#include "FilterProcessor.h"
+
+// What one worker slot has done since the farm started.
+struct WorkerStats
+{
+	int jobs_done;
+	int jobs_failed;
+	int restarts;
+	qint64 busy_ms;
+};
+
+class WorkerFarm : public QObject
+{
+	Q_OBJECT
+
+	public:
+		WorkerFarm( QObject* parent = 0 );
+		~WorkerFarm();
+
+		bool Start( int worker_count );
+		void Stop();
+		bool IsRunning() const;
+
+		int Submit( const QImage& image, QStringList recipe );
+		bool IsFull() const;
+		int Capacity() const;
+
+		QVector<WorkerStats> Stats() const;
+
+	signals:
+		void JobFinished( int job_id, QImage result, bool success );
+
+	private slots:
+		void NewConnection();
+		void ReadyRead();
+		void WorkerExited( int exit_code, QProcess::ExitStatus exit_status );
+
+	private:
+		struct Worker
+		{
+			QProcess* process;
+			QLocalSocket* socket;
+			int job_id;
+			QElapsedTimer job_timer;
+			WorkerStats stats;
+			int crashes;		// Crashes before hello or while idle, since a worker last said hello
+			bool retired;		// The slot crashed too often in a row and isn't restarted
+		};
+
+		struct Job
+		{
+			IngestedImage ingested;
+			QStringList recipe;
+			QSharedMemory* memory;
+		};
+
+		void LaunchWorker( int index );
+		void RestartWorker( int index, bool count_crash );
+		bool HasWorkers() const;
+		void Dispatch();
+		void FinishJob( int index, bool success );
+		void FailQueuedJobs();
+
+		QLocalServer mServer;
+		QVector<Worker> mWorkers;
+		QMap<int, Job> mJobs;
+		QQueue<int> mQueue;
+		int mNextJobId;
+		bool mRunning;
+		int mGeneration;	// Counts starts, so restarts scheduled before a stop are ignored
+};
+
+#endif
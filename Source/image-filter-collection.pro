@@ -1,26 +1,70 @@
 include (boost.pri)
 
 TARGET = ImageFilterCollection
-QT += widgets
+QT += widgets network
+CONFIG += c++11
 DESTDIR = ../Build
+LIBS += -lz
 
 HEADERS += \
+	BatchDialog.h \
+	BatchProcessor.h \
+	ExecutionPlanner.h \
 	Filter.h \
+	FilterCache.h \
+	FilterPlugin.h \
 	FilterProcessor.h \
+	FilterWorker.h \
+	FolderWatcher.h \
 	Filters/BoxBlur.h \
 	Filters/Canny.h \
+	Filters/CpuFeatures.h \
+	Filters/FFT.h \
 	Filters/GaussianBlur.h \
 	Filters/ImageAlgorithms.h \
+	Filters/ImagePyramid.h \
 	Filters/InvertFilter.h \
+	Filters/KernelCache.h \
+	Filters/KernelDecomposition.h \
+	Filters/LookupTable.h \
+	Filters/MedianFilter.h \
+	Filters/ParallelRanges.h \
+	Filters/PixelConversion.h \
+	Filters/PixelTraits.h \
+	Filters/UnsharpMask.h \
+	ImageEncoder.h \
+	ImageIO.h \
 	MainWindow.h \
+	SequencePipeline.h \
+	WorkerFarm.h \
 
 SOURCES += \
+	BatchDialog.cpp \
+	BatchProcessor.cpp \
+	ExecutionPlanner.cpp \
+	FilterCache.cpp \
 	FilterProcessor.cpp \
+	FilterWorker.cpp \
+	FolderWatcher.cpp \
 	Filters/BoxBlur.cpp \
 	Filters/Canny.cpp \
+	Filters/CpuFeatures.cpp \
+	Filters/FFT.cpp \
 	Filters/GaussianBlur.cpp \
 	Filters/ImageAlgorithms.cpp \
+	Filters/ImagePyramid.cpp \
 	Filters/InvertFilter.cpp \
+	Filters/KernelCache.cpp \
+	Filters/KernelDecomposition.cpp \
+	Filters/LookupTable.cpp \
+	Filters/MedianFilter.cpp \
+	Filters/ParallelRanges.cpp \
+	Filters/PixelConversion.cpp \
+	Filters/UnsharpMask.cpp \
+	ImageEncoder.cpp \
+	ImageIO.cpp \
     main.cpp \
     MainWindow.cpp \
+    SequencePipeline.cpp \
+    WorkerFarm.cpp \
     
@@ -1,15 +1,55 @@
 ///
-/// The main method for the filter collection program. Sets up Qt's main window.
+/// The main method for the filter collection program. Sets up Qt's main window, runs as a
+/// filter worker process when started by a worker farm with --worker, or runs as a daemon
+/// that filters new images in watched folders with
+///   --watch <filter>[,<filter>...] <input folder> <output folder> [<input folder> <output folder>...]
 ///
 /// Created by Crystal Valente.
 ///
 
 #include <iostream>
 #include <QApplication>
+#include "FilterWorker.h"
+#include "FolderWatcher.h"
 #include "MainWindow.h"
 
 int main(int argc, char *argv[])
 {
+    if( argc == 4 && QString(argv[1]) == "--worker" )
+    {
+        QCoreApplication app(argc, argv);
+        FilterWorker worker(argv[2], QString(argv[3]).toInt());
+        if( !worker.Connect() )
+        {
+            return 1;
+        }
+        return app.exec();
+    }
+
+    if( argc >= 5 && argc % 2 == 1 && QString(argv[1]) == "--watch" )
+    {
+        QCoreApplication app(argc, argv);
+        FilterProcessor filter_processor;
+        FolderWatcher watcher(&filter_processor);
+        QObject::connect(&watcher, &FolderWatcher::WatchStatus, [](QString status_text) {
+            std::cout << status_text.toStdString() << std::endl;
+        });
+        if( !watcher.SetRecipe(QString(argv[2]).split(',')) )
+        {
+            std::cerr << "Unknown filter in " << argv[2] << std::endl;
+            return 1;
+        }
+        for( int i = 3; i < argc; i += 2 )
+        {
+            if( !watcher.AddFolder(argv[i], argv[i + 1]) )
+            {
+                std::cerr << "Can't watch " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        return app.exec();
+    }
+
     QApplication app(argc, argv);
     app.setApplicationName("artistimagefilers");
     app.setOrganizationName("crystalvalente");